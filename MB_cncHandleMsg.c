@@ -27,8 +27,6 @@
 
 #define ERROR_MSG_LENGTH 60
 
-bool getPeripheralEnum(webResponse_tp p_webResponse, int destination, const char *peripheral, PERIPHERAL_e *periEnum);
-bool getCommandEnum(webResponse_tp p_webResponse, const char *command, CNC_ACTION_e *cmdEnum);
 void handleWebCncRequest(webResponse_tp p_webResponse,
                          int destination,
                          PERIPHERAL_e periEnum,
@@ -562,3 +560,225 @@ void handleWebCncRequest(webResponse_tp p_webResponse,
         // CNC task to timeout for us
     }
 }
+
+// result given to the boards that did not answer before the deadline of a fan-out
+static const cncPayload_t cncFanOutTimeoutPayload = {.cmd.cncMsgPayloadHeader.cncActionData.result = osEventTimeout};
+
+// Fan-outs in progress, an entry's generation changes each time it is released so a late
+// response of a released fan-out is dropped. Changed with the scheduler suspended.
+static cncFanOut_tp cncFanOutActive[CNC_FANOUT_MAX];
+static uint16_t cncFanOutGen[CNC_FANOUT_MAX];
+
+// callback id of a board of a fan-out
+#define CNC_FANOUT_CB_ID(slot, boardIdx) (((uint32_t)cncFanOutGen[slot] << 16) | ((slot) << 8) | (boardIdx))
+
+static const char *cncFanOutStatusStr[] = {
+    [CNC_FANOUT_PENDING] = "pending",
+    [CNC_FANOUT_DONE] = "done",
+    [CNC_FANOUT_TIMEOUT] = "timeout",
+    [CNC_FANOUT_SEND_ERROR] = "send error",
+};
+
+/**
+ * @fn cncFanOutCB
+ *
+ * @brief Store the response of a board of a fan-out
+ *
+ * The scheduler is suspended while the fan-out is looked up and updated so the caller cannot
+ * pass its deadline and release it between the lookup and the notification.
+ *
+ * @param[in] cbId: CNC_FANOUT_CB_ID() of the board
+ *
+ * @return osOK
+ **/
+static osStatus cncFanOutCB(spiDbMbCmd_e spiDbMbCmd,
+                            uint32_t cbId,
+                            uint8_t xInfo,
+                            spiDbMbPacketCmdResponse_t cmdResponse,
+                            cncPayload_tp p_payload) {
+    uint32_t slot = (cbId >> 8) & 0xFF;
+    uint32_t boardIdx = cbId & 0xFF;
+
+    assert(slot < CNC_FANOUT_MAX);
+    vTaskSuspendAll();
+    cncFanOut_tp p_fanOut = cncFanOutActive[slot];
+    if (p_fanOut != NULL && cncFanOutGen[slot] == (cbId >> 16) && boardIdx < p_fanOut->cnt) {
+        cncFanOutBoard_tp p_board = &p_fanOut->board[boardIdx];
+        memcpy(&p_board->payload, p_payload, sizeof(cncPayload_t));
+        p_board->webCncCbId.xInfo = xInfo;
+        p_board->webCncCbId.cmdResponse = cmdResponse.cmdResponse;
+        p_board->elapsedMs = HAL_GetTick() - p_fanOut->startTick;
+        p_board->webCncCbId.p_payload = &p_board->payload;
+        p_board->status = CNC_FANOUT_DONE;
+        p_fanOut->pending--;
+        xTaskNotifyGive(p_fanOut->taskHandle);
+    }
+    xTaskResumeAll();
+    return osOK;
+}
+
+/**
+ * @fn cncFanOutSweep
+ *
+ * @brief Release a fan-out whose deadline passed, the boards still pending time out
+ *
+ * The fan-out leaves the table of fan-outs in progress, the callbacks still to come are dropped
+ * and the caller owns it whether or not they ever come.
+ *
+ * @param[in] p_fanOut: fan-out
+ **/
+static void cncFanOutSweep(cncFanOut_tp p_fanOut) {
+    vTaskSuspendAll();
+    cncFanOutActive[p_fanOut->slot] = NULL;
+    cncFanOutGen[p_fanOut->slot]++;
+    for (uint32_t i = 0; i < p_fanOut->cnt; i++) {
+        cncFanOutBoard_tp p_board = &p_fanOut->board[i];
+        if (p_board->status == CNC_FANOUT_PENDING) {
+            p_board->elapsedMs = HAL_GetTick() - p_fanOut->startTick;
+            p_board->webCncCbId.p_payload = (cncPayload_tp)&cncFanOutTimeoutPayload;
+            p_board->status = CNC_FANOUT_TIMEOUT;
+        }
+    }
+    p_fanOut->pending = 0;
+    xTaskResumeAll();
+}
+
+cncFanOut_tp cncFanOut(int destination,
+                       spiDbMbCmd_e cmd,
+                       cncPayload_tp p_payload,
+                       uint8_t xInfo,
+                       bool (*p_select)(int destination),
+                       uint32_t deadlineMs) {
+    int minDest = destination;
+    int maxDest = destination + 1;
+
+    if (destination == DESTINATION_ALL) {
+        minDest = 0;
+        maxDest = MAX_CS_ID;
+    }
+
+    cncFanOut_tp p_fanOut = pvPortMalloc(sizeof(cncFanOut_t));
+    if (p_fanOut == NULL) {
+        DPRINTF_ERROR("%s no memory for %u bytes\r\n", __FUNCTION__, sizeof(cncFanOut_t));
+        return NULL;
+    }
+    p_fanOut->taskHandle = xTaskGetCurrentTaskHandle();
+    p_fanOut->cmd = cmd;
+    p_fanOut->startTick = HAL_GetTick();
+    p_fanOut->pending = 0;
+    p_fanOut->slot = CNC_FANOUT_MAX;
+    p_fanOut->cnt = 0;
+
+    vTaskSuspendAll();
+    for (uint32_t slot = 0; slot < CNC_FANOUT_MAX; slot++) {
+        if (cncFanOutActive[slot] == NULL) {
+            cncFanOutActive[slot] = p_fanOut;
+            p_fanOut->slot = slot;
+            break;
+        }
+    }
+    xTaskResumeAll();
+    if (p_fanOut->slot == CNC_FANOUT_MAX) {
+        DPRINTF_ERROR("%s %u fan-outs already in progress\r\n", __FUNCTION__, CNC_FANOUT_MAX);
+        vPortFree(p_fanOut);
+        return NULL;
+    }
+
+    // every command is queued before the first response is waited for
+    for (int i = minDest; i < maxDest; i++) {
+        if (p_select != NULL && !p_select(i)) {
+            continue;
+        }
+        cncFanOutBoard_tp p_board = &p_fanOut->board[p_fanOut->cnt++];
+        p_board->webCncCbId.taskHandle = p_fanOut->taskHandle;
+        p_board->webCncCbId.p_payload = NULL;
+        p_board->webCncCbId.xInfo = 0;
+        p_board->webCncCbId.cmdResponse = UNKNOWN_COMMAND;
+        p_board->webCncCbId.hCli = NULL;
+        p_board->p_fanOut = p_fanOut;
+        p_board->elapsedMs = 0;
+        p_board->destination = i;
+        p_board->status = CNC_FANOUT_PENDING;
+
+        vTaskSuspendAll();
+        p_fanOut->pending++;
+        xTaskResumeAll();
+
+        osStatus status = cncSendMsg(
+            i, cmd, p_payload, xInfo, cncFanOutCB, CNC_FANOUT_CB_ID(p_fanOut->slot, p_fanOut->cnt - 1));
+        if (status != osOK) {
+            // the message was not queued, no callback will come
+            vTaskSuspendAll();
+            p_fanOut->pending--;
+            xTaskResumeAll();
+            p_board->payload.cmd.cncMsgPayloadHeader.cncActionData.result = status;
+            p_board->webCncCbId.p_payload = &p_board->payload;
+            p_board->status = CNC_FANOUT_SEND_ERROR;
+        }
+    }
+
+    uint32_t elapsed;
+    while (p_fanOut->pending != 0 && (elapsed = HAL_GetTick() - p_fanOut->startTick) < deadlineMs) {
+        ulTaskNotifyTake(true, deadlineMs - elapsed);
+    }
+
+    cncFanOutSweep(p_fanOut);
+    // drop a notification given after the last wait, a later single request would take it
+    ulTaskNotifyTake(true, 0);
+    return p_fanOut;
+}
+
+uint32_t cncFanOutResult(cncFanOutBoard_tp p_board) {
+    if (p_board->status == CNC_FANOUT_DONE && p_board->p_fanOut->cmd == SPICMD_CNC_SHORT) {
+        return p_board->webCncCbId.cmdResponse;
+    }
+    return p_board->webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result;
+}
+
+uint32_t cncFanOutErrors(webResponse_tp p_webResponse, cncFanOut_tp p_fanOut) {
+    json_object *jsonErrors = NULL;
+    uint32_t errorCnt = 0;
+
+    for (uint32_t i = 0; i < p_fanOut->cnt; i++) {
+        cncFanOutBoard_tp p_board = &p_fanOut->board[i];
+        uint32_t result = cncFanOutResult(p_board);
+        if (p_board->status == CNC_FANOUT_DONE && result == 0) {
+            continue;
+        }
+        if (jsonErrors == NULL) {
+            jsonErrors = json_object_new_array();
+        }
+        json_object *jsonError = json_object_new_object();
+        json_object_object_add_ex(
+            jsonError, "destination", json_object_new_int(p_board->destination), JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object_object_add_ex(jsonError,
+                                  "status",
+                                  json_object_new_string(cncFanOutStatusStr[p_board->status]),
+                                  JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object_object_add_ex(jsonError, "result", json_object_new_int(result), JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object_object_add_ex(
+            jsonError, "msec", json_object_new_int(p_board->elapsedMs), JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object_array_add(jsonErrors, jsonError);
+        errorCnt++;
+    }
+    if (jsonErrors != NULL) {
+        json_object_object_add_ex(p_webResponse->jsonResponse, "errors", jsonErrors, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    }
+    return errorCnt;
+}
+
+void cncFanOutFree(cncFanOut_tp p_fanOut) {
+    if (p_fanOut == NULL) {
+        return;
+    }
+    // released from the table by cncFanOutSweep() before cncFanOut() returned
+    vPortFree(p_fanOut);
+}
+
+void cncFanOutNoMemory(webResponse_tp p_webResponse) {
+    p_webResponse->httpCode = HTTP_ERROR_INTERNAL_SERVER;
+    json_object *jsonResult = json_object_new_string("error");
+    json_object *jsonDetail = json_object_new_string("Out of memory");
+    json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    json_object_object_add_ex(p_webResponse->jsonResponse, "detail", jsonDetail, JSON_C_OBJECT_KEY_IS_CONSTANT);
+}
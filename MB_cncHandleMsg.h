@@ -24,6 +24,47 @@ typedef struct {
     CLI *hCli;
 } webCncCbId_t, *webCncCbId_tp;
 
+typedef enum {
+    CNC_FANOUT_PENDING,    // sent, no response yet
+    CNC_FANOUT_DONE,       // response received before the deadline
+    CNC_FANOUT_TIMEOUT,    // no response before the deadline
+    CNC_FANOUT_SEND_ERROR, // the command could not be queued
+} CNC_FANOUT_e;
+
+#define CNC_FANOUT_MAX 4 // fan-outs in progress at once, one per web or CLI request
+
+/**
+ * @struct cncFanOutBoard_t
+ * Result of one board of a fan-out. Once cncFanOut() returns webCncCbId.p_payload is valid
+ * whatever the status, it points at a timeout result when the board did not answer.
+ */
+typedef struct {
+    webCncCbId_t webCncCbId;    // same fields a single request gets from webCncRequestCB()
+    cncPayload_t payload;       // copy of the response payload
+    struct cncFanOut *p_fanOut; // fan-out of the board
+    uint32_t elapsedMs;         // from the send to the response or the deadline
+    int destination;
+    CNC_FANOUT_e status;
+} cncFanOutBoard_t, *cncFanOutBoard_tp;
+
+/**
+ * @struct cncFanOut_t
+ * One command sent to several boards at once, the boards are served concurrently by their
+ * dbComm tasks and spi busses.
+ * The callbacks find the fan-out through a table of the fan-outs in progress. At the deadline
+ * it is taken out of the table, whether or not every board answered, and belongs to the caller
+ * alone; a response arriving later, or never, no longer reaches it.
+ */
+typedef struct cncFanOut {
+    osThreadId taskHandle;     // notified by each response
+    spiDbMbCmd_e cmd;          // SPICMD_CNC or SPICMD_CNC_SHORT
+    uint32_t startTick;
+    volatile uint32_t pending; // boards still to answer
+    uint32_t slot;             // entry of the fan-out in the table of fan-outs in progress
+    uint32_t cnt;              // boards the command was sent to, in board order
+    cncFanOutBoard_t board[MAX_CS_ID];
+} cncFanOut_t, *cncFanOut_tp;
+
 /**
  * @fn webCncRequestCB
  *
@@ -56,4 +97,96 @@ osStatus webCncRequestCB(spiDbMbCmd_e spiDbMbCmd,
  **/
 bool testDestinationValue(webResponse_tp p_webResponse, int destination);
 
+/**
+ * @fn getPeripheralEnum
+ *
+ * @brief Find the peripheral named in a request, only MCU is allowed on the main board
+ *
+ * @param[in] p_webResponse: Web response, filled when the name is not valid
+ * @param[in] destination: board of the request, not DESTINATION_ALL
+ * @param[in] peripheral: peripheral name, case is ignored
+ * @param[out] periEnum: peripheral
+ *
+ * @return true if the peripheral is valid
+ **/
+bool getPeripheralEnum(webResponse_tp p_webResponse, int destination, const char *peripheral, PERIPHERAL_e *periEnum);
+
+/**
+ * @fn getCommandEnum
+ *
+ * @brief Find the command named in a request
+ *
+ * @param[in] p_webResponse: Web response, filled when the name is not valid
+ * @param[in] command: command name, case is ignored
+ * @param[out] cmdEnum: command
+ *
+ * @return true if the command is valid
+ **/
+bool getCommandEnum(webResponse_tp p_webResponse, const char *command, CNC_ACTION_e *cmdEnum);
+
+/**
+ * @fn cncFanOut
+ *
+ * @brief Send a command to every selected board at once and wait for the responses
+ *
+ * @param[in] destination: board or DESTINATION_ALL
+ * @param[in] cmd: SPICMD_CNC or SPICMD_CNC_SHORT
+ * @param[in] p_payload: command payload, the same for every board
+ * @param[in] xInfo: passed to cncSendMsg()
+ * @param[in] p_select: boards the command is sent to, NULL for all
+ * @param[in] deadlineMs: time given to all boards to answer
+ *
+ * @return results, cncFanOutFree() must be called, or NULL when out of memory or
+ *         CNC_FANOUT_MAX fan-outs are already in progress
+ **/
+cncFanOut_tp cncFanOut(int destination,
+                       spiDbMbCmd_e cmd,
+                       cncPayload_tp p_payload,
+                       uint8_t xInfo,
+                       bool (*p_select)(int destination),
+                       uint32_t deadlineMs);
+
+/**
+ * @fn cncFanOutResult
+ *
+ * @brief Result of a board of a fan-out, the payload result or the short response
+ *
+ * @param[in] p_board: board result
+ *
+ * @return 0 on success
+ **/
+uint32_t cncFanOutResult(cncFanOutBoard_tp p_board);
+
+/**
+ * @fn cncFanOutErrors
+ *
+ * @brief Add the boards that failed to the web response
+ *
+ * Adds an "errors" array with the destination, status, result and msec of each failed board.
+ *
+ * @param[in] p_webResponse: Web response
+ * @param[in] p_fanOut: results
+ *
+ * @return number of boards that failed
+ **/
+uint32_t cncFanOutErrors(webResponse_tp p_webResponse, cncFanOut_tp p_fanOut);
+
+/**
+ * @fn cncFanOutFree
+ *
+ * @brief Release the results of a fan-out, the board payloads must not be used afterwards
+ *
+ * @param[in] p_fanOut: results, may be NULL
+ **/
+void cncFanOutFree(cncFanOut_tp p_fanOut);
+
+/**
+ * @fn cncFanOutNoMemory
+ *
+ * @brief Fill the web response of a fan-out that could not be allocated
+ *
+ * @param[in] p_webResponse: Web response
+ **/
+void cncFanOutNoMemory(webResponse_tp p_webResponse);
+
 #endif /* APP_INC_MB_CNCHANDLEMSG_H_ */
@@ -9,18 +9,25 @@
 /*
  * Two buffers are maintained, This task will set all the clean bits
  * (identifying new data) for each DB section. As each db task gets new adc
- * readings it will get the Sema and then update its section, clearing its
- * clean bit
- * When the next start conversion interrupt fires, the gather task will lock
- * the semaphore, move the buffer to the new bufferlocation, set the clean bits
- * and send the old buffer over IP to the server. It will also gather stats for
- * all the db to identify any problematic system errors with timing.
+ * readings it will update its section of the buffer selected by streamDataIdx,
+ * setting its new data bit.
+ * When the next start conversion interrupt fires, the gather task will clear
+ * the idle buffer, flip streamDataIdx to it and send the old buffer over IP to
+ * the server. No lock is taken on either side: each writer, a db task or the
+ * spi DMA complete interrupt, brackets its write with a sequence count
+ * (slotPublish) so the gather task can detect a write that straddled the flip
+ * and drop that one slot instead of blocking.
+ * It will also gather stats for all the db to identify any problematic system
+ * errors with timing.
  */
 
 #define GENERATE_IPTYPE_STRING_NAMES
+#define GENERATE_STREAM_CLOCK_SRC_STRING_NAMES
 #include "MB_gatherTask.h"
 #undef GENERATE_IPTYPE_STRING_NAMES
+#undef GENERATE_STREAM_CLOCK_SRC_STRING_NAMES
 #include "MB_cncHandleMsg.h"
+#include "boardStatus.h"
 #include "cli/cli_print.h"
 #include "cmsis_os.h"
 #include "ctrlSpiCommTask.h"
@@ -29,6 +36,7 @@
 #include "debugPrint.h"
 #include "eeprom.h"
 #include "imuLib.h"
+#include "macros.h"
 #include "peripherals/MB_handleReg.h"
 #include "pwmPinConfig.h"
 #include "raiseIssue.h"
@@ -42,7 +50,11 @@
 #include <lwip/inet.h>
 #include <lwip/opt.h>
 #include <lwip/sys.h>
+#include <lwip/tcp.h>
+#include <lwip/tcpip.h>
+#include <lwip/udp.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 
 #ifdef TRACEALYZER
@@ -52,29 +64,47 @@ extern TraceStringHandle_t gatherMsg;
 
 #define ALL24BOARDSMASK 0x00FFFFFF
 #define REMOVE_BOARD(mask, dbId) (mask & ((~(1 << dbId)) & ALL24BOARDSMASK))
-#define DB_UP_RETRY_MAX 5 // try maximum of x times to bring up all the expected sensor boards.
-#define WAIT_FOR_SENSOR_BOARDS_TO_SETTLE_MS(x) (x)
+#define SENSOR_DISCOVERY_PROBE_MS 100 // configured boards still silent are enabled again this often
+// boards not discovered by then raise the configuration error, the former boot retries took as long
+#define SENSOR_DISCOVERY_TIMEOUT_MS (6 * (2000 + DB_MAX_UNANSWERED_RESPONSE_DISABLE * DB_SPI_INTERVAL_MS * 2))
 
-#define MAX_STREAM_DATA_PKT_IDX 2    // keep 2 buffers, one is being sent while the other is updated
-#define MAX_ETHERNET_SIZE_BYTES 1500 // Max size before fragmentation
+#define MAX_STREAM_DATA_PKT_IDX 8    // stream ring slots, one is filled while the others wait for the tx task
+#define MIN_STREAM_RING_DEPTH 2      // one slot filling and one being sent
 
 #define MAX_ADC_READING 4
 
-#define SENSOR_BOARD_READING_VERSION 2
+#define SENSOR_BOARD_READING_VERSION 5 // 3: dummy[0..1] replaced by payloadLen, 4: triggerTime_us added, 5: layoutVersion added
 #define STREAM_PKT_VERSION 2
 
 #define NEW_DATA_FLAG 0x80
+#define STREAM_BATCH_FLAG 0x80 // set in the stream header version when the frame holds several samples
+#define STREAM_FILTER_FLAG 0x40 // set in the stream header version when the frame holds a subset of the boards
+#define STREAM_BATCH_CNT_MAX 32
+#define STREAM_BATCH_FLUSH_MS 5 // a partial batched frame is sent once its first sample waited this long
 
 #define NEW_DATA(value) (value & NEW_DATA_FLAG)
 
 #define STRM_PKT_0 0
-#define STRM_PKT_1 1
 #define SENSOR_0 0
 #define SENSOR_1 1
 
 #define MAX_SEND_ERRORS 10 // close connection if too many errors;
+#define MAX_STREAM_SUBSCRIBERS 8 // tcp clients and udp destinations fed from the stream ring
+#define STREAM_TCP_SEGS_PER_PKT 2 // tcp segments one stream packet may need in the send queue
+#if !LWIP_TCPIP_CORE_LOCKING
+#error "sendTcpData() and streamRingRelease() read the tcp pcb under LOCK_TCPIP_CORE()"
+#endif
+#define STREAM_ACK_WAIT_MAX_MS 10 // a zero copy client slower to acknowledge is sent copies instead
+#define STREAM_ACK_RETRY_MS 1000  // a client sent copies gets zero copy again once it has caught up this long after
+#define STREAM_MCAST_TTL 4
 #define MAX_ARR 0xFFFF
 
+#define STREAM_CLOCK_SYNC_MS 1000       // the wall clock offset is corrected from the RTC once a second
+#define STREAM_CLOCK_STEP_US 1000000    // larger errors, the RTC was set, are stepped instead of slewed
+#define STREAM_CLOCK_DEADBAND_US 4000   // RTC sub second resolution is 1/256 s
+#define STREAM_CLOCK_SLEW_MAX_PPB 500000
+#define STREAM_CLOCK_PPB 1000000000LL
+
 // 20 bytes
 typedef struct __attribute__((packed)) {
     uint8_t version;  // sensor board reading structure version
@@ -165,7 +195,7 @@ typedef enum {
     ECG12_READING_V1
 } ECG12_READING_LOCATION_e;
 
-// last calculated sizeof is 1168 bytes
+// last calculated sizeof is 1169 bytes
 typedef struct __attribute__((packed)) {
     uint32_t uid; // packet UID
     uint8_t version;
@@ -173,8 +203,11 @@ typedef struct __attribute__((packed)) {
     uint8_t ecgReadingCnt;   // number of elements in ecgReading[]
     uint8_t ecg12ReadingCnt; // number of elements in ecg12
     uint8_t imuReadingCnt;   // number of elements in imuReading[]
-    uint8_t dummy[3];        // empty, 3 to align on 32bit
-    double timeStamp;        // seconds since epoch
+    uint16_t payloadLen;     // number of valid bytes in the packet, header included
+    uint8_t sampleCnt;       // number of samples in a batched frame (STREAM_BATCH_FLAG), else 0
+    uint8_t layoutVersion;   // bumped each time the board types, and so the dataReadings layout, change
+    double timeStamp;        // seconds since epoch, RTC slewed, for display
+    uint64_t triggerTime_us; // monotonic time of the TIM_UDP_TX_SIGNAL edge, us since boot, for alignment
     // Note this only works because A IMU board takes two slots so replacing a sensor board with a coil board always
     // reduces the size. But there are built in 3 busses that can take a coil driver board without replacing 2 sensor
     // boards.
@@ -187,6 +220,15 @@ typedef struct __attribute__((packed)) {
 
 _Static_assert(sizeof(streamSensorPkt_t) < MAX_ETHERNET_SIZE_BYTES);
 
+#define STREAM_PKT_HEADER_SIZE offsetof(streamSensorPkt_t, dataReadings)
+
+// A batched frame is a stream header (version has STREAM_BATCH_FLAG set, payloadLen is the
+// frame length) followed by sampleCnt entries of this header + the sample dataReadings.
+typedef struct __attribute__((packed)) {
+    uint32_t uid;              // packet UID of this sample
+    int32_t timeStampDelta_us; // sample time relative to the frame timeStamp
+} streamBatchSampleHdr_t, *streamBatchSampleHdr_tp;
+
 #if 0 // macro to print sizeof values at compile time
 char (*__kaboom)[sizeof(streamSensorPkt_t)] = 1;
 void kaboom_print(void) {
@@ -195,10 +237,11 @@ void kaboom_print(void) {
 #endif
 
 typedef struct {
-    osSemaphoreId access;
-    uint32_t streamDataIdx;
+    volatile uint32_t streamDataIdx; // buffer the db tasks write to, only changed by the gather task
     uint32_t streamPktDataSize;
     streamSensorPkt_t streamPktData[MAX_STREAM_DATA_PKT_IDX];
+    uint8_t batchFrame[MAX_STREAM_FRAME_SIZE_BYTES]; // STREAM_BATCH_CNT samples are packed here
+    uint32_t batchTick;                              // HAL tick the first sample of batchFrame was packed
 } streamData_t, *streamData_tp;
 
 typedef struct {
@@ -207,16 +250,102 @@ typedef struct {
     uint32_t sentPkts[IMU_PER_BOARD];
     uint32_t overWrittenData;
     uint32_t alignmentData;
-    uint32_t accessBlocked;
+    uint32_t tornData;     // write was in progress when its buffer was sent, slot marked invalid
+    uint32_t publishRetry; // buffer flipped between reading streamDataIdx and starting the write
+    uint32_t burstSamples; // burst samples stored
+    uint32_t burstGaps;    // samples missing between two bursts, seq skipped
+    uint32_t burstLate;    // burst samples older than the slots still held back
+    uint32_t burstDups;    // burst samples already stored
 } dbStats_t;
 
 typedef struct {
     dbStats_t db[MAX_CS_ID];
-    uint32_t accessBlockCnt;
+    uint32_t bufferFlips;
     uint32_t notifyTimeoutCnt;
     uint32_t sentPkts;
 } gatherStats_t;
 
+// Per board write state used in place of a lock around the stream buffers.
+typedef struct {
+    volatile uint32_t seq;    // odd while the db task or spi interrupt is writing its slot
+    volatile uint32_t bufIdx; // stream buffer targeted by the write in progress
+    volatile uint32_t span;   // older buffers the write may also reach, burst samples only
+    volatile bool torn;       // a buffer the write reaches was sent while it was in progress
+} slotPublish_t;
+
+// Stream ring state, slots ackTail..tail-1 were sent with NETCONN_NOCOPY and wait for the TCP ACK,
+// slots tail..tail+count-1 are filled and wait for the tx task, the held slots after them still take
+// late burst samples while streamDataIdx, the slot after them, is being filled.
+// Only changed with interrupts disabled.
+typedef struct {
+    uint32_t depth;          // slots in use, MIN_STREAM_RING_DEPTH..MAX_STREAM_DATA_PKT_IDX
+    uint32_t requestedDepth; // applied by the gather task once the ring is empty
+    uint32_t ackTail;        // oldest slot still referenced by lwIP
+    uint32_t inFlight;       // slots sent but not yet acknowledged
+    uint32_t tail;           // oldest filled slot
+    uint32_t count;          // filled slots not yet sent
+    uint32_t held;           // flipped slots held back for late burst samples
+    bool txActive;           // tx task is sending the tail slot
+    uint32_t highWater;      // largest count + inFlight seen
+    uint32_t drops;          // samples discarded because the ring was full
+    bool ackWait[MAX_STREAM_DATA_PKT_IDX];     // slot must stay untouched until ackSeq is acknowledged
+    uint32_t ackSeq[MAX_STREAM_DATA_PKT_IDX];  // subscriber txBytes just past the slot data
+    uint32_t ackTick[MAX_STREAM_DATA_PKT_IDX]; // HAL tick the slot was written
+    uint32_t ackSub;                           // subscriber the in flight slots were written to
+    uint32_t ackSubGen;                        // generation of that subscriber entry
+    uint32_t ackStalls;                        // zero copy given up on a client slow to acknowledge
+} streamRing_t;
+
+// Acknowledgement of the zero copy slots, read from the tcp pcb with the core locked by streamRingRelease()
+typedef struct {
+    struct netconn *volatile conn; // connection the in flight slots were written to, NULL once closed
+    bool stalled;                  // the client is sent copies, it was slow to acknowledge
+    uint32_t stalledTick;          // HAL tick the client was found slow to acknowledge
+} streamAck_t;
+
+typedef enum { STREAM_SUB_FREE, STREAM_SUB_TCP, STREAM_SUB_UDP } STREAM_SUB_e;
+
+// One consumer of the stream, every subscriber is sent the same encoded packet each tick.
+typedef struct {
+    STREAM_SUB_e type;
+    uint32_t gen;          // bumped each time the entry is reused, tags the zero copy writes
+    struct netconn *conn;  // tcp client connection
+    ip_addr_t addr;        // udp destination, unicast or IPv4 multicast
+    uint16_t port;         // udp destination port
+    uint32_t sentPkts;
+    uint32_t drops;        // packets not sent, tcp send buffer full or udp send error
+    uint32_t sendErrs;     // tcp: consecutive write errors, udp: total send errors
+    volatile uint32_t txBytes; // tcp: bytes written to the connection, counted once the write returned
+    streamFilterState_t filter; // all-pass subscribers share the encoded packet, the others get their own frame
+} streamSub_t, *streamSub_tp;
+
+// Monotonic timebase, the DWT cycle counter extended to 64 bits, and the wall clock
+// offset slewed toward the RTC. Updated with interrupts disabled, read by the ISR.
+typedef struct {
+    uint32_t lastCycles;         // DWT->CYCCNT at the last update
+    uint32_t lastTick;           // HAL_GetTick() at the last update, counts the cycle counter wraps between updates
+    uint64_t cycles;             // core cycles since the timebase started
+    uint32_t timerTickCycles;    // core cycles per TIM_UDP_TX_SIGNAL counter tick
+    volatile uint32_t triggerSeq; // bumped by each trigger capture
+    uint64_t trigger_us;         // time of the last TIM_UDP_TX_SIGNAL update edge
+    STREAM_CLOCK_SRC_e source;   // what the offset is steered by
+    int64_t offset_us;           // wall clock - monotonic time at offsetBase_us
+    uint64_t offsetBase_us;
+    int32_t ratePpb; // offset change rate toward the source
+    uint32_t steps;  // offset corrections too large to slew
+} streamClock_t;
+
+#if GATHER_BENCH
+// Stream transmit cost, used to compare the TCP copy and zero-copy modes
+typedef struct {
+    uint32_t startTick; // HAL tick when the counters were cleared
+    uint32_t pkts;
+    uint64_t bytes;
+    uint64_t cycles; // DWT cycles spent in the send calls
+    uint32_t maxCycles;
+} streamTxBench_t;
+#endif
+
 #define MB_GATHER_TASK_TIMEOUT_MS 20
 
 #define INTERVAL_1ms 1000
@@ -249,10 +378,50 @@ typedef struct {
                       // assemble them in the holding area
 } sensorBoardDataLocation_t, *sensorBoardDataLocation_tp;
 
-static __DTCMRAM__ sensorBoardDataLocation_t sensorBoardDataLocation[MAX_CS_ID] = {0};
-static __DTCMRAM__ uint32_t sensorBoardCnt[BOARDTYPE_MAX] = {0};
-bool useUdpChan = true;
-struct netconn *tcpConn = NULL;
+// Two copies of the board layout, the db tasks use the one sensorBoardDataLocation points at while the
+// gather task builds the other, see streamLayoutApply()
+static __DTCMRAM__ sensorBoardDataLocation_t sensorBoardLayout[2][MAX_CS_ID] = {0};
+static __DTCMRAM__ uint32_t sensorBoardLayoutCnt[2][BOARDTYPE_MAX] = {0};
+static sensorBoardDataLocation_tp sensorBoardDataLocation = sensorBoardLayout[0];
+static uint32_t *sensorBoardCnt = sensorBoardLayoutCnt[0];
+
+// boot discovery of the sensor boards, run by the board status task, see discoverSensorBoards().
+// The board types it reads are published to sensorBoardDataLocation by the gather task.
+typedef struct {
+    bool started;                  // configuration read by the gather thread
+    bool complete;                 // every configured board verified, or the discovery timed out
+    uint32_t startTick;            // HAL tick the discovery started at
+    uint32_t probeTick;            // HAL tick the silent boards were last enabled
+    uint32_t configuredMask;       // boards expected by the configuration
+    uint32_t verifiedMask;         // configured boards whose type was read
+    uint32_t readyMask;            // boards whose type matches their configuration
+    uint32_t relayoutMask;         // boards whose type was changed by streamLayoutApply(), to verify again
+    uint32_t renegotiate;          // settings written since the boards were verified, SENSOR_RENEGOTIATE_*
+    volatile uint32_t publishMask; // boards whose hwType waits for sensorDiscoveryPublish()
+    BOARDTYPE_e hwType[MAX_CS_ID]; // board types read by the discovery
+    uint32_t firstPacketMs;        // msec from boot to the first stream packet, 0 until it is sent
+} sensorDiscovery_t;
+static sensorDiscovery_t sensorDiscovery = {0};
+
+#define SENSOR_RENEGOTIATE_FRAME_SIZE (1 << 0) // SPI_BURST_CNT changed, see negotiateSpiFrameSize()
+#define SENSOR_RENEGOTIATE_CNC_WINDOW (1 << 1) // DB_CNC_WINDOW changed, see negotiateCncWindow()
+
+// Board types changed without a reboot, applied by the gather task once the ring is empty, see streamLayoutApply()
+typedef struct {
+    volatile bool pending;            // requested[] waits for the gather task
+    uint8_t version;                  // layoutVersion of the stream header
+    BOARDTYPE_e requested[MAX_CS_ID]; // board types of the pending layout
+} streamLayout_t;
+static streamLayout_t streamLayout = {0};
+osMutexDef(streamLayoutAccess);
+static osMutexId streamLayoutAccess = NULL; // one layout change at a time
+bool useUdpChan = true; // subscribe the EEPROM configured udp server
+static streamSub_t streamSubs[MAX_STREAM_SUBSCRIBERS];
+static uint8_t streamFilterFrame[MAX_STREAM_FRAME_SIZE_BYTES]; // filtered subscriber frame, tx task only
+static const streamFilter_t streamFilterAll = {STREAM_BOARDS_ALL, STREAM_TYPES_ALL, 1, false};
+static struct netconn *udpConn = NULL;
+osMutexDef(streamSubAccess);
+static osMutexId streamSubAccess = NULL;
 
 /**
  * @fn
@@ -260,8 +429,8 @@ struct netconn *tcpConn = NULL;
  * @brief Set the global array sensorBoardDataLocation to uninitialized data values
  **/
 static void sensorBoardDataLocationInit(void) {
-    memset(sensorBoardDataLocation, 0, sizeof(sensorBoardDataLocation));
-    for (int i = 0; i < MAX_STREAM_DATA_PKT_IDX; i++) {
+    memset(sensorBoardLayout, 0, sizeof(sensorBoardLayout));
+    for (int i = 0; i < MAX_CS_ID; i++) {
         sensorBoardDataLocation[i].configBoardType = BOARDTYPE_UNKNOWN;
         sensorBoardDataLocation[i].hwBoardType = BOARDTYPE_UNKNOWN;
     }
@@ -277,36 +446,101 @@ static void sensorBoardDataLocationInit(void) {
  **/
 static void mbGatherThread(const void *arg);
 
+/**
+ * @fn
+ *
+ * @brief Stream transmit thread, drains the filled stream ring slots to the network.
+ *        It is woken by the gather thread each time a slot is filled.
+ * @param arg, unused.
+ *
+ **/
+static void mbStreamTxThread(const void *arg);
+
 // Stream data is stored in memory that is not cached and accessible by the ETHERNET PHY
 streamData_t streamData __attribute__((section(".streamDataSection")));
 
 __DTCMRAM__ osThreadId mbGatherTaskHandle = NULL;
+__DTCMRAM__ osThreadId mbStreamTxTaskHandle = NULL;
+static __DTCMRAM__ streamClock_t streamClock;
 
-static __DTCMRAM__ imuData_t imuDataStorage[IMU_MAX_BOARD][IMU_PER_BOARD] = {0};
+// IMU samples being assembled, a layout change that moves the IMU boards switches to the other copy
+static __DTCMRAM__ imuData_t imuDataBuffers[2][IMU_MAX_BOARD][IMU_PER_BOARD] = {0};
+static imuData_t (*imuDataStorage)[IMU_PER_BOARD] = imuDataBuffers[0];
 static __DTCMRAM__ imuReadings_t
     g_imuData[IMU_PER_BOARD]; // Used for printing the last imu data captured from any device.
 static __DTCMRAM__ gatherStats_t gatherStats;
+static __DTCMRAM__ slotPublish_t slotPublish[MAX_CS_ID];
 static __DTCMRAM__ StaticTask_t mbGatherTaskCtrlBlock;
 static __DTCMRAM__ StackType_t mbGatherTaskStack[MBGATHER_STACK_WORDS];
-static __DTCMRAM__ osStaticMutexDef_t streamDataAccessCtrlSema;
+static __DTCMRAM__ StaticTask_t mbStreamTxTaskCtrlBlock;
+static __DTCMRAM__ StackType_t mbStreamTxTaskStack[STREAMTX_STACK_WORDS];
+static __DTCMRAM__ streamRing_t streamRing;
+static streamAck_t streamAck;
+#if GATHER_BENCH
+static __DTCMRAM__ streamTxBench_t streamTxBench;
+#endif
+static __DTCMRAM__ bool streamTcpZeroCopy = VALUE_STREAM_TCP_ZERO_COPY;
+static __DTCMRAM__ uint32_t streamBatchCnt = VALUE_STREAM_BATCH_CNT;
+static __DTCMRAM__ uint32_t spiBurstCnt = VALUE_SPI_BURST_CNT;
+static __DTCMRAM__ uint32_t dbCncWindow = VALUE_DB_CNC_WINDOW;
+static __DTCMRAM__ uint32_t streamIntervalUs = VALUE_STREAM_INTERVAL_US;
+static __DTCMRAM__ uint32_t burstSeq[MAX_CS_ID]; // seq of the last burst sample stored
+static __DTCMRAM__ bool burstSynced[MAX_CS_ID];  // burstSeq was taken from the board since it was enabled
+
+__ITCMRAM__ void sendData(void *p_data, size_t dataLen);
+__ITCMRAM__ void sendToSubscribers(void *p_data, size_t dataLen); // streamSubAccess held, all-pass subscribers only
+__ITCMRAM__ bool sendTcpData(streamSub_tp p_sub, void *p_data, size_t dataLen, uint8_t apiFlags);
+__ITCMRAM__ void sendUdpData(streamSub_tp p_sub, void *p_data, size_t dataLen);
+static void streamUdpOpen(void);
+
+/**
+ * @fn
+ *
+ * @brief Close the Tcp connection of the subscriber and free its entry
+ *
+ * @note called with streamSubAccess held
+ *
+ **/
+__ITCMRAM__ void closeTcpSubscriber(streamSub_tp p_sub);
 
-uint32_t sendErrCnt = 0;
+/**
+ * @fn
+ *
+ * @brief Add a stream subscriber
+ *
+ * @param[in] type: STREAM_SUB_TCP or STREAM_SUB_UDP
+ * @param[in] p_conn: accepted connection for tcp, NULL for udp
+ * @param[in] p_addr: udp destination address, NULL for tcp
+ * @param[in] port: udp destination port
+ *
+ * @return subscriber index or -1 if the table is full
+ **/
+static int streamSubAdd(STREAM_SUB_e type, struct netconn *p_conn, const ip_addr_t *p_addr, uint16_t port);
 
-__ITCMRAM__ void sendTcpData(void *p_data, size_t dataLen);
-__ITCMRAM__ void sendUdpData(void *p_data, size_t dataLen);
+/**
+ * @fn
+ *
+ * @brief Remove a stream subscriber, closing its connection if it is tcp
+ *
+ * @param[in] subIdx: subscriber index
+ *
+ * @return RETURN_OK or RETURN_ERR_PARAM if subIdx is out of range
+ **/
+static RETURN_CODE streamSubRemove(uint32_t subIdx);
 
 /**
  * @fn
  *
- * @brief CLose the Tcp connection
+ * @brief Byte offset of a sensor board's readings in the stream packet data
  *
+ * @param[in] dbId: sensor board slot 0-23
  **/
-inline void closeTcpConnection(void);
+static inline uint32_t streamBoardOffset(uint32_t dbId);
 
 /**
  * @fn
  *
- * @brief Thread to handle waiting on TCP connections. Will only allow one TCP connection at a time.
+ * @brief Thread to handle waiting on TCP connections. Each connection becomes a stream subscriber.
  *
  * @param arg - unused
  *
@@ -331,6 +565,7 @@ void setUdpSendInterval(uint32_t interval_us) {
     uint32_t arr = (pwmMap[TIM_UDP_TX_SIGNAL].clockFrequency / ONE_MICRO_SECOND) * interval_us / (psc + 1) - 1;
 
     TS_DELTA = interval_us / (ONE_MICRO_SECOND * 1.0);
+    streamIntervalUs = interval_us;
 
     if (interval_us == INTERVAL_1ms) {
         arr = ARRREG;
@@ -345,31 +580,239 @@ void setUdpSendInterval(uint32_t interval_us) {
     pwmMap[TIM_UDP_TX_SIGNAL].htim->Instance->PSC = psc;
     pwmMap[TIM_UDP_TX_SIGNAL].htim->Instance->ARR = arr;
     pwmMap[TIM_UDP_TX_SIGNAL].htim->Instance->CCR1 = arr / 2;
+    streamClock.timerTickCycles = (psc + 1) * (SystemCoreClock / pwmMap[TIM_UDP_TX_SIGNAL].clockFrequency);
     DPRINTF_INFO("UDP TX INTERVAL %u us TIM13 PSC=%u, ARR=%u, PULSE=%u\r\n", interval_us, psc, arr, arr / 2);
 }
 
 void tcpDataServerWaitTaskInit(int priority, int stackSize) {
+    // first stream task started, the subscriber table must exist before a client is accepted
+    memset(streamSubs, 0, sizeof(streamSubs));
+    streamSubAccess = osMutexCreate(osMutex(streamSubAccess));
+    assert(streamSubAccess != NULL);
+
     osThreadDef(tcpServerConnection, waitOnTcpServerConnectionThread, priority, 0, stackSize);
     osThreadId thread = osThreadCreate(osThread(tcpServerConnection), NULL);
     assert(thread != NULL);
 }
 
+/**
+ * @fn
+ *
+ * @brief Advance the 64 bit cycle count of the timebase
+ *
+ * The cycle counter wraps every 8.9 s at 480 MHz. The ms tick gives the time since the last
+ * update to well within half a wrap, so the wraps it missed are added back and the updates
+ * can be any distance apart.
+ *
+ * @note called with interrupts disabled
+ *
+ * @return core cycles since the timebase started
+ **/
+__ITCMRAM__ static inline uint64_t streamClockCycles(void) {
+    uint32_t now = DWT->CYCCNT;
+    uint32_t tick = HAL_GetTick();
+    uint32_t delta = now - streamClock.lastCycles;
+    uint64_t expected = (uint64_t)(tick - streamClock.lastTick) * (SystemCoreClock / 1000);
+    // rounded to the nearest wrap, the tick is within 1 ms of the cycle counter
+    uint64_t wraps = (expected + (1ULL << 31) - delta) >> 32;
+    streamClock.cycles += (wraps << 32) + delta;
+    streamClock.lastCycles = now;
+    streamClock.lastTick = tick;
+    return streamClock.cycles;
+}
+
+__ITCMRAM__ uint64_t streamTimeUs(void) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint64_t cycles = streamClockCycles();
+    __set_PRIMASK(primask);
+    return cycles / (SystemCoreClock / ONE_MICRO_SECOND);
+}
+
+__ITCMRAM__ void mbGatherTriggerFromISR(void) {
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    // the timer counts from the update edge, so the ISR latency is taken out of the capture
+    uint32_t timerCnt = pwmMap[TIM_UDP_TX_SIGNAL].htim->Instance->CNT;
+    uint64_t cycles = streamClockCycles() - (uint64_t)timerCnt * streamClock.timerTickCycles;
+    streamClock.trigger_us = cycles / (SystemCoreClock / ONE_MICRO_SECOND);
+    streamClock.triggerSeq++;
+    __set_PRIMASK(primask);
+    vTaskNotifyGiveFromISR(mbGatherTaskHandle, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/**
+ * @fn
+ *
+ * @brief Time of the trigger edge that woke the gather task
+ *
+ * @param[in,out] p_lastSeq: capture sequence seen at the previous call
+ *
+ * @return trigger edge time in us, the current time if the ISR did not capture it
+ **/
+__ITCMRAM__ static uint64_t streamTriggerTimeUs(uint32_t *p_lastSeq) {
+    __disable_irq();
+    uint32_t seq = streamClock.triggerSeq;
+    uint64_t trigger_us = streamClock.trigger_us;
+    __enable_irq();
+    if (seq == *p_lastSeq) {
+        trigger_us = streamTimeUs();
+    }
+    *p_lastSeq = seq;
+    return trigger_us;
+}
+
+/**
+ * @fn
+ *
+ * @brief Wall clock offset at a monotonic time
+ *
+ * @note called with interrupts disabled
+ *
+ * @param[in] mono_us: monotonic time in us
+ **/
+__ITCMRAM__ static inline int64_t streamClockOffsetAt(uint64_t mono_us) {
+    return streamClock.offset_us +
+           (int64_t)(mono_us - streamClock.offsetBase_us) * streamClock.ratePpb / STREAM_CLOCK_PPB;
+}
+
+/**
+ * @fn
+ *
+ * @brief Fold the offset accumulated at the current rate in, so the rate can change
+ *
+ * @note called with interrupts disabled
+ *
+ * @param[in] now: current monotonic time in us
+ **/
+static inline void streamClockRebase(uint64_t now) {
+    streamClock.offset_us = streamClockOffsetAt(now);
+    streamClock.offsetBase_us = now;
+}
+
+__ITCMRAM__ int64_t streamWallTimeUs(uint64_t mono_us) {
+    __disable_irq();
+    int64_t offset_us = streamClockOffsetAt(mono_us);
+    __enable_irq();
+    return (int64_t)mono_us + offset_us;
+}
+
+/**
+ * @fn
+ *
+ * @brief Convert a monotonic time to seconds since epoch with the slewed offset
+ *
+ * @param[in] mono_us: monotonic time in us
+ **/
+__ITCMRAM__ static double streamWallTime(uint64_t mono_us) {
+    return (double)streamWallTimeUs(mono_us) / ONE_MICRO_SECOND;
+}
+
+void streamClockSteer(int64_t step_us, int32_t ratePpb) {
+    if (ratePpb > STREAM_CLOCK_SLEW_MAX_PPB) {
+        ratePpb = STREAM_CLOCK_SLEW_MAX_PPB;
+    } else if (ratePpb < -STREAM_CLOCK_SLEW_MAX_PPB) {
+        ratePpb = -STREAM_CLOCK_SLEW_MAX_PPB;
+    }
+    uint64_t now = streamTimeUs();
+    __disable_irq();
+    streamClockRebase(now);
+    streamClock.offset_us += step_us;
+    streamClock.ratePpb = ratePpb;
+    streamClock.steps += (step_us != 0) ? 1 : 0;
+    streamClock.source = STREAM_CLOCK_NET;
+    __enable_irq();
+}
+
+void streamClockRelease(void) {
+    __disable_irq();
+    if (streamClock.source == STREAM_CLOCK_NET) {
+        streamClock.source = STREAM_CLOCK_RTC;
+    }
+    __enable_irq();
+}
+
+/**
+ * @fn
+ *
+ * @brief Steer the wall clock offset toward the RTC
+ *
+ * Small errors are slewed at up to STREAM_CLOCK_SLEW_MAX_PPB so the stream time stamps
+ * never jump, the first sync and errors over STREAM_CLOCK_STEP_US are stepped.
+ * The RTC is read here, on the transmit task, to keep mktime() and the RTC mutex off
+ * the gather task. Nothing is done while the network time sync steers the clock.
+ **/
+static void streamClockDiscipline(void) {
+    if (streamClock.source == STREAM_CLOCK_NET) {
+        return;
+    }
+    double rtc = timeSinceEpoch();
+    if (rtc == 0) {
+        return;
+    }
+    int64_t rtc_us = (int64_t)(rtc * ONE_MICRO_SECOND);
+    uint64_t now = streamTimeUs();
+
+    __disable_irq();
+    if (streamClock.source == STREAM_CLOCK_NET) {
+        // the network time sync took over while the RTC was read
+        __enable_irq();
+        return;
+    }
+    streamClockRebase(now);
+    int64_t err_us = rtc_us - ((int64_t)now + streamClock.offset_us);
+    if (streamClock.source == STREAM_CLOCK_FREE || err_us > STREAM_CLOCK_STEP_US || err_us < -STREAM_CLOCK_STEP_US) {
+        streamClock.offset_us = rtc_us - (int64_t)now;
+        streamClock.ratePpb = 0;
+        streamClock.steps += (streamClock.source == STREAM_CLOCK_FREE) ? 0 : 1;
+        streamClock.source = STREAM_CLOCK_RTC;
+    } else if (err_us < STREAM_CLOCK_DEADBAND_US && err_us > -STREAM_CLOCK_DEADBAND_US) {
+        streamClock.ratePpb = 0;
+    } else {
+        // err_us over one sync period is the rate that removes it by the next sync
+        int64_t ppb = err_us * 1000 * 1000 / STREAM_CLOCK_SYNC_MS;
+        if (ppb > STREAM_CLOCK_SLEW_MAX_PPB) {
+            ppb = STREAM_CLOCK_SLEW_MAX_PPB;
+        } else if (ppb < -STREAM_CLOCK_SLEW_MAX_PPB) {
+            ppb = -STREAM_CLOCK_SLEW_MAX_PPB;
+        }
+        streamClock.ratePpb = ppb;
+    }
+    __enable_irq();
+}
+
 void mbGatherTaskInit(int priority, int stackSize) {
+    // the cycle counter is the stream timebase, with GATHER_BENCH it also times the send calls
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    memset(&streamClock, 0, sizeof(streamClock));
+    streamClock.lastCycles = DWT->CYCCNT;
+    streamClock.lastTick = HAL_GetTick();
 
     sensorBoardDataLocationInit();
     memset(&streamData, 0, sizeof(streamData_t));
-
-    osMutexStaticDef(streamDataAccess, &streamDataAccessCtrlSema);
+    memset(slotPublish, 0, sizeof(slotPublish));
+    memset(&streamRing, 0, sizeof(streamRing));
+    memset(&streamLayout, 0, sizeof(streamLayout));
     streamData.streamDataIdx = 0;
+    streamLayoutAccess = osMutexCreate(osMutex(streamLayoutAccess));
+    assert(streamLayoutAccess != NULL);
 
-    streamData.access = osMutexCreate(osMutex(streamDataAccess));
-    assert(streamData.access != NULL);
+    registerInfo_t regInfo = {.mbId = STREAM_RING_DEPTH, .type = DATA_UINT};
+    registerRead(&regInfo);
+    if (setStreamRingDepth(regInfo.u.dataUint) != RETURN_OK) {
+        setStreamRingDepth(VALUE_STREAM_RING_DEPTH);
+    }
+    streamRing.depth = streamRing.requestedDepth;
 
     osThreadStaticDef(mbGatherTask, mbGatherThread, priority, 0, stackSize, mbGatherTaskStack, &mbGatherTaskCtrlBlock);
     mbGatherTaskHandle = osThreadCreate(osThread(mbGatherTask), NULL);
     assert(mbGatherTaskHandle != NULL);
 
-    registerInfo_t regInfo = {.mbId = IP_TX_DATA_TYPE, .type = DATA_UINT};
+    regInfo.mbId = IP_TX_DATA_TYPE;
     registerRead(&regInfo);
     if (regInfo.u.dataUint == IPTYPE_TCP) {
         useUdpChan = false;
@@ -381,6 +824,76 @@ void mbGatherTaskInit(int priority, int stackSize) {
     regInfo.mbId = STREAM_INTERVAL_US;
     registerRead(&regInfo);
     setUdpSendInterval(regInfo.u.dataUint);
+
+    regInfo.mbId = STREAM_BATCH_CNT;
+    registerRead(&regInfo);
+    setStreamBatchCnt(regInfo.u.dataUint);
+
+    regInfo.mbId = SPI_BURST_CNT;
+    registerRead(&regInfo);
+    if (setSpiBurstCnt(regInfo.u.dataUint) != RETURN_OK) {
+        setSpiBurstCnt(VALUE_SPI_BURST_CNT);
+    }
+
+    regInfo.mbId = DB_CNC_WINDOW;
+    registerRead(&regInfo);
+    if (setDbCncWindow(regInfo.u.dataUint) != RETURN_OK) {
+        setDbCncWindow(VALUE_DB_CNC_WINDOW);
+    }
+}
+
+RETURN_CODE setStreamBatchCnt(uint32_t batchCnt) {
+    if (batchCnt == 0 || batchCnt > STREAM_BATCH_CNT_MAX) {
+        DPRINTF_ERROR("Stream batch count %u out of range [1-%u]\r\n", batchCnt, STREAM_BATCH_CNT_MAX);
+        return RETURN_ERR_PARAM;
+    }
+    streamBatchCnt = batchCnt;
+    DPRINTF_INFO("Stream batch count %u\r\n", batchCnt);
+    return RETURN_OK;
+}
+
+void mbStreamTxTaskInit(int priority, int stackSize) {
+#if GATHER_BENCH
+    memset(&streamTxBench, 0, sizeof(streamTxBench));
+    streamTxBench.startTick = HAL_GetTick();
+#endif
+
+    registerInfo_t regInfo = {.mbId = STREAM_TCP_ZERO_COPY, .type = DATA_UINT};
+    registerRead(&regInfo);
+    setStreamTcpZeroCopy(regInfo.u.dataUint != 0);
+
+    osThreadStaticDef(
+        mbStreamTxTask, mbStreamTxThread, priority, 0, stackSize, mbStreamTxTaskStack, &mbStreamTxTaskCtrlBlock);
+    mbStreamTxTaskHandle = osThreadCreate(osThread(mbStreamTxTask), NULL);
+    assert(mbStreamTxTaskHandle != NULL);
+}
+
+RETURN_CODE setStreamRingDepth(uint32_t depth) {
+    if (depth < MIN_STREAM_RING_DEPTH || depth > MAX_STREAM_DATA_PKT_IDX) {
+        DPRINTF_ERROR(
+            "Stream ring depth %u out of range [%u-%u]\r\n", depth, MIN_STREAM_RING_DEPTH, MAX_STREAM_DATA_PKT_IDX);
+        return RETURN_ERR_PARAM;
+    }
+    streamRing.requestedDepth = depth;
+    DPRINTF_INFO("Stream ring depth %u\r\n", depth);
+    return RETURN_OK;
+}
+
+void setStreamTcpZeroCopy(bool enable) {
+    streamTcpZeroCopy = enable;
+    DPRINTF_INFO("Stream TCP zero copy %s\r\n", enable ? "enabled" : "disabled");
+}
+
+RETURN_CODE streamRingHighWaterRead(const registerInfo_tp regInfo) {
+    assert(regInfo != NULL);
+    regInfo->u.dataUint = streamRing.highWater;
+    return RETURN_OK;
+}
+
+RETURN_CODE streamRingDropsRead(const registerInfo_tp regInfo) {
+    assert(regInfo != NULL);
+    regInfo->u.dataUint = streamRing.drops;
+    return RETURN_OK;
 }
 
 __ITCMRAM__ void setDaughterboardState(int boardId, bool enable) {
@@ -389,168 +902,373 @@ __ITCMRAM__ void setDaughterboardState(int boardId, bool enable) {
         return;
     }
     gatherStats.db[boardId].statusEn = enable;
+    if (enable) {
+        // a board that rebooted restarts its burst sequence
+        burstSynced[boardId] = false;
+    }
     updateSPIEnableCount(boardId, enable);
 }
 
-__ITCMRAM__ void updateSensorData(dbCommThreadInfo_tp p_threadInfo, uint8_t *sensorReadings, size_t sensorReadingCnt) {
-    assert(p_threadInfo->daughterBoardId < MAX_CS_ID);
-    osStatus result = osMutexWait(streamData.access, 2);
-    if (result == osOK) {
+#if !USING32_ADC_SAMPLES_IN_SPI || GATHER_BENCH
+/**
+ * @fn
+ *
+ * @brief Sign extend packed 24 bit big endian ADC readings to 32 bit
+ *
+ * Four readings are loaded as three words. REV puts each word in big endian order,
+ * the barrel shifter joins the readings split across words and an arithmetic shift
+ * sign extends them, 3 loads and 4 stores per 4 readings instead of a byte at a time.
+ *
+ * @param[out] p_dst: 32 bit readings, adc24Reading_t, may be unaligned
+ * @param[in] p_src: packed readings, adcPacked24_t
+ * @param[in] cnt: number of readings
+ **/
+__ITCMRAM__ static void adcUnpack24(void *p_dst, const void *p_src, uint32_t cnt) {
+    const uint8_t *p_in = p_src;
+    uint8_t *p_out = p_dst;
+    uint32_t i = 0;
+
+    for (; i + 4 <= cnt; i += 4) {
+        uint32_t w0 = __REV(__UNALIGNED_UINT32_READ(p_in));
+        uint32_t w1 = __REV(__UNALIGNED_UINT32_READ(p_in + 4));
+        uint32_t w2 = __REV(__UNALIGNED_UINT32_READ(p_in + 8));
+        __UNALIGNED_UINT32_WRITE(p_out, (uint32_t)((int32_t)w0 >> 8));
+        __UNALIGNED_UINT32_WRITE(p_out + 4, (uint32_t)((int32_t)((w0 << 24) | (w1 >> 8)) >> 8));
+        __UNALIGNED_UINT32_WRITE(p_out + 8, (uint32_t)((int32_t)((w1 << 16) | (w2 >> 16)) >> 8));
+        __UNALIGNED_UINT32_WRITE(p_out + 12, (uint32_t)((int32_t)(w2 << 8) >> 8));
+        p_in += 4 * BYTES_IN_24_BIT;
+        p_out += 4 * sizeof(adc24Reading_t);
+    }
+    for (; i < cnt; i++) {
+        __UNALIGNED_UINT32_WRITE(p_out, (uint32_t)READ_24BITSVALUE(p_in));
+        p_in += BYTES_IN_24_BIT;
+        p_out += sizeof(adc24Reading_t);
+    }
+}
+#endif
 
-        rx_dbNopPayload_tp p_payload = (rx_dbNopPayload_tp)sensorReadings;
+/**
+ * @fn
+ *
+ * @brief Mark a reading written by a board as new, unless its buffer was sent during the write
+ *
+ * The flags byte is written last. A db task preempted by the gather task can resume into a
+ * buffer dropTornSlots() already invalidated and queued, the check and the store are done
+ * with the interrupts disabled so the reading stays invalid.
+ *
+ * @param[in] boardId: board writing
+ * @param[in] p_flags: flags byte of the reading
+ * @param[in] flags: NEW_DATA_FLAG and the board type
+ *
+ * @return true if the reading was marked new
+ **/
+__ITCMRAM__ static inline bool slotCommit(uint32_t boardId, volatile uint8_t *p_flags, uint8_t flags) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    bool owned = !slotPublish[boardId].torn;
+    if (owned) {
+        *p_flags = flags;
+    }
+    __set_PRIMASK(primask);
+    return owned;
+}
+
+/**
+ * @fn
+ *
+ * @brief Store a complete IMU sample in the stream buffer
+ *
+ * @param[in] boardId: board that sent the sample
+ * @param[in] bufIdx: stream buffer claimed by updateSensorData()
+ * @param[in] imuIdx: IMU of the board
+ * @param[in] p_sample: quaternionData_t sample
+ **/
+__ITCMRAM__ static inline void updateImuReadings(uint32_t boardId,
+                                                 uint32_t bufIdx,
+                                                 uint32_t imuIdx,
+                                                 const uint8_t *p_sample) {
+    imuReadings_tp p_imuReadings = sensorBoardDataLocation[boardId].dataLocation[bufIdx][imuIdx].p_imu;
+    p_imuReadings->boardId = boardId;
+    p_imuReadings->version = STREAM_PKT_VERSION;
+    p_imuReadings->sensorId = imuIdx;
+
+    memcpy(&p_imuReadings->u8[0], p_sample, sizeof(quaternionData_t));
+    memcpy(&g_imuData[imuIdx].u8[0], &p_imuReadings->u8[0], sizeof(quaternionData_t));
+    displaySentBinaryData(&p_imuReadings->u8[4], DATA_TYPE_EULER_2NDBYTE);
+    if (slotCommit(boardId, &p_imuReadings->flags, NEW_DATA_FLAG | sensorBoardDataLocation[boardId].configBoardType)) {
+        gatherStats.db[boardId].sentPkts[imuIdx]++;
+    }
+}
 
+/**
+ * @fn
+ *
+ * @brief Store an ADC sample in the stream buffer
+ *
+ * @param[in] boardId: board that sent the sample
+ * @param[in] bufIdx: stream buffer claimed by slotClaim()
+ * @param[in] p_adc: NUMBER_OF_SENSOR_READINGS readings
+ * @param[in] p_ctrlData: coil data of an MCG board, NULL for an ECG board
+ **/
+__ITCMRAM__ static inline void updateAdcReadings(uint32_t boardId,
+                                                 uint32_t bufIdx,
+                                                 const adcSpiReading_t *p_adc,
+                                                 const coilData_t *p_ctrlData) {
+    // the MCG readings are the ECG readings followed by the coil data
+    sensorECGBoardReadings_tp p_readings = sensorBoardDataLocation[boardId].dataLocation[bufIdx][SENSOR_0].p_ECGsensors;
+
+    if (NEW_DATA(p_readings->flags)) {
+        gatherStats.db[boardId].overWrittenData++;
+    }
 
-        switch (sensorBoardDataLocation[p_threadInfo->daughterBoardId].configBoardType) {
-        case BOARDTYPE_MCG: {
-            // THE MCG contains extra data at the end of the sensor data, the ECG do not.
-            const size_t cpySz = sizeof(coilData_t)*SENSORS_PER_BOARD + sizeof(adc24Reading_t) * NUMBER_OF_SENSOR_READINGS;
-            sensorMCGBoardReadings_tp p_readings = sensorBoardDataLocation[p_threadInfo->daughterBoardId]
-                                                    .dataLocation[streamData.streamDataIdx][SENSOR_0]
-                                                    .p_MCGsensors;
+    p_readings->boardId = boardId;
+    p_readings->sensorId = SENSOR_0;
+    p_readings->version = STREAM_PKT_VERSION;
 
-            if (NEW_DATA(p_readings->flags)) {
-                gatherStats.db[p_threadInfo->daughterBoardId].overWrittenData++;
-            }
+#if USING32_ADC_SAMPLES_IN_SPI
+    memcpy(p_readings->readings, p_adc, sizeof(adc24Reading_t) * NUMBER_OF_SENSOR_READINGS);
+#else
+    adcUnpack24(p_readings->readings, p_adc, NUMBER_OF_SENSOR_READINGS);
+#endif
+    if (p_ctrlData != NULL) {
+        memcpy(((sensorMCGBoardReadings_tp)p_readings)->ctrlData, p_ctrlData, sizeof(coilData_t) * SENSORS_PER_BOARD);
+    }
+    if (slotCommit(boardId, &p_readings->flags, NEW_DATA_FLAG | sensorBoardDataLocation[boardId].configBoardType)) {
+        gatherStats.db[boardId].sentPkts[0]++;
+    }
+}
 
-            p_readings->boardId = p_threadInfo->daughterBoardId;
-            p_readings->sensorId = SENSOR_0;
-            p_readings->version = STREAM_PKT_VERSION;
-            p_readings->flags = NEW_DATA_FLAG | sensorBoardDataLocation[p_threadInfo->daughterBoardId].configBoardType;
+/**
+ * @fn
+ *
+ * @brief Claim the stream buffer being filled for a write by a board, ended by slotRelease()
+ *
+ * The writer is a db task or, with SPI_FAST_PATH, the spi DMA complete interrupt. A db task runs
+ * below the gather task, so once the odd sequence is visible and the index is re-read unchanged
+ * any flip will see it. The interrupt cannot be preempted by the gather task, a flip only lands
+ * between two interrupt writes, but the same bracket is kept so both writers share one path.
+ *
+ * @param[in] boardId: board writing
+ * @param[in] span: older buffers the write may also reach, 0 unless storing a burst
+ *
+ * @return stream buffer index to write
+ **/
+__ITCMRAM__ static inline uint32_t slotClaim(uint32_t boardId, uint32_t span) {
+    slotPublish_t *p_publish = &slotPublish[boardId];
+    uint32_t bufIdx;
 
-            memcpy(p_readings->readings, &p_payload->adc[SENSOR_0], cpySz);
-            gatherStats.db[p_threadInfo->daughterBoardId].sentPkts[0]++;
+    p_publish->span = span;
+    p_publish->torn = false;
+    while (1) {
+        bufIdx = streamData.streamDataIdx;
+        p_publish->bufIdx = bufIdx;
+        p_publish->seq++;
+        __DMB();
+        if (streamData.streamDataIdx == bufIdx) {
+            break;
         }
-        break;
-        case BOARDTYPE_ECG:
-        case BOARDTYPE_12ECG:
-            {
-            const size_t cpySz = sizeof(adc24Reading_t) * NUMBER_OF_SENSOR_READINGS;
-            sensorECGBoardReadings_tp p_readings = sensorBoardDataLocation[p_threadInfo->daughterBoardId]
-                                                    .dataLocation[streamData.streamDataIdx][SENSOR_0]
-                                                    .p_ECGsensors;
-
-            if (NEW_DATA(p_readings->flags)) {
-                gatherStats.db[p_threadInfo->daughterBoardId].overWrittenData++;
-            }
+        p_publish->seq++;
+        gatherStats.db[boardId].publishRetry++;
+    }
+    return bufIdx;
+}
+
+/**
+ * @fn
+ *
+ * @brief End the write started by slotClaim()
+ *
+ * @param[in] boardId: board writing
+ **/
+__ITCMRAM__ static inline void slotRelease(uint32_t boardId) {
+    __DMB();
+    slotPublish[boardId].seq++;
+}
+
+__ITCMRAM__ void updateSensorData(dbCommThreadInfo_tp p_threadInfo, uint8_t *sensorReadings, size_t sensorReadingCnt) {
+    assert(p_threadInfo->daughterBoardId < MAX_CS_ID);
+    uint32_t bufIdx = slotClaim(p_threadInfo->daughterBoardId, 0);
 
-            p_readings->boardId = p_threadInfo->daughterBoardId;
-            p_readings->sensorId = SENSOR_0;
-            p_readings->version = STREAM_PKT_VERSION;
-            p_readings->flags = NEW_DATA_FLAG | sensorBoardDataLocation[p_threadInfo->daughterBoardId].configBoardType;
+    rx_dbNopPayload_tp p_payload = (rx_dbNopPayload_tp)sensorReadings;
 
-            memcpy(p_readings->readings, &p_payload->adc[SENSOR_0], cpySz);
-            gatherStats.db[p_threadInfo->daughterBoardId].sentPkts[0]++;
-            break;
-            }
+
+    switch (sensorBoardDataLocation[p_threadInfo->daughterBoardId].configBoardType) {
+    case BOARDTYPE_MCG:
+        updateAdcReadings(p_threadInfo->daughterBoardId, bufIdx, p_payload->adc, p_payload->ctrlData);
         break;
-        case BOARDTYPE_IMU_COIL:
-            for (int imuIdx = IMU0_IDX; imuIdx <= IMU1_IDX; imuIdx++) {
-                switch (PAYLOAD_GET_FLAG(imuIdx, p_payload->imuFlag)) {
-                case IMU_DATA_FLAG_SENT_HIGH_TRIBBLE:
+    case BOARDTYPE_ECG:
+    case BOARDTYPE_12ECG:
+        updateAdcReadings(p_threadInfo->daughterBoardId, bufIdx, p_payload->adc, NULL);
+        break;
+    case BOARDTYPE_IMU_COIL:
+        for (int imuIdx = IMU0_IDX; imuIdx <= IMU1_IDX; imuIdx++) {
+            switch (PAYLOAD_GET_FLAG(imuIdx, p_payload->imuFlag)) {
+            case IMU_DATA_FLAG_SENT_HIGH_TRIBBLE:
+                if (imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
+                        .flag != IMU_DATA_FLAG_NEW) {
+                    gatherStats.db[p_threadInfo->daughterBoardId].overWrittenData++;
+                }
+                imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx].flag =
+                    IMU_DATA_FLAG_SENT_HIGH_TRIBBLE;
+                memcpy(&imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
+                            .tribble[PAYLOAD_TRIBLE_INDEX(IMU_DATA_FLAG_SENT_HIGH_TRIBBLE)],
+                       p_payload->imu[imuIdx],
+                       SIZE_OF_IMU_FRAGMENT * sizeof(uint32_t));
+                break;
+            case IMU_DATA_FLAG_SENT_MED_TRIBBLE:
+                if (imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
+                        .flag != IMU_DATA_FLAG_SENT_HIGH_TRIBBLE) {
                     if (imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
                             .flag != IMU_DATA_FLAG_NEW) {
-                        gatherStats.db[p_threadInfo->daughterBoardId].overWrittenData++;
-                    }
-                    imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx].flag =
-                        IMU_DATA_FLAG_SENT_HIGH_TRIBBLE;
-                    memcpy(&imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
-                                .tribble[PAYLOAD_TRIBLE_INDEX(IMU_DATA_FLAG_SENT_HIGH_TRIBBLE)],
-                           p_payload->imu[imuIdx],
-                           SIZE_OF_IMU_FRAGMENT * sizeof(uint32_t));
-                    break;
-                case IMU_DATA_FLAG_SENT_MED_TRIBBLE:
-                    if (imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
-                            .flag != IMU_DATA_FLAG_SENT_HIGH_TRIBBLE) {
-                        if (imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
-                                .flag != IMU_DATA_FLAG_NEW) {
-                            gatherStats.db[p_threadInfo->daughterBoardId].alignmentData++;
-                        }
-                        imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
-                            .flag = IMU_DATA_FLAG_NEW;
-                    } else {
-                        imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
-                            .flag = IMU_DATA_FLAG_SENT_MED_TRIBBLE;
-                        memcpy(
-                            &imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
-                                 .tribble[PAYLOAD_TRIBLE_INDEX(IMU_DATA_FLAG_SENT_MED_TRIBBLE)],
-                            p_payload->imu[imuIdx],
-                            sizeof(p_payload->imu[0]));
-                    }
-                    break;
-                case IMU_DATA_FLAG_SENT_LOW_TRIBBLE:
-                    if (imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
-                            .flag != IMU_DATA_FLAG_SENT_MED_TRIBBLE) {
-                        if (imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
-                                .flag != IMU_DATA_FLAG_NEW) {
-                            gatherStats.db[p_threadInfo->daughterBoardId].alignmentData++;
-                        }
-                        imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
-                            .flag = IMU_DATA_FLAG_NEW;
-                    } else {
-                        imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
-                            .flag = IMU_DATA_FLAG_NEW;
-                        memcpy(
-                            &imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
-                                 .tribble[PAYLOAD_TRIBLE_INDEX(IMU_DATA_FLAG_SENT_LOW_TRIBBLE)],
-                            p_payload->imu[imuIdx],
-                            sizeof(p_payload->imu[0]));
-
-                        // send data in ethernet packet
-                        imuReadings_tp p_imuReadings = sensorBoardDataLocation[p_threadInfo->daughterBoardId]
-                                                           .dataLocation[streamData.streamDataIdx][imuIdx]
-                                                           .p_imu;
-                        p_imuReadings->boardId = p_threadInfo->daughterBoardId;
-                        p_imuReadings->version = STREAM_PKT_VERSION;
-                        p_imuReadings->flags =
-                            NEW_DATA_FLAG | sensorBoardDataLocation[p_threadInfo->daughterBoardId].configBoardType;
-                        p_imuReadings->sensorId = imuIdx;
-
-                        memcpy(
-                            &p_imuReadings->u8[0],
-                            imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
-                                .darray,
-                            sizeof(quaternionData_t));
-                        memcpy(&g_imuData[imuIdx].u8[0], &p_imuReadings->u8[0], sizeof(quaternionData_t));
-                        displaySentBinaryData(&p_imuReadings->u8[4], DATA_TYPE_EULER_2NDBYTE);
-                        gatherStats.db[p_threadInfo->daughterBoardId].sentPkts[imuIdx]++;
+                        gatherStats.db[p_threadInfo->daughterBoardId].alignmentData++;
                     }
-                    break;
-                case IMU_DATA_FLAG_NEW:
-                    // fall through
-                case IMU_DATA_FLAG_SENT_EMPTY_TRIBBLE:
+                    imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
+                        .flag = IMU_DATA_FLAG_NEW;
+                } else {
+                    imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
+                        .flag = IMU_DATA_FLAG_SENT_MED_TRIBBLE;
+                    memcpy(
+                        &imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
+                             .tribble[PAYLOAD_TRIBLE_INDEX(IMU_DATA_FLAG_SENT_MED_TRIBBLE)],
+                        p_payload->imu[imuIdx],
+                        sizeof(p_payload->imu[0]));
+                }
+                break;
+            case IMU_DATA_FLAG_SENT_LOW_TRIBBLE:
+                if (imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
+                        .flag != IMU_DATA_FLAG_SENT_MED_TRIBBLE) {
                     if (imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
                             .flag != IMU_DATA_FLAG_NEW) {
                         gatherStats.db[p_threadInfo->daughterBoardId].alignmentData++;
                     }
-                    imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx].flag =
-                        IMU_DATA_FLAG_NEW;
-                    break;
-                default:
-                    static uint32_t throttleCnt = 0;
-                    if (THROTTLE_PRINT_OUTPUT(throttleCnt, PRINT_1_OUT_OF_(1000))) {
-                        DPRINTF_ERROR("Unknown IMU%d switch flag %d %u\r\n",
-                                      imuIdx,
-                                      PAYLOAD_GET_FLAG(imuIdx, p_payload->imuFlag));
-                    }
+                    imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
+                        .flag = IMU_DATA_FLAG_NEW;
+                } else {
+                    imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
+                        .flag = IMU_DATA_FLAG_NEW;
+                    memcpy(
+                        &imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
+                             .tribble[PAYLOAD_TRIBLE_INDEX(IMU_DATA_FLAG_SENT_LOW_TRIBBLE)],
+                        p_payload->imu[imuIdx],
+                        sizeof(p_payload->imu[0]));
+
+                    // send data in ethernet packet
+                    updateImuReadings(
+                        p_threadInfo->daughterBoardId,
+                        bufIdx,
+                        imuIdx,
+                        imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
+                            .darray);
+                }
+                break;
+            case IMU_DATA_FLAG_SENT_FULL:
+                // extended frame, the whole sample is in this packet and no tribble is pending
+                if (sensorReadingCnt < sizeof(rx_dbExtPayload_t)) {
+                    gatherStats.db[p_threadInfo->daughterBoardId].alignmentData++;
                     break;
-                }  // end switch(payload flag)
-            }      // end for(imuIdx
-            break; // end of case BOARDTYPE_IMU_COIL:
-        default:
-            break;
-        }
-
-        osMutexRelease(streamData.access);
-    } else {
-        gatherStats.db[p_threadInfo->daughterBoardId].accessBlocked++;
+                }
+                imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx].flag =
+                    IMU_DATA_FLAG_NEW;
+                updateImuReadings(p_threadInfo->daughterBoardId,
+                                  bufIdx,
+                                  imuIdx,
+                                  (const uint8_t *)&((rx_dbExtPayload_tp)sensorReadings)->imuSample[imuIdx]);
+                break;
+            case IMU_DATA_FLAG_NEW:
+                // fall through
+            case IMU_DATA_FLAG_SENT_EMPTY_TRIBBLE:
+                if (imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx]
+                        .flag != IMU_DATA_FLAG_NEW) {
+                    gatherStats.db[p_threadInfo->daughterBoardId].alignmentData++;
+                }
+                imuDataStorage[sensorBoardDataLocation[p_threadInfo->daughterBoardId].boardTypeIdx][imuIdx].flag =
+                    IMU_DATA_FLAG_NEW;
+                break;
+            default:
+                static uint32_t throttleCnt = 0;
+                if (THROTTLE_PRINT_OUTPUT(throttleCnt, PRINT_1_OUT_OF_(1000))) {
+                    DPRINTF_ERROR("Unknown IMU%d switch flag %d %u\r\n",
+                                  imuIdx,
+                                  PAYLOAD_GET_FLAG(imuIdx, p_payload->imuFlag));
+                }
+                break;
+            }  // end switch(payload flag)
+        }      // end for(imuIdx
+        break; // end of case BOARDTYPE_IMU_COIL:
+    default:
+        break;
     }
+    slotRelease(p_threadInfo->daughterBoardId);
 }
 
-void handleCncReadIntRegisterRequest(int destination, uint32_t address, uint32_t *value, uint32_t *uid) {
-    cncMsgPayload_t cncPayload = {
-        .cncMsgPayloadHeader.peripheral = PER_MCU, .cncMsgPayloadHeader.action = CNC_ACTION_READ, .cncMsgPayloadHeader.addr = address, .value = *value, .cncMsgPayloadHeader.cncActionData.result = 0xFF};
-    webCncCbId_t cncCbId = {.taskHandle = xTaskGetCurrentTaskHandle(), .p_payload = NULL, .xInfo = 0};
-    cncSendMsg(destination, SPICMD_CNC, (cncPayload_tp)&cncPayload, *uid, webCncRequestCB, (uint32_t)&cncCbId);
+__ITCMRAM__ void updateSensorBurst(dbCommThreadInfo_tp p_threadInfo, uint8_t *sensorReadings, size_t sensorReadingCnt) {
+    assert(p_threadInfo->daughterBoardId < MAX_CS_ID);
+    uint32_t boardId = p_threadInfo->daughterBoardId;
+    rx_dbBurstPayload_tp p_burst = (rx_dbBurstPayload_tp)sensorReadings;
+    const coilData_t *p_ctrlData = NULL;
+    dbStats_t *p_stats = &gatherStats.db[boardId];
+
+    switch (sensorBoardDataLocation[boardId].configBoardType) {
+    case BOARDTYPE_MCG:
+    case BOARDTYPE_ECG:
+    case BOARDTYPE_12ECG:
+        break;
+    default:
+        p_stats->alignmentData++;
+        return;
+    }
+    if (p_burst->sampleCnt > SPI_BURST_SAMPLES_MAX ||
+        offsetof(rx_dbBurstPayload_t, sample) + p_burst->sampleCnt * sizeof(adcBurstSample_t) > sensorReadingCnt) {
+        p_stats->alignmentData++;
+        return;
+    }
+
+    // Held slots are only released by the gather task, the ones still held once the
+    // buffer is claimed stay writable until this write ends.
+    uint32_t span = streamRing.held;
+    uint32_t bufIdx = slotClaim(boardId, span);
+    uint32_t held = MIN(span, streamRing.held);
+    uint32_t depth = streamRing.depth;
+
+    if (!burstSynced[boardId] && p_burst->sampleCnt != 0) {
+        // first burst since the board was enabled, its samples are all new
+        burstSeq[boardId] = p_burst->sample[0].seq - 1;
+        burstSynced[boardId] = true;
+    }
+    for (uint32_t i = 0; i < p_burst->sampleCnt; i++) {
+        adcBurstSample_tp p_sample = &p_burst->sample[i];
+        int32_t seqDelta = (int32_t)(p_sample->seq - burstSeq[boardId]);
+
+        if (seqDelta <= 0 && seqDelta > -SPI_BURST_SAMPLES_MAX) {
+            // sent again by the board, a response was lost
+            p_stats->burstDups++;
+            continue;
+        }
+        if (seqDelta > 1) {
+            p_stats->burstGaps += seqDelta - 1;
+        }
+        burstSeq[boardId] = p_sample->seq;
+
+        // the sample belongs to the interval of its conversion
+        uint32_t back = (streamIntervalUs != 0) ? (p_sample->age_us + streamIntervalUs / 2) / streamIntervalUs : 0;
+        if (back > held) {
+            p_stats->burstLate++;
+            continue;
+        }
+        if (sensorBoardDataLocation[boardId].configBoardType == BOARDTYPE_MCG) {
+            p_ctrlData = p_sample->ctrlData;
+        }
+        updateAdcReadings(boardId, (bufIdx + depth - back) % depth, p_sample->adc, p_ctrlData);
+        p_stats->burstSamples++;
+    }
+    slotRelease(boardId);
+}
+
+void handleCncReadIntRegisterRequest(int destination, uint32_t address, uint32_t *value, uint32_t *uid) {
+    cncMsgPayload_t cncPayload = {
+        .cncMsgPayloadHeader.peripheral = PER_MCU, .cncMsgPayloadHeader.action = CNC_ACTION_READ, .cncMsgPayloadHeader.addr = address, .value = *value, .cncMsgPayloadHeader.cncActionData.result = 0xFF};
+    webCncCbId_t cncCbId = {.taskHandle = xTaskGetCurrentTaskHandle(), .p_payload = NULL, .xInfo = 0};
+    cncSendMsg(destination, SPICMD_CNC, (cncPayload_tp)&cncPayload, *uid, webCncRequestCB, (uint32_t)&cncCbId);
     uint32_t osResult = ulTaskNotifyTake(true, TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
     DPRINTF("TaskNotify osResult=%d\r\n", osResult);
     if (osResult == TASK_NOTIFY_OK) {
@@ -586,36 +1304,393 @@ void handleCncReadStringRegisterRequest(
     }
 }
 
-bool verifySensorConfiguration(void) {
-    bool allMatched = true;
-    for (int i = EEPROM_SENSOR_BOARD_0; i <= EEPROM_SENSOR_BOARD_23; i++) {
-        uint32_t boardIdx = i - EEPROM_SENSOR_BOARD_0;
-        // get information from each daughter board for verification
-
-        if (sensorBoardDataLocation[i - EEPROM_SENSOR_BOARD_0].configBoardType != BOARDTYPE_EMPTY) {
-            uint32_t hwType = 0;
-            uint32_t uid = 0;
-            if (sensorBoardPresent(boardIdx)) {
-                handleCncReadIntRegisterRequest(boardIdx, SB_HW_TYPE, &hwType, &uid);
-            } else {
-                hwType = BOARDTYPE_UNKNOWN;
-            }
+/**
+ * @fn
+ *
+ * @brief Write an integer register of a sensor board
+ *
+ * @param[in] destination: sensor board
+ * @param[in] address: SB_ register
+ * @param[in] value: value to write
+ * @param[in] uid: command uid
+ *
+ * @return result of the sensor board, 0 when written
+ **/
+static uint32_t handleCncWriteIntRegisterRequest(int destination, uint32_t address, uint32_t value, uint32_t *uid) {
+    cncMsgPayload_t cncPayload = {
+        .cncMsgPayloadHeader.peripheral = PER_MCU, .cncMsgPayloadHeader.action = CNC_ACTION_WRITE, .cncMsgPayloadHeader.addr = address, .value = value, .cncMsgPayloadHeader.cncActionData.result = 0xFF};
+    webCncCbId_t cncCbId = {.taskHandle = xTaskGetCurrentTaskHandle(), .p_payload = NULL, .xInfo = 0};
+    cncSendMsg(destination, SPICMD_CNC, (cncPayload_tp)&cncPayload, *uid, webCncRequestCB, (uint32_t)&cncCbId);
+    uint32_t osResult = ulTaskNotifyTake(true, TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
+    if (osResult != TASK_NOTIFY_OK) {
+        assert(false);
+        // CNC task to timeout first.
+        return 0xFF;
+    }
+    return cncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result;
+}
+
+/**
+ * @fn
+ *
+ * @brief Negotiate the SPI frame size of a sensor board
+ *
+ * An IMU board sends a whole IMU pair per extended frame instead of three tribbles. An ADC
+ * board queues SPI_BURST_CNT conversions and sends them in one burst frame, with one it stays
+ * on the legacy frame and the gather stores one ADC sample per board and trigger.
+ * A board whose firmware does not know SB_SPI_FRAME_SIZE or SB_SPI_BURST_CNT rejects the write
+ * and stays on the legacy frame, its IMU samples are reassembled from the tribbles.
+ *
+ * @param[in] boardIdx: sensor board
+ * @param[in] hwType: board type read from the board
+ **/
+static void negotiateSpiFrameSize(uint32_t boardIdx, uint32_t hwType) {
+    uint32_t frameSize = sizeof(spiDbMbPacket_t);
+    uint32_t uid = 0;
+    uint32_t result;
+
+    if (hwType == BOARDTYPE_IMU_COIL) {
+        frameSize = spiDbMbFrameSizeof(sizeof(rx_dbExtPayload_t));
+    } else if (spiBurstCnt > 1 || spiFrameSize(boardIdx) != frameSize) {
+        // the board sends no more samples per burst than its frame holds
+        result = handleCncWriteIntRegisterRequest(boardIdx, SB_SPI_BURST_CNT, spiBurstCnt, &uid);
+        if (result != 0) {
+            DPRINTF_INFO("Board %d keeps one sample per transaction, result %d\r\n", boardIdx, result);
+        } else if (spiBurstCnt > 1) {
+            frameSize = spiDbMbBurstFrameSizeof(spiBurstCnt);
+        }
+    }
+    if (frameSize == spiFrameSize(boardIdx)) {
+        return;
+    }
+    result = handleCncWriteIntRegisterRequest(boardIdx, SB_SPI_FRAME_SIZE, frameSize, &uid);
+    if (result == 0) {
+        spiSetFrameSize(boardIdx, frameSize);
+        DPRINTF_INFO("Board %d SPI frame %d bytes\r\n", boardIdx, frameSize);
+    } else {
+        DPRINTF_INFO("Board %d keeps the legacy SPI frame, result %d\r\n", boardIdx, result);
+    }
+}
+
+RETURN_CODE setSpiBurstCnt(uint32_t burstCnt) {
+    if (burstCnt == 0 || burstCnt > SPI_BURST_SAMPLES_MAX) {
+        DPRINTF_ERROR("SPI burst count %u out of range [1-%u]\r\n", burstCnt, SPI_BURST_SAMPLES_MAX);
+        return RETURN_ERR_PARAM;
+    }
+    spiBurstCnt = burstCnt;
+    DPRINTF_INFO("SPI burst count %u\r\n", burstCnt);
+
+    // The register is written from the CNC task, which also carries the negotiation, the
+    // verified boards are negotiated again by the board status task, see sensorRenegotiate()
+    __disable_irq();
+    sensorDiscovery.renegotiate |= SENSOR_RENEGOTIATE_FRAME_SIZE;
+    __enable_irq();
+    return RETURN_OK;
+}
+
+/**
+ * @fn
+ *
+ * @brief Negotiate the number of CNC commands a sensor board accepts before answering
+ *
+ * A board whose firmware does not know SB_CNC_WINDOW rejects the write and is sent one
+ * command at a time, each after the response to the previous one.
+ *
+ * @param[in] boardIdx: sensor board
+ **/
+static void negotiateCncWindow(uint32_t boardIdx) {
+    uint32_t window = dbCncWindow;
+    uint32_t uid = 0;
+
+    if (window == dbCommCncWindow(boardIdx)) {
+        return;
+    }
+    uint32_t result = handleCncWriteIntRegisterRequest(boardIdx, SB_CNC_WINDOW, window, &uid);
+    if (result != 0) {
+        DPRINTF_INFO("Board %d keeps one CNC command in flight, result %d\r\n", boardIdx, result);
+        window = 1;
+    } else {
+        DPRINTF_INFO("Board %d CNC window %d\r\n", boardIdx, window);
+    }
+    dbCommSetCncWindow(boardIdx, window);
+}
+
+/**
+ * @fn
+ *
+ * @brief Negotiate the sensor frames a sensor board keeps for SPICMD_SENSOR_RESEND
+ *
+ * A board whose firmware does not know SB_SENSOR_RESEND rejects the write, a sensor frame of it
+ * that fails its crc is counted lost and not requested again.
+ *
+ * @param[in] boardIdx: sensor board
+ **/
+static void negotiateSensorResend(uint32_t boardIdx) {
+    uint32_t uid = 0;
+    uint32_t result = handleCncWriteIntRegisterRequest(boardIdx, SB_SENSOR_RESEND, DB_SENSOR_RESEND_DEPTH, &uid);
+
+    if (result != 0) {
+        DPRINTF_INFO("Board %d keeps no sensor frames to resend, result %d\r\n", boardIdx, result);
+    }
+    spiSetSensorResend(boardIdx, result == 0);
+}
+
+/**
+ * @fn
+ *
+ * @brief Negotiate the chunked large buffer reads of a sensor board
+ *
+ * A board whose firmware does not know SB_LBUF_CHUNKED rejects the write, its log and debug
+ * buffers are read in one transfer with the chip select held.
+ *
+ * @param[in] boardIdx: sensor board
+ **/
+static void negotiateLargeBufferChunked(uint32_t boardIdx) {
+    uint32_t uid = 0;
+    uint32_t result = handleCncWriteIntRegisterRequest(boardIdx, SB_LBUF_CHUNKED, 1, &uid);
+
+    if (result != 0) {
+        DPRINTF_INFO("Board %d large buffers read in one transfer, result %d\r\n", boardIdx, result);
+    }
+    spiSetLargeBufferChunked(boardIdx, result == 0);
+}
+
+RETURN_CODE setDbCncWindow(uint32_t window) {
+    if (window == 0 || window > DB_CNC_WINDOW_MAX) {
+        DPRINTF_ERROR("CNC window %u out of range [1-%u]\r\n", window, DB_CNC_WINDOW_MAX);
+        return RETURN_ERR_PARAM;
+    }
+    dbCncWindow = window;
+    DPRINTF_INFO("CNC window %u\r\n", window);
+
+    // negotiated from the board status task like SPI_BURST_CNT, see setSpiBurstCnt()
+    __disable_irq();
+    sensorDiscovery.renegotiate |= SENSOR_RENEGOTIATE_CNC_WINDOW;
+    __enable_irq();
+    return RETURN_OK;
+}
+
+/**
+ * @fn
+ *
+ * @brief Compare the cached board type of a board with its configuration
+ *
+ * A matching board gets its SPI frame size, CNC window, sensor frame resend and chunked
+ * large buffer reads negotiated.
+ * The type is published to sensorBoardDataLocation by the gather task, see sensorDiscoveryPublish().
+ *
+ * @param[in] boardIdx: sensor board
+ *
+ * @return true if the board type matches the configuration
+ **/
+static bool verifySensorBoard(uint32_t boardIdx) {
+    boardStatus_t status;
+    BOARDTYPE_e configType = sensorBoardDataLocation[boardIdx].configBoardType;
+    BOARDTYPE_e hwType = BOARDTYPE_UNKNOWN;
+
+    if (configType == BOARDTYPE_EMPTY) {
+        hwType = BOARDTYPE_EMPTY;
+    } else {
+        boardStatusGet(boardIdx, &status);
+        if (status.present && status.hwTypeValid) {
+            hwType = status.hwType;
+        }
+    }
+    sensorDiscovery.hwType[boardIdx] = hwType;
+    __disable_irq();
+    sensorDiscovery.publishMask |= (1 << boardIdx);
+    __enable_irq();
+
+    if (configType == BOARDTYPE_EMPTY) {
+        return true;
+    }
+    if (configType == hwType) {
+        negotiateSpiFrameSize(boardIdx, hwType);
+        negotiateCncWindow(boardIdx);
+        negotiateSensorResend(boardIdx);
+        negotiateLargeBufferChunked(boardIdx);
+    } else {
+        DPRINTF_WARN("Board %d type %d does not match config %d\r\n", boardIdx, hwType, configType);
+    }
+    return configType == hwType;
+}
+
+/**
+ * @fn
+ *
+ * @brief Publish the board types read by the discovery, run by the gather task
+ *
+ * sensorBoardDataLocation is only changed by the gather task, the discovery running in the
+ * board status task hands its results over through sensorDiscovery.publishMask.
+ **/
+static void sensorDiscoveryPublish(void) {
+    __disable_irq();
+    uint32_t publishMask = sensorDiscovery.publishMask;
+    sensorDiscovery.publishMask = 0;
+    __enable_irq();
+    for (uint32_t boardIdx = 0; boardIdx < MAX_CS_ID; boardIdx++) {
+        if (publishMask & (1 << boardIdx)) {
+            BOARDTYPE_e hwType = sensorDiscovery.hwType[boardIdx];
             sensorBoardDataLocation[boardIdx].hwBoardType = hwType;
             sensorBoardDataLocation[boardIdx].match = (sensorBoardDataLocation[boardIdx].configBoardType == hwType);
-            if (sensorBoardDataLocation[boardIdx].configBoardType != hwType) {
-                allMatched = false;
-                DPRINTF_WARN("Board %d type %d does not match config %d\r\n",
+        }
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Negotiate the settings written since the boards were verified with the matching boards
+ *
+ * Run by the board status task, the negotiation waits for the CNC task to carry its commands.
+ **/
+static void sensorRenegotiate(void) {
+    __disable_irq();
+    uint32_t renegotiate = sensorDiscovery.renegotiate;
+    sensorDiscovery.renegotiate = 0;
+    __enable_irq();
+    if (renegotiate == 0) {
+        return;
+    }
+    for (uint32_t boardIdx = 0; boardIdx < MAX_CS_ID; boardIdx++) {
+        BOARDTYPE_e hwType = sensorDiscovery.hwType[boardIdx];
+        if (!(sensorDiscovery.readyMask & (1 << boardIdx))) {
+            continue;
+        }
+        if ((renegotiate & SENSOR_RENEGOTIATE_FRAME_SIZE) &&
+            (hwType == BOARDTYPE_MCG || hwType == BOARDTYPE_ECG || hwType == BOARDTYPE_12ECG)) {
+            negotiateSpiFrameSize(boardIdx, hwType);
+        }
+        if ((renegotiate & SENSOR_RENEGOTIATE_CNC_WINDOW) && hwType != BOARDTYPE_EMPTY) {
+            negotiateCncWindow(boardIdx);
+        }
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Start the boot discovery once the configuration is read
+ *
+ * Every chip select is enabled at once, the boards of the three buses are probed in parallel.
+ **/
+static void sensorDiscoveryStart(void) {
+    for (uint32_t boardIdx = 0; boardIdx < MAX_CS_ID; boardIdx++) {
+        if (sensorBoardDataLocation[boardIdx].configBoardType == BOARDTYPE_EMPTY) {
+            verifySensorBoard(boardIdx);
+        } else {
+            sensorDiscovery.configuredMask |= (1 << boardIdx);
+        }
+    }
+    sensorDiscovery.startTick = HAL_GetTick();
+    sensorDiscovery.probeTick = sensorDiscovery.startTick;
+    dbCommTaskEnableAll();
+    __DMB();
+    sensorDiscovery.started = true;
+}
+
+/**
+ * @fn
+ *
+ * @brief Check if the gather thread can start streaming
+ *
+ * @return true once a configured board is ready or the discovery is over
+ **/
+static bool sensorDiscoveryReady(void) {
+    return (sensorDiscovery.readyMask != 0) || sensorDiscovery.complete;
+}
+
+bool discoverSensorBoards(void) {
+    uint32_t newMask = 0;
+
+    if (!sensorDiscovery.started) {
+        return true;
+    }
+
+    // boards given a new type without a reboot are verified again, a board still configured is enabled again
+    __disable_irq();
+    uint32_t relayoutMask = sensorDiscovery.relayoutMask;
+    sensorDiscovery.relayoutMask = 0;
+    __enable_irq();
+    for (uint32_t boardIdx = 0; boardIdx < MAX_CS_ID; boardIdx++) {
+        uint32_t bit = (1 << boardIdx);
+        if (!(relayoutMask & bit)) {
+            continue;
+        }
+        sensorDiscovery.verifiedMask &= ~bit;
+        sensorDiscovery.readyMask &= ~bit;
+        sensorDiscovery.hwType[boardIdx] = BOARDTYPE_UNKNOWN;
+        if (sensorBoardDataLocation[boardIdx].configBoardType == BOARDTYPE_EMPTY) {
+            sensorDiscovery.configuredMask &= ~bit;
+            verifySensorBoard(boardIdx);
+        } else {
+            sensorDiscovery.configuredMask |= bit;
+            dbCommTaskEnable(boardIdx, true);
+        }
+    }
+    sensorRenegotiate();
+
+    // boards answering for the first time, a board whose type could not be read is tried again
+    for (uint32_t boardIdx = 0; boardIdx < MAX_CS_ID; boardIdx++) {
+        uint32_t bit = (1 << boardIdx);
+        if ((sensorDiscovery.configuredMask & bit) && !(sensorDiscovery.verifiedMask & bit) &&
+            sensorBoardPresent(boardIdx)) {
+            newMask |= bit;
+        }
+    }
+
+    if (newMask != 0) {
+        // the boards that came up together are read at once
+        boardStatusRefresh(((newMask & (newMask - 1)) != 0) ? DESTINATION_ALL : __builtin_ctz(newMask));
+        for (uint32_t boardIdx = 0; boardIdx < MAX_CS_ID; boardIdx++) {
+            uint32_t bit = (1 << boardIdx);
+            boardStatus_t status;
+            if (!(newMask & bit)) {
+                continue;
+            }
+            boardStatusGet(boardIdx, &status);
+            if (!status.hwTypeValid) {
+                continue;
+            }
+            sensorDiscovery.verifiedMask |= bit;
+            if (verifySensorBoard(boardIdx)) {
+                sensorDiscovery.readyMask |= bit;
+                DPRINTF_INFO("Board %d ready %d ms after discovery start\r\n",
                              boardIdx,
-                             hwType,
-                             sensorBoardDataLocation[i - EEPROM_SENSOR_BOARD_0].configBoardType);
+                             HAL_GetTick() - sensorDiscovery.startTick);
             }
-        } else {
-            sensorBoardDataLocation[boardIdx].hwBoardType = BOARDTYPE_EMPTY;
-            sensorBoardDataLocation[boardIdx].match = true;
         }
     }
-    DPRINTF("allMatched=%d\r\n", allMatched);
-    return allMatched;
+
+    if (!sensorDiscovery.complete) {
+        uint32_t elapsed = HAL_GetTick() - sensorDiscovery.startTick;
+        if ((sensorDiscovery.verifiedMask == sensorDiscovery.configuredMask) ||
+            (elapsed > SENSOR_DISCOVERY_TIMEOUT_MS)) {
+            sensorDiscovery.complete = true;
+            DPRINTF_INFO("Sensor board discovery %d ms, ready %06x\r\n", elapsed, sensorDiscovery.readyMask);
+            if (sensorDiscovery.readyMask != sensorDiscovery.configuredMask) {
+                configurationErrorRaise(NULL);
+                DPRINTF_ERROR("Boards missing %06x\r\n", sensorDiscovery.configuredMask & ~sensorDiscovery.readyMask);
+            }
+        } else if (HAL_GetTick() - sensorDiscovery.probeTick >= SENSOR_DISCOVERY_PROBE_MS) {
+            // a board disabled before it booted is probed again without waiting for DB_RETRY_INTERVAL_S
+            sensorDiscovery.probeTick = HAL_GetTick();
+            for (uint32_t boardIdx = 0; boardIdx < MAX_CS_ID; boardIdx++) {
+                uint32_t bit = (1 << boardIdx);
+                if ((sensorDiscovery.configuredMask & ~sensorDiscovery.verifiedMask & bit) &&
+                    !sensorBoardEnabled(boardIdx)) {
+                    dbCommTaskEnable(boardIdx, true);
+                }
+            }
+        }
+    }
+    return !sensorDiscovery.complete;
+}
+
+RETURN_CODE bootFirstPacketRead(const registerInfo_tp regInfo) {
+    assert(regInfo != NULL);
+    regInfo->u.dataUint = sensorDiscovery.firstPacketMs;
+    return RETURN_OK;
 }
 
 void jsonAddConfigSettings(int destination, json_object *jsonArray) {
@@ -639,11 +1714,41 @@ void jsonAddConfigSettings(int destination, json_object *jsonArray) {
         type = (type < BOARDTYPE_MAX) ? type : BOARDTYPE_MAX;
         json_object *jstr = json_object_new_string(BOARDTYPE_e_Strings[type]);
         json_object_object_add_ex(next, "CFG_TYPE", jstr, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        // CFG_TYPE is the type streamed, a change still waiting for the gather task is pending
+        bool pending =
+            streamLayout.pending && (streamLayout.requested[i] != sensorBoardDataLocation[i].configBoardType);
+        json_object_object_add_ex(
+            next, "LAYOUT_PENDING", json_object_new_boolean(pending), JSON_C_OBJECT_KEY_IS_CONSTANT);
         json_object_array_add(jsonArray, next);
     }
     return;
 }
 
+/**
+ * @fn
+ *
+ * @brief Add the link counters of a board status
+ *
+ * @param[in] next: board json object
+ * @param[in] p_status: cached status
+ **/
+static void jsonAddLinkStats(json_object *next, const boardStatus_t *p_status) {
+    json_object *jlink = json_object_new_object();
+    json_object_object_add_ex(
+        jlink, "RX_DATA", json_object_new_int64(p_status->link.rxDataCnt), JSON_C_OBJECT_KEY_IS_CONSTANT);
+    json_object_object_add_ex(
+        jlink, "RX_CMDS", json_object_new_int64(p_status->link.rxCmdsCnt), JSON_C_OBJECT_KEY_IS_CONSTANT);
+    json_object_object_add_ex(
+        jlink, "CRC_ERRORS", json_object_new_int64(p_status->link.crcErrors), JSON_C_OBJECT_KEY_IS_CONSTANT);
+    json_object_object_add_ex(
+        jlink, "CNC_RESENT", json_object_new_int64(p_status->link.resendCNCCnt), JSON_C_OBJECT_KEY_IS_CONSTANT);
+    json_object_object_add_ex(
+        jlink, "CNC_LOST", json_object_new_int64(p_status->link.lostCNCCnt), JSON_C_OBJECT_KEY_IS_CONSTANT);
+    json_object_object_add_ex(
+        jlink, "ENABLED", json_object_new_int64(p_status->link.enabledCnt), JSON_C_OBJECT_KEY_IS_CONSTANT);
+    json_object_object_add_ex(next, "LINK", jlink, JSON_C_OBJECT_KEY_IS_CONSTANT);
+}
+
 void jsonAddConfigStatus(int destination, json_object *jsonArray) {
 
     uint32_t minDest = 0;
@@ -657,7 +1762,9 @@ void jsonAddConfigStatus(int destination, json_object *jsonArray) {
         maxDest = destination + 1;
     }
 
+    // the status is answered from the cache, see boardStatusThread()
     for (int i = minDest; i < maxDest; i++) {
+        boardStatus_t status;
         json_object *next = json_object_new_object();
         json_object *jint = json_object_new_int(i);
         json_object_object_add_ex(next, "Destination", jint, JSON_C_OBJECT_KEY_IS_CONSTANT);
@@ -667,84 +1774,79 @@ void jsonAddConfigStatus(int destination, json_object *jsonArray) {
         json_object *jstr = json_object_new_string(BOARDTYPE_e_Strings[type]);
         json_object_object_add_ex(next, "CFG_TYPE", jstr, JSON_C_OBJECT_KEY_IS_CONSTANT);
 
-        bool present = sensorBoardPresent(i);
-        json_object *jpresent = json_object_new_boolean(present);
+        boardStatusGet(i, &status);
+        json_object *jpresent = json_object_new_boolean(status.present);
         json_object_object_add_ex(next, "PRESENT", jpresent, JSON_C_OBJECT_KEY_IS_CONSTANT);
 
-        if (present) {
-
-            cncMsgPayload_t cncPayload = {
-                .cncMsgPayloadHeader.peripheral = PER_MCU, .cncMsgPayloadHeader.action = CNC_ACTION_READ, .cncMsgPayloadHeader.addr = SB_HW_TYPE, .cncMsgPayloadHeader.cncActionData.result = 0xFF};
-            webCncCbId_t webCncCbId = {.taskHandle = xTaskGetCurrentTaskHandle(), .p_payload = NULL, .xInfo = 0};
-            cncSendMsg(i, SPICMD_CNC, (cncPayload_tp)&cncPayload, 0, webCncRequestCB, (uint32_t)&webCncCbId);
-            uint32_t osResult = ulTaskNotifyTake(true, TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
-            DPRINTF_CMD_STREAM(
-                "%s %d payload=%s\r\n", __FUNCTION__, __LINE__, (char *)(&webCncCbId.p_payload->cmd.str));
-            if (osResult == TASK_NOTIFY_OK) {
-                if (webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result == 0) {
-                    json_object *jBoardType = json_object_new_int(webCncCbId.p_payload->cmd.value);
-                    json_object_object_add_ex(next, "BOARD_TYPE", jBoardType, JSON_C_OBJECT_KEY_IS_CONSTANT);
-                } else {
-                    json_object *jstr = json_object_new_string("NOT AVAILABLE");
-                    json_object_object_add_ex(next, "BOARD_TYPE", jstr, JSON_C_OBJECT_KEY_IS_CONSTANT);
-                }
-            }
+        uint32_t age = boardStatusAgeMs(&status);
+        json_object *jage = (age == BOARD_STATUS_NEVER) ? json_object_new_string("NEVER") : json_object_new_int64(age);
+        json_object_object_add_ex(next, "AGE_MS", jage, JSON_C_OBJECT_KEY_IS_CONSTANT);
+
+        if (status.hwTypeValid) {
+            json_object *jBoardType = json_object_new_int(status.hwType);
+            json_object_object_add_ex(next, "BOARD_TYPE", jBoardType, JSON_C_OBJECT_KEY_IS_CONSTANT);
         } else {
-            json_object *jstr = json_object_new_string("NOT AVAILABLE");
-            json_object_object_add_ex(next, "BOARD_TYPE", jstr, JSON_C_OBJECT_KEY_IS_CONSTANT);
+            json_object *jstrNA = json_object_new_string("NOT AVAILABLE");
+            json_object_object_add_ex(next, "BOARD_TYPE", jstrNA, JSON_C_OBJECT_KEY_IS_CONSTANT);
         }
 
-        if (present) {
-            handleCncRequestStrJson(next, i, CNC_ACTION_READ, SB_SERIAL_NUMBER, 0, 0, "SERIAL");
+        if (!status.present) {
+            jstr = json_object_new_string("NOT PRESENT");
+        } else if (status.serialValid) {
+            DPRINTF_CMD_STREAM("%s %d payload=%s\r\n", __FUNCTION__, __LINE__, status.serial);
+            jstr = json_object_new_string(status.serial);
         } else {
-            json_object *jstr = json_object_new_string("NOT PRESENT");
-            json_object_object_add_ex(next, "SERIAL", jstr, JSON_C_OBJECT_KEY_IS_CONSTANT);
-        }
-
-        if (present) {
-            cncMsgPayload_t cncPayload = {
-                .cncMsgPayloadHeader.peripheral = PER_MCU, .cncMsgPayloadHeader.action = CNC_ACTION_READ, .cncMsgPayloadHeader.addr = SB_PERIPHERAL_FAIL_MASK, .cncMsgPayloadHeader.cncActionData.result = 0xFF};
-            webCncCbId_t webCncCbId = {.taskHandle = xTaskGetCurrentTaskHandle(), .p_payload = NULL, .xInfo = 0};
-            cncSendMsg(i, SPICMD_CNC, (cncPayload_tp)&cncPayload, 0, webCncRequestCB, (uint32_t)&webCncCbId);
-            uint32_t osResult = ulTaskNotifyTake(true, TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
-            DPRINTF_CMD_STREAM(
-                "%s %d payload=%s\r\n", __FUNCTION__, __LINE__, (char *)(&webCncCbId.p_payload->cmd.str));
-
-            if (osResult == TASK_NOTIFY_OK) {
-
-                if (webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result == 0) {
-
-                    json_object *errorArray = json_object_new_array();
-                    if (webCncCbId.p_payload->cmd.value == 0) {
-                        json_object *jPeripheralErrorValue = json_object_new_string("NONE");
-                        json_object_array_add(errorArray, jPeripheralErrorValue);
-                        json_object *jstr = json_object_new_string("OK");
-                        json_object_object_add_ex(next, "BOARD STATUS", jstr, JSON_C_OBJECT_KEY_IS_CONSTANT);
-                    } else {
-                        for (int i = 0; i < PER_MAX; i++) {
-                            if ((1 << i) & webCncCbId.p_payload->cmd.value) {
-                                json_object *jstrIdx = json_object_new_string(PERIPHERAL_e_Strings[i]);
-                                json_object_array_add(errorArray, jstrIdx);
-                            }
-                        }
-                        json_object *jstrError = json_object_new_string("ERROR");
-                        json_object_object_add_ex(next, "BOARD STATUS", jstrError, JSON_C_OBJECT_KEY_IS_CONSTANT);
-                    }
-                    json_object_object_add_ex(next, "PERIPHERAL_ERRORS", errorArray, JSON_C_OBJECT_KEY_IS_CONSTANT);
+            jstr = json_object_new_string("NOT AVAILABLE");
+        }
+        json_object_object_add_ex(next, "SERIAL", jstr, JSON_C_OBJECT_KEY_IS_CONSTANT);
+
+        if (!status.present) {
+            jstr = json_object_new_string("NOT PRESENT");
+        } else if (status.fwVersionValid) {
+            char version[48];
+            snprintf(version,
+                     sizeof(version),
+                     "%lu.%lu.%lu.%lu",
+                     (unsigned long)status.fwVersion[0],
+                     (unsigned long)status.fwVersion[1],
+                     (unsigned long)status.fwVersion[2],
+                     (unsigned long)status.fwVersion[3]);
+            jstr = json_object_new_string(version);
+        } else {
+            jstr = json_object_new_string("NOT AVAILABLE");
+        }
+        json_object_object_add_ex(next, "FW_VERSION", jstr, JSON_C_OBJECT_KEY_IS_CONSTANT);
 
-                } else {
-                    json_object *jstrNA = json_object_new_string("NOT AVAILABLE");
-                    json_object_object_add_ex(next, "PERIPHERAL_ERRORS", jstrNA, JSON_C_OBJECT_KEY_IS_CONSTANT);
-                }
+        jsonAddLinkStats(next, &status);
 
+        if (!status.present) {
+            json_object *jstrNP = json_object_new_string("NOT PRESENT");
+            json_object_object_add_ex(next, "BOARD STATUS", jstrNP, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        } else if (!status.refreshed) {
+            json_object *jstrNA2 = json_object_new_string("NOT AVAILABLE");
+            json_object_object_add_ex(next, "BOARD STATUS", jstrNA2, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        } else if (status.failMaskValid) {
+            uint32_t failMask = status.peripheralFailMask;
+            json_object *errorArray = json_object_new_array();
+            if (failMask == 0) {
+                json_object *jPeripheralErrorValue = json_object_new_string("NONE");
+                json_object_array_add(errorArray, jPeripheralErrorValue);
+                json_object *jstr = json_object_new_string("OK");
+                json_object_object_add_ex(next, "BOARD STATUS", jstr, JSON_C_OBJECT_KEY_IS_CONSTANT);
             } else {
-                json_object *jstrNA2 = json_object_new_string("NOT AVAILABLE");
-                json_object_object_add_ex(next, "BOARD STATUS", jstrNA2, JSON_C_OBJECT_KEY_IS_CONSTANT);
+                for (int per = 0; per < PER_MAX; per++) {
+                    if ((1 << per) & failMask) {
+                        json_object *jstrIdx = json_object_new_string(PERIPHERAL_e_Strings[per]);
+                        json_object_array_add(errorArray, jstrIdx);
+                    }
+                }
+                json_object *jstrError = json_object_new_string("ERROR");
+                json_object_object_add_ex(next, "BOARD STATUS", jstrError, JSON_C_OBJECT_KEY_IS_CONSTANT);
             }
-
+            json_object_object_add_ex(next, "PERIPHERAL_ERRORS", errorArray, JSON_C_OBJECT_KEY_IS_CONSTANT);
         } else {
-            json_object *jstrNP = json_object_new_string("NOT PRESENT");
-            json_object_object_add_ex(next, "BOARD STATUS", jstrNP, JSON_C_OBJECT_KEY_IS_CONSTANT);
+            json_object *jstrNA = json_object_new_string("NOT AVAILABLE");
+            json_object_object_add_ex(next, "PERIPHERAL_ERRORS", jstrNA, JSON_C_OBJECT_KEY_IS_CONSTANT);
         }
 
         json_object_array_add(jsonArray, next);
@@ -752,10 +1854,17 @@ void jsonAddConfigStatus(int destination, json_object *jsonArray) {
     return;
 }
 
-void alterConfigSettings(int destination, BOARDTYPE_e boardType) {
+RETURN_CODE alterConfigSettings(int destination, BOARDTYPE_e boardType) {
 
     uint32_t minDest = 0;
     uint32_t maxDest = 0;
+    uint32_t changedMask = 0;
+    uint32_t imuCnt = 0;
+    // createPktStructure() reads any other value as an empty slot
+    BOARDTYPE_e layoutType = (boardType == BOARDTYPE_MCG || boardType == BOARDTYPE_ECG ||
+                              boardType == BOARDTYPE_12ECG || boardType == BOARDTYPE_IMU_COIL)
+                                 ? boardType
+                                 : BOARDTYPE_EMPTY;
 
     if (destination == DESTINATION_ALL) {
         minDest = 0;
@@ -765,11 +1874,52 @@ void alterConfigSettings(int destination, BOARDTYPE_e boardType) {
         maxDest = destination + 1;
     }
 
+    osMutexWait(streamLayoutAccess, osWaitForever);
+    if (streamLayout.pending) {
+        // the previous change is still waiting for the ring to empty
+        osMutexRelease(streamLayoutAccess);
+        DPRINTF_ERROR("Stream layout change already pending\r\n");
+        return RETURN_ERR_STATE;
+    }
+    for (uint32_t i = 0; i < MAX_CS_ID; i++) {
+        streamLayout.requested[i] = sensorBoardDataLocation[i].configBoardType;
+        if (i >= minDest && i < maxDest) {
+            streamLayout.requested[i] = layoutType;
+        }
+        if (streamLayout.requested[i] != sensorBoardDataLocation[i].configBoardType) {
+            changedMask |= (1 << i);
+        }
+        if (streamLayout.requested[i] == BOARDTYPE_IMU_COIL) {
+            imuCnt++;
+        }
+    }
+    if (imuCnt > IMU_MAX_BOARD) {
+        osMutexRelease(streamLayoutAccess);
+        DPRINTF_ERROR("Too many Coil boards, %d\r\n", imuCnt);
+        return RETURN_ERR_PARAM;
+    }
+
     for (int i = minDest; i < maxDest; i++) {
         registerInfo_t regInfo = {.mbId = SENSOR_BOARD_0 + i, .type = DATA_UINT, .u.dataUint = boardType};
         registerWrite(&regInfo);
     }
-    return;
+    if (changedMask == 0) {
+        osMutexRelease(streamLayoutAccess);
+        return RETURN_OK;
+    }
+
+    // quiesce the boards changing type, the others keep streaming, discoverSensorBoards() verifies
+    // and enables them again once the new layout is applied
+    for (uint32_t i = 0; i < MAX_CS_ID; i++) {
+        if (changedMask & (1 << i)) {
+            dbCommTaskEnable(i, false);
+        }
+    }
+    __DMB();
+    streamLayout.pending = true;
+    osMutexRelease(streamLayoutAccess);
+    DPRINTF_INFO("Stream layout change of boards %06x pending\r\n", changedMask);
+    return RETURN_OK;
 }
 
 void jsonDetailConfigurationError(json_object *jsonArray) {
@@ -806,6 +1956,76 @@ void cliDetailConfigurationError(CLI *hCli) {
         }
     }
 }
+/**
+ * @fn
+ *
+ * @brief Count the boards of each configured type and point every board at its readings
+ *        in each stream buffer
+ *
+ * The readings are packed by type, MCG first, then ECG and ECG12, then IMU, each in board
+ * order. A board without readings gets NULL pointers. Nothing is printed, the gather task
+ * builds the next layout with it while the db tasks use the current one, see streamLayoutApply().
+ *
+ * @param[in,out] p_layout: boards with their configBoardType set, the rest is filled in
+ * @param[out] p_cnt: boards of each type, BOARDTYPE_MAX entries
+ *
+ * @return bytes of dataReadings in use
+ **/
+static uint32_t layoutPktStructure(sensorBoardDataLocation_tp p_layout, uint32_t *p_cnt) {
+    memset(p_cnt, 0, BOARDTYPE_MAX * sizeof(uint32_t));
+    for (int i = 0; i < MAX_CS_ID; i++) {
+        p_layout[i].boardTypeIdx = p_cnt[p_layout[i].configBoardType]++;
+    }
+
+    uint32_t mcgOffset = 0;
+    uint32_t ecgOffset = p_cnt[BOARDTYPE_MCG] * sizeof(sensorMCGBoardReadings_t);
+    uint32_t origEcgOffset = ecgOffset;
+    uint32_t ecg12Offset = ecgOffset + (p_cnt[BOARDTYPE_ECG] * sizeof(sensorECGBoardReadings_t));
+    uint32_t origEcg12Offset = ecg12Offset;
+    uint32_t imuOffset = ecg12Offset + (p_cnt[BOARDTYPE_12ECG] * sizeof(sensorECGBoardReadings_t));
+    uint32_t origImuOffset = imuOffset;
+
+    for (int i = 0; i < MAX_CS_ID; i++) {
+        memset(p_layout[i].dataLocation, 0, sizeof(p_layout[i].dataLocation));
+        switch (p_layout[i].configBoardType) {
+        case BOARDTYPE_MCG:
+            for (int pkt = 0; pkt < MAX_STREAM_DATA_PKT_IDX; pkt++) {
+                p_layout[i].dataLocation[pkt][SENSOR_0].p_uint8 =
+                    &streamData.streamPktData[pkt].dataReadings[mcgOffset];
+            }
+            mcgOffset += sizeof(sensorMCGBoardReadings_t);
+            break;
+        case BOARDTYPE_12ECG:
+            // fall through
+        case BOARDTYPE_ECG:
+            for (int pkt = 0; pkt < MAX_STREAM_DATA_PKT_IDX; pkt++) {
+                p_layout[i].dataLocation[pkt][SENSOR_0].p_uint8 =
+                    &streamData.streamPktData[pkt].dataReadings[ecgOffset];
+            }
+            ecgOffset += sizeof(sensorECGBoardReadings_t);
+
+            break;
+        case BOARDTYPE_IMU_COIL:
+            for (int pkt = 0; pkt < MAX_STREAM_DATA_PKT_IDX; pkt++) {
+                p_layout[i].dataLocation[pkt][SENSOR_0].p_uint8 =
+                    &streamData.streamPktData[pkt].dataReadings[imuOffset];
+                p_layout[i].dataLocation[pkt][SENSOR_1].p_uint8 =
+                    &streamData.streamPktData[pkt].dataReadings[imuOffset + sizeof(imuReadings_t)];
+            }
+            imuOffset += 2 * sizeof(imuReadings_t);
+            break;
+        default:
+            break;
+        }
+    }
+
+    assert(mcgOffset <= origEcgOffset);
+    assert(ecg12Offset <= origEcg12Offset);
+    assert(ecgOffset <= origImuOffset);
+    assert(imuOffset <= SIZE_OF_DATAREADINGS);
+    return imuOffset;
+}
+
 /*
  * This function reads the slot registers and counts all the MCG, ECG, IMU boards
  * It then creates a structure that corresponds to the number and assigns
@@ -823,115 +2043,562 @@ uint32_t createPktStructure(void) {
         eepromReadRegister(i, (uint8_t *)&boardType, sizeof(boardType));
         switch (boardType) {
         case BOARDTYPE_MCG:
-            sensorBoardDataLocation[i - EEPROM_SENSOR_BOARD_0].boardTypeIdx = sensorBoardCnt[BOARDTYPE_MCG]++;
-            sensorBoardDataLocation[i - EEPROM_SENSOR_BOARD_0].configBoardType = BOARDTYPE_MCG;
-            break;
         case BOARDTYPE_ECG:
-            sensorBoardDataLocation[i - EEPROM_SENSOR_BOARD_0].boardTypeIdx = sensorBoardCnt[BOARDTYPE_ECG]++;
-            sensorBoardDataLocation[i - EEPROM_SENSOR_BOARD_0].configBoardType = BOARDTYPE_ECG;
-            break;
         case BOARDTYPE_12ECG:
-            sensorBoardDataLocation[i - EEPROM_SENSOR_BOARD_0].boardTypeIdx = sensorBoardCnt[BOARDTYPE_12ECG]++;
-            sensorBoardDataLocation[i - EEPROM_SENSOR_BOARD_0].configBoardType = BOARDTYPE_12ECG;
-            break;
         case BOARDTYPE_IMU_COIL:
-            sensorBoardDataLocation[i - EEPROM_SENSOR_BOARD_0].boardTypeIdx = sensorBoardCnt[BOARDTYPE_IMU_COIL]++;
-            sensorBoardDataLocation[i - EEPROM_SENSOR_BOARD_0].configBoardType = BOARDTYPE_IMU_COIL;
+            sensorBoardDataLocation[i - EEPROM_SENSOR_BOARD_0].configBoardType = boardType;
             break;
         default:
             mask = REMOVE_BOARD(mask, i);
-            sensorBoardDataLocation[i - EEPROM_SENSOR_BOARD_0].boardTypeIdx = sensorBoardCnt[BOARDTYPE_EMPTY]++;
             sensorBoardDataLocation[i - EEPROM_SENSOR_BOARD_0].configBoardType = BOARDTYPE_EMPTY;
             break;
         }
     }
     eepromClose();
-    uint32_t mcgOffset = 0;
-    uint32_t ecgOffset = sensorBoardCnt[BOARDTYPE_MCG] * sizeof(sensorMCGBoardReadings_t);
-    uint32_t origEcgOffset = ecgOffset;
-    uint32_t ecg12Offset = ecgOffset + (sensorBoardCnt[BOARDTYPE_ECG] * sizeof(sensorECGBoardReadings_t));
-    uint32_t origEcg12Offset = ecg12Offset;
-    uint32_t imuOffset = ecg12Offset + (sensorBoardCnt[BOARDTYPE_12ECG] * sizeof(sensorECGBoardReadings_t));
-    uint32_t origImuOffset = imuOffset;
 
+    uint32_t dataSize = layoutPktStructure(sensorBoardDataLocation, sensorBoardCnt);
+    streamData.streamPktDataSize = STREAM_PKT_HEADER_SIZE + dataSize;
     if (sensorBoardCnt[BOARDTYPE_IMU_COIL] > IMU_MAX_BOARD) {
         DPRINTF_ERROR("Too many Coil boards, %d\r\n", sensorBoardCnt[BOARDTYPE_IMU_COIL]);
     }
 
-    for (int i = 0; i < MAX_CS_ID; i++) {
-        switch (sensorBoardDataLocation[i].configBoardType) {
-        case BOARDTYPE_MCG:
-            sensorBoardDataLocation[i].dataLocation[STRM_PKT_0][SENSOR_0].p_uint8 =
-                &streamData.streamPktData[STRM_PKT_0].dataReadings[mcgOffset];
-            sensorBoardDataLocation[i].dataLocation[STRM_PKT_1][SENSOR_0].p_uint8 =
-                &streamData.streamPktData[STRM_PKT_1].dataReadings[mcgOffset];
-            mcgOffset += sizeof(sensorMCGBoardReadings_t);
-            break;
-        case BOARDTYPE_12ECG:
-            // fall through
-        case BOARDTYPE_ECG:
-            sensorBoardDataLocation[i].dataLocation[STRM_PKT_0][SENSOR_0].p_uint8 =
-                &streamData.streamPktData[STRM_PKT_0].dataReadings[ecgOffset];
-            sensorBoardDataLocation[i].dataLocation[STRM_PKT_1][SENSOR_0].p_uint8 =
-                &streamData.streamPktData[STRM_PKT_1].dataReadings[ecgOffset];
-            ecgOffset += sizeof(sensorECGBoardReadings_t);
-
-            break;
-        case BOARDTYPE_IMU_COIL:
-            sensorBoardDataLocation[i].dataLocation[STRM_PKT_0][SENSOR_0].p_uint8 =
-                &streamData.streamPktData[STRM_PKT_0].dataReadings[imuOffset];
-            sensorBoardDataLocation[i].dataLocation[STRM_PKT_1][SENSOR_0].p_uint8 =
-                &streamData.streamPktData[STRM_PKT_1].dataReadings[imuOffset];
-            imuOffset += sizeof(imuReadings_t);
-
-            sensorBoardDataLocation[i].dataLocation[STRM_PKT_0][SENSOR_1].p_uint8 =
-                &streamData.streamPktData[STRM_PKT_0].dataReadings[imuOffset];
-            sensorBoardDataLocation[i].dataLocation[STRM_PKT_1][SENSOR_1].p_uint8 =
-                &streamData.streamPktData[STRM_PKT_1].dataReadings[imuOffset];
-            imuOffset += sizeof(imuReadings_t);
-            break;
-        default:
-            break;
-        }
-    }
-
-    size_t pktSize = &streamData.streamPktData[STRM_PKT_0].dataReadings[0] -
-                     (uint8_t *)(&streamData.streamPktData[STRM_PKT_0]) + imuOffset;
-    streamData.streamPktDataSize = pktSize;
     DPRINTF_RAW("###########################################\r\n");
     DPRINTF_RAW("#\tPacket Stream information\r\n");
-    DPRINTF_RAW("#\tStream Total size = %d\r\n", pktSize);
+    DPRINTF_RAW("#\tStream Total size = %d\r\n", streamData.streamPktDataSize);
     DPRINTF_RAW("#\tMax Stream size = %d\r\n", sizeof(streamSensorPkt_t));
-    DPRINTF_RAW("#\tData only Size = %d\r\n", imuOffset);
+    DPRINTF_RAW("#\tData only Size = %d\r\n", dataSize);
     DPRINTF_RAW("#\tMCG Boards = %d, ECG Boards = %d, ECG12 Boards = %d, IMU Boards = %d\r\n",
                 sensorBoardCnt[BOARDTYPE_MCG],
                 sensorBoardCnt[BOARDTYPE_ECG],
                 sensorBoardCnt[BOARDTYPE_12ECG],
                 sensorBoardCnt[BOARDTYPE_IMU_COIL]);
     DPRINTF_RAW("###########################################\r\n");
-    assert(mcgOffset <= origEcgOffset);
-    assert(ecg12Offset <= origEcg12Offset);
-    assert(ecgOffset <= origImuOffset);
-    assert(imuOffset <= SIZE_OF_DATAREADINGS);
     return mask;
 }
 
-__ITCMRAM__ static inline void setStreamPktHeader(int idx, double timeStamp) {
+/**
+ * @fn
+ *
+ * @brief Apply the board types requested by alterConfigSettings() once no slot of the old
+ *        layout is waiting to be sent
+ *
+ * Queued and held slots are sent with the layout they were filled with, so they must be gone
+ * and no db task may be halfway through a write. Slots waiting for their TCP ACK are already
+ * encoded and are left alone. The new layout, the IMU assembly area and the next slot are
+ * prepared with the interrupts enabled, the db tasks are then switched to them at once. The
+ * sample being filled has the old layout and is dropped.
+ *
+ * @return true if the layout was applied
+ **/
+static bool streamLayoutApply(void) {
+    // the next slot must be free to move the db tasks to it, see streamRingReserve()
+    if (streamRing.count != 0 || streamRing.held != 0 || streamRing.txActive ||
+        streamRing.inFlight + 1 >= streamRing.depth) {
+        return false;
+    }
+
+    int next = (sensorBoardDataLocation == sensorBoardLayout[0]) ? 1 : 0;
+    sensorBoardDataLocation_tp p_layout = sensorBoardLayout[next];
+    uint32_t *p_cnt = sensorBoardLayoutCnt[next];
+    uint32_t changedMask = 0;
+    bool imuChanged = false;
+    memcpy(p_layout, sensorBoardDataLocation, sizeof(sensorBoardLayout[0]));
+    for (int i = 0; i < MAX_CS_ID; i++) {
+        if (p_layout[i].configBoardType != streamLayout.requested[i]) {
+            imuChanged |= (p_layout[i].configBoardType == BOARDTYPE_IMU_COIL ||
+                           streamLayout.requested[i] == BOARDTYPE_IMU_COIL);
+            p_layout[i].configBoardType = streamLayout.requested[i];
+            p_layout[i].hwBoardType = BOARDTYPE_UNKNOWN;
+            p_layout[i].match = false;
+            changedMask |= (1 << i);
+        }
+    }
+    uint32_t pktDataSize = STREAM_PKT_HEADER_SIZE + layoutPktStructure(p_layout, p_cnt);
+
+    imuData_t(*p_imuData)[IMU_PER_BOARD] = imuDataStorage;
+    if (imuChanged) {
+        // the IMU boards may have moved, drop the samples being assembled
+        p_imuData = imuDataBuffers[(imuDataStorage == imuDataBuffers[0]) ? 1 : 0];
+        memset(p_imuData, 0, sizeof(imuDataBuffers[0]));
+    }
+    // only the gather task adds slots to the ring, the next one stays free
+    uint32_t nextIdx = (streamData.streamDataIdx + 1) % streamRing.depth;
+    memset(&streamData.streamPktData[nextIdx], 0, pktDataSize);
+
+    __disable_irq();
+    if (streamRing.count != 0 || streamRing.held != 0 || streamRing.txActive) {
+        __enable_irq();
+        return false;
+    }
+    for (int i = 0; i < MAX_CS_ID; i++) {
+        if (slotPublish[i].seq & 1) {
+            __enable_irq();
+            return false;
+        }
+    }
+    sensorBoardDataLocation = p_layout;
+    sensorBoardCnt = p_cnt;
+    imuDataStorage = p_imuData;
+    streamData.streamPktDataSize = pktDataSize;
+    streamData.streamDataIdx = nextIdx;
+    streamRing.tail = nextIdx;
+    if (streamRing.inFlight == 0) {
+        streamRing.ackTail = nextIdx;
+    }
+    streamLayout.version++;
+    sensorDiscovery.relayoutMask |= changedMask;
+    // a type read before the change is not published, the boards are verified again
+    sensorDiscovery.publishMask &= ~changedMask;
+    __DMB();
+    streamLayout.pending = false;
+    __enable_irq();
+    return true;
+}
+
+__ITCMRAM__ static inline void setStreamPktHeader(int idx, uint64_t trigger_us) {
     static uint32_t uid = 0;
     assert(idx < MAX_CS_ID);
     streamData.streamPktData[idx].ecgReadingCnt = sensorBoardCnt[BOARDTYPE_ECG];
     streamData.streamPktData[idx].ecg12ReadingCnt = sensorBoardCnt[BOARDTYPE_12ECG];
     streamData.streamPktData[idx].imuReadingCnt = sensorBoardCnt[BOARDTYPE_IMU_COIL];
     streamData.streamPktData[idx].mcgReadingCnt = sensorBoardCnt[BOARDTYPE_MCG];
-    streamData.streamPktData[idx].timeStamp = timeStamp;
+    streamData.streamPktData[idx].timeStamp = streamWallTime(trigger_us);
+    streamData.streamPktData[idx].triggerTime_us = trigger_us;
     streamData.streamPktData[idx].uid = uid;
     streamData.streamPktData[idx].version = SENSOR_BOARD_READING_VERSION;
+    streamData.streamPktData[idx].layoutVersion = streamLayout.version;
+    streamData.streamPktData[idx].payloadLen = streamData.streamPktDataSize;
     uid++;
 }
 
+/**
+ * @fn
+ *
+ * @brief Number of samples to pack in the next batched frame, limited by the MTU
+ *
+ * @return samples per frame, 1 means send each packet on its own
+ **/
+__ITCMRAM__ static inline uint32_t streamBatchLimit(void) {
+    size_t sampleSz = sizeof(streamBatchSampleHdr_t) + streamData.streamPktDataSize - STREAM_PKT_HEADER_SIZE;
+    uint32_t fit = (MAX_STREAM_FRAME_SIZE_BYTES - STREAM_PKT_HEADER_SIZE) / sampleSz;
+    return (streamBatchCnt < fit) ? streamBatchCnt : fit;
+}
+
+/**
+ * @fn
+ *
+ * @brief Send any samples waiting in the batched frame
+ **/
+__ITCMRAM__ static void flushStreamBatch(void) {
+    streamSensorPkt_tp p_frame = (streamSensorPkt_tp)streamData.batchFrame;
+    if (p_frame->sampleCnt != 0) {
+        sendData(p_frame, p_frame->payloadLen);
+        p_frame->sampleCnt = 0;
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Send the batched frame if its first sample waited STREAM_BATCH_FLUSH_MS,
+ *        so a low sample rate does not leave samples waiting for the frame to fill
+ *
+ * @return msec the tx task may wait before calling it again
+ **/
+__ITCMRAM__ static uint32_t flushStreamBatchDue(void) {
+    streamSensorPkt_tp p_frame = (streamSensorPkt_tp)streamData.batchFrame;
+    if (p_frame->sampleCnt == 0) {
+        return MB_GATHER_TASK_TIMEOUT_MS;
+    }
+    uint32_t age = HAL_GetTick() - streamData.batchTick;
+    if (age >= STREAM_BATCH_FLUSH_MS) {
+        flushStreamBatch();
+        return MB_GATHER_TASK_TIMEOUT_MS;
+    }
+    return STREAM_BATCH_FLUSH_MS - age;
+}
+
+/**
+ * @fn
+ *
+ * @brief Append the stream packet to the batched frame, send the frame once it holds batchLimit samples
+ *
+ * @param[in] idx: stream packet index to append
+ * @param[in] batchLimit: samples per frame
+ **/
+__ITCMRAM__ static void appendStreamBatch(int idx, uint32_t batchLimit) {
+    streamSensorPkt_tp p_frame = (streamSensorPkt_tp)streamData.batchFrame;
+    streamSensorPkt_tp p_pkt = &streamData.streamPktData[idx];
+    size_t dataSz = streamData.streamPktDataSize - STREAM_PKT_HEADER_SIZE;
+
+    // the samples of a frame share the layout of its header
+    if (p_frame->sampleCnt != 0 && p_frame->layoutVersion != p_pkt->layoutVersion) {
+        flushStreamBatch();
+    }
+    if (p_frame->sampleCnt == 0) {
+        memcpy(p_frame, p_pkt, STREAM_PKT_HEADER_SIZE);
+        p_frame->version |= STREAM_BATCH_FLAG;
+        p_frame->payloadLen = STREAM_PKT_HEADER_SIZE;
+        streamData.batchTick = HAL_GetTick();
+    }
+    streamBatchSampleHdr_tp p_sample = (streamBatchSampleHdr_tp)&streamData.batchFrame[p_frame->payloadLen];
+    p_sample->uid = p_pkt->uid;
+    p_sample->timeStampDelta_us = (int32_t)(p_pkt->triggerTime_us - p_frame->triggerTime_us);
+    memcpy((uint8_t *)(p_sample + 1), p_pkt->dataReadings, dataSz);
+    p_frame->payloadLen += sizeof(streamBatchSampleHdr_t) + dataSz;
+    p_frame->sampleCnt++;
+    assert(p_frame->payloadLen <= MAX_STREAM_FRAME_SIZE_BYTES);
+
+    if (p_frame->sampleCnt >= batchLimit) {
+        flushStreamBatch();
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Invalidate any slot whose db task was still writing into the buffer when it was sent,
+ *        the buffer it claimed or one of the older ones a burst reaches
+ *
+ * @param[in] idx: stream packet index about to be sent
+ **/
+__ITCMRAM__ static void dropTornSlots(uint32_t idx) {
+    for (int i = 0; i < MAX_CS_ID; i++) {
+        if ((slotPublish[i].seq & 1) &&
+            (slotPublish[i].bufIdx + streamRing.depth - idx) % streamRing.depth <= slotPublish[i].span) {
+            gatherStats.db[i].tornData++;
+            slotPublish[i].torn = true;
+            // the flags byte is at the same offset in every readings structure
+            for (int sensorIdx = 0; sensorIdx < SENSORS_PER_BOARD; sensorIdx++) {
+                if (sensorBoardDataLocation[i].dataLocation[idx][sensorIdx].p_uint8 != NULL) {
+                    sensorBoardDataLocation[i].dataLocation[idx][sensorIdx].p_ECGsensors->flags &= ~NEW_DATA_FLAG;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Make room in the ring for the slot being filled, called before the flip.
+ *        Applies a pending depth change once the ring is empty. When the ring is full
+ *        the oldest slot, queued or held, is dropped unless it is being sent.
+ *
+ * @return true if the fill slot can be flipped, false if the sample must be held back
+ **/
+__ITCMRAM__ static bool streamRingReserve(void) {
+    bool flip = true;
+    __disable_irq();
+    if (streamRing.depth != streamRing.requestedDepth && streamRing.count == 0 && streamRing.inFlight == 0 &&
+        streamRing.held == 0 && !streamRing.txActive && streamData.streamDataIdx < streamRing.requestedDepth) {
+        streamRing.depth = streamRing.requestedDepth;
+        streamRing.tail = streamData.streamDataIdx;
+        streamRing.ackTail = streamData.streamDataIdx;
+    }
+    if (streamRing.count + streamRing.inFlight + streamRing.held >= streamRing.depth - 1) {
+        streamRing.drops++;
+        if (streamRing.txActive || streamRing.inFlight != 0) {
+            // slots still referenced by lwIP cannot be reused
+            flip = false;
+        } else {
+            streamRing.tail = (streamRing.tail + 1) % streamRing.depth;
+            streamRing.ackTail = streamRing.tail;
+            if (streamRing.count != 0) {
+                streamRing.count--;
+            } else {
+                streamRing.held--;
+            }
+        }
+    }
+    __enable_irq();
+    return flip;
+}
+
+/**
+ * @fn
+ *
+ * @brief Hold back the slot just flipped out of the db tasks, late burst samples may still be stored in it
+ **/
+__ITCMRAM__ static void streamRingHold(void) {
+    __disable_irq();
+    streamRing.held++;
+    __enable_irq();
+}
+
+/**
+ * @fn
+ *
+ * @brief Number of flipped slots to hold back, one less than the samples of a burst.
+ *        None are held while a depth or layout change waits for the ring to empty.
+ *
+ * @return slots to hold
+ **/
+__ITCMRAM__ static uint32_t streamRingHoldTarget(void) {
+    if (streamRing.depth != streamRing.requestedDepth || streamLayout.pending) {
+        return 0;
+    }
+    // the fill slot and one queued slot must still fit
+    return MIN(spiBurstCnt - 1, streamRing.depth - 2);
+}
+
+/**
+ * @fn
+ *
+ * @brief Queue the oldest held slot for the tx task
+ **/
+__ITCMRAM__ static void streamRingPush(void) {
+    __disable_irq();
+    streamRing.held--;
+    streamRing.count++;
+    if (streamRing.count + streamRing.inFlight > streamRing.highWater) {
+        streamRing.highWater = streamRing.count + streamRing.inFlight;
+    }
+    __enable_irq();
+}
+
+/**
+ * @fn
+ *
+ * @brief Get the oldest filled slot and mark it as being sent
+ *
+ * @param[out] p_idx: stream packet index to send
+ *
+ * @return true if a slot is waiting to be sent
+ **/
+__ITCMRAM__ static bool streamRingPeek(uint32_t *p_idx) {
+    bool ready = false;
+    __disable_irq();
+    if (streamRing.count != 0) {
+        *p_idx = streamRing.tail;
+        streamRing.txActive = true;
+        ready = true;
+    }
+    __enable_irq();
+    return ready;
+}
+
+/**
+ * @fn
+ *
+ * @brief Finish with the slot returned by streamRingPeek()
+ *
+ * @param[in] ackWait: slot was written with NETCONN_NOCOPY and stays in use until acknowledged
+ * @param[in] ackSeq: subscriber txBytes just past the slot data
+ **/
+__ITCMRAM__ static void streamRingPop(bool ackWait, uint32_t ackSeq) {
+    uint32_t tick = HAL_GetTick();
+    __disable_irq();
+    streamRing.ackWait[streamRing.tail] = ackWait;
+    streamRing.ackSeq[streamRing.tail] = ackSeq;
+    streamRing.ackTick[streamRing.tail] = tick;
+    streamRing.tail = (streamRing.tail + 1) % streamRing.depth;
+    streamRing.count--;
+    if (ackWait || streamRing.inFlight != 0) {
+        // keep the slots in order, one that needs no ACK is freed with the ones before it
+        streamRing.inFlight++;
+    } else {
+        streamRing.ackTail = streamRing.tail;
+    }
+    streamRing.txActive = false;
+    __enable_irq();
+}
+
+/**
+ * @fn
+ *
+ * @brief Free the sent slots that lwIP no longer references, oldest first.
+ *        All of them are freed when the connection they were written to is gone.
+ *
+ * The bytes between lastack and snd_lbb are still queued or unacknowledged, the pcb is read
+ * with the core locked as in sendTcpData(). closeTcpSubscriber() clears the connection before
+ * deleting it, the delete waits for the core. A client that leaves the oldest slot
+ * unacknowledged for STREAM_ACK_WAIT_MAX_MS, a delayed ACK, is sent copies so it cannot stall
+ * the ring. It gets zero copy again once everything sent to it is acknowledged, at least
+ * STREAM_ACK_RETRY_MS later.
+ **/
+__ITCMRAM__ static void streamRingRelease(void) {
+    if (streamRing.inFlight == 0 && !streamAck.stalled) {
+        return;
+    }
+    bool gone = true;
+    uint32_t unackedBytes = 0;
+    uint32_t ackedBytes = 0;
+    LOCK_TCPIP_CORE();
+    struct netconn *conn = streamAck.conn;
+    if (conn != NULL && conn->pcb.tcp != NULL) {
+        unackedBytes = conn->pcb.tcp->snd_lbb - conn->pcb.tcp->lastack;
+        ackedBytes = streamSubs[streamRing.ackSub].txBytes - unackedBytes;
+        gone = false;
+    }
+    UNLOCK_TCPIP_CORE();
+
+    __disable_irq();
+    while (streamRing.inFlight != 0) {
+        uint32_t idx = streamRing.ackTail;
+        if (!gone && streamRing.ackWait[idx] && (int32_t)(ackedBytes - streamRing.ackSeq[idx]) < 0) {
+            break;
+        }
+        streamRing.ackTail = (streamRing.ackTail + 1) % streamRing.depth;
+        streamRing.inFlight--;
+    }
+    bool late = (streamRing.inFlight != 0) && !streamAck.stalled &&
+                (HAL_GetTick() - streamRing.ackTick[streamRing.ackTail] > STREAM_ACK_WAIT_MAX_MS);
+    if (late) {
+        streamRing.ackStalls++;
+    }
+    __enable_irq();
+    if (late) {
+        streamAck.stalled = true;
+        streamAck.stalledTick = HAL_GetTick();
+        DPRINTF_GATH("Stream client slow to acknowledge, sending copies\r\n");
+    } else if (streamAck.stalled &&
+               (gone || (unackedBytes == 0 && HAL_GetTick() - streamAck.stalledTick >= STREAM_ACK_RETRY_MS))) {
+        streamAck.stalled = false;
+        DPRINTF_GATH("Stream client caught up, zero copy again\r\n");
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Find the subscriber a stream slot can be written to without a copy.
+ *        Zero copy is only used when a single tcp client is subscribed, otherwise
+ *        a slow client would hold the slots every other subscriber needs.
+ *
+ * @note called with streamSubAccess held
+ *
+ * @return the only subscriber if it is tcp, else NULL
+ **/
+__ITCMRAM__ static streamSub_tp streamZeroCopySub(void) {
+    streamSub_tp p_found = NULL;
+    for (int i = 0; i < MAX_STREAM_SUBSCRIBERS; i++) {
+        if (streamSubs[i].type != STREAM_SUB_FREE) {
+            if (p_found != NULL) {
+                return NULL;
+            }
+            p_found = &streamSubs[i];
+        }
+    }
+    if (p_found != NULL && streamAck.stalled && p_found == &streamSubs[streamRing.ackSub] &&
+        p_found->gen == streamRing.ackSubGen) {
+        // keep copying to a client slow to acknowledge, see streamRingRelease()
+        return NULL;
+    }
+    return (p_found != NULL && p_found->type == STREAM_SUB_TCP && streamFilterIsAll(&p_found->filter)) ? p_found
+                                                                                                       : NULL;
+}
+
+/**
+ * @fn
+ *
+ * @brief Send a stream slot to every subscriber, without copying it into lwIP when possible
+ *
+ * @param[in] p_data: slot data, must stay unchanged until acknowledged when zero copy is used
+ * @param[in] dataLen: number of bytes to send
+ * @param[out] p_ackSeq: TCP sequence number just past the data
+ *
+ * @return true if lwIP references the data and the slot must wait for the ACK
+ **/
+__ITCMRAM__ static bool sendStreamPkt(void *p_data, size_t dataLen, uint32_t *p_ackSeq) {
+    bool ackWait = false;
+
+    osMutexWait(streamSubAccess, osWaitForever);
+    streamSub_tp p_sub = streamTcpZeroCopy ? streamZeroCopySub() : NULL;
+    if (p_sub != NULL && streamAck.conn != p_sub->conn && streamRing.inFlight != 0) {
+        // the slots written to the previous connection are counted in its bytes, copy until they are freed
+        p_sub = NULL;
+    }
+    if (p_sub == NULL) {
+        sendToSubscribers(p_data, dataLen);
+    } else if (sendTcpData(p_sub, p_data, dataLen, NETCONN_NOCOPY)) {
+        // the slot is freed once txBytes is acknowledged, see streamRingRelease()
+        if (streamAck.conn != p_sub->conn) {
+            streamRing.ackSub = p_sub - streamSubs;
+            streamRing.ackSubGen = p_sub->gen;
+            streamAck.stalled = false;
+            __DMB();
+            streamAck.conn = p_sub->conn;
+        }
+        *p_ackSeq = p_sub->txBytes;
+        ackWait = true;
+    }
+    osMutexRelease(streamSubAccess);
+    return ackWait;
+}
+
+/**
+ * @fn
+ *
+ * @brief Send the frame due this tick to each filtered subscriber
+ *
+ * Filtered frames are always copied and never batched, a subscriber whose decimation
+ * window is not complete only costs a counter increment, or the sums when averaging.
+ *
+ * @param[in] idx: stream packet index just sent
+ **/
+__ITCMRAM__ static void sendFilteredSubs(uint32_t idx) {
+    osMutexWait(streamSubAccess, osWaitForever);
+    for (int i = 0; i < MAX_STREAM_SUBSCRIBERS; i++) {
+        streamSub_tp p_sub = &streamSubs[i];
+        if (p_sub->type == STREAM_SUB_FREE || streamFilterIsAll(&p_sub->filter)) {
+            continue;
+        }
+        size_t len = streamFilterPkt(
+            &p_sub->filter, &streamData.streamPktData[idx], streamFilterFrame, sizeof(streamFilterFrame));
+        if (len == 0) {
+            continue;
+        }
+        if (p_sub->type == STREAM_SUB_TCP) {
+            sendTcpData(p_sub, streamFilterFrame, len, NETCONN_COPY);
+        } else {
+            sendUdpData(p_sub, streamFilterFrame, len);
+        }
+    }
+    osMutexRelease(streamSubAccess);
+}
+
+/**
+ * @fn
+ *
+ * @brief Send one stream slot, batched, copied or zero-copy depending on the settings
+ *
+ * @param[in] idx: stream packet index to send
+ * @param[out] p_ackSeq: set when the slot must wait for a TCP ACK
+ *
+ * @return true if the slot must wait for the TCP ACK before reuse
+ **/
+__ITCMRAM__ static bool sendStreamSlot(uint32_t idx, uint32_t *p_ackSeq) {
+    bool ackWait = false;
+    uint32_t batchLimit = streamBatchLimit();
+#if GATHER_BENCH
+    uint32_t start = DWT->CYCCNT;
+#endif
+
+    if (batchLimit > 1) {
+        appendStreamBatch(idx, batchLimit);
+    } else {
+        flushStreamBatch();
+        ackWait = sendStreamPkt(&streamData.streamPktData[idx], streamData.streamPktDataSize, p_ackSeq);
+    }
+    sendFilteredSubs(idx);
+
+#if GATHER_BENCH
+    uint32_t cycles = DWT->CYCCNT - start;
+    streamTxBench.pkts++;
+    streamTxBench.bytes += streamData.streamPktDataSize;
+    streamTxBench.cycles += cycles;
+    if (cycles > streamTxBench.maxCycles) {
+        streamTxBench.maxCycles = cycles;
+    }
+#endif
+    return ackWait;
+}
+
 __ITCMRAM__ static inline void clearStreamPktData(int idx) {
     assert(idx < MAX_STREAM_DATA_PKT_IDX);
-    memset(&streamData.streamPktData[idx], 0, sizeof(streamData.streamPktData[0]));
+    // only the populated prefix is ever written or sent, see createPktStructure()
+    memset(&streamData.streamPktData[idx], 0, streamData.streamPktDataSize);
 }
 
 void waitOnTcpServerConnectionThread(const void *arg) {
@@ -972,220 +2639,790 @@ void waitOnTcpServerConnectionThread(const void *arg) {
         }
 
         netconn_addr(newconn, &addr, &port);
-        if (tcpConn == NULL) {
-            tcpConn = newconn;
+        if (streamSubAdd(STREAM_SUB_TCP, newconn, NULL, 0) >= 0) {
             DPRINTF_GATH("Accepting connection from %s:%d\r\n", ipaddr_ntoa(&addr), port);
         } else {
-            DPRINTF_GATH("Ignoring connection from %s:%d\r\n", ipaddr_ntoa(&addr), port);
+            DPRINTF_GATH("Ignoring connection from %s:%d, no free subscriber\r\n", ipaddr_ntoa(&addr), port);
+            netconn_close(newconn);
+            netconn_delete(newconn);
         }
     }
 }
 
-__ITCMRAM__ void sendData(void *p_data, size_t dataLen) {
-    if (useUdpChan) {
-        sendUdpData(p_data, dataLen);
-    } else {
-        if (tcpConn) {
-            sendTcpData(p_data, dataLen);
+static int streamSubAdd(STREAM_SUB_e type, struct netconn *p_conn, const ip_addr_t *p_addr, uint16_t port) {
+    int subIdx = -1;
+    osMutexWait(streamSubAccess, osWaitForever);
+    for (int i = 0; i < MAX_STREAM_SUBSCRIBERS; i++) {
+        streamSub_tp p_sub = &streamSubs[i];
+        if (p_sub->type == STREAM_SUB_FREE) {
+            uint32_t gen = p_sub->gen + 1;
+            memset(p_sub, 0, sizeof(streamSub_t));
+            p_sub->gen = gen;
+            p_sub->conn = p_conn;
+            if (p_addr != NULL) {
+                ip_addr_copy(p_sub->addr, *p_addr);
+            }
+            p_sub->port = port;
+            streamFilterSet(&p_sub->filter, &streamFilterAll);
+            p_sub->type = type;
+            subIdx = i;
+            break;
         }
     }
+    osMutexRelease(streamSubAccess);
+    return subIdx;
 }
 
-__ITCMRAM__ void closeTcpConnection(void) {
-    netconn_close(tcpConn);
-    tcpConn = NULL;
-    sendErrCnt = 0;
+static RETURN_CODE streamSubRemove(uint32_t subIdx) {
+    if (subIdx >= MAX_STREAM_SUBSCRIBERS) {
+        return RETURN_ERR_PARAM;
+    }
+    osMutexWait(streamSubAccess, osWaitForever);
+    streamSub_tp p_sub = &streamSubs[subIdx];
+    if (p_sub->type == STREAM_SUB_TCP) {
+        closeTcpSubscriber(p_sub);
+    }
+    p_sub->type = STREAM_SUB_FREE;
+    osMutexRelease(streamSubAccess);
+    return RETURN_OK;
 }
 
-__ITCMRAM__ void sendTcpData(void *p_data, size_t dataLen) {
+__ITCMRAM__ void closeTcpSubscriber(streamSub_tp p_sub) {
+    if (streamAck.conn == p_sub->conn) {
+        // the slots written to it are freed, streamRingRelease() no longer touches it
+        streamAck.conn = NULL;
+        __DMB();
+    }
+    netconn_close(p_sub->conn);
+    netconn_delete(p_sub->conn);
+    p_sub->conn = NULL;
+    p_sub->type = STREAM_SUB_FREE;
+}
 
+/**
+ * @fn
+ *
+ * @brief Open the udp connection shared by all udp subscribers and subscribe the
+ *        EEPROM configured server when udp is the selected IP_TX_DATA_TYPE.
+ **/
+static void streamUdpOpen(void) {
     err_t err;
+    uint32_t udpTxPort;
+    uint32_t clientPort = 5005;
+    ip_addr_t destAddr;
 
-    if (tcpConn == NULL) {
-        return;
+    udpConn = netconn_new(NETCONN_UDP);
+    if (udpConn == NULL) {
+        DPRINTF_ERROR("ERROR opening socket");
+        assert(false);
     }
 
-    if ((err = netconn_err(tcpConn)) != ERR_OK) {
+    eepromOpen(osWaitForever);
+    eepromReadRegister(EEPROM_UDP_TX_PORT, (uint8_t *)&udpTxPort, sizeof(udpTxPort));
+    eepromReadRegister(EEPROM_SERVER_UDP_IP, (uint8_t *)&destAddr, sizeof(destAddr));
+    eepromReadRegister(EEPROM_SERVER_UPD_PORT, (uint8_t *)&clientPort, sizeof(clientPort));
+    eepromClose();
+    DPRINTF_INFO("UDP TX is sending from port %u\r\n", udpTxPort);
+    err = netconn_bind(udpConn, IP_ADDR_ANY, udpTxPort);
+    if (err != ERR_OK) {
+        DPRINTF_ERROR("netconn bind error %d\r\n", err);
+        assert(false);
+    }
+#if LWIP_MULTICAST_TX_OPTIONS
+    udp_set_multicast_ttl(udpConn->pcb.udp, STREAM_MCAST_TTL);
+#endif
+
+    if (useUdpChan) {
+        uint8_t *pBuffer = (uint8_t *)&destAddr;
+        DPRINTF_INFO(
+            "Using udp server %u,%u,%u,%u port %u\r\n", pBuffer[0], pBuffer[1], pBuffer[2], pBuffer[3], clientPort);
+        streamSubAdd(STREAM_SUB_UDP, NULL, &destAddr, clientPort);
+    }
+}
+
+__ITCMRAM__ void sendToSubscribers(void *p_data, size_t dataLen) {
+    for (int i = 0; i < MAX_STREAM_SUBSCRIBERS; i++) {
+        if (!streamFilterIsAll(&streamSubs[i].filter)) {
+            continue;
+        } else if (streamSubs[i].type == STREAM_SUB_TCP) {
+            sendTcpData(&streamSubs[i], p_data, dataLen, NETCONN_COPY);
+        } else if (streamSubs[i].type == STREAM_SUB_UDP) {
+            sendUdpData(&streamSubs[i], p_data, dataLen);
+        }
+    }
+}
+
+__ITCMRAM__ void sendData(void *p_data, size_t dataLen) {
+    osMutexWait(streamSubAccess, osWaitForever);
+    sendToSubscribers(p_data, dataLen);
+    osMutexRelease(streamSubAccess);
+}
+
+__ITCMRAM__ bool sendTcpData(streamSub_tp p_sub, void *p_data, size_t dataLen, uint8_t apiFlags) {
+
+    err_t err;
+    bool sent = false;
+
+    if ((err = netconn_err(p_sub->conn)) != ERR_OK) {
         DPRINTF_INFO("Closing TCP connection due to error %d\r\n", err);
-        closeTcpConnection();
-        return;
+        closeTcpSubscriber(p_sub);
+        return false;
+    }
+
+    // A client that is not keeping up misses this packet instead of blocking the other subscribers.
+    // Only this task queues data, so the space seen here is still there for the write. The pcb is
+    // owned by the tcpip thread and is freed by a reset, it is only read with the core locked.
+    LOCK_TCPIP_CORE();
+    struct tcp_pcb *pcb = p_sub->conn->pcb.tcp;
+    bool room = (pcb != NULL) && (tcp_sndbuf(pcb) >= dataLen) &&
+                (tcp_sndqueuelen(pcb) + STREAM_TCP_SEGS_PER_PKT <= TCP_SND_QUEUELEN);
+    UNLOCK_TCPIP_CORE();
+    if (!room) {
+        p_sub->drops++;
+        return false;
     }
 
     // MEASURE TCP Tx Execution Time with GPIO Pin
     HAL_GPIO_WritePin(DBG2_PORT, DBG2_PIN, 1);
 
-    if ((err = netconn_write(tcpConn, p_data, dataLen, NETCONN_COPY)) != ERR_OK) {
+    if ((err = netconn_write(p_sub->conn, p_data, dataLen, apiFlags)) != ERR_OK) {
         DPRINTF_ERROR("netconn_send failed %d\r\n", err);
-        if (sendErrCnt++ > MAX_SEND_ERRORS) {
+        if (p_sub->sendErrs++ > MAX_SEND_ERRORS) {
             DPRINTF_INFO("Closing TCP connection due to SEND errors %d\r\n", err);
-            closeTcpConnection();
-            return;
+            closeTcpSubscriber(p_sub);
+            HAL_GPIO_WritePin(DBG2_PORT, DBG2_PIN, 0);
+            return false;
         }
     } else {
-        sendErrCnt = 0;
+        p_sub->sendErrs = 0;
+        p_sub->sentPkts++;
+        p_sub->txBytes += dataLen;
+        sent = true;
     }
 
     // MEASURE TCP TX Execution Time with GPIO Pin
     HAL_GPIO_WritePin(DBG2_PORT, DBG2_PIN, 0);
+    return sent;
 }
 
-__ITCMRAM__ void sendUdpData(void *p_data, size_t dataLen) {
-
-    static ip_addr_t destAddr;
-    static uint32_t clientPort = 5005;
-    static struct netconn *conn = NULL;
-    static uint32_t cnt = 0;
-    if (conn == NULL) {
-        err_t err;
-        conn = netconn_new(NETCONN_UDP);
-        if (conn == NULL) {
-            DPRINTF_ERROR("ERROR opening socket");
-            assert(false);
-        }
-
-        uint32_t udpTxPort;
-        eepromOpen(osWaitForever);
-        eepromReadRegister(EEPROM_UDP_TX_PORT, (uint8_t *)&udpTxPort, sizeof(udpTxPort));
-        eepromReadRegister(EEPROM_SERVER_UDP_IP, (uint8_t *)&destAddr, sizeof(destAddr));
-        eepromReadRegister(EEPROM_SERVER_UPD_PORT, (uint8_t *)&clientPort, sizeof(clientPort));
-        eepromClose();
-        DPRINTF_INFO("UDP TX is sending from port %u\r\n", udpTxPort);
-        err = netconn_bind(conn, IP_ADDR_ANY, udpTxPort);
-        if (err != ERR_OK) {
-            DPRINTF_ERROR("netconn bind error %d\r\n", err);
-            assert(false);
-        }
-
-        uint8_t *pBuffer = (uint8_t *)&destAddr;
-        DPRINTF_INFO(
-            "Using udp server %u,%u,%u,%u port %u\r\n", pBuffer[0], pBuffer[1], pBuffer[2], pBuffer[3], clientPort);
-    }
+__ITCMRAM__ void sendUdpData(streamSub_tp p_sub, void *p_data, size_t dataLen) {
 
     struct netbuf *buf = netbuf_new();
     netbuf_ref(buf, p_data, dataLen);
     HAL_GPIO_WritePin(DBG2_PORT, DBG2_PIN, 1);
-    uint32_t sendErr = netconn_sendto(conn, buf, &destAddr, clientPort);
+    uint32_t sendErr = netconn_sendto(udpConn, buf, &p_sub->addr, p_sub->port);
     if (sendErr != ERR_OK) {
-        if (cnt < 10 || cnt % 60000 == 0) {
+        if (p_sub->sendErrs < 10 || p_sub->sendErrs % 60000 == 0) {
             DPRINTF_ERROR("netconn_send failed %d\r\n", sendErr);
         }
-        cnt++;
+        p_sub->sendErrs++;
+        p_sub->drops++;
+    } else {
+        p_sub->sentPkts++;
     }
     HAL_GPIO_WritePin(DBG2_PORT, DBG2_PIN, 0);
     netbuf_delete(buf);
 }
-static double timeStamp;
+
+/**
+ * @fn
+ *
+ * @brief Hand a flipped slot to the tx task once late burst samples can no longer reach it
+ *
+ * @param[in] idx: stream packet index to send
+ **/
+__ITCMRAM__ static void streamSlotSend(uint32_t idx) {
+    dropTornSlots(idx);
+
+    gatherStats.sentPkts++;
+    for (int i = 0; i < MAX_CS_ID; i++) {
+        // we cannot count missed data as we miss data 4 out of 5 transmissions for IMU data.
+        if (sensorBoardDataLocation[i].configBoardType == BOARDTYPE_MCG) {
+            sensorMCGBoardReadings_tp p_header = sensorBoardDataLocation[i].dataLocation[idx][0].p_MCGsensors;
+            if (NEW_DATA(p_header->flags)) {
+                gatherStats.db[i].sentPkts[SENSOR_0]++;
+            } else {
+                gatherStats.db[i].missedData++;
+            }
+        } else if (sensorBoardDataLocation[i].configBoardType == BOARDTYPE_ECG || sensorBoardDataLocation[i].configBoardType == BOARDTYPE_12ECG) {
+            sensorECGBoardReadings_tp p_header = sensorBoardDataLocation[i].dataLocation[idx][0].p_ECGsensors;
+            if (NEW_DATA(p_header->flags)) {
+                gatherStats.db[i].sentPkts[SENSOR_0]++;
+            } else {
+                gatherStats.db[i].missedData++;
+            }
+        } else if(sensorBoardDataLocation[i].configBoardType == BOARDTYPE_IMU_COIL) {
+            for (int sensorIdx = 0; sensorIdx < SENSORS_PER_BOARD; sensorIdx++) {
+
+                imuReadings_tp p_imuHeader = sensorBoardDataLocation[i].dataLocation[idx][sensorIdx].p_imu;
+                if (NEW_DATA(p_imuHeader->flags)) {
+                    gatherStats.db[i].sentPkts[sensorIdx]++;
+                }
+            }
+        } // end of else if IMU_COIL
+    } // end of for i<MAX_CS_ID
+
+    streamRingPush();
+    xTaskNotifyGive(mbStreamTxTaskHandle);
+}
+
 static uint32_t sendingIdx;
-static uint32_t lastTick;
+static uint32_t triggerSeq;
 
 __ITCMRAM__ void mbGatherThread(const void *arg) {
     uint32_t notify;
     DPRINTF_GATH("Gather Task starting\r\n");
 
-    uint32_t dbMask = createPktStructure();
-    registerInfo_t regInfo = {0};
-    uint32_t cnt = 0;
-    // as long as we have all of dbMask up, there can be others up too that
-    // we don't care about.
-    while ((dbMask & regInfo.u.dataUint) != dbMask) {
-        // Give time for sensor boards to come up and become responsive. ECG12 takes the longest time to boot
-        osDelay(WAIT_FOR_SENSOR_BOARDS_TO_SETTLE_MS(2000));
-        dbTriggerEnableAll();
-        // Give time for sensor boards to fail
-        // Multiply minimum fail time by 2
-        osDelay(WAIT_FOR_SENSOR_BOARDS_TO_SETTLE_MS(DB_MAX_UNANSWERED_RESPONSE_DISABLE * DB_SPI_INTERVAL_MS * 2));
-        dbTriggerMaskRead(&regInfo);
-        if (cnt++ > DB_UP_RETRY_MAX) {
-            break;
-        }
-    }
-    DPRINTF_INFO("Sensor Board Up retry cnt = %d\r\n", cnt);
-    if (!verifySensorConfiguration()) {
-        configurationErrorRaise(NULL);
-        dbTriggerMaskRead(&regInfo);
-        DPRINTF_ERROR("Boards missing %x\r\n", regInfo.u.dataUint);
+    createPktStructure();
+    // the board status task discovers the boards as they answer, streaming starts with the first
+    // ready board and the others join when they are discovered
+    sensorDiscoveryStart();
+    while (!sensorDiscoveryReady()) {
+        osDelay(SENSOR_DISCOVERY_POLL_MS);
     }
+    sensorDiscoveryPublish();
+    DPRINTF_INFO("Streaming %d ms after boot, ready %06x\r\n", HAL_GetTick(), sensorDiscovery.readyMask);
 
     watchdogAssignToCurrentTask(WDT_TASK_GATHER);
     watchdogSetTaskEnabled(WDT_TASK_GATHER, 1);
 
     HAL_TIM_Base_Start_IT(pwmMap[TIM_UDP_TX_SIGNAL].htim);
 
-    lastTick = HAL_GetTick();
-    timeStamp = timeSinceEpoch();
+    triggerSeq = streamClock.triggerSeq;
     while (1) {
         // A new conversion has started. So lock down the current data and
         // send it!
         notify = ulTaskNotifyTake(true, MB_GATHER_TASK_TIMEOUT_MS);
         watchdogKickFromTask(WDT_TASK_GATHER);
+        if (sensorDiscovery.publishMask != 0) {
+            sensorDiscoveryPublish();
+        }
         if (notify == TASK_NOTIFY_OK) {
-            if ((HAL_GetTick() - lastTick > 1000)) { // approx 1/sec
-                timeStamp = timeSinceEpoch();        // resync time stamp
-                lastTick = HAL_GetTick();
-            } else {
-                timeStamp += TS_DELTA;
+            uint64_t trigger_us = streamTriggerTimeUs(&triggerSeq);
+            if (streamLayout.pending && streamLayoutApply()) {
+                // the sample being filled had the old layout, it was dropped for a cleared slot
+                DPRINTF_INFO("Stream layout %d applied, %d bytes\r\n",
+                             streamLayout.version,
+                             streamData.streamPktDataSize);
+                continue;
             }
-            osStatus osResult = osMutexWait(streamData.access, 2);
-            if (osResult == osOK) {
-                sendingIdx = streamData.streamDataIdx;
-                streamData.streamDataIdx++;
-                streamData.streamDataIdx %= MAX_STREAM_DATA_PKT_IDX;
-                clearStreamPktData(streamData.streamDataIdx);
-                // Moving the IDX locks down this data so we can release the semaphore now.
-                osMutexRelease(streamData.access);
-
-                setStreamPktHeader(sendingIdx, timeStamp);
-
-                sendData((void *)&streamData.streamPktData[sendingIdx], sizeof(streamData.streamPktData[sendingIdx]));
-
-                gatherStats.sentPkts++;
-                for (int i = 0; i < MAX_CS_ID; i++) {
-                    // we cannot count missed data as we miss data 4 out of 5 transmissions for IMU data.
-                    if (sensorBoardDataLocation[i].configBoardType == BOARDTYPE_MCG) {
-                        sensorMCGBoardReadings_tp p_header =
-                            sensorBoardDataLocation[i].dataLocation[streamData.streamDataIdx][0].p_MCGsensors;
-                        if (NEW_DATA(p_header->flags)) {
-                            gatherStats.db[i].sentPkts[SENSOR_0]++;
-                        } else {
-                            gatherStats.db[i].missedData++;
-                        }
-                    } else if (sensorBoardDataLocation[i].configBoardType == BOARDTYPE_ECG || sensorBoardDataLocation[i].configBoardType == BOARDTYPE_12ECG) {
-                        sensorECGBoardReadings_tp p_header =
-                            sensorBoardDataLocation[i].dataLocation[streamData.streamDataIdx][0].p_ECGsensors;
-                        if (NEW_DATA(p_header->flags)) {
-                            gatherStats.db[i].sentPkts[SENSOR_0]++;
-                        } else {
-                            gatherStats.db[i].missedData++;
-                        }
-                    } else if(sensorBoardDataLocation[i].configBoardType == BOARDTYPE_IMU_COIL) {
-                        for (int sensorIdx = 0; sensorIdx < SENSORS_PER_BOARD; sensorIdx++) {
-
-                            imuReadings_tp p_imuHeader =
-                                sensorBoardDataLocation[i].dataLocation[streamData.streamDataIdx][sensorIdx].p_imu;
-                            if (NEW_DATA(p_imuHeader->flags)) {
-                                gatherStats.db[i].sentPkts[sensorIdx]++;
-                            }
-                        }
-                    } // end of else if IMU_COIL
-                } // end of for i<MAX_CS_ID
-            } else {
-                timeStamp = timeSinceEpoch();
-                gatherStats.accessBlockCnt++;
+            if (!streamRingReserve()) {
+                // the slot being sent is the only free one, keep filling the current slot
+                continue;
+            }
+            // Clear the next free slot before handing it to the db tasks, then flip.
+            uint32_t nextIdx = (streamData.streamDataIdx + 1) % streamRing.depth;
+            clearStreamPktData(nextIdx);
+            __DMB();
+            sendingIdx = streamData.streamDataIdx;
+            streamData.streamDataIdx = nextIdx;
+            __DMB();
+            gatherStats.bufferFlips++;
+            setStreamPktHeader(sendingIdx, trigger_us);
+            streamRingHold();
+
+            // send the slots that late burst samples can no longer reach, oldest first
+            uint32_t holdTarget = streamRingHoldTarget();
+            while (streamRing.held > holdTarget) {
+                streamSlotSend((streamRing.tail + streamRing.count) % streamRing.depth);
             }
-
         } else {
-            timeStamp = timeSinceEpoch();
             gatherStats.notifyTimeoutCnt++;
-            lastTick = HAL_GetTick();
         }
     }
 }
 
+__ITCMRAM__ void mbStreamTxThread(const void *arg) {
+    uint32_t idx;
+    uint32_t waitMs = MB_GATHER_TASK_TIMEOUT_MS;
+    uint32_t lastSyncTick = HAL_GetTick();
+    DPRINTF_GATH("Stream Tx Task starting\r\n");
+    streamUdpOpen();
+    streamClockDiscipline();
+
+    watchdogAssignToCurrentTask(WDT_TASK_STREAMTX);
+    watchdogSetTaskEnabled(WDT_TASK_STREAMTX, 1);
+
+    while (1) {
+        ulTaskNotifyTake(true, waitMs);
+        watchdogKickFromTask(WDT_TASK_STREAMTX);
+        if (HAL_GetTick() - lastSyncTick >= STREAM_CLOCK_SYNC_MS) {
+            lastSyncTick = HAL_GetTick();
+            streamClockDiscipline();
+        }
+        streamRingRelease();
+        while (streamRingPeek(&idx)) {
+            uint32_t ackSeq = 0;
+            bool ackWait = sendStreamSlot(idx, &ackSeq);
+            if (sensorDiscovery.firstPacketMs == 0) {
+                sensorDiscovery.firstPacketMs = HAL_GetTick();
+            }
+            streamRingPop(ackWait, ackSeq);
+            streamRingRelease();
+        }
+        waitMs = flushStreamBatchDue();
+    }
+}
+
+#define CMD_ARG_IDX 1
+#define SUBCMD_ARG_IDX 2
+
+#if GATHER_BENCH
+#define UNPACK_BENCH_LOOPS 16
+#define UNPACK_BENCH_RATE_HZ 2000 // sensor packet rate of each board
+
+/**
+ * @fn
+ *
+ * @brief Measure the cycles needed to sign extend the packed 24 bit readings of every board
+ *
+ * adcUnpack24() and the byte at a time READ_24BITSVALUE() are run on the readings of MAX_CS_ID
+ * boards with the interrupts disabled, the best of UNPACK_BENCH_LOOPS runs is reported.
+ *
+ * @param[in] hCli: cli handle
+ *
+ * @return 1 if both give the same readings
+ **/
+static int16_t gatherUnpackBench(CLI *hCli) {
+    static adcPacked24_t packed[MAX_CS_ID][NUMBER_OF_SENSOR_READINGS];
+    static adc24Reading_t unpacked[MAX_CS_ID][NUMBER_OF_SENSOR_READINGS];
+    static adc24Reading_t reference[MAX_CS_ID][NUMBER_OF_SENSOR_READINGS];
+    uint32_t kernelCycles = UINT32_MAX;
+    uint32_t scalarCycles = UINT32_MAX;
+
+    uint32_t value = 0x00812345;
+    for (int i = 0; i < MAX_CS_ID; i++) {
+        for (int j = 0; j < NUMBER_OF_SENSOR_READINGS; j++) {
+            // pseudo random readings of both signs
+            value = value * 1664525 + 1013904223;
+            WRITE_24BITVALUE(packed[i][j].value24bit, value);
+        }
+    }
+
+    for (int loop = 0; loop < UNPACK_BENCH_LOOPS; loop++) {
+        __disable_irq();
+        uint32_t start = DWT->CYCCNT;
+        for (int i = 0; i < MAX_CS_ID; i++) {
+            adcUnpack24(unpacked[i], packed[i], NUMBER_OF_SENSOR_READINGS);
+        }
+        uint32_t cycles = DWT->CYCCNT - start;
+        if (cycles < kernelCycles) {
+            kernelCycles = cycles;
+        }
+
+        start = DWT->CYCCNT;
+        for (int i = 0; i < MAX_CS_ID; i++) {
+            for (int j = 0; j < NUMBER_OF_SENSOR_READINGS; j++) {
+                reference[i][j].value32bit = READ_24BITSVALUE(packed[i][j].value24bit);
+            }
+        }
+        cycles = DWT->CYCCNT - start;
+        __enable_irq();
+        if (cycles < scalarCycles) {
+            scalarCycles = cycles;
+        }
+    }
+
+    bool match = (memcmp(unpacked, reference, sizeof(unpacked)) == 0);
+    // cpu load in 1/100 %, cycles per second over the core clock
+    uint32_t load = (uint64_t)kernelCycles * UNPACK_BENCH_RATE_HZ * 10000 / SystemCoreClock;
+    uint32_t scalarLoad = (uint64_t)scalarCycles * UNPACK_BENCH_RATE_HZ * 10000 / SystemCoreClock;
+
+    CliPrintf(hCli,
+              "Unpack %d boards x %d readings, %s\r\n",
+              MAX_CS_ID,
+              NUMBER_OF_SENSOR_READINGS,
+              match ? "readings match" : "READINGS MISMATCH");
+    CliPrintf(hCli,
+              "\tadcUnpack24      = %lu cycles, %lu per board, %lu.%02lu %% cpu at %d Hz\r\n",
+              kernelCycles,
+              kernelCycles / MAX_CS_ID,
+              load / 100,
+              load % 100,
+              UNPACK_BENCH_RATE_HZ);
+    CliPrintf(hCli,
+              "\tREAD_24BITSVALUE = %lu cycles, %lu per board, %lu.%02lu %% cpu at %d Hz\r\n",
+              scalarCycles,
+              scalarCycles / MAX_CS_ID,
+              scalarLoad / 100,
+              scalarLoad % 100,
+              UNPACK_BENCH_RATE_HZ);
+    CliPrintf(hCli,
+              "\tSpi saving       = %d bytes per packet, %d kB/s for all boards at %d Hz\r\n",
+              (int)((sizeof(adc24Reading_t) - sizeof(adcPacked24_t)) * NUMBER_OF_SENSOR_READINGS),
+              (int)((sizeof(adc24Reading_t) - sizeof(adcPacked24_t)) * NUMBER_OF_SENSOR_READINGS * MAX_CS_ID *
+                    UNPACK_BENCH_RATE_HZ / 1000),
+              UNPACK_BENCH_RATE_HZ);
+    return match ? 1 : 0;
+}
+#endif
+
+int16_t gatherCliCmd(CLI *hCli, int argc, char *argv[]) {
+    uint16_t success = 0;
+    if (argc == SUBCMD_ARG_IDX && strcmp(argv[CMD_ARG_IDX], "stats") == 0) {
+        CliPrintf(hCli, "System:\r\n");
+        CliPrintf(hCli, "\tSent Pkts       = %lu\r\n", gatherStats.sentPkts);
+        CliPrintf(hCli, "\tBuffer Flips    = %lu\r\n", gatherStats.bufferFlips);
+        CliPrintf(hCli, "\tNotify Timeouts = %lu\r\n", gatherStats.notifyTimeoutCnt);
+        CliPrintf(hCli, "\tRing Depth      = %lu (requested %lu)\r\n", streamRing.depth, streamRing.requestedDepth);
+        CliPrintf(hCli, "\tRing Queued     = %lu\r\n", streamRing.count);
+        CliPrintf(hCli, "\tRing Held       = %lu (burst %lu)\r\n", streamRing.held, spiBurstCnt);
+        CliPrintf(hCli, "\tRing High Water = %lu\r\n", streamRing.highWater);
+        CliPrintf(hCli, "\tRing Drops      = %lu\r\n", streamRing.drops);
+        CliPrintf(hCli, "\tRing Unacked    = %lu\r\n", streamRing.inFlight);
+        CliPrintf(hCli, "\tRing Ack Stalls = %lu\r\n", streamRing.ackStalls);
+        CliPrintf(hCli,
+                  "\tLayout Version  = %u%s, %lu bytes\r\n",
+                  streamLayout.version,
+                  streamLayout.pending ? " (change pending)" : "",
+                  streamData.streamPktDataSize);
+        CliPrintf(hCli, "\tClock Uptime    = %lu s\r\n", (uint32_t)(streamTimeUs() / ONE_MICRO_SECOND));
+        CliPrintf(hCli,
+                  "\tClock Source    = %s, rate %ld ppb, steps %lu\r\n",
+                  STREAM_CLOCK_SRC_e_Strings[streamClock.source],
+                  streamClock.ratePpb,
+                  streamClock.steps);
+
+#if GATHER_BENCH
+        uint32_t elapsed_ms = HAL_GetTick() - streamTxBench.startTick;
+        uint32_t cyclesPerUs = SystemCoreClock / ONE_MICRO_SECOND;
+        uint32_t pkts = (streamTxBench.pkts != 0) ? streamTxBench.pkts : 1;
+        CliPrintf(hCli,
+                  "Transmit (tcp %s, interval %lu us):\r\n",
+                  streamTcpZeroCopy ? "zero copy" : "copy",
+                  (uint32_t)(TS_DELTA * ONE_MICRO_SECOND));
+        CliPrintf(hCli, "\tElapsed         = %lu ms\r\n", elapsed_ms);
+        CliPrintf(hCli, "\tTx Pkts         = %lu\r\n", streamTxBench.pkts);
+        CliPrintf(hCli,
+                  "\tThroughput      = %lu kB/s\r\n",
+                  (elapsed_ms != 0) ? (uint32_t)(streamTxBench.bytes / elapsed_ms) : 0);
+        CliPrintf(hCli,
+                  "\tSend Time       = avg %lu us, max %lu us\r\n",
+                  (uint32_t)(streamTxBench.cycles / pkts / cyclesPerUs),
+                  streamTxBench.maxCycles / cyclesPerUs);
+        CliPrintf(hCli,
+                  "\tSend CPU        = %lu.%lu %%\r\n",
+                  (elapsed_ms != 0) ? (uint32_t)(streamTxBench.cycles / cyclesPerUs / elapsed_ms / 10) : 0,
+                  (elapsed_ms != 0) ? (uint32_t)(streamTxBench.cycles / cyclesPerUs / elapsed_ms % 10) : 0);
+#endif
+        for (int i = 0; i < MAX_CS_ID; i++) {
+            if (sensorBoardDataLocation[i].configBoardType == BOARDTYPE_EMPTY) {
+                continue;
+            }
+            CliPrintf(hCli, "DB %d:\r\n", i);
+            CliPrintf(hCli, "\tSent Pkts       = %lu %lu\r\n", gatherStats.db[i].sentPkts[0], gatherStats.db[i].sentPkts[1]);
+            CliPrintf(hCli, "\tMissed Data     = %lu\r\n", gatherStats.db[i].missedData);
+            CliPrintf(hCli, "\tOverwritten     = %lu\r\n", gatherStats.db[i].overWrittenData);
+            CliPrintf(hCli, "\tAlignment       = %lu\r\n", gatherStats.db[i].alignmentData);
+            CliPrintf(hCli, "\tTorn Data       = %lu\r\n", gatherStats.db[i].tornData);
+            CliPrintf(hCli, "\tPublish Retry   = %lu\r\n", gatherStats.db[i].publishRetry);
+            CliPrintf(hCli,
+                      "\tBurst           = %lu samples, %lu gaps, %lu late, %lu dups\r\n",
+                      gatherStats.db[i].burstSamples,
+                      gatherStats.db[i].burstGaps,
+                      gatherStats.db[i].burstLate,
+                      gatherStats.db[i].burstDups);
+        }
+        success = 1;
+#if GATHER_BENCH
+    } else if (argc == SUBCMD_ARG_IDX && strcmp(argv[CMD_ARG_IDX], "unpackbench") == 0) {
+        success = gatherUnpackBench(hCli);
+#endif
+    } else if (argc == SUBCMD_ARG_IDX && strcmp(argv[CMD_ARG_IDX], "clear") == 0) {
+        for (int i = 0; i < MAX_CS_ID; i++) {
+            bool statusEn = gatherStats.db[i].statusEn;
+            memset(&gatherStats.db[i], 0, sizeof(gatherStats.db[i]));
+            gatherStats.db[i].statusEn = statusEn;
+        }
+        gatherStats.sentPkts = 0;
+        gatherStats.bufferFlips = 0;
+        gatherStats.notifyTimeoutCnt = 0;
+        __disable_irq();
+        streamRing.highWater = streamRing.count;
+        streamRing.drops = 0;
+        streamRing.ackStalls = 0;
+        __enable_irq();
+#if GATHER_BENCH
+        memset(&streamTxBench, 0, sizeof(streamTxBench));
+        streamTxBench.startTick = HAL_GetTick();
+#endif
+        for (int i = 0; i < MAX_STREAM_SUBSCRIBERS; i++) {
+            streamSubs[i].sentPkts = 0;
+            streamSubs[i].drops = 0;
+        }
+        success = 1;
+    } else if (argc == SUBCMD_ARG_IDX && strcmp(argv[CMD_ARG_IDX], "sub") == 0) {
+        osMutexWait(streamSubAccess, osWaitForever);
+        for (int i = 0; i < MAX_STREAM_SUBSCRIBERS; i++) {
+            streamSub_tp p_sub = &streamSubs[i];
+            if (p_sub->type == STREAM_SUB_TCP) {
+                ip_addr_t addr;
+                uint16_t port = 0;
+                netconn_peer(p_sub->conn, &addr, &port);
+                CliPrintf(hCli, "%d: tcp %s:%u", i, ipaddr_ntoa(&addr), port);
+            } else if (p_sub->type == STREAM_SUB_UDP) {
+                CliPrintf(hCli,
+                          "%d: udp %s:%u%s",
+                          i,
+                          ipaddr_ntoa(&p_sub->addr),
+                          p_sub->port,
+                          ip_addr_ismulticast(&p_sub->addr) ? " multicast" : "");
+            } else {
+                continue;
+            }
+            CliPrintf(hCli, " sent %lu drops %lu errors %lu", p_sub->sentPkts, p_sub->drops, p_sub->sendErrs);
+            if (!streamFilterIsAll(&p_sub->filter)) {
+                CliPrintf(hCli,
+                          " boards 0x%lx types 0x%lx decimation %lu%s",
+                          p_sub->filter.cfg.boardMask,
+                          p_sub->filter.cfg.typeMask,
+                          p_sub->filter.cfg.decimation,
+                          p_sub->filter.cfg.average ? " avg" : "");
+            }
+            CliPrintf(hCli, "\r\n");
+        }
+        osMutexRelease(streamSubAccess);
+        success = 1;
+    } else if (argc == SUBCMD_ARG_IDX + 3 && strcmp(argv[CMD_ARG_IDX], "sub") == 0 &&
+               strcmp(argv[SUBCMD_ARG_IDX], "add") == 0) {
+        ip_addr_t addr;
+        uint32_t port = atoi(argv[SUBCMD_ARG_IDX + 2]);
+        if (!ipaddr_aton(argv[SUBCMD_ARG_IDX + 1], &addr) || port == 0 || port > UINT16_MAX) {
+            CliPrintf(hCli, "Invalid udp destination %s %s\r\n", argv[SUBCMD_ARG_IDX + 1], argv[SUBCMD_ARG_IDX + 2]);
+        } else if (streamSubAdd(STREAM_SUB_UDP, NULL, &addr, port) < 0) {
+            CliPrintf(hCli, "No free subscriber, max %d\r\n", MAX_STREAM_SUBSCRIBERS);
+        } else {
+            success = 1;
+        }
+    } else if (argc == SUBCMD_ARG_IDX + 2 && strcmp(argv[CMD_ARG_IDX], "sub") == 0 &&
+               strcmp(argv[SUBCMD_ARG_IDX], "del") == 0) {
+        success = (streamSubRemove(atoi(argv[SUBCMD_ARG_IDX + 1])) == RETURN_OK);
+    } else if ((argc == SUBCMD_ARG_IDX + 5 || argc == SUBCMD_ARG_IDX + 6) &&
+               strcmp(argv[CMD_ARG_IDX], "sub") == 0 && strcmp(argv[SUBCMD_ARG_IDX], "filter") == 0) {
+        uint32_t subIdx = atoi(argv[SUBCMD_ARG_IDX + 1]);
+        streamFilter_t cfg = {
+            .boardMask = strtoul(argv[SUBCMD_ARG_IDX + 2], NULL, 0),
+            .typeMask = strtoul(argv[SUBCMD_ARG_IDX + 3], NULL, 0),
+            .decimation = strtoul(argv[SUBCMD_ARG_IDX + 4], NULL, 0),
+            .average = (argc == SUBCMD_ARG_IDX + 6 && strcmp(argv[SUBCMD_ARG_IDX + 5], "avg") == 0),
+        };
+        if (subIdx < MAX_STREAM_SUBSCRIBERS) {
+            osMutexWait(streamSubAccess, osWaitForever);
+            if (streamSubs[subIdx].type != STREAM_SUB_FREE) {
+                success = (streamFilterSet(&streamSubs[subIdx].filter, &cfg) == RETURN_OK);
+            }
+            osMutexRelease(streamSubAccess);
+        }
+        if (!success) {
+            CliPrintf(hCli,
+                      "Invalid filter, decimation 1-%d, avg needs decimation <= %d\r\n",
+                      STREAM_DECIMATION_MAX,
+                      STREAM_AVG_WINDOW_MAX);
+        }
+    }
+    return success;
+}
+
 bool coilDriverBoard(uint32_t dbId) {
     assert(dbId < MAX_CS_ID);
     return (sensorBoardDataLocation[dbId].configBoardType == BOARDTYPE_IMU_COIL);
 }
 
+static inline uint32_t streamBoardOffset(uint32_t dbId) {
+    return sensorBoardDataLocation[dbId].dataLocation[STRM_PKT_0][SENSOR_0].p_uint8 -
+           streamData.streamPktData[STRM_PKT_0].dataReadings;
+}
+
+/**
+ * @fn
+ *
+ * @brief Select the boards of the filter in the current layout
+ *
+ * @param [in] p_cfg, filter settings
+ *
+ * @return bit per board selected by both the board and the type mask
+ **/
+static uint32_t streamFilterBoards(const streamFilter_t *p_cfg) {
+    uint32_t boards = 0;
+    for (int i = 0; i < MAX_CS_ID; i++) {
+        if ((p_cfg->boardMask & (1UL << i)) &&
+            (p_cfg->typeMask & (1UL << sensorBoardDataLocation[i].configBoardType))) {
+            boards |= (1UL << i);
+        }
+    }
+    return boards;
+}
+
+RETURN_CODE streamFilterSet(streamFilterState_tp p_state, const streamFilter_t *p_cfg) {
+    uint32_t boardMask = p_cfg->boardMask & STREAM_BOARDS_ALL;
+    uint32_t typeMask = p_cfg->typeMask & STREAM_TYPES_ALL;
+
+    if (boardMask == 0 || typeMask == 0 || p_cfg->decimation < 1 || p_cfg->decimation > STREAM_DECIMATION_MAX ||
+        (p_cfg->average && p_cfg->decimation > STREAM_AVG_WINDOW_MAX)) {
+        return RETURN_ERR_PARAM;
+    }
+    memset(p_state, 0, sizeof(streamFilterState_t));
+    p_state->cfg = *p_cfg;
+    p_state->cfg.boardMask = boardMask;
+    p_state->cfg.typeMask = typeMask;
+    p_state->boards = streamFilterBoards(&p_state->cfg);
+    p_state->layoutVersion = streamLayout.version;
+    return RETURN_OK;
+}
+
+__ITCMRAM__ bool streamFilterIsAll(const streamFilterState_t *p_state) {
+    return (p_state->cfg.decimation == 1 && p_state->cfg.boardMask == STREAM_BOARDS_ALL &&
+            p_state->cfg.typeMask == STREAM_TYPES_ALL);
+}
+
+/**
+ * @fn
+ *
+ * @brief Add the new ADC readings of the selected MCG and ECG boards to the filter sums
+ *
+ * @param [in,out] p_state, filter state
+ *
+ * @param [in] p_pkt, stream packet
+ **/
+__ITCMRAM__ static void streamFilterAccumulate(streamFilterState_tp p_state, const streamSensorPkt_t *p_pkt) {
+    for (int i = 0; i < MAX_CS_ID; i++) {
+        BOARDTYPE_e type = sensorBoardDataLocation[i].configBoardType;
+        if ((p_state->boards & (1UL << i)) == 0 || type == BOARDTYPE_IMU_COIL) {
+            continue;
+        }
+        // MCG readings start with the same fields as ECG readings
+        const sensorECGBoardReadings_t *p_readings =
+            (const sensorECGBoardReadings_t *)&p_pkt->dataReadings[streamBoardOffset(i)];
+        if (!NEW_DATA(p_readings->flags)) {
+            continue;
+        }
+        for (int j = 0; j < NUMBER_OF_SENSOR_READINGS; j++) {
+            const uint8_t *p_value = (const uint8_t *)&p_readings->readings[j];
+            p_state->sum[i][j] += READ_32BITSVALUE(p_value);
+        }
+        p_state->sumCnt[i]++;
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Build the frame holding the boards selected by the filter
+ *
+ * @param [in] p_pkt, stream packet as sent to the subscribers
+ *
+ * @param [in] p_state, filter state, the sums replace the ADC readings when averaging
+ *
+ * @param [out] p_frame, location to build the frame
+ *
+ * @param [in] frameSz, size of p_frame in bytes
+ *
+ * @return frame length in bytes
+ **/
+__ITCMRAM__ static size_t streamPktFilter(const void *p_pkt,
+                                          const streamFilterState_t *p_state,
+                                          uint8_t *p_frame,
+                                          size_t frameSz) {
+    const streamSensorPkt_t *p_src = (const streamSensorPkt_t *)p_pkt;
+    streamSensorPkt_tp p_dst = (streamSensorPkt_tp)p_frame;
+    uint32_t boardMask = p_state->boards;
+    size_t len = STREAM_PKT_HEADER_SIZE + sizeof(boardMask);
+    assert(frameSz >= len);
+
+    memcpy(p_dst, p_src, STREAM_PKT_HEADER_SIZE);
+    p_dst->version |= STREAM_FILTER_FLAG;
+    p_dst->mcgReadingCnt = 0;
+    p_dst->ecgReadingCnt = 0;
+    p_dst->ecg12ReadingCnt = 0;
+    p_dst->imuReadingCnt = 0;
+    memcpy(&p_frame[STREAM_PKT_HEADER_SIZE], &boardMask, sizeof(boardMask));
+
+    // keep the board order of the full packet, MCG, then ECG and ECG12, then IMU
+    for (int pass = 0; pass < 3; pass++) {
+        for (int i = 0; i < MAX_CS_ID; i++) {
+            size_t sz;
+            uint8_t *p_cnt;
+            if ((boardMask & (1UL << i)) == 0) {
+                continue;
+            }
+            switch (sensorBoardDataLocation[i].configBoardType) {
+            case BOARDTYPE_MCG:
+                if (pass != 0) {
+                    continue;
+                }
+                sz = sizeof(sensorMCGBoardReadings_t);
+                p_cnt = &p_dst->mcgReadingCnt;
+                break;
+            case BOARDTYPE_ECG:
+                if (pass != 1) {
+                    continue;
+                }
+                sz = sizeof(sensorECGBoardReadings_t);
+                p_cnt = &p_dst->ecgReadingCnt;
+                break;
+            case BOARDTYPE_12ECG:
+                if (pass != 1) {
+                    continue;
+                }
+                sz = sizeof(sensorECGBoardReadings_t);
+                p_cnt = &p_dst->ecg12ReadingCnt;
+                break;
+            case BOARDTYPE_IMU_COIL:
+                if (pass != 2) {
+                    continue;
+                }
+                sz = SENSORS_PER_BOARD * sizeof(imuReadings_t);
+                p_cnt = &p_dst->imuReadingCnt;
+                break;
+            default:
+                continue;
+            }
+            if (len + sz > frameSz) {
+                break;
+            }
+            memcpy(&p_frame[len], &p_src->dataReadings[streamBoardOffset(i)], sz);
+            if (p_state->cfg.average && pass != 2 && p_state->sumCnt[i] != 0) {
+                sensorECGBoardReadings_tp p_readings = (sensorECGBoardReadings_tp)&p_frame[len];
+                p_readings->flags |= NEW_DATA_FLAG;
+                for (int j = 0; j < NUMBER_OF_SENSOR_READINGS; j++) {
+                    uint8_t *p_value = (uint8_t *)&p_readings->readings[j];
+                    int32_t mean = p_state->sum[i][j] / p_state->sumCnt[i];
+                    WRITE_32BITVALUE(p_value, mean);
+                }
+            }
+            len += sz;
+            (*p_cnt)++;
+        }
+    }
+    p_dst->payloadLen = len;
+    return len;
+}
+
+__ITCMRAM__ size_t streamFilterPkt(streamFilterState_tp p_state, const void *p_pkt, uint8_t *p_frame, size_t frameSz) {
+    uint8_t layoutVersion = ((const streamSensorPkt_t *)p_pkt)->layoutVersion;
+    if (layoutVersion != p_state->layoutVersion) {
+        // a board may now have another type, select the boards again and restart the sums
+        p_state->boards = streamFilterBoards(&p_state->cfg);
+        memset(p_state->sum, 0, sizeof(p_state->sum));
+        memset(p_state->sumCnt, 0, sizeof(p_state->sumCnt));
+        p_state->layoutVersion = layoutVersion;
+    }
+    if (p_state->cfg.average) {
+        streamFilterAccumulate(p_state, (const streamSensorPkt_t *)p_pkt);
+    }
+    if (++p_state->skipCnt < p_state->cfg.decimation) {
+        return 0;
+    }
+    p_state->skipCnt = 0;
+
+    size_t len = streamPktFilter(p_pkt, p_state, p_frame, frameSz);
+    if (p_state->cfg.average) {
+        memset(p_state->sum, 0, sizeof(p_state->sum));
+        memset(p_state->sumCnt, 0, sizeof(p_state->sumCnt));
+    }
+    return len;
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wstrict-aliasing"
 void printStreamData(CLI *hCli, int dbId) {
@@ -1622,7 +3859,7 @@ uint32_t printStreamDataToBuffer(char *buf, uint32_t bufSz, uint32_t dbId) {
 void testSensorFill(bool quatImuType) {
     dbCommThreadInfo_t threadInfo;
     static uint32_t fill = 0x00;
-    uint32_t readings[SENSORS_PER_BOARD][MAX_ADC_READING];
+    rx_dbNopPayload_t readings;
     imuReadings_t imuReadings;
     for (int sbId = 0; sbId < MAX_CS_ID; sbId++) {
         threadInfo.daughterBoardId = sbId;
@@ -1632,13 +3869,15 @@ void testSensorFill(bool quatImuType) {
         case BOARDTYPE_ECG:
             // fall through
         case BOARDTYPE_12ECG:
+            memset(&readings, 0, sizeof(readings));
             for (int sensor = SENSOR_0; sensor <= SENSOR_1; sensor++) {
-                readings[sensor][0] = sbId;
+                WRITE_XBITVALUE(((uint8_t *)&readings.adc[sensor * MAX_ADC_READING]), sbId);
                 for (int read = 1; read < MAX_ADC_READING; read++) {
-                    readings[sensor][read] = fill++;
+                    WRITE_XBITVALUE(((uint8_t *)&readings.adc[sensor * MAX_ADC_READING + read]), fill);
+                    fill++;
                 }
             }
-            updateSensorData(&threadInfo, (uint8_t *)&readings[0][0], sizeof(readings));
+            updateSensorData(&threadInfo, (uint8_t *)&readings, sizeof(readings));
             break;
         case BOARDTYPE_IMU_COIL:
             for (int sensor = SENSOR_0; sensor <= SENSOR_1; sensor++) {
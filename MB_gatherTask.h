@@ -11,6 +11,7 @@
 
 #include "ctrlSpiCommTask.h"
 #include "json.h"
+#include "registerParams.h"
 #include "saqTarget.h"
 #include <lwip/api.h>
 #include <lwip/inet.h>
@@ -18,6 +19,34 @@
 #include <lwip/sys.h>
 #include <stdbool.h>
 
+#define MAX_ETHERNET_SIZE_BYTES 1500 // Max size before fragmentation
+#define UDP_IP_HEADER_SIZE_BYTES 28  // IPv4 + UDP header
+#define MAX_STREAM_FRAME_SIZE_BYTES (MAX_ETHERNET_SIZE_BYTES - UDP_IP_HEADER_SIZE_BYTES)
+
+#define STREAM_BOARDS_ALL ((1UL << MAX_CS_ID) - 1)
+#define STREAM_TYPES_ALL                                                                                               \
+    ((1UL << BOARDTYPE_MCG) | (1UL << BOARDTYPE_ECG) | (1UL << BOARDTYPE_12ECG) | (1UL << BOARDTYPE_IMU_COIL))
+#define STREAM_DECIMATION_MAX 10000
+#define STREAM_AVG_WINDOW_MAX 64 // int32 sums of 24 bit readings cannot overflow
+
+// Selection of the stream data sent to one subscriber
+typedef struct {
+    uint32_t boardMask;  // bit n selects sensor board slot n
+    uint32_t typeMask;   // bit BOARDTYPE_x selects the boards of that type
+    uint32_t decimation; // one frame per decimation stream packets
+    bool average;        // ADC readings are the mean over the decimation window instead of the last sample
+} streamFilter_t, *streamFilter_tp;
+
+// Running state of a subscriber filter
+typedef struct {
+    streamFilter_t cfg;
+    uint32_t boards; // boards selected by cfg and present in the configuration
+    uint32_t skipCnt;
+    int32_t sum[MAX_CS_ID][NUMBER_OF_SENSOR_READINGS];
+    uint16_t sumCnt[MAX_CS_ID];
+    uint8_t layoutVersion; // layoutVersion the boards were selected with and the sums started in
+} streamFilterState_t, *streamFilterState_tp;
+
 #define macro_IPTYPE(T)                                                                                                \
     T(IPTYPE_UDP)                                                                                                      \
     T(IPTYPE_TCP)                                                                                                      \
@@ -30,6 +59,20 @@ extern const char *IPTYPE_e_Strings[];
 #endif
 GENERATE_ENUM_LIST(macro_IPTYPE, IPTYPE_e)
 #undef macro_IPTYPE
+
+// What steers the wall clock offset of the stream time stamps
+#define macro_STREAM_CLOCK_SRC(T)                                                                                      \
+    T(STREAM_CLOCK_FREE)                                                                                               \
+    T(STREAM_CLOCK_RTC)                                                                                                \
+    T(STREAM_CLOCK_NET)
+
+#ifdef GENERATE_STREAM_CLOCK_SRC_STRING_NAMES
+GENERATE_ENUM_STRING_NAMES(macro_STREAM_CLOCK_SRC, STREAM_CLOCK_SRC_e)
+#else
+extern const char *STREAM_CLOCK_SRC_e_Strings[];
+#endif
+GENERATE_ENUM_LIST(macro_STREAM_CLOCK_SRC, STREAM_CLOCK_SRC_e)
+#undef macro_STREAM_CLOCK_SRC
 /**
  * @fn
  *
@@ -44,13 +87,82 @@ GENERATE_ENUM_LIST(macro_IPTYPE, IPTYPE_e)
  **/
 void mbGatherTaskInit(int priority, int stackSize);
 
+/**
+ * @fn
+ *
+ * @brief Initialize the stream transmit task
+ *
+ * This task drains the stream ring filled by the gather task to the udp or tcp
+ * server, so a slow send no longer delays the gathering of the next sample.
+ * @note must be called after mbGatherTaskInit()
+ *
+ * @param[in] priority: Set the task priority
+ *
+ * @param[in] stackSize: set the stask size for the task.
+ **/
+void mbStreamTxTaskInit(int priority, int stackSize);
+
+/**
+ * @fn
+ *
+ * @brief Capture the TIM_UDP_TX_SIGNAL update edge time and wake the gather task
+ *
+ * @note must be called from the TIM_UDP_TX_SIGNAL period elapsed interrupt in place
+ *       of notifying mbGatherTaskHandle directly.
+ **/
+void mbGatherTriggerFromISR(void);
+
+/**
+ * @fn
+ *
+ * @brief Read the monotonic stream timebase
+ *
+ * The DWT cycle counter extended to 64 bits, its wraps are counted with the ms tick so it
+ * does not need to be read periodically. It never steps with RTC changes.
+ * Safe to call from an interrupt.
+ *
+ * @return microseconds since mbGatherTaskInit()
+ **/
+uint64_t streamTimeUs(void);
+
+/**
+ * @fn
+ *
+ * @brief Convert a monotonic stream time to wall clock time
+ *
+ * @param[in] mono_us: time returned by streamTimeUs()
+ *
+ * @return microseconds since epoch, with the offset steered by the RTC or the network time sync
+ **/
+int64_t streamWallTimeUs(uint64_t mono_us);
+
+/**
+ * @fn
+ *
+ * @brief Steer the stream wall clock from the network time sync
+ *
+ * The RTC no longer steers the clock once this is called, until streamClockRelease().
+ *
+ * @param[in] step_us: offset correction applied now, 0 to only change the rate
+ *
+ * @param[in] ratePpb: offset change rate, limited to +-500000 ppb
+ **/
+void streamClockSteer(int64_t step_us, int32_t ratePpb);
+
+/**
+ * @fn
+ *
+ * @brief Hand the stream wall clock back to the RTC
+ **/
+void streamClockRelease(void);
+
 /**
  * @fn
  *
  * @brief Initialize the thread that waits for connections to the TCP Server
  *
- * This task is responsible for waiting for connections and updating the
- * global connection value. It only allows one connection at a time.
+ * This task is responsible for waiting for connections and adding each one
+ * to the stream subscriber table. Connections beyond the table size are closed.
  *
  * @param[in] priority: Set the task priority
  *
@@ -81,6 +193,20 @@ void updateUdpConnection(struct netconn *p_conn);
  **/
 void updateSensorData(dbCommThreadInfo_tp p_threadInfo, uint8_t *sensorReadings, size_t sensorReadingSz);
 
+/**
+ * @fn
+ *
+ * @brief Store the samples of a burst response, each in the stream packet of the interval it was converted in
+ *
+ * @note a sample older than the packets still held back by the gather task is dropped,
+ *       see setSpiBurstCnt().
+ *
+ * @param[in] p_threadInfo: Daughter board process info
+ * @param[in] sensorReadings: rx_dbBurstPayload_t
+ * @param[in] sensorReadingSz: payload size in bytes
+ **/
+void updateSensorBurst(dbCommThreadInfo_tp p_threadInfo, uint8_t *sensorReadings, size_t sensorReadingSz);
+
 /**
  * @fn
  *
@@ -104,6 +230,101 @@ void setDaughterboardState(int boardId, bool enable);
  **/
 void setUdpSendInterval(uint32_t interval_ms);
 
+/**
+ * @fn
+ *
+ * @brief Set the number of stream samples packed into each datagram
+ *
+ * @note the count is reduced at run time so a frame never exceeds the MTU, a frame that
+ *       is not full is sent once its first sample waited STREAM_BATCH_FLUSH_MS.
+ *
+ * @param[in] batchCnt: samples per datagram, 1 disables batching
+ *
+ * @return RETURN_OK or RETURN_ERR_PARAM if batchCnt is out of range
+ **/
+RETURN_CODE setStreamBatchCnt(uint32_t batchCnt);
+
+/**
+ * @fn
+ *
+ * @brief Set the number of stream ring slots
+ *
+ * @note the new depth is applied once the ring is empty.
+ *
+ * @param[in] depth: number of slots, 2 to 8
+ *
+ * @return RETURN_OK or RETURN_ERR_PARAM if depth is out of range
+ **/
+RETURN_CODE setStreamRingDepth(uint32_t depth);
+
+/**
+ * @fn
+ *
+ * @brief Set the number of ADC samples an ADC board queues and sends per SPI transaction
+ *
+ * @note the boards already verified are negotiated again by the board status task, see
+ *       discoverSensorBoards(), the register write does not wait for it. The stream is sent
+ *       burstCnt - 1 intervals late so the samples of a burst reach their own packet, the ring
+ *       depth must be at least burstCnt + 1 for that. DB_SPI_INTERVAL_US is expected to be
+ *       burstCnt times STREAM_INTERVAL_US.
+ *
+ * @param[in] burstCnt: samples per burst, 1 to SPI_BURST_SAMPLES_MAX
+ *
+ * @return RETURN_OK or RETURN_ERR_PARAM if burstCnt is out of range
+ **/
+RETURN_CODE setSpiBurstCnt(uint32_t burstCnt);
+
+/**
+ * @fn
+ *
+ * @brief Set the number of CNC commands sent to a sensor board before its responses are received
+ *
+ * @note the boards already verified are negotiated again by the board status task, see
+ *       discoverSensorBoards(), the register write does not wait for it. A board that
+ *       rejects SB_CNC_WINDOW is sent one command at a time.
+ *
+ * @param[in] window: commands in flight, 1 to DB_CNC_WINDOW_MAX
+ *
+ * @return RETURN_OK or RETURN_ERR_PARAM if window is out of range
+ **/
+RETURN_CODE setDbCncWindow(uint32_t window);
+
+/**
+ * @fn
+ *
+ * @brief Select how stream packets are handed to the TCP connection
+ *
+ * @note with zero copy a stream ring slot is not reused until the client
+ *       acknowledged it, so a slow client fills the ring instead of lwIP's pbuf pool.
+ *       A client that leaves a slot unacknowledged for STREAM_ACK_WAIT_MAX_MS, a delayed
+ *       ACK, is sent copies for the rest of its connection.
+ *
+ * @param[in] enable: true to send the ring slots with NETCONN_NOCOPY, false to copy them
+ **/
+void setStreamTcpZeroCopy(bool enable);
+
+/**
+ * @fn
+ *
+ * @brief Read the largest number of stream ring slots waiting to be sent
+ *
+ * @param[out] regInfo: u.dataUint is set to the high water mark
+ *
+ * @return RETURN_OK
+ **/
+RETURN_CODE streamRingHighWaterRead(const registerInfo_tp regInfo);
+
+/**
+ * @fn
+ *
+ * @brief Read the number of stream samples dropped because the ring was full
+ *
+ * @param[out] regInfo: u.dataUint is set to the drop count
+ *
+ * @return RETURN_OK
+ **/
+RETURN_CODE streamRingDropsRead(const registerInfo_tp regInfo);
+
 /**
  * @fn
  *
@@ -126,15 +347,34 @@ void printStreamData(CLI *hCli, int dbId);
  **/
 void testSensorFill(bool quadImuType);
 
+#define SENSOR_DISCOVERY_POLL_MS 10 // board status poll period while the boards are discovered
+
+/**
+ * @fn
+ *
+ * @brief Verify the configured boards that answered since the last call
+ *
+ * Called by the board status task. The boards answering for the first time have their type read
+ * at once and are verified, the matching boards are ready. Until every configured board answered
+ * the silent ones are enabled again every SENSOR_DISCOVERY_PROBE_MS. The configuration error is
+ * raised when a configured board is not ready after SENSOR_DISCOVERY_TIMEOUT_MS, a board answering
+ * later is still verified when it comes up. The settings written since, SPI_BURST_CNT and
+ * DB_CNC_WINDOW, are negotiated again with the matching boards.
+ *
+ * @return true while the boot discovery is running and should be polled every SENSOR_DISCOVERY_POLL_MS
+ **/
+bool discoverSensorBoards(void);
+
 /**
  * @fn
  *
- * @brief Test the Stored configuration against the installed boards.
+ * @brief Read the time from boot to the first stream packet
  *
- * @return True if all slots match installed boards else false.
+ * @param[out] regInfo: u.dataUint is set to the msec, 0 until the first packet is sent
  *
+ * @return RETURN_OK
  **/
-bool verifySensorConfiguration(void);
+RETURN_CODE bootFirstPacketRead(const registerInfo_tp regInfo);
 
 /**
  * @fn
@@ -160,8 +400,9 @@ void jsonDetailConfigurationError(json_object *jsonArray);
  * @fn
  *
  * @brief add configuration settings to json array for the destination
- * @note these are the run time settings and do not reflect any changes made
- *       to the registers that are only read on boot.
+ * @note these are the run time settings, they follow alterConfigSettings() but not
+ *       other changes made to the registers that are only read on boot. LAYOUT_PENDING is
+ *       true while a change of the board waits for the gather task to apply the new layout.
  *
  * @param destination, 0-23, -1 (all) location to read the data from, if -1 is sent then
  * all configuration slots are read
@@ -174,19 +415,27 @@ void jsonAddConfigSettings(int destination, json_object *jsonResponse);
  * @fn
  *
  * @brief update the underlying configuration register with the new board type
- * @note this change only takes affect after rebooting
+ * @note the stream layout is changed without a reboot. The boards changing type stop sending
+ *       until the gather task applies the new layout, once the stream ring is empty, then they
+ *       are verified again. The other boards keep streaming, they lose the sample being filled.
+ *       The layoutVersion of the stream header is bumped.
  *
  * @param destination, 0-23, -1 (all) location to read the data from, if -1 is sent then
  * all configuration slots are read
  * @param boardType, slot to update.
  *
+ * @return RETURN_OK once the registers are written, the new layout is applied later by the
+ *         gather task, see LAYOUT_PENDING of jsonAddConfigSettings(). RETURN_ERR_PARAM when too
+ *         many IMU boards, RETURN_ERR_STATE when a previous change is still pending.
  **/
-void alterConfigSettings(int destination, BOARDTYPE_e boardType);
+RETURN_CODE alterConfigSettings(int destination, BOARDTYPE_e boardType);
 
 /**
  * @fn
  *
  * @brief add configuration status information to jsonArray
+ * @note the status is answered from the board status cache, AGE_MS is the time since it
+ *       was read from the board.
  *
  * @param [in] destination, 0-23, -1 (all) location to read the data from, if -1 is sent then
  * all configuration slots are read
@@ -220,6 +469,51 @@ bool coilDriverBoard(uint32_t dbId);
  **/
 uint32_t printStreamDataToBuffer(char *buf, uint32_t bufSz, uint32_t dbId);
 
+/**
+ * @fn
+ *
+ * @brief Set a subscriber filter and restart its decimation window
+ *
+ * @param [out] p_state, filter state to initialize
+ *
+ * @param [in] p_cfg, boards, types, decimation 1-10000 and averaging, which needs decimation <= 64
+ *
+ * @return RETURN_OK or RETURN_ERR_PARAM if p_cfg is out of range, p_state is unchanged
+ **/
+RETURN_CODE streamFilterSet(streamFilterState_tp p_state, const streamFilter_t *p_cfg);
+
+/**
+ * @fn
+ *
+ * @brief return true if the filter passes every stream packet unchanged
+ *
+ * @param [in] p_state, filter state
+ **/
+bool streamFilterIsAll(const streamFilterState_t *p_state);
+
+/**
+ * @fn
+ *
+ * @brief Feed one stream packet to a subscriber filter
+ *
+ * Counts the packet against the decimation window, adds it to the averages when enabled
+ * and builds a frame once the window is complete. The frame is the stream header with
+ * STREAM_FILTER_FLAG (0x40) set in the version, the reading counts of the selected
+ * boards and payloadLen of the frame, followed by the uint32_t board mask and the
+ * readings of the selected boards in packet order.
+ *
+ * @param [in,out] p_state, filter state
+ *
+ * @param [in] p_pkt, stream packet as sent to the subscribers
+ *
+ * @param [out] p_frame, location to build the frame
+ *
+ * @param [in] frameSz, size of p_frame in bytes
+ *
+ * @return frame length in bytes, 0 if no frame is due for this packet
+ **/
+size_t streamFilterPkt(streamFilterState_tp p_state, const void *p_pkt, uint8_t *p_frame, size_t frameSz);
+
 /**
  * @fn
  *
@@ -13,6 +13,7 @@
 #include "MB_cncHandleMsg.h"
 #include "MB_gatherTask.h"
 #include "ctrlSpiCommTask.h"
+#include "dbCommTask.h"
 #include "ddsTrigTask.h"
 #include "debugPrint.h"
 #include "peripherals/MB_handleDAC.h"
@@ -31,7 +32,6 @@
 #define DAC_VALUE_NOT_PRESENT (-1)
 
 extern const strLUT_t peripheralLUT[PER_MAX];
-extern __DTCMRAM__ dbCommThreadInfo_t dbCommThreads[MAX_CS_ID];
 
 typedef struct {
     const char *ddsType;
@@ -282,64 +282,57 @@ static void handleCncCommon(webResponse_tp p_webResponse,
     json_object *jsonResult = NULL;
 
     char buf[CNC_BUF_SZ_BYTES];
-    uint32_t minDest = 0;
-    uint32_t maxDest = 0;
 
-    if (destination == DESTINATION_ALL) {
-        minDest = 0;
-        maxDest = MAX_CS_ID;
-    } else {
-        minDest = destination;
-        maxDest = destination + 1;
+    DPRINTF_CMD_STREAM_VERBOSE("%s, command = %d destination = %d, peripheral =%s addr = %d, value = %d\r\n",
+                               (cncCmd == SPICMD_CNC) ? "SPICMD_CNC" : "SPICMD_CNC_SHORT",
+                               commandEnum,
+                               destination,
+                               PERIPHERAL_e_Strings[commandEnum],
+                               address,
+                               value);
+    // the enabled boards are all sent the command before the first response is waited for
+    printSpi = true;
+    cncFanOut_tp p_fanOut = cncFanOut(
+        destination, cncCmd, (cncPayload_tp)&cncPayload, xinfo, sensorBoardEnabled, TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
+    printSpi = false;
+    if (p_fanOut == NULL) {
+        json_object_put(jsonValuesArray);
+        cncFanOutNoMemory(p_webResponse);
+        return;
     }
 
-    for (int i = minDest; i < maxDest; i++) {
-        if (dbCommThreads[i].dbCommState.enabled == true) {
-            DPRINTF_CMD_STREAM_VERBOSE("%s, command = %d destination = %d, peripheral =%s addr = %d, value = %d\r\n",
-                                       (cncCmd == SPICMD_CNC) ? "SPICMD_CNC" : "SPICMD_CNC_SHORT",
-                                       commandEnum,
-                                       destination,
-                                       PERIPHERAL_e_Strings[commandEnum],
-                                       address,
-                                       value);
-            printSpi = true;
-            webCncCbId.cmdResponse = UNKNOWN_COMMAND;
-            cncSendMsg(i, cncCmd, (cncPayload_tp)&cncPayload, xinfo, webCncRequestCB, (uint32_t)&webCncCbId);
-            uint32_t startTick = HAL_GetTick();
-            uint32_t osResult = ulTaskNotifyTake(true, TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
-
-            if (osResult == TASK_NOTIFY_OK) {
-                 uint16_t result = (cncCmd==SPICMD_CNC) ? webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result : webCncCbId.cmdResponse;
-                 if (result == NO_ERROR) {
-                     uint8_t dac = DAC_VALUE_NOT_PRESENT;
-                     if(dacValuePresent) {
-                         dac = (cncCmd==SPICMD_CNC) ?
-                               webCncCbId.p_payload->cmd.cncMsgPayloadHeader.addr - baseDacOffsetValue :
-                               address - baseDacOffsetValue;
-                     }
-
-                    if (cncCmd != SPICMD_CNC) {
-                        webCncCbId.p_payload->cmd.value = value;
-                    }
-                    DPRINTF_CMD_STREAM_VERBOSE("Value received: %d\r\n", webCncCbId.p_payload->cmd.value);
-                    ddsRequestHelper(
-                        p_webResponse, jsonValuesArray, i, peripheral, dac, webCncCbId, returnField, coilBoard);
-
-                } else {
-                    uint32_t delta = HAL_GetTick() - startTick;
-                     snprintf(buf, sizeof(buf), "cnc error: board %d did not respond in time, delta %lu msec result=%ld", i, delta, webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result);
-                     jsonResult = json_object_new_string(buf);
-                 }
-             } else {
-                 // Must not reach here. THe CNC task must timeout first as this task is transient
-                 assert(false);
-             }
-             printSpi = false;
-         }
-     }
-     json_object_object_add_ex(p_webResponse->jsonResponse, "values", jsonValuesArray, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    for (uint32_t i = 0; i < p_fanOut->cnt; i++) {
+        cncFanOutBoard_tp p_board = &p_fanOut->board[i];
+        webCncCbId = p_board->webCncCbId;
+        if (cncFanOutResult(p_board) == NO_ERROR) {
+            uint8_t dac = DAC_VALUE_NOT_PRESENT;
+            if (dacValuePresent) {
+                dac = (cncCmd == SPICMD_CNC) ? webCncCbId.p_payload->cmd.cncMsgPayloadHeader.addr - baseDacOffsetValue
+                                             : address - baseDacOffsetValue;
+            }
+
+            if (cncCmd != SPICMD_CNC) {
+                webCncCbId.p_payload->cmd.value = value;
+            }
+            DPRINTF_CMD_STREAM_VERBOSE("Value received: %d\r\n", webCncCbId.p_payload->cmd.value);
+            ddsRequestHelper(p_webResponse,
+                             jsonValuesArray,
+                             p_board->destination,
+                             peripheral,
+                             dac,
+                             webCncCbId,
+                             returnField,
+                             coilBoard);
+        } else {
+            snprintf(buf, sizeof(buf), "cnc error: board %d did not respond in time, delta %lu msec result=%ld", p_board->destination, p_board->elapsedMs, webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result);
+            jsonResult = json_object_new_string(buf);
+        }
+    }
+    json_object_object_add_ex(p_webResponse->jsonResponse, "values", jsonValuesArray, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    cncFanOutErrors(p_webResponse, p_fanOut);
 
     CHECK_ERRORS
+    cncFanOutFree(p_fanOut);
 }
 
 static void handleCncGenericRequest(webResponse_tp p_webResponse,
@@ -205,46 +205,40 @@ void handleCncRequest(webResponse_tp p_webResponse,
     json_object *jsonValuesArray = json_object_new_array();
     json_object *jsonResult = NULL;
     char buf[JSON_STR_BUFFER_SZ_BYTES];
-    uint32_t minDest = 0;
-    uint32_t maxDest = 0;
-
-    if (destination == DESTINATION_ALL) {
-        minDest = 0;
-        maxDest = MAX_CS_ID;
-    } else {
-        minDest = destination;
-        maxDest = destination + 1;
+
+    // the present boards are all sent the command before the first response is waited for
+    cncFanOut_tp p_fanOut = cncFanOut(
+        destination, SPICMD_CNC, (cncPayload_tp)&cncPayload, xinfo, sensorBoardPresent, TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
+    if (p_fanOut == NULL) {
+        json_object_put(jsonValuesArray);
+        cncFanOutNoMemory(p_webResponse);
+        return;
+    }
+    if (destination != DESTINATION_ALL && p_fanOut->cnt == 0) {
+        // board not present
+        cncFanOutFree(p_fanOut);
+        json_object_put(jsonValuesArray);
+        json_object *jsonResult = json_object_new_string("error");
+        p_webResponse->httpCode = HTTP_ERROR_PRECONDITION_FAILED;
+        json_object *jsonDetail = json_object_new_string("Board is disabled or missing");
+        json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object_object_add_ex(p_webResponse->jsonResponse, "detail", jsonDetail, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        return;
     }
 
-    for (int i = minDest; i < maxDest; i++) {
-        if (sensorBoardPresent(i) == true) {
-            uint32_t startTick = HAL_GetTick();
-            cncSendMsg(i, SPICMD_CNC, (cncPayload_tp)&cncPayload, xinfo, webCncRequestCB, (uint32_t)&webCncCbId);
-            uint32_t osResult = ulTaskNotifyTake(true, TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
-
-            if (osResult == TASK_NOTIFY_OK) {
-                if (webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result == 0) {
-                    dacRequestHelper(jsonValuesArray, i, slot, webCncCbId);
-                } else {
-                    uint32_t delta = HAL_GetTick() - startTick;
-                    snprintf(buf, sizeof(buf), "cnc error %s: board %d did not respond in time, delta %lu msec result=%ld",__FUNCTION__, i, delta, webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result);
-                    jsonResult = json_object_new_string(buf);
-                }
-            } else {
-                // Must not reach here. THe CNC task must timeout first as this task is transient
-                assert(false);
-            }
-        } else if (maxDest - minDest == 1) {
-            // board not present
-            json_object *jsonResult = json_object_new_string("error");
-            p_webResponse->httpCode = HTTP_ERROR_PRECONDITION_FAILED;
-            json_object *jsonDetail = json_object_new_string("Board is disabled or missing");
-            json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
-            json_object_object_add_ex(p_webResponse->jsonResponse, "detail", jsonDetail, JSON_C_OBJECT_KEY_IS_CONSTANT);
-            return;
+    for (uint32_t i = 0; i < p_fanOut->cnt; i++) {
+        cncFanOutBoard_tp p_board = &p_fanOut->board[i];
+        webCncCbId = p_board->webCncCbId;
+        if (cncFanOutResult(p_board) == 0) {
+            dacRequestHelper(jsonValuesArray, p_board->destination, slot, webCncCbId);
+        } else {
+            snprintf(buf, sizeof(buf), "cnc error %s: board %d did not respond in time, delta %lu msec result=%ld",__FUNCTION__, p_board->destination, p_board->elapsedMs, webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result);
+            jsonResult = json_object_new_string(buf);
         }
     }
     json_object_object_add_ex(p_webResponse->jsonResponse, "values", jsonValuesArray, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    cncFanOutErrors(p_webResponse, p_fanOut);
 
     CHECK_ERRORS
+    cncFanOutFree(p_fanOut);
 }
@@ -9,6 +9,7 @@
 #include "peripherals/MB_handleIMU.h"
 #include "MB_cncHandleMsg.h"
 #include "ctrlSpiCommTask.h"
+#include "dbCommTask.h"
 #include "ddsTrigTask.h"
 #include "debugPrint.h"
 #include "perseioTrace.h"
@@ -18,7 +19,6 @@
 #include <string.h>
 
 extern const strLUT_t peripheralLUT[PER_MAX];
-extern __DTCMRAM__ dbCommThreadInfo_t dbCommThreads[MAX_CS_ID];
 
 #define ERRORBUFFER_SZ 70
 
@@ -110,45 +110,41 @@ void handleCncIMUCmd(webResponse_tp p_webResponse,
     json_object *jsonValuesArray = json_object_new_array();
     json_object *jsonResult = NULL;
     char buf[ERRORBUFFER_SZ];
-    uint32_t minDest = 0;
-    uint32_t maxDest = 0;
-
-    if (destination == DESTINATION_ALL) {
-        minDest = 0;
-        maxDest = MAX_CS_ID;
-    } else {
-        minDest = destination;
-        maxDest = destination + 1;
+
+    xTracePrintF(imuMsg,
+                 "handleCncImuCmd dest=%d, peripheral=%d, action=%d cmdStr=%s",
+                 destination,
+                 peripheral,
+                 commandEnum,
+                 cncMsgPayload.str);
+    // the enabled boards are all sent the command before the first response is waited for
+    cncFanOut_tp p_fanOut = cncFanOut(destination,
+                                      SPICMD_CNC,
+                                      (cncPayload_tp)&cncMsgPayload,
+                                      xinfo,
+                                      sensorBoardEnabled,
+                                      TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
+    if (p_fanOut == NULL) {
+        json_object_put(jsonValuesArray);
+        cncFanOutNoMemory(p_webResponse);
+        return;
     }
-    for (int i = minDest; i < maxDest; i++) {
-        if (dbCommThreads[i].dbCommState.enabled == true) {
-            xTracePrintF(imuMsg,
-                         "handleCncImuCmd dest=%d, peripheral=%d, action=%d cmdStr=%s",
-                         i,
-                         peripheral,
-                         commandEnum,
-                         cncMsgPayload.str);
-            cncSendMsg(i, SPICMD_CNC, (cncPayload_tp)&cncMsgPayload, xinfo, webCncRequestCB, (uint32_t)&webCncCbId);
-            uint32_t osResult = ulTaskNotifyTake(true, TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
-            uint32_t startTick = HAL_GetTick();
-            if (osResult == TASK_NOTIFY_OK) {
-                xTracePrintF(imuMsg,"handleCncImuCmd result=%d",i,peripheral, commandEnum, webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result);
-                if (webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result == 0) {
-
-                    imuRequestHelper(p_webResponse, jsonValuesArray, i, webCncCbId, IMU_CMD_RESPONSE_KEY);
-                } else {
-                    uint32_t delta = HAL_GetTick() - startTick;
-                    snprintf(buf, sizeof(buf), "cnc error: board %d did not respond in time, delta %lu msec result=%ld", i, delta, webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result);
-                    jsonResult = json_object_new_string(buf);
-                }
-            } else {
-                // Must not reach here. THe CNC task must timeout first as this task is transient
-                assert(false);
-            }
+
+    for (uint32_t i = 0; i < p_fanOut->cnt; i++) {
+        cncFanOutBoard_tp p_board = &p_fanOut->board[i];
+        webCncCbId = p_board->webCncCbId;
+        xTracePrintF(imuMsg, "handleCncImuCmd dest=%d result=%d", p_board->destination, cncFanOutResult(p_board));
+        if (cncFanOutResult(p_board) == 0) {
+            imuRequestHelper(p_webResponse, jsonValuesArray, p_board->destination, webCncCbId, IMU_CMD_RESPONSE_KEY);
+        } else {
+            snprintf(buf, sizeof(buf), "cnc error: board %d did not respond in time, delta %lu msec result=%ld", p_board->destination, p_board->elapsedMs, webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result);
+            jsonResult = json_object_new_string(buf);
         }
     }
 
     json_object_object_add_ex(p_webResponse->jsonResponse, "values", jsonValuesArray, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    cncFanOutErrors(p_webResponse, p_fanOut);
 
     CHECK_ERRORS
+    cncFanOutFree(p_fanOut);
 }
@@ -197,59 +197,53 @@ static void handleCncRequest(webResponse_tp p_webResponse,
         json_object_object_add_ex(p_webResponse->jsonResponse, "detail", jsonError, JSON_C_OBJECT_KEY_IS_CONSTANT);
         return;
     }
-    webCncCbId_t webCncCbIdCmd = {.taskHandle = xTaskGetCurrentTaskHandle(), .p_payload = NULL, .xInfo = 0};
-
     json_object *jsonResult = NULL;
     uint32_t onResult = 0;
-    uint32_t minDest = 0;
-    uint32_t maxDest = 0;
 
     if (destination == MAIN_BOARD_ID) {
         return handleCNCLocalLED(p_webResponse, periEnum, commandEnum, led, onState, xinfo);
     }
 
-    if (destination == DESTINATION_ALL) {
-        minDest = 0;
-        maxDest = MAX_CS_ID;
-    } else {
-        minDest = destination;
-        maxDest = destination + 1;
+    // the present boards are all sent the command before the first response is waited for
+    cncFanOut_tp p_fanOut = cncFanOut(destination,
+                                      SPICMD_CNC,
+                                      (cncPayload_tp)&cncPayloadCmd,
+                                      xinfo,
+                                      sensorBoardPresent,
+                                      TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
+    if (p_fanOut == NULL) {
+        cncFanOutNoMemory(p_webResponse);
+        return;
     }
+    if ((destination != DESTINATION_ALL) && (p_fanOut->cnt == 0)) {
+        // board not present
+        cncFanOutFree(p_fanOut);
+        json_object *jsonResult = json_object_new_string("error");
+        p_webResponse->httpCode = HTTP_ERROR_PRECONDITION_FAILED;
+        json_object *jsonDetail = json_object_new_string("Board is disabled or missing");
+        json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object_object_add_ex(p_webResponse->jsonResponse, "detail", jsonDetail, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        return;
+    }
+
     json_object *jsonValuesArray = json_object_new_array();
-    for (int i = minDest; i < maxDest; i++) {
-        if (sensorBoardPresent(i) == true) {
-            cncSendMsg(i, SPICMD_CNC, (cncPayload_tp)&cncPayloadCmd, xinfo, webCncRequestCB, (uint32_t)&webCncCbIdCmd);
-            uint32_t startTick = HAL_GetTick();
-            uint32_t osResultCmd = ulTaskNotifyTake(true, TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
-            uint32_t cncResult = webCncCbIdCmd.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result;
-            uint32_t onState = webCncCbIdCmd.p_payload->cmd.value;
-            onResult = webCncCbIdCmd.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result;
-
-            if (osResultCmd == TASK_NOTIFY_OK) {
-                if (cncResult == 0) {
-                    ledRequestHelper(p_webResponse, jsonValuesArray, i, led, onState);
-                } else {
-                    uint32_t delta = HAL_GetTick() - startTick;
-                    snprintf(buf, sizeof(buf), "cnc error: board %d did not respond in time, delta %lu msec result=%ld", i, delta, webCncCbIdCmd.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result);
-                    jsonResult = json_object_new_string(buf);
-                }
-            } else {
-                // Must not reach here. THe CNC task must timeout first as this task is transient
-                assert(false);
-            }
-
-        } else if (maxDest - minDest == 1) {
-            // board not present
-            json_object *jsonResult = json_object_new_string("error");
-            p_webResponse->httpCode = HTTP_ERROR_PRECONDITION_FAILED;
-            json_object *jsonDetail = json_object_new_string("Board is disabled or missing");
-            json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
-            json_object_object_add_ex(p_webResponse->jsonResponse, "detail", jsonDetail, JSON_C_OBJECT_KEY_IS_CONSTANT);
-            return;
+    for (uint32_t i = 0; i < p_fanOut->cnt; i++) {
+        cncFanOutBoard_tp p_board = &p_fanOut->board[i];
+        uint32_t cncResult = cncFanOutResult(p_board);
+        uint32_t onState = p_board->webCncCbId.p_payload->cmd.value;
+        onResult = cncResult;
+
+        if (cncResult == 0) {
+            ledRequestHelper(p_webResponse, jsonValuesArray, p_board->destination, led, onState);
+        } else {
+            snprintf(buf, sizeof(buf), "cnc error: board %d did not respond in time, delta %lu msec result=%ld", p_board->destination, p_board->elapsedMs, cncResult);
+            jsonResult = json_object_new_string(buf);
         }
     }
 
     json_object_object_add_ex(p_webResponse->jsonResponse, "values", jsonValuesArray, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    cncFanOutErrors(p_webResponse, p_fanOut);
+    cncFanOutFree(p_fanOut);
 
     if (jsonResult != NULL) {
         p_webResponse->httpCode = HTTP_ERROR_BAD_REQUEST;
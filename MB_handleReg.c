@@ -501,6 +501,14 @@ void regRequestHelperStr(webResponse_tp p_webResponse,
     json_object_array_add(jsonValuesArray, next);
 }
 
+static void regBoardNotPresent(webResponse_tp p_webResponse) {
+    json_object *jsonResult = json_object_new_string("error");
+    p_webResponse->httpCode = HTTP_ERROR_PRECONDITION_FAILED;
+    json_object *jsonDetail = json_object_new_string("Board is disabled or missing");
+    json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    json_object_object_add_ex(p_webResponse->jsonResponse, "detail", jsonDetail, JSON_C_OBJECT_KEY_IS_CONSTANT);
+}
+
 void handleCncRequest(webResponse_tp p_webResponse,
                       int destination,
                       CNC_ACTION_e commandEnum,
@@ -513,52 +521,44 @@ void handleCncRequest(webResponse_tp p_webResponse,
 
     webCncCbId_t webCncCbId = {.taskHandle = xTaskGetCurrentTaskHandle(), .p_payload = NULL, .xInfo = 0};
 
-    json_object *jsonValuesArray = json_object_new_array();
     json_object *jsonResult = NULL;
     char buf[HTTP_RESPONSE_BUFFER_SIZE_BYTES];
-    uint32_t minDest = 0;
-    uint32_t maxDest = 0;
 
-    if (destination == DESTINATION_ALL) {
-        minDest = 0;
-        maxDest = MAX_CS_ID;
-    } else {
-        minDest = destination;
-        maxDest = destination + 1;
+    // the present boards are all sent the command before the first response is waited for
+    cncFanOut_tp p_fanOut = cncFanOut(destination,
+                                      SPICMD_CNC,
+                                      (cncPayload_tp)&cncPayload,
+                                      uid,
+                                      sensorBoardPresent,
+                                      TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
+    if (p_fanOut == NULL) {
+        cncFanOutNoMemory(p_webResponse);
+        return;
+    }
+    // if there is only one board being accessed and it is not available, fail the request.
+    if ((destination != DESTINATION_ALL) && (p_fanOut->cnt == 0)) {
+        cncFanOutFree(p_fanOut);
+        regBoardNotPresent(p_webResponse);
+        return;
     }
 
-    for (int i = minDest; i < maxDest; i++) {
-        if (sensorBoardPresent(i) == true) {
-            cncSendMsg(i, SPICMD_CNC, (cncPayload_tp)&cncPayload, uid, webCncRequestCB, (uint32_t)&webCncCbId);
-            uint32_t startTick = HAL_GetTick();
-            uint32_t osResult = ulTaskNotifyTake(true, TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
-
-            if (osResult == TASK_NOTIFY_OK) {
-                if (webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result == 0) {
-                    regRequestHelper(p_webResponse, jsonValuesArray, i, webCncCbId, valueName);
-                } else {
-                    uint32_t delta = HAL_GetTick() - startTick;
-                    snprintf(buf, sizeof(buf), "cnc error: board %d did not respond in time, delta %lu msec result=%ld", i, delta, webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result);
-                }
-            } else {
-                // Should never reach this. The CommThread must time out and respond with an error because
-                // this code is called from a transient thread.
-                assert(false);
-            }
-            // if there is only one board being accessed and it is not available, fail the request.
-        } else if ((maxDest - minDest) == 1) {
-            // board not present
-            json_object *jsonResult = json_object_new_string("error");
-            p_webResponse->httpCode = HTTP_ERROR_PRECONDITION_FAILED;
-            json_object *jsonDetail = json_object_new_string("Board is disabled or missing");
-            json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
-            json_object_object_add_ex(p_webResponse->jsonResponse, "detail", jsonDetail, JSON_C_OBJECT_KEY_IS_CONSTANT);
-            return;
+    json_object *jsonValuesArray = json_object_new_array();
+    for (uint32_t i = 0; i < p_fanOut->cnt; i++) {
+        cncFanOutBoard_tp p_board = &p_fanOut->board[i];
+        webCncCbId = p_board->webCncCbId;
+        if (cncFanOutResult(p_board) == 0) {
+            regRequestHelper(p_webResponse, jsonValuesArray, p_board->destination, webCncCbId, valueName);
         }
     }
     json_object_object_add_ex(p_webResponse->jsonResponse, "values", jsonValuesArray, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    cncFanOutErrors(p_webResponse, p_fanOut);
 
     CHECK_ERRORS
+    cncFanOutFree(p_fanOut);
+}
+
+static bool regStrBoardSelect(int destination) {
+    return (destination == MAIN_BOARD_ID) || sensorBoardPresent(destination);
 }
 
 void handleCncRequestStr(webResponse_tp p_webResponse,
@@ -569,8 +569,6 @@ void handleCncRequestStr(webResponse_tp p_webResponse,
                          uint32_t uid,
                          const char *valueName) {
     char buf[HTTP_RESPONSE_BUFFER_SIZE_BYTES];
-    uint32_t minDest = 0;
-    uint32_t maxDest = 0;
 
     cncMsgPayload_t cncPayload = {.cncMsgPayloadHeader.peripheral = PER_MCU, .cncMsgPayloadHeader.action = commandEnum, .cncMsgPayloadHeader.addr = addr, .cncMsgPayloadHeader.cncActionData.result = 0xFF};
     if ((commandEnum == CNC_ACTION_WRITE) && (strlen(str) > (sizeof(cncPayload.str) - sizeof('\0')))) {
@@ -591,51 +589,44 @@ void handleCncRequestStr(webResponse_tp p_webResponse,
 
     webCncCbId_t webCncCbId = {.taskHandle = xTaskGetCurrentTaskHandle(), .p_payload = NULL, .xInfo = 0};
 
-    json_object *jsonValuesArray = json_object_new_array();
     json_object *jsonResult = NULL;
 
-    if (destination == DESTINATION_ALL) {
-        minDest = 0;
-        maxDest = MAX_CS_ID;
-    } else {
-        minDest = destination;
-        maxDest = destination + 1;
+    // the main board and the present sensor boards are all sent the command before the first response is waited for
+    cncFanOut_tp p_fanOut = cncFanOut(destination,
+                                      SPICMD_CNC,
+                                      (cncPayload_tp)&cncPayload,
+                                      uid,
+                                      regStrBoardSelect,
+                                      TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
+    if (p_fanOut == NULL) {
+        cncFanOutNoMemory(p_webResponse);
+        return;
+    }
+    // if there is only one board being accessed and it is not available, fail the request.
+    if ((destination != DESTINATION_ALL) && (p_fanOut->cnt == 0)) {
+        cncFanOutFree(p_fanOut);
+        regBoardNotPresent(p_webResponse);
+        return;
     }
 
-    for (int i = minDest; i < maxDest; i++) {
-        if ((i == MAIN_BOARD_ID) || (sensorBoardPresent(i) == true)) {
-            cncSendMsg(i, SPICMD_CNC, (cncPayload_tp)&cncPayload, uid, webCncRequestCB, (uint32_t)&webCncCbId);
-            uint32_t startTick = HAL_GetTick();
-            uint32_t osResult = ulTaskNotifyTake(true, TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
-            DPRINTF_CMD_STREAM(
-                "%s %d i=%d web payload=%s\r\n", __FUNCTION__, __LINE__, i, (char *)(&webCncCbId.p_payload->cmd.str));
-            DPRINTF_CMD_STREAM("%s %d i=%d cnc payload=%s\r\n", __FUNCTION__, __LINE__, i, (cncPayload.str));
-            if (osResult == TASK_NOTIFY_OK) {
-                if (webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result == 0) {
-                    regRequestHelperStr(p_webResponse, jsonValuesArray, i, webCncCbId, valueName);
-                } else {
-                    uint32_t delta = HAL_GetTick() - startTick;
-                    snprintf(buf, sizeof(buf), "cnc error: board %d did not respond in time, delta %lu msec result=%ld", i, delta, webCncCbId.p_payload->cmd.cncMsgPayloadHeader.cncActionData.result);
-                }
-            } else {
-                // Should never reach this. The CommThread must time out and respond with an error because
-                // this code is called from a transient thread.
-                assert(false);
-            }
-            // if there is only one board being accessed and it is not available, fail the request.
-        } else if ((maxDest - minDest) == 1) {
-            // board not present
-            json_object *jsonResult = json_object_new_string("error");
-            p_webResponse->httpCode = HTTP_ERROR_PRECONDITION_FAILED;
-            json_object *jsonDetail = json_object_new_string("Board is disabled or missing");
-            json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
-            json_object_object_add_ex(p_webResponse->jsonResponse, "detail", jsonDetail, JSON_C_OBJECT_KEY_IS_CONSTANT);
-            return;
+    json_object *jsonValuesArray = json_object_new_array();
+    for (uint32_t i = 0; i < p_fanOut->cnt; i++) {
+        cncFanOutBoard_tp p_board = &p_fanOut->board[i];
+        webCncCbId = p_board->webCncCbId;
+        DPRINTF_CMD_STREAM("%s %d i=%d web payload=%s\r\n",
+                           __FUNCTION__,
+                           __LINE__,
+                           p_board->destination,
+                           (char *)(&webCncCbId.p_payload->cmd.str));
+        if (cncFanOutResult(p_board) == 0) {
+            regRequestHelperStr(p_webResponse, jsonValuesArray, p_board->destination, webCncCbId, valueName);
         }
     }
     json_object_object_add_ex(p_webResponse->jsonResponse, "values", jsonValuesArray, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    cncFanOutErrors(p_webResponse, p_fanOut);
 
     CHECK_ERRORS
+    cncFanOutFree(p_fanOut);
 }
 
 osStatus handleCncRequestStrJson(json_object *jsonResponse,
@@ -413,7 +413,7 @@ osStatus ads1298WriteRegister(uint8_t addr, uint8_t numRegisters, const uint8_t
  *
  * @return osStatus
  **/
-osStatus ads1298ReadData(adc24Reading_t adcData[NUMBER_OF_SENSOR_READINGS], uint32_t *statusReg);
+osStatus ads1298ReadData(adcSpiReading_t adcData[NUMBER_OF_SENSOR_READINGS], uint32_t *statusReg);
 
 /**
  * @fn ads1298SendCmd
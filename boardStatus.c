@@ -0,0 +1,201 @@
+/*
+ * boardStatus.c
+ *
+ * Cache of the sensor board status, refreshed in the background
+ *
+ *  Copyright Nuvation Research Corporation 2018-2024. All Rights Reserved.
+ *      Author: rlegault
+ */
+
+#include "boardStatus.h"
+#include "MB_cncHandleMsg.h"
+#include "MB_gatherTask.h"
+#include "cmsis_os.h"
+#include "ctrlSpiCommTask.h"
+#include "dbCommTask.h"
+#include "debugPrint.h"
+#include "mongooseHandler.h"
+#include "registerParams.h"
+#include "stmTarget.h"
+#include "taskWatchdog.h"
+#include "watchDog.h"
+
+#include <string.h>
+
+extern __DTCMRAM__ dbCommThreadInfo_t dbCommThreads[MAX_CS_ID];
+
+static boardStatus_t boardStatusCache[MAX_CS_ID];
+static osMutexId boardStatusAccess = NULL; // cache, poller and status requests
+osMutexDef(boardStatusAccess);
+
+// registers read by a refresh, one fan-out each
+static const uint32_t boardStatusRegs[] = {
+    SB_HW_TYPE,
+    SB_SERIAL_NUMBER,
+    SB_PERIPHERAL_FAIL_MASK,
+    SB_FW_VERSION_MAJ,
+    SB_FW_VERSION_MIN,
+    SB_FW_VERSION_MAINT,
+    SB_FW_VERSION_BUILD,
+};
+
+/**
+ * @fn
+ *
+ * @brief Store the register read from each board of a fan-out
+ *
+ * @param[in] p_fanOut: results
+ * @param[in] addr: register read
+ **/
+static void boardStatusStore(cncFanOut_tp p_fanOut, uint32_t addr) {
+    osMutexWait(boardStatusAccess, osWaitForever);
+    for (uint32_t i = 0; i < p_fanOut->cnt; i++) {
+        cncFanOutBoard_tp p_board = &p_fanOut->board[i];
+        boardStatus_tp p_status = &boardStatusCache[p_board->destination];
+        cncMsgPayload_tp p_payload = &p_board->webCncCbId.p_payload->cmd;
+        bool valid = (cncFanOutResult(p_board) == 0);
+
+        switch (addr) {
+        case SB_HW_TYPE:
+            p_status->hwTypeValid = valid;
+            p_status->hwType = valid ? p_payload->value : BOARDTYPE_UNKNOWN;
+            break;
+        case SB_SERIAL_NUMBER:
+            p_status->serialValid = valid;
+            if (valid) {
+                strlcpy(p_status->serial, p_payload->str, sizeof(p_status->serial));
+            }
+            break;
+        case SB_PERIPHERAL_FAIL_MASK:
+            p_status->failMaskValid = valid;
+            p_status->peripheralFailMask = valid ? p_payload->value : 0;
+            break;
+        default:
+            // the version is valid when all of its parts were read, the major part is read first
+            p_status->fwVersionValid = valid && ((addr == SB_FW_VERSION_MAJ) || p_status->fwVersionValid);
+            p_status->fwVersion[addr - SB_FW_VERSION_MAJ] = valid ? p_payload->value : 0;
+            break;
+        }
+    }
+    osMutexRelease(boardStatusAccess);
+}
+
+void boardStatusRefresh(int destination) {
+    uint32_t minDest = 0;
+    uint32_t maxDest = 0;
+
+    if (destination == DESTINATION_ALL) {
+        minDest = 0;
+        maxDest = MAX_CS_ID;
+    } else {
+        minDest = destination;
+        maxDest = destination + 1;
+    }
+
+    for (uint32_t r = 0; r < sizeof(boardStatusRegs) / sizeof(boardStatusRegs[0]); r++) {
+        cncMsgPayload_t cncPayload = {.cncMsgPayloadHeader.peripheral = PER_MCU,
+                                      .cncMsgPayloadHeader.action = CNC_ACTION_READ,
+                                      .cncMsgPayloadHeader.addr = boardStatusRegs[r],
+                                      .cncMsgPayloadHeader.cncActionData.result = 0xFF};
+        cncFanOut_tp p_fanOut = cncFanOut(destination,
+                                          SPICMD_CNC,
+                                          (cncPayload_tp)&cncPayload,
+                                          0,
+                                          sensorBoardPresent,
+                                          TRANSIENT_TASK_NOTIFY_TIMEOUT_MS);
+        // kicks boardStatusThread() between the reads, a refresh run by another task kicks nothing
+        watchdogKickFromCurrentTask();
+        if (p_fanOut == NULL) {
+            DPRINTF_ERROR("%s no memory to read register %d\r\n", __FUNCTION__, boardStatusRegs[r]);
+            continue;
+        }
+        boardStatusStore(p_fanOut, boardStatusRegs[r]);
+        cncFanOutFree(p_fanOut);
+    }
+
+    osMutexWait(boardStatusAccess, osWaitForever);
+    for (uint32_t i = minDest; i < maxDest; i++) {
+        boardStatus_tp p_status = &boardStatusCache[i];
+        dbCommState_tp p_state = &dbCommThreads[i].dbCommState;
+
+        p_status->present = sensorBoardPresent(i);
+        if (!p_status->present) {
+            p_status->hwTypeValid = false;
+            p_status->hwType = BOARDTYPE_UNKNOWN;
+            p_status->serialValid = false;
+            p_status->failMaskValid = false;
+            p_status->fwVersionValid = false;
+        }
+        p_status->link.rxDataCnt = p_state->rxDataCnt;
+        p_status->link.rxCmdsCnt = p_state->rxCmdsCnt;
+        p_status->link.crcErrors = p_state->crcErrors;
+        p_status->link.resendCNCCnt = p_state->resendCNCCnt;
+        p_status->link.lostCNCCnt = p_state->lostCNCCnt;
+        p_status->link.enabledCnt = p_state->enabledCnt;
+        p_status->refreshTick = HAL_GetTick();
+        p_status->refreshed = true;
+    }
+    osMutexRelease(boardStatusAccess);
+}
+
+bool boardStatusGet(uint32_t boardIdx, boardStatus_tp p_status) {
+    assert(boardIdx < MAX_CS_ID);
+    osMutexWait(boardStatusAccess, osWaitForever);
+    memcpy(p_status, &boardStatusCache[boardIdx], sizeof(boardStatus_t));
+    osMutexRelease(boardStatusAccess);
+    return p_status->refreshed;
+}
+
+uint32_t boardStatusAgeMs(const boardStatus_t *p_status) {
+    if (!p_status->refreshed) {
+        return BOARD_STATUS_NEVER;
+    }
+    return HAL_GetTick() - p_status->refreshTick;
+}
+
+/**
+ * @fn
+ *
+ * @brief Refresh one board per poll, the boards in turn
+ *
+ * A board that went away is refreshed once more so the cache records it as missing.
+ * The sensor boards are discovered here, see discoverSensorBoards(), polled every
+ * SENSOR_DISCOVERY_POLL_MS during the boot discovery.
+ *
+ * @param[in] arg: unused
+ **/
+static void boardStatusThread(const void *arg) {
+    uint32_t next = 0;
+    DPRINTF_INFO("Board status task starting\r\n");
+
+    watchdogAssignToCurrentTask(WDT_TASK_BOARDSTATUS);
+    watchdogSetTaskEnabled(WDT_TASK_BOARDSTATUS, 1);
+
+    while (1) {
+        watchdogKickFromTask(WDT_TASK_BOARDSTATUS);
+        if (discoverSensorBoards()) {
+            osDelay(SENSOR_DISCOVERY_POLL_MS);
+            continue;
+        }
+        osDelay(BOARD_STATUS_POLL_MS);
+
+        for (uint32_t n = 0; n < MAX_CS_ID; n++) {
+            uint32_t boardIdx = (next + n) % MAX_CS_ID;
+            if (sensorBoardPresent(boardIdx) || boardStatusCache[boardIdx].present) {
+                boardStatusRefresh(boardIdx);
+                next = boardIdx + 1;
+                break;
+            }
+        }
+    }
+}
+
+void boardStatusTaskInit(int priority, int stackSize) {
+    memset(boardStatusCache, 0, sizeof(boardStatusCache));
+    boardStatusAccess = osMutexCreate(osMutex(boardStatusAccess));
+    assert(boardStatusAccess != NULL);
+
+    osThreadDef(boardStatusTask, boardStatusThread, priority, 0, stackSize);
+    osThreadId thread = osThreadCreate(osThread(boardStatusTask), NULL);
+    assert(thread != NULL);
+}
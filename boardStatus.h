@@ -0,0 +1,95 @@
+/*
+ * boardStatus.h
+ *
+ * Cache of the sensor board status, refreshed in the background
+ *
+ *  Copyright Nuvation Research Corporation 2018-2024. All Rights Reserved.
+ *      Author: rlegault
+ */
+
+#ifndef APP_INC_BOARDSTATUS_H_
+#define APP_INC_BOARDSTATUS_H_
+
+#include "cmdAndCtrl.h"
+#include "saqTarget.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BOARD_STATUS_POLL_MS 500         // one board is refreshed per poll, the boards in turn
+#define BOARD_STATUS_NEVER UINT32_MAX    // age of an entry never refreshed
+#define BOARD_STATUS_FW_VERSION_PARTS 4  // major, minor, maintenance, build
+
+// SPI link counters of a board, copied from its dbComm task at the refresh
+typedef struct {
+    uint32_t rxDataCnt;
+    uint32_t rxCmdsCnt;
+    uint32_t crcErrors;
+    uint32_t resendCNCCnt;
+    uint32_t lostCNCCnt;
+    uint32_t enabledCnt;
+} boardLinkStats_t;
+
+// Status of a sensor board, the values are only meaningful when their valid flag is set
+typedef struct {
+    uint32_t refreshTick; // HAL tick of the last refresh
+    bool refreshed;       // refreshed at least once
+    bool present;         // sensorBoardPresent() at the refresh
+    bool hwTypeValid;
+    bool serialValid;
+    bool failMaskValid;
+    bool fwVersionValid;
+    uint32_t hwType; // SB_HW_TYPE, BOARDTYPE_UNKNOWN when not read
+    uint32_t peripheralFailMask;
+    uint32_t fwVersion[BOARD_STATUS_FW_VERSION_PARTS];
+    char serial[CNC_MSG_PAYLOAD_STR_SZ];
+    boardLinkStats_t link;
+} boardStatus_t, *boardStatus_tp;
+
+/**
+ * @fn
+ *
+ * @brief Create the task that keeps the board status cache fresh
+ *
+ * The cache must exist before the gather task starts the boot discovery of the sensor boards,
+ * which this task then runs, see discoverSensorBoards().
+ *
+ * @param[in] priority: task priority
+ * @param[in] stackSize: task stack size in words
+ **/
+void boardStatusTaskInit(int priority, int stackSize);
+
+/**
+ * @fn
+ *
+ * @brief Read the status of the boards again
+ *
+ * Each register is read from all the present boards at once, see cncFanOut().
+ *
+ * @param[in] destination: 0-23, or DESTINATION_ALL
+ **/
+void boardStatusRefresh(int destination);
+
+/**
+ * @fn
+ *
+ * @brief Copy the cached status of a board
+ *
+ * @param[in] boardIdx: sensor board
+ * @param[out] p_status: status
+ *
+ * @return true if the board was refreshed at least once
+ **/
+bool boardStatusGet(uint32_t boardIdx, boardStatus_tp p_status);
+
+/**
+ * @fn
+ *
+ * @brief Time since a status was refreshed
+ *
+ * @param[in] p_status: status copied by boardStatusGet()
+ *
+ * @return msec, BOARD_STATUS_NEVER when never refreshed
+ **/
+uint32_t boardStatusAgeMs(const boardStatus_t *p_status);
+
+#endif /* APP_INC_BOARDSTATUS_H_ */
@@ -7,6 +7,7 @@
  */
 
 #include "MB_gatherTask.h"
+#include "boardStatus.h"
 #include "ctrlSpiCommTask.h"
 #include "dbCommTask.h"
 #include "dbTriggerTask.h"
@@ -14,6 +15,8 @@
 #include "pwm.h"
 #include "pwmPinConfig.h"
 #include "realTimeClock.h"
+#include "timeSync.h"
+#include "webBatch.h"
 
 #define LED_BLINK_FREQ 1.0
 #define LED_BLINK_DUTY 50
@@ -40,7 +43,19 @@ void initBoardTasks(void) {
     initMongoose(osPriorityLow, MONGOOSE_STACK_WORDS); // Command and control by user
     osDelay(INIT_DELAYS);
 
-    mbGatherTaskInit(osPriorityRealtime, MBGATHER_STACK_WORDS); // send sensor information to server
+    webBatchTaskInit(osPriorityLow, WEBBATCH_STACK_WORDS); // run the asynchronous /batch requests
+    osDelay(INIT_DELAYS);
+
+    boardStatusTaskInit(osPriorityLow, BOARDSTATUS_STACK_WORDS); // keep the sensor board status cache fresh
+    osDelay(INIT_DELAYS);
+
+    mbGatherTaskInit(osPriorityRealtime, MBGATHER_STACK_WORDS); // gather sensor information into the stream ring
+    osDelay(INIT_DELAYS);
+
+    mbStreamTxTaskInit(osPriorityAboveNormal, STREAMTX_STACK_WORDS); // send sensor information to server
+    osDelay(INIT_DELAYS);
+
+    timeSyncTaskInit(osPriorityAboveNormal, TIMESYNC_STACK_WORDS); // discipline the stream clock to a time server
     osDelay(INIT_DELAYS);
 
     pwmStart(LED_GREEN);
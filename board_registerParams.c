@@ -13,6 +13,7 @@
 #include "pwm.h"
 #include "raiseIssue.h"
 #include "registerParams.h"
+#include "timeSync.h"
 #include "version.h"
 
 #define LED_PWM_ALWAYS_ON 100
@@ -41,6 +42,127 @@ RETURN_CODE streamIntervalWrite(const registerInfo_tp regInfo);
  **/
 RETURN_CODE dbSpiInterval(const registerInfo_tp regInfo);
 
+/**
+ * @fn streamBatchCntWrite
+ *
+ * @brief Set the number of stream samples packed in each datagram
+ *
+ * @param[in] regInfo contains the desired sample count
+ *
+ * @return RETURN_OK on success, RETURN_ERR_PARAM if out of range
+ **/
+RETURN_CODE streamBatchCntWrite(const registerInfo_tp regInfo);
+
+/**
+ * @fn streamRingDepthWrite
+ *
+ * @brief Set the number of stream ring slots, applied once the ring is empty
+ *
+ * @param[in] regInfo contains the desired depth
+ *
+ * @return RETURN_OK on success, RETURN_ERR_PARAM if out of range
+ **/
+RETURN_CODE streamRingDepthWrite(const registerInfo_tp regInfo);
+
+/**
+ * @fn streamTcpZeroCopyWrite
+ *
+ * @brief Select copy (0) or zero copy (1) transmit of the TCP stream
+ *
+ * @param[in] regInfo contains the desired mode
+ *
+ * @return RETURN_OK on success
+ **/
+RETURN_CODE streamTcpZeroCopyWrite(const registerInfo_tp regInfo);
+
+/**
+ * @fn timeSyncServerWrite
+ *
+ * @brief Set the time server address, 0 stops the network time sync
+ *
+ * @param[in] regInfo contains the IPv4 address in network byte order
+ *
+ * @return RETURN_OK on success
+ **/
+RETURN_CODE timeSyncServerWrite(const registerInfo_tp regInfo);
+
+/**
+ * @fn timeSyncServerPortWrite
+ *
+ * @brief Set the time server port, 123 polls with NTP
+ *
+ * @param[in] regInfo contains the udp port
+ *
+ * @return RETURN_OK on success, RETURN_ERR_PARAM if out of range
+ **/
+RETURN_CODE timeSyncServerPortWrite(const registerInfo_tp regInfo);
+
+/**
+ * @fn timeSyncIntervalWrite
+ *
+ * @brief Set the seconds between time server polls
+ *
+ * @param[in] regInfo contains the interval
+ *
+ * @return RETURN_OK on success, RETURN_ERR_PARAM if out of range
+ **/
+RETURN_CODE timeSyncIntervalWrite(const registerInfo_tp regInfo);
+
+/**
+ * @fn timeSyncPtpPortWrite
+ *
+ * @brief Set the port answering two-way time exchange requests
+ *
+ * @param[in] regInfo contains the udp port, 0 stops answering
+ *
+ * @return RETURN_OK on success, RETURN_ERR_PARAM if out of range
+ **/
+RETURN_CODE timeSyncPtpPortWrite(const registerInfo_tp regInfo);
+
+/**
+ * @fn spiLargeBufferShareWrite
+ *
+ * @brief Set the percent of spi bus time given to large buffer reads
+ *
+ * @param[in] regInfo contains the percent
+ *
+ * @return RETURN_OK on success, RETURN_ERR_PARAM if out of range
+ **/
+RETURN_CODE spiLargeBufferShareWrite(const registerInfo_tp regInfo);
+
+/**
+ * @fn spiBurstCntWrite
+ *
+ * @brief Set the number of ADC samples pulled from an ADC board per transaction
+ *
+ * @param[in] regInfo contains the sample count
+ *
+ * @return RETURN_OK on success, RETURN_ERR_PARAM if out of range
+ **/
+RETURN_CODE spiBurstCntWrite(const registerInfo_tp regInfo);
+
+/**
+ * @fn spiCrcTargetPpmWrite
+ *
+ * @brief Set the crc error rate the spi busses are kept under
+ *
+ * @param[in] regInfo contains the errors per million transfers
+ *
+ * @return RETURN_OK on success, RETURN_ERR_PARAM if out of range
+ **/
+RETURN_CODE spiCrcTargetPpmWrite(const registerInfo_tp regInfo);
+
+/**
+ * @fn dbCncWindowWrite
+ *
+ * @brief Set the number of CNC commands sent to a sensor board before its responses
+ *
+ * @param[in] regInfo contains the window size
+ *
+ * @return RETURN_OK on success, RETURN_ERR_PARAM if out of range
+ **/
+RETURN_CODE dbCncWindowWrite(const registerInfo_tp regInfo);
+
 /**
  * @fn greenLedStateChange
  *
@@ -204,6 +326,128 @@ paramStorage_t paramStorage =
                                    .readPtr = mapPeriperalError,
                                    .writePtr = noWriteFn},
          EEPROM_PARAM_ELEMENT(FAN_POP, DATA_UINT, sizeof(uint32_t)),
+         [STREAM_BATCH_CNT] = {.info = {.mbId = STREAM_BATCH_CNT,
+                                        .type = DATA_UINT,
+                                        .size = sizeof(uint32_t),
+                                        .u.dataUint = VALUE_STREAM_BATCH_CNT},
+                               .name = "STREAM_BATCH_CNT",
+                               .writePtr = streamBatchCntWrite},
+         [STREAM_RING_DEPTH] = {.info = {.mbId = STREAM_RING_DEPTH,
+                                         .type = DATA_UINT,
+                                         .size = sizeof(uint32_t),
+                                         .u.dataUint = VALUE_STREAM_RING_DEPTH},
+                                .name = "STREAM_RING_DEPTH",
+                                .writePtr = streamRingDepthWrite},
+         [STREAM_RING_HIGH_WATER] = {.info = {.mbId = STREAM_RING_HIGH_WATER, .type = DATA_UINT, .u.dataUint = 0},
+                                     .name = "STREAM_RING_HIGH_WATER",
+                                     .readPtr = streamRingHighWaterRead,
+                                     .writePtr = noWriteFn},
+         [STREAM_RING_DROPS] = {.info = {.mbId = STREAM_RING_DROPS, .type = DATA_UINT, .u.dataUint = 0},
+                                .name = "STREAM_RING_DROPS",
+                                .readPtr = streamRingDropsRead,
+                                .writePtr = noWriteFn},
+         [STREAM_TCP_ZERO_COPY] = {.info = {.mbId = STREAM_TCP_ZERO_COPY,
+                                            .type = DATA_UINT,
+                                            .size = sizeof(uint32_t),
+                                            .u.dataUint = VALUE_STREAM_TCP_ZERO_COPY},
+                                   .name = "STREAM_TCP_ZERO_COPY",
+                                   .writePtr = streamTcpZeroCopyWrite},
+         [TIME_SYNC_SERVER] = {.info = {.mbId = TIME_SYNC_SERVER,
+                                        .type = DATA_UINT,
+                                        .size = sizeof(uint32_t),
+                                        .u.dataUint = VALUE_TIME_SYNC_SERVER},
+                               .name = "TIME_SYNC_SERVER",
+                               .writePtr = timeSyncServerWrite},
+         [TIME_SYNC_SERVER_PORT] = {.info = {.mbId = TIME_SYNC_SERVER_PORT,
+                                             .type = DATA_UINT,
+                                             .size = sizeof(uint32_t),
+                                             .u.dataUint = VALUE_TIME_SYNC_SERVER_PORT},
+                                    .name = "TIME_SYNC_SERVER_PORT",
+                                    .writePtr = timeSyncServerPortWrite},
+         [TIME_SYNC_INTERVAL_S] = {.info = {.mbId = TIME_SYNC_INTERVAL_S,
+                                            .type = DATA_UINT,
+                                            .size = sizeof(uint32_t),
+                                            .u.dataUint = VALUE_TIME_SYNC_INTERVAL_S},
+                                   .name = "TIME_SYNC_INTERVAL_S",
+                                   .writePtr = timeSyncIntervalWrite},
+         [TIME_SYNC_PTP_PORT] = {.info = {.mbId = TIME_SYNC_PTP_PORT,
+                                          .type = DATA_UINT,
+                                          .size = sizeof(uint32_t),
+                                          .u.dataUint = VALUE_TIME_SYNC_PTP_PORT},
+                                 .name = "TIME_SYNC_PTP_PORT",
+                                 .writePtr = timeSyncPtpPortWrite},
+         [TIME_SYNC_STATE] = {.info = {.mbId = TIME_SYNC_STATE, .type = DATA_UINT, .u.dataUint = 0},
+                              .name = "TIME_SYNC_STATE",
+                              .readPtr = timeSyncStateRead,
+                              .writePtr = noWriteFn},
+         [TIME_SYNC_OFFSET_US] = {.info = {.mbId = TIME_SYNC_OFFSET_US, .type = DATA_INT, .u.dataInt = 0},
+                                  .name = "TIME_SYNC_OFFSET_US",
+                                  .readPtr = timeSyncOffsetRead,
+                                  .writePtr = noWriteFn},
+         [TIME_SYNC_JITTER_US] = {.info = {.mbId = TIME_SYNC_JITTER_US, .type = DATA_UINT, .u.dataUint = 0},
+                                  .name = "TIME_SYNC_JITTER_US",
+                                  .readPtr = timeSyncJitterRead,
+                                  .writePtr = noWriteFn},
+         [TIME_SYNC_DRIFT_PPB] = {.info = {.mbId = TIME_SYNC_DRIFT_PPB, .type = DATA_INT, .u.dataInt = 0},
+                                  .name = "TIME_SYNC_DRIFT_PPB",
+                                  .readPtr = timeSyncDriftRead,
+                                  .writePtr = noWriteFn},
+         [SPI_LARGE_BUFFER_SHARE] = {.info = {.mbId = SPI_LARGE_BUFFER_SHARE,
+                                              .type = DATA_UINT,
+                                              .size = sizeof(uint32_t),
+                                              .u.dataUint = VALUE_SPI_LARGE_BUFFER_SHARE},
+                                     .name = "SPI_LARGE_BUFFER_SHARE",
+                                     .writePtr = spiLargeBufferShareWrite},
+         [SPI_BURST_CNT] = {.info = {.mbId = SPI_BURST_CNT,
+                                     .type = DATA_UINT,
+                                     .size = sizeof(uint32_t),
+                                     .u.dataUint = VALUE_SPI_BURST_CNT},
+                            .name = "SPI_BURST_CNT",
+                            .writePtr = spiBurstCntWrite},
+         [SPI_CRC_TARGET_PPM] = {.info = {.mbId = SPI_CRC_TARGET_PPM,
+                                          .type = DATA_UINT,
+                                          .size = sizeof(uint32_t),
+                                          .u.dataUint = VALUE_SPI_CRC_TARGET_PPM},
+                                 .name = "SPI_CRC_TARGET_PPM",
+                                 .writePtr = spiCrcTargetPpmWrite},
+         [SPI1_CLOCK_KHZ] = {.info = {.mbId = SPI1_CLOCK_KHZ, .type = DATA_UINT, .u.dataUint = 0},
+                             .name = "SPI1_CLOCK_KHZ",
+                             .readPtr = spiLinkRead,
+                             .writePtr = noWriteFn},
+         [SPI2_CLOCK_KHZ] = {.info = {.mbId = SPI2_CLOCK_KHZ, .type = DATA_UINT, .u.dataUint = 0},
+                             .name = "SPI2_CLOCK_KHZ",
+                             .readPtr = spiLinkRead,
+                             .writePtr = noWriteFn},
+         [SPI3_CLOCK_KHZ] = {.info = {.mbId = SPI3_CLOCK_KHZ, .type = DATA_UINT, .u.dataUint = 0},
+                             .name = "SPI3_CLOCK_KHZ",
+                             .readPtr = spiLinkRead,
+                             .writePtr = noWriteFn},
+         [SPI1_RESEND_BUDGET] = {.info = {.mbId = SPI1_RESEND_BUDGET, .type = DATA_UINT, .u.dataUint = 0},
+                                 .name = "SPI1_RESEND_BUDGET",
+                                 .readPtr = spiLinkRead,
+                                 .writePtr = noWriteFn},
+         [SPI2_RESEND_BUDGET] = {.info = {.mbId = SPI2_RESEND_BUDGET, .type = DATA_UINT, .u.dataUint = 0},
+                                 .name = "SPI2_RESEND_BUDGET",
+                                 .readPtr = spiLinkRead,
+                                 .writePtr = noWriteFn},
+         [SPI3_RESEND_BUDGET] = {.info = {.mbId = SPI3_RESEND_BUDGET, .type = DATA_UINT, .u.dataUint = 0},
+                                 .name = "SPI3_RESEND_BUDGET",
+                                 .readPtr = spiLinkRead,
+                                 .writePtr = noWriteFn},
+         [SPI_LINK_ADJUSTS] = {.info = {.mbId = SPI_LINK_ADJUSTS, .type = DATA_UINT, .u.dataUint = 0},
+                               .name = "SPI_LINK_ADJUSTS",
+                               .readPtr = spiLinkRead,
+                               .writePtr = noWriteFn},
+         [DB_CNC_WINDOW] = {.info = {.mbId = DB_CNC_WINDOW,
+                                     .type = DATA_UINT,
+                                     .size = sizeof(uint32_t),
+                                     .u.dataUint = VALUE_DB_CNC_WINDOW},
+                            .name = "DB_CNC_WINDOW",
+                            .writePtr = dbCncWindowWrite},
+         [BOOT_FIRST_PACKET_MS] = {.info = {.mbId = BOOT_FIRST_PACKET_MS, .type = DATA_UINT, .u.dataUint = 0},
+                                   .name = "BOOT_FIRST_PACKET_MS",
+                                   .readPtr = bootFirstPacketRead,
+                                   .writePtr = noWriteFn},
      }};
 
 RETURN_CODE streamIntervalWrite(const registerInfo_tp regInfo) {
@@ -220,6 +464,101 @@ RETURN_CODE dbSpiInterval(const registerInfo_tp regInfo) {
     return RETURN_OK;
 }
 
+RETURN_CODE streamBatchCntWrite(const registerInfo_tp regInfo) {
+    assert(regInfo != NULL);
+    RETURN_CODE rc = setStreamBatchCnt(regInfo->u.dataUint);
+    if (rc == RETURN_OK) {
+        registerWriteForce(regInfo);
+    }
+    return rc;
+}
+
+RETURN_CODE streamRingDepthWrite(const registerInfo_tp regInfo) {
+    assert(regInfo != NULL);
+    RETURN_CODE rc = setStreamRingDepth(regInfo->u.dataUint);
+    if (rc == RETURN_OK) {
+        registerWriteForce(regInfo);
+    }
+    return rc;
+}
+
+RETURN_CODE streamTcpZeroCopyWrite(const registerInfo_tp regInfo) {
+    assert(regInfo != NULL);
+    setStreamTcpZeroCopy(regInfo->u.dataUint != 0);
+    registerWriteForce(regInfo);
+    return RETURN_OK;
+}
+
+RETURN_CODE timeSyncServerWrite(const registerInfo_tp regInfo) {
+    assert(regInfo != NULL);
+    setTimeSyncServer(regInfo->u.dataUint);
+    registerWriteForce(regInfo);
+    return RETURN_OK;
+}
+
+RETURN_CODE timeSyncServerPortWrite(const registerInfo_tp regInfo) {
+    assert(regInfo != NULL);
+    RETURN_CODE rc = setTimeSyncServerPort(regInfo->u.dataUint);
+    if (rc == RETURN_OK) {
+        registerWriteForce(regInfo);
+    }
+    return rc;
+}
+
+RETURN_CODE timeSyncIntervalWrite(const registerInfo_tp regInfo) {
+    assert(regInfo != NULL);
+    RETURN_CODE rc = setTimeSyncInterval(regInfo->u.dataUint);
+    if (rc == RETURN_OK) {
+        registerWriteForce(regInfo);
+    }
+    return rc;
+}
+
+RETURN_CODE timeSyncPtpPortWrite(const registerInfo_tp regInfo) {
+    assert(regInfo != NULL);
+    RETURN_CODE rc = setTimeSyncPtpPort(regInfo->u.dataUint);
+    if (rc == RETURN_OK) {
+        registerWriteForce(regInfo);
+    }
+    return rc;
+}
+
+RETURN_CODE spiLargeBufferShareWrite(const registerInfo_tp regInfo) {
+    assert(regInfo != NULL);
+    RETURN_CODE rc = setSpiLargeBufferShare(regInfo->u.dataUint);
+    if (rc == RETURN_OK) {
+        registerWriteForce(regInfo);
+    }
+    return rc;
+}
+
+RETURN_CODE spiBurstCntWrite(const registerInfo_tp regInfo) {
+    assert(regInfo != NULL);
+    RETURN_CODE rc = setSpiBurstCnt(regInfo->u.dataUint);
+    if (rc == RETURN_OK) {
+        registerWriteForce(regInfo);
+    }
+    return rc;
+}
+
+RETURN_CODE spiCrcTargetPpmWrite(const registerInfo_tp regInfo) {
+    assert(regInfo != NULL);
+    RETURN_CODE rc = setSpiCrcTargetPpm(regInfo->u.dataUint);
+    if (rc == RETURN_OK) {
+        registerWriteForce(regInfo);
+    }
+    return rc;
+}
+
+RETURN_CODE dbCncWindowWrite(const registerInfo_tp regInfo) {
+    assert(regInfo != NULL);
+    RETURN_CODE rc = setDbCncWindow(regInfo->u.dataUint);
+    if (rc == RETURN_OK) {
+        registerWriteForce(regInfo);
+    }
+    return rc;
+}
+
 RETURN_CODE greenLedStateChange(const registerInfo_tp regInfo) {
     if (regInfo->u.dataUint) {
         pwmSetDutyCycle(LED_GREEN, LED_PWM_ALWAYS_ON);
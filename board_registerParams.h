@@ -16,6 +16,16 @@ typedef struct registerInfo *registerInfo_tp;
 #include "saqTarget.h"
 RETURN_CODE streamIntervalWrite(const registerInfo_tp regInfo);
 RETURN_CODE dbSpiInterval(const registerInfo_tp regInfo);
+RETURN_CODE streamBatchCntWrite(const registerInfo_tp regInfo);
+RETURN_CODE streamRingDepthWrite(const registerInfo_tp regInfo);
+RETURN_CODE streamTcpZeroCopyWrite(const registerInfo_tp regInfo);
+RETURN_CODE timeSyncServerWrite(const registerInfo_tp regInfo);
+RETURN_CODE timeSyncServerPortWrite(const registerInfo_tp regInfo);
+RETURN_CODE timeSyncIntervalWrite(const registerInfo_tp regInfo);
+RETURN_CODE timeSyncPtpPortWrite(const registerInfo_tp regInfo);
+RETURN_CODE spiLargeBufferShareWrite(const registerInfo_tp regInfo);
+RETURN_CODE spiCrcTargetPpmWrite(const registerInfo_tp regInfo);
+RETURN_CODE dbCncWindowWrite(const registerInfo_tp regInfo);
 
 RETURN_CODE noWriteFn(const registerInfo_tp regInfo);
 
@@ -13,8 +13,16 @@
 #include "dbCommTask.h"
 #include "dbTriggerTask.h"
 #include "ddsTrigTask.h"
+#include "debugCompileOptions.h"
 #include "realTimeClock.h"
 
+#if GATHER_BENCH
+#define GATHER_BENCH_HELP                                                                                              \
+    "\tunpackbench - measure the cpu cycles to sign extend the packed 24 bit readings of all boards\r\n"
+#else
+#define GATHER_BENCH_HELP
+#endif
+
 int16_t testCommand(CLI *hCli, int argc, char *argv[]);
 int16_t spiCliCmd(CLI *hCli, int argc, char *argv[]);
 int16_t adcCommand(CLI *hCli, int argc, char *argv[]);
@@ -22,14 +30,17 @@ int16_t ipCliCommand(CLI *hCli, int argc, char *argv[]);
 int16_t resetCmd(CLI *hCli, int argc, char *argv[]);
 int16_t gpioCommand(CLI *hCli, int argc, char *argv[]);
 int16_t fanCtrlCliCmd(CLI *hCli, int argc, char *argv[]);
+int16_t gatherCliCmd(CLI *hCli, int argc, char *argv[]);
+int16_t timeSyncCliCmd(CLI *hCli, int argc, char *argv[]);
 
-#define NUM_BOARD_CMDS 10
+#define NUM_BOARD_CMDS 12
 #define BOARD_CMDS                                                                                                     \
     {"spi",                                                                                                            \
      "Display spi Information\r\n",                                                                                    \
      "\tstats - display spi stats\r\n"                                                                                 \
      "\tclear - clear spi stats\r\n"                                                                                   \
      "\tsend -  send a test packet to wake the spi bus\r\n"                                                            \
+     "\tstress <rounds> - send rounds of CNC reads to every board while streaming\r\n"                                 \
      "\ttxcrcerrorcnt - <spi> <cnt> on this spi send consecutive crc errors\r\n"                                       \
      "\tmapBoardToDbg6 <board>  - maps board SPI CS to DBG_6 pin\r\n",                                                 \
      spiCliCmd},                                                                                                       \
@@ -114,6 +125,21 @@ int16_t fanCtrlCliCmd(CLI *hCli, int argc, char *argv[]);
          "\tgetManual - boolean read the current manual setting\r\n"                                                   \
          "\tsetSpeed <0-100> - read the current speed setting 0-100%\r\n"                                              \
          "\tsetManual <0|1> - boolean 0=manual setting disabled, 1=required for setSpeed to take effect\r\n",          \
-         fanCtrlCliCmd},
+         fanCtrlCliCmd},                                                                                               \
+        {"gather",                                                                                                     \
+         "Display stream gather task statistics",                                                                      \
+         "\tstats - display stream stats for the gather task and each configured board\r\n"                            \
+         "\tclear - clear the gather stats\r\n" GATHER_BENCH_HELP                                                      \
+         "\tsub - list the stream subscribers\r\n"                                                                     \
+         "\tsub add <ip> <port> - send the stream to a udp unicast or multicast destination\r\n"                       \
+         "\tsub del <idx> - remove a stream subscriber\r\n"                                                            \
+         "\tsub filter <idx> <boards> <types> <decimation> [avg] - send one frame per decimation packets holding\r\n"  \
+         "\t\tthe boards in the board mask whose type bit (0=MCG,1=ECG,2=IMU,3=12ECG) is set, avg sends\r\n"           \
+         "\t\tthe mean ADC readings of the window\r\n",                                                                \
+         gatherCliCmd},                                                                                                \
+        {"timesync",                                                                                                   \
+         "Display network time sync status",                                                                           \
+         "\tstats - display the time server, clock offset, jitter and drift\r\n",                                      \
+         timeSyncCliCmd},
 
 #endif /* APP_INC_CLI_COMMANDS_DB_H_ */
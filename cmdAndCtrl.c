@@ -11,6 +11,7 @@
 #include "cli/cli_print.h"
 #include "cmsis_os.h"
 #include "debugPrint.h"
+#include "stmTarget.h"
 #include "taskWatchdog.h"
 #ifdef STM32F411xE
 #include "gpioDB.h"
@@ -21,8 +22,7 @@
 #define CNC_TASK_MSG_TIMEOUT_MS 500
 #define CNC_MSG_PUT_TIMEOUT_MS 5
 
-osPoolDef(cncMsgPool, CNC_MSG_POOL_DEPTH, cncInfo_t);
-osPoolId cncMsgPool = NULL;
+CNC_MSG_LIST_DEF(cncMsgList, CNC_MSG_POOL_DEPTH);
 
 osMessageQDef(cncMsgQ, CNC_MSG_POOL_DEPTH, cncInfo_tp);
 static osMessageQId cncMsgQ = NULL;
@@ -34,10 +34,79 @@ const strLUT_t commandLUT[CNC_WEB_CMD_MAX] = {
 
 static void startCncTask(void const *argument);
 
+void cncMsgListInit(cncMsgList_tp p_list) {
+    assert(p_list->depth < CNC_MSG_LIST_END);
+    for (uint32_t i = 0; i < p_list->depth; i++) {
+        p_list->p_next[i] = (i + 1 < p_list->depth) ? i + 1 : CNC_MSG_LIST_END;
+    }
+    p_list->freeCnt = p_list->depth;
+    p_list->lowWater = p_list->depth;
+    p_list->emptyCnt = 0;
+    p_list->head = 0;
+}
+
+/**
+ * @fn
+ *
+ * @brief Add to a counter shared with the interrupts
+ *
+ * @param[in] p_cnt: counter
+ * @param[in] delta: value added
+ *
+ * @return counter after the add
+ **/
+static uint32_t cncMsgListCount(volatile uint32_t *p_cnt, int32_t delta) {
+    uint32_t cnt;
+    do {
+        cnt = __LDREXW(p_cnt) + delta;
+    } while (__STREXW(cnt, p_cnt) != 0);
+    return cnt;
+}
+
+cncInfo_tp cncMsgListAlloc(cncMsgList_tp p_list) {
+    uint32_t idx;
+    do {
+        idx = __LDREXW(&p_list->head);
+        if (idx == CNC_MSG_LIST_END) {
+            __CLREX();
+            p_list->emptyCnt++;
+            return NULL;
+        }
+    } while (__STREXW(p_list->p_next[idx], &p_list->head) != 0);
+
+    uint32_t freeCnt = cncMsgListCount(&p_list->freeCnt, -1);
+    if (freeCnt < p_list->lowWater) {
+        p_list->lowWater = freeCnt;
+    }
+    return &p_list->p_items[idx];
+}
+
+void cncMsgListFree(cncMsgList_tp p_list, cncInfo_tp p_msg) {
+    assert(cncMsgListOwns(p_list, p_msg));
+    uint32_t idx = p_msg - p_list->p_items;
+    uint32_t head;
+    do {
+        head = __LDREXW(&p_list->head);
+        p_list->p_next[idx] = head;
+    } while (__STREXW(idx, &p_list->head) != 0);
+    cncMsgListCount(&p_list->freeCnt, 1);
+}
+
+cncInfo_tp cncMsgAlloc(void) {
+    return cncMsgListAlloc(&cncMsgList);
+}
+
+void cncMsgFree(cncInfo_tp p_msg) {
+    cncMsgListFree(&cncMsgList, p_msg);
+}
+
+cncMsgList_tp cncMsgListGet(void) {
+    return &cncMsgList;
+}
+
 void cncTaskInit(int priority, int stackSize) {
 
-    cncMsgPool = osPoolCreate(osPool(cncMsgPool));
-    assert(cncMsgPool != NULL);
+    cncMsgListInit(&cncMsgList);
 
     cncMsgQ = osMessageCreate(osMessageQ(cncMsgQ), NULL);
     assert(cncMsgQ != NULL);
@@ -62,7 +131,7 @@ void startCncTask(void const *argument) {
             data = evt.value.p;
             DPRINTF_CMD_STREAM_VERBOSE("Got msg from cncMsgQ \r\n");
             cncHandleMsg(data);
-            osPoolFree(cncMsgPool, data);
+            cncMsgFree(data);
         }
 
         watchdogKickFromTask(WDT_TASK_CNC);
@@ -76,7 +145,7 @@ osStatus cncSendMsg(uint8_t destination,
                     cncCbFnPtr cbFnPtr,
                     uint32_t callbackId) {
     cncInfo_tp msg;
-    msg = osPoolAlloc(cncMsgPool);
+    msg = cncMsgAlloc();
     if (msg == NULL) {
         return osErrorNoMemory;
     }
@@ -90,7 +159,11 @@ osStatus cncSendMsg(uint8_t destination,
     msg->cbId = callbackId;
     msg->cmd = spiDbMbCmd;
     DPRINTF_CMD_STREAM_VERBOSE("Put msg in cncMsgQ cbId=%d\r\n", msg->cbId);
-    return (osMessagePut(cncMsgQ, (uint32_t)msg, CNC_MSG_PUT_TIMEOUT_MS));
+    osStatus status = osMessagePut(cncMsgQ, (uint32_t)msg, CNC_MSG_PUT_TIMEOUT_MS);
+    if (status != osOK) {
+        cncMsgFree(msg);
+    }
+    return status;
 }
 
 // MB and DB have their own versions.
@@ -73,7 +73,7 @@ typedef osStatus (*cncCbFnPtr)(spiDbMbCmd_e spiDbMbCmd,
  * @struct cncInfo_t
  * This structure is used to communicate with Daughter Board procs on the main board and the
  * main board and daughter board CNC tasks.
- * @Note: This structure is available from an osPool so use the osPoolAlloc and osPoolFree methods
+ * @Note: This structure is available from a cncMsgList_t so use the cncMsgAlloc and cncMsgFree methods
  * to get instances to pass to other tasks.
  */
 typedef struct __attribute__((packed)) cncInfo {
@@ -88,6 +88,32 @@ typedef struct __attribute__((packed)) cncInfo {
     uint32_t cbId;
 } cncInfo_t, *cncInfo_tp;
 
+#define CNC_MSG_LIST_END 0xFFFF
+
+/**
+ * @struct cncMsgList_t
+ * Bounded free list of cncInfo_t, the free items are linked by index.
+ * Alloc and free take the same time whatever the list holds and may be called from any task
+ * or interrupt. The head is swapped with LDREX/STREX, an interrupt between the two clears the
+ * exclusive monitor so the store fails and is tried again.
+ */
+typedef struct {
+    volatile uint32_t head;    // first free item, CNC_MSG_LIST_END when empty
+    volatile uint32_t freeCnt;
+    uint32_t lowWater;         // fewest free items since the last clear
+    uint32_t emptyCnt;         // allocations refused, the list was empty
+    uint32_t depth;
+    cncInfo_tp p_items;
+    uint16_t *p_next;
+} cncMsgList_t, *cncMsgList_tp;
+
+// Define a list of DEPTH items, cncMsgListInit() must be called before its first use
+#define CNC_MSG_LIST_DEF(NAME, DEPTH)                                                                                  \
+    static cncInfo_t NAME##Items[DEPTH];                                                                               \
+    static uint16_t NAME##Next[DEPTH];                                                                                 \
+    static cncMsgList_t NAME = {                                                                                       \
+        .head = CNC_MSG_LIST_END, .depth = (DEPTH), .p_items = NAME##Items, .p_next = NAME##Next}
+
 // Check that the payload fits in the SPI payload field
 _Static_assert(sizeof(cncPayload_t) == sizeof(spiDBMBPacket_payload_t), "Data structure is too large for SPI payload");
 
@@ -111,6 +137,77 @@ void kaboom_print(void) {
  **/
 void cncTaskInit(int priority, int stackSize);
 
+/**
+ * @fn cncMsgListInit
+ *
+ * @brief Put every item of a list on its free list
+ *
+ * @param[in] p_list: list defined with CNC_MSG_LIST_DEF
+ **/
+void cncMsgListInit(cncMsgList_tp p_list);
+
+/**
+ * @fn cncMsgListAlloc
+ *
+ * @brief Take an item from a list, callable from an interrupt
+ *
+ * @param[in] p_list: list to take the item from
+ *
+ * @return item or NULL when the list is empty
+ **/
+cncInfo_tp cncMsgListAlloc(cncMsgList_tp p_list);
+
+/**
+ * @fn cncMsgListFree
+ *
+ * @brief Give an item back to its list, callable from an interrupt
+ *
+ * @param[in] p_list: list the item was taken from
+ * @param[in] p_msg: item
+ **/
+void cncMsgListFree(cncMsgList_tp p_list, cncInfo_tp p_msg);
+
+/**
+ * @fn cncMsgListOwns
+ *
+ * @brief Check that a message is an item of a list
+ *
+ * @param[in] p_list: list
+ * @param[in] p_msg: message
+ *
+ * @return true if p_msg is one of the list items
+ **/
+static inline bool cncMsgListOwns(cncMsgList_tp p_list, cncInfo_tp p_msg) {
+    return p_msg >= p_list->p_items && p_msg < &p_list->p_items[p_list->depth];
+}
+
+/**
+ * @fn cncMsgAlloc
+ *
+ * @brief Take a message from the command and control list
+ *
+ * @return message or NULL when all CNC_MSG_POOL_DEPTH messages are in use
+ **/
+cncInfo_tp cncMsgAlloc(void);
+
+/**
+ * @fn cncMsgFree
+ *
+ * @brief Give a message taken with cncMsgAlloc back
+ *
+ * @param[in] p_msg: message
+ **/
+void cncMsgFree(cncInfo_tp p_msg);
+
+/**
+ * @fn cncMsgListGet
+ *
+ * @brief Return the command and control list, for its statistics
+ *
+ * @return list
+ **/
+cncMsgList_tp cncMsgListGet(void);
+
 /**
  * @fn cncSendMsg
  *
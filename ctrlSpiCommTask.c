@@ -16,10 +16,14 @@
 #include "cmdAndCtrl.h"
 #include "cmsis_os.h"
 #include "dbCommTask.h"
+#include "dbTriggerTask.h"
 #include "debugPrint.h"
 #include "gpioMB.h"
 #include "largeBuffer.h"
+#include "macros.h"
+#include "MB_gatherTask.h"
 #include "perseioTrace.h"
+#include "registerParams.h"
 #include "saqTarget.h"
 #include "stmTarget.h"
 #include "taskWatchdog.h"
@@ -70,15 +74,22 @@ extern CRC_HandleTypeDef hcrc;
 #define SB_BUFFER_CHANGE_DELAY_MS 1
 
 #define SPI_DBMB_PKT_SIZE sizeof(spiDbMbPacket_t)
+#define SPI_DBMB_EXT_PKT_SIZE sizeof(spiDbMbExtPacket_t)
+
+// crc field of a packet of frameSize bytes
+#define SPI_FRAME_CRC(p_spiPkt, frameSize) (*(uint32_t *)&((uint8_t *)(p_spiPkt))[(frameSize) - SIZEOF_CRC])
+
+// consecutive legacy frames received from a board before it is sent legacy frames again
+#define SPI_FRAME_LEGACY_LIMIT 8
 
 #define MAX_CS_ID (MAX_CS_PER_SPI * MAX_SPI)
 
 // Allow
 #define SPI_MSG_DEPTH 2 * (MAX_CS_PER_SPI + 3)
 
-// Tried 25% (5/4) above MAX_CS_ID but that was insufficient
-// 30 was not enough, at 60 we saw no errors.
-#define SPI_MSG_POOL_DEPTH (MAX_CS_ID * 10 / 4)
+// Only the commands use the list, the sensor transactions are the boards' own sensorMsg.
+// A board waits for the response to its command before sending the next one.
+#define SPI_MSG_LIST_DEPTH (MAX_CS_ID * 2)
 
 // CLI command argv access indexes
 #define CMD_ARG_IDX 1
@@ -98,12 +109,47 @@ extern CRC_HandleTypeDef hcrc;
     } // DBG_6
 #define SPI_TXRX_NOTIFY_TIMEOUT_MS 2
 
-/* 8=bits per character,
- * 1000 translate to msec
- * 12500000 spi bus speed
+/* chunk transfer time at the bus clock set by the link quality manager,
  * 2 buffer
  */
-#define SPI_RX_LARGEBUFFER_TIMEOUT_MS ((LARGE_BUFFER_SIZE_BYTES * 8 * 1000 / 12500000) + 2)
+#define SPI_LBUF_CHUNK_TIMEOUT_MS(len, bytesPerMs) (((len) / (bytesPerMs)) + 2)
+
+/* Large buffer reads are split into chunks sent between the sensor transactions.
+ * Each bus earns its bytes per ms * share / 100 bytes of large buffer credit per ms,
+ * a chunk is read once the credit covers it and no sensor transaction is waiting.
+ * A chunk holds the bus for 512 * 8 / 12.5MHz = 330us at the boot clock.
+ * The chip select is raised between chunks, which needs a daughter board whose SPI slave
+ * keeps its DMA position while deselected. Only a board that accepted SB_LBUF_CHUNKED is read
+ * in chunks, see spiSetLargeBufferChunked(). The others, and every board with the share at
+ * SPI_LARGE_BUFFER_SHARE_MAX, are read in one transfer with the chip select held.
+ */
+#define SPI_LBUF_CHUNK_BYTES 512
+#define SPI_LBUF_CREDIT_MAX_BYTES (4 * SPI_LBUF_CHUNK_BYTES)
+#define SPI_LBUF_POLL_MS 1 // queue wait while a large buffer read is in progress
+
+/* Link quality, the crc error rate of each bus over the last SPI_LINK_WINDOW_S seconds
+ * sets its clock and the sensor frames a walk may request again, see spiLinkUpdate().
+ * The kernel clock is divided by 2 << mbr, the divider stays between 16 and 64,
+ * 12.5MHz to 3.125MHz with the 200MHz kernel clock of the 12.5MHz boot clock.
+ * The clock is never raised above the boot clock, the fastest one validated with
+ * the sensor boards.
+ */
+#define SPI_LINK_WINDOW_S 8
+#define SPI_LINK_MBR_FAST 3
+#define SPI_LINK_MBR_SLOW 5
+#define SPI_LINK_MIN_XFERS 1000 // transfers in the window before the rate is acted on
+#define SPI_LINK_HOLD_MAX_S 512 // longest wait before raising again a clock that had to be lowered
+#define SPI_LINK_RESEND_MIN 1
+
+#define SPI_DEFERRED_RX_DEPTH 4 // fast path responses waiting for the bus task
+#define SPI_RESEND_GUARD_US 100  // a sensor frame is not requested again this close to the next trigger
+
+/* The fast path keeps two packets per bus, one on the wire while the other is checked
+ * and the next one prepared. The task path uses the first buffers.
+ */
+#define SPI_PIPELINE_DEPTH 2
+#define SPI_PIPE_TX(p_threadInfo, idx) ((spiDbMbPacket_tp)TX_DATA[(p_threadInfo)->spiBusId][idx])
+#define SPI_PIPE_RX(p_threadInfo, idx) ((spiDbMbPacket_tp)RX_DATA[(p_threadInfo)->spiBusId][idx])
 
 __DTCMRAM__ StaticQueue_t spiQMsgCtrl[MAX_SPI];
 __DTCMRAM__ uint8_t spiMsgQ[MAX_SPI][SPI_MSG_DEPTH * sizeof(cncInfo_tp)];
@@ -127,7 +173,6 @@ typedef struct {
     int pin;
 } spiCs_t, *spiCs_tp;
 
-static uint32_t noSpiMsgPoolMemoryCnt = 0;
 typedef struct {
     uint32_t crcError;
     uint32_t txPktCnt;
@@ -137,8 +182,96 @@ typedef struct {
     uint32_t lastTxPktCnt;
     uint32_t txPktRatePerSec;
     uint32_t msgPending;
+    uint32_t lbufChunkCnt;   // large buffer chunks read
+    uint32_t lbufSkipCnt;    // sensor transactions skipped while their board sent a large buffer
+    uint32_t frameLegacyCnt; // legacy frames received from boards sent extended frames
+    uint32_t frameRevertCnt; // boards put back on the legacy frame
+    uint32_t sensorBusyCnt;  // triggers skipped, the board's sensor transaction was still queued
 } spiStats_t, *spiStats_tp;
 
+typedef enum {
+    SPI_LBUF_IDLE,
+    SPI_LBUF_PROCESSING, // daughter board is filling its buffer
+    SPI_LBUF_READING,    // chunks are read as the bus share allows
+    SPI_LBUF_SETTLING,   // daughter board is resetting its buffer
+} SPI_LBUF_STATE_e;
+
+// Large buffer read in progress on one bus
+typedef struct {
+    SPI_LBUF_STATE_e state;
+    volatile uint32_t dest; // board sending the buffer, MAX_CS_ID when idle
+    cncInfo_tp p_cncInfo;   // request, freed once the read completes
+    spiDbMbPacket_t rxInfo; // response handed to handleRxMsg()
+    uint8_t *p_buffer;
+    uint32_t size;
+    uint32_t offset;
+    uint32_t credit; // bytes that may be read without exceeding the bus share
+    uint32_t dueTick;
+    uint32_t lastTick;
+} spiLargeBuffer_t, *spiLargeBuffer_tp;
+
+// Fast path response that cannot be handled in the interrupt, passed to the bus task
+typedef struct {
+    cncInfo_t info; // sensor transaction, its callback handles the response
+    spiDbMbExtPacket_t pkt;
+    uint32_t frameSize;
+    volatile bool used;
+} spiDeferredRx_t, *spiDeferredRx_tp;
+
+// Sensor transactions of the triggers, read back to back from the DMA complete interrupt
+typedef struct {
+    volatile bool active;      // a walk owns the bus
+    volatile bool taskOwned;   // the bus task owns the bus, triggers wait in pendingMask
+    volatile bool taskWaiting; // the bus task waits for the walk to complete
+    uint32_t mask;             // boards left to read, bit 0 is the first board of the bus
+    uint32_t pendingMask;
+    uint32_t dest;     // board being read
+    uint32_t wireIdx;  // pipeline buffers of the transfer on the wire
+    uint32_t prepDest; // board whose packet is prepared, MAX_CS_ID when none
+    uint32_t prepIdx;  // pipeline buffers of the prepared packet
+    uint32_t frameSize[SPI_PIPELINE_DEPTH]; // size of the packet in each pipeline buffer
+    bool resend[SPI_PIPELINE_DEPTH];        // the packet in each pipeline buffer requests a sensor frame again
+    uint32_t resendMask;                    // boards whose sensor frame failed its crc, bit 0 is the first board
+    uint32_t xferCnt;                       // transfers since the walk began
+    uint32_t resendLeft;                    // sensor frames the walk may still request again
+    uint32_t deferIdx;
+    uint32_t walkCnt;
+    uint32_t overrunCnt;   // triggers received before the previous walk completed
+    uint32_t deferDropCnt; // responses lost, no deferred entry free
+    uint32_t errorCnt;     // DMA start failures
+    uint32_t resendCnt;    // sensor frames requested again after a crc error
+    uint32_t recoveredCnt; // sensor frames received from a resend
+    uint32_t lostCnt;      // sensor frames lost to a crc error, no bus time left or the resend failed
+} spiWalk_t, *spiWalk_tp;
+
+// Trigger to last board complete time of one bus
+typedef struct {
+    uint64_t trigger_us;
+    uint32_t done_us; // last board complete of the current trigger, 0 until one completes
+    uint32_t last_us;
+    uint32_t max_us;
+    uint32_t cnt;
+    uint64_t sum_us;
+} spiTiming_t, *spiTiming_tp;
+
+// Crc error rate of one bus and the clock and resend budget it led to
+typedef struct {
+    volatile uint32_t mbr;          // clock divider 2 << mbr, put on the bus by spiLinkApply()
+    uint32_t appliedMbr;            // divider on the bus
+    uint32_t bootMbr;               // divider set by the spi init
+    volatile uint32_t resendBudget; // sensor frames a walk may request again
+    uint32_t xfers[SPI_LINK_WINDOW_S];
+    uint32_t errors[SPI_LINK_WINDOW_S];
+    uint32_t slot;
+    uint32_t lastXfers;  // tx count at the last update
+    uint32_t lastErrors; // crc error count at the last update
+    uint32_t errorPpm;   // crc errors per million transfers over the window
+    uint32_t sinceS;     // seconds since the last adjustment
+    uint32_t holdS;      // seconds below the target before the clock is raised
+    bool raised;         // the last adjustment raised the clock
+    uint32_t adjustCnt;
+} spiLink_t, *spiLink_tp;
+
 typedef struct {
     spiStats_t spiStats;
     uint16_t nxtTxId;
@@ -157,13 +290,38 @@ typedef struct {
     spiDbMbPacket_tp p_txBuffer;
     spiDbMbPacket_tp p_rxBuffer;
     spiStateInfo_t state;
+    spiLargeBuffer_t lbuf;
+    spiWalk_t walk;
+    spiTiming_t timing;
+    spiLink_t link;
 } ctrlCommThreadInfo_t, *ctrlCommThreadInfo_tp;
 
-// Pool is shared among all 4 spi busses
-osPoolId spiMsgPool = NULL;
+// List is shared among all 3 spi busses
+CNC_MSG_LIST_DEF(spiMsgList, SPI_MSG_LIST_DEPTH);
+
+// sensorMsg of the board is in a bus queue, see spiSendSensorMsg()
+__DTCMRAM__ static volatile bool spiSensorQueued[MAX_CS_ID];
+
+static volatile uint32_t spiLargeBufferShare = VALUE_SPI_LARGE_BUFFER_SHARE; // percent of bus time
+static volatile uint32_t spiCrcTargetPpm = VALUE_SPI_CRC_TARGET_PPM; // 0 keeps the boot clock
+static uint32_t spiKernelHz;                                        // clock divided by 2 << mbr
 
-__attribute__((section(".spiRxDmaSection"))) static uint8_t RX_DATA[MAX_SPI][sizeof(spiDbMbPacket_t)];
-__attribute__((section(".spiTxDmaSection"))) static uint8_t TX_DATA[MAX_SPI][sizeof(spiDbMbPacket_t)];
+// Frame size used with each board, see spiSetFrameSize()
+typedef struct {
+    volatile uint32_t size;
+    uint32_t legacyCnt; // consecutive legacy frames received while sending extended frames
+    uint32_t rxSize;    // size of the last response that passed its crc, see spiFrameRxSize()
+    volatile bool resend; // the board keeps its frames for SPICMD_SENSOR_RESEND, see spiSetSensorResend()
+    volatile bool lbufChunked; // the board keeps its large buffer position while deselected
+} spiFrame_t, *spiFrame_tp;
+
+__DTCMRAM__ static spiFrame_t spiFrame[MAX_CS_ID];
+
+// sized for the extended frame, the legacy frame uses the start of each buffer
+__attribute__((section(".spiRxDmaSection"))) static uint8_t
+    RX_DATA[MAX_SPI][SPI_PIPELINE_DEPTH][sizeof(spiDbMbExtPacket_t)];
+__attribute__((section(".spiTxDmaSection"))) static uint8_t
+    TX_DATA[MAX_SPI][SPI_PIPELINE_DEPTH][sizeof(spiDbMbExtPacket_t)];
 
 #define csMap(PORT, PIN)                                                                                               \
     { GPIO##PORT, GPIO_PIN_##PIN }
@@ -240,14 +398,27 @@ char *csName(uint32_t csIdx) {
     SPI_COMM_THREAD_INFO.threadId = NULL;                                                                              \
     SPI_COMM_THREAD_INFO.watchDogId = WDT_TASK_CTRLCOMM_SPI##BUS;                                                      \
     SPI_COMM_THREAD_INFO.csStartIdx = MAX_CS_PER_SPI * IDX;                                                            \
-    SPI_COMM_THREAD_INFO.p_txBuffer = (spiDbMbPacket_tp)TX_DATA[IDX];                                                  \
-    SPI_COMM_THREAD_INFO.p_rxBuffer = (spiDbMbPacket_tp)RX_DATA[IDX];
+    SPI_COMM_THREAD_INFO.p_txBuffer = (spiDbMbPacket_tp)TX_DATA[IDX][0];                                               \
+    SPI_COMM_THREAD_INFO.p_rxBuffer = (spiDbMbPacket_tp)RX_DATA[IDX][0];                                               \
+    SPI_COMM_THREAD_INFO.walk.prepDest = MAX_CS_ID;                                                                    \
+    SPI_COMM_THREAD_INFO.lbuf.dest = MAX_CS_ID;
 
 __DTCMRAM__ static ctrlCommThreadInfo_t spiCommThreadInfo[MAX_SPI];
+#if SPI_FAST_PATH
+__DTCMRAM__ static spiDeferredRx_t spiDeferredRx[MAX_SPI][SPI_DEFERRED_RX_DEPTH];
+#endif
 
 static void ctrlCommTaskThread(void const *argument);
 static HAL_StatusTypeDef handleSpiMsg(ctrlCommThreadInfo_tp p_threadInfo, cncInfo_tp p_data);
-static HAL_StatusTypeDef handleRxMsg(ctrlCommThreadInfo_tp p_threadInfo, cncInfo_tp p_cncInfo, spiDbMbPacket_tp p_data);
+static HAL_StatusTypeDef handleRxMsg(ctrlCommThreadInfo_tp p_threadInfo,
+                                     cncInfo_tp p_cncInfo,
+                                     spiDbMbPacket_tp p_data,
+                                     uint32_t frameSize);
+static void spiLargeBufferService(ctrlCommThreadInfo_tp p_threadInfo, bool drain);
+static void spiBusAcquire(ctrlCommThreadInfo_tp p_threadInfo);
+static void spiBusRelease(ctrlCommThreadInfo_tp p_threadInfo);
+static void spiLinkApply(ctrlCommThreadInfo_tp p_threadInfo);
+static void spiLinkAdjust(ctrlCommThreadInfo_tp p_threadInfo, uint32_t mbr, uint32_t resendBudget);
 static osStatus ctrlSpiCommCliCallback(spiDbMbCmd_e spiDbMbCmd,
                                        uint32_t cbId,
                                        uint8_t xInfo,
@@ -271,6 +442,122 @@ __DTCMRAM__ StackType_t spiStack[MAX_SPI][SPI_STACK_WORDS];
 #warning "SPI interaction with only one board"
 #endif
 
+/**
+ * @fn
+ *
+ * @brief Calculate the CRC of a spi packet, the CRC unit is shared by the bus tasks and the DMA interrupts
+ *
+ * @param[in] p_spiPkt: packet
+ * @param[in] frameSize: packet size in bytes, legacy or extended frame
+ *
+ * @return crc of the packet without its crc field
+ **/
+__ITCMRAM__ static inline uint32_t spiPktCrc(spiDbMbPacket_tp p_spiPkt, uint32_t frameSize) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t crc = HAL_CRC_Calculate(&hcrc, p_spiPkt->u32, (frameSize - SIZEOF_CRC) / sizeof(uint32_t));
+    __set_PRIMASK(primask);
+    return crc;
+}
+
+/**
+ * @fn
+ *
+ * @brief Set the crc of a packet to send
+ *
+ * An extended frame also carries the legacy crc so a board that restarted on the legacy
+ * frame still accepts it, the extended payload past the legacy one is not used by the boards.
+ *
+ * @param[in] p_spiPkt: packet
+ * @param[in] frameSize: packet size in bytes
+ **/
+__ITCMRAM__ static inline void spiPktSeal(spiDbMbPacket_tp p_spiPkt, uint32_t frameSize) {
+    if (frameSize != SPI_DBMB_PKT_SIZE) {
+        p_spiPkt->crc = spiPktCrc(p_spiPkt, SPI_DBMB_PKT_SIZE);
+    }
+    SPI_FRAME_CRC(p_spiPkt, frameSize) = spiPktCrc(p_spiPkt, frameSize);
+}
+
+/**
+ * @fn
+ *
+ * @brief Check the crc of a response
+ *
+ * A board sent extended frames may answer with a legacy frame, while switching or after it
+ * restarted, the legacy crc is checked when the extended one fails. The board is sent legacy
+ * frames again after SPI_FRAME_LEGACY_LIMIT consecutive legacy responses.
+ * The board is read by one bus at a time, from its task or its DMA interrupt.
+ *
+ * @param[in] p_threadInfo: spi bus
+ * @param[in] dest: board that sent the response
+ * @param[in] p_spiPkt: response
+ * @param[in] frameSize: size of the transfer in bytes
+ *
+ * @return size of the frame received, 0 on a crc error
+ **/
+__ITCMRAM__ static uint32_t spiFrameCheck(ctrlCommThreadInfo_tp p_threadInfo,
+                                          uint32_t dest,
+                                          spiDbMbPacket_tp p_spiPkt,
+                                          uint32_t frameSize) {
+    spiFrame_tp p_frame = &spiFrame[dest];
+
+    if (spiPktCrc(p_spiPkt, frameSize) == SPI_FRAME_CRC(p_spiPkt, frameSize)) {
+        p_frame->legacyCnt = 0;
+        p_frame->rxSize = frameSize;
+        return frameSize;
+    }
+    if (frameSize == SPI_DBMB_PKT_SIZE || spiPktCrc(p_spiPkt, SPI_DBMB_PKT_SIZE) != p_spiPkt->crc) {
+        return 0;
+    }
+    p_frame->rxSize = SPI_DBMB_PKT_SIZE;
+    p_threadInfo->state.spiStats.frameLegacyCnt++;
+    if (++p_frame->legacyCnt >= SPI_FRAME_LEGACY_LIMIT && p_frame->size == frameSize) {
+        p_frame->size = SPI_DBMB_PKT_SIZE;
+        p_frame->legacyCnt = 0;
+        p_threadInfo->state.spiStats.frameRevertCnt++;
+    }
+    return SPI_DBMB_PKT_SIZE;
+}
+
+/**
+ * @fn
+ *
+ * @brief Start the trigger to last board complete measurement, the previous trigger is added to the statistics
+ *
+ * A trigger that arrives while the previous walk is still reading is counted as an overrun by the
+ * caller, the measurement keeps running from the first trigger so the merged walk is timed once.
+ *
+ * @param[in] p_threadInfo: spi bus
+ * @param[in] overrun: the previous walk of the bus has not completed
+ **/
+__ITCMRAM__ static inline void spiTimingTrigger(ctrlCommThreadInfo_tp p_threadInfo, bool overrun) {
+    spiTiming_tp p_timing = &p_threadInfo->timing;
+    if (overrun) {
+        return;
+    }
+    if (p_timing->done_us != 0) {
+        p_timing->last_us = p_timing->done_us;
+        if (p_timing->done_us > p_timing->max_us) {
+            p_timing->max_us = p_timing->done_us;
+        }
+        p_timing->sum_us += p_timing->done_us;
+        p_timing->cnt++;
+        p_timing->done_us = 0;
+    }
+    p_timing->trigger_us = streamTimeUs();
+}
+
+/**
+ * @fn
+ *
+ * @brief Record a sensor transaction complete, the last one of the trigger is kept
+ *
+ * @param[in] p_threadInfo: spi bus
+ **/
+__ITCMRAM__ static inline void spiTimingDone(ctrlCommThreadInfo_tp p_threadInfo) {
+    p_threadInfo->timing.done_us = streamTimeUs() - p_threadInfo->timing.trigger_us;
+}
+
 extern bool printSpi;
 
 bool SPIIsReady(uint32_t destination) {
@@ -290,13 +577,37 @@ void ctrlSpiCommTaskInit(int priority, int stackSize) {
     spiCommThreadInfoCreate(spiCommThreadInfo[1], 2, 1);
     spiCommThreadInfoCreate(spiCommThreadInfo[2], 3, 2);
 
+    for (int i = 0; i < MAX_CS_ID; i++) {
+        spiFrame[i].size = SPI_DBMB_PKT_SIZE;
+    }
+
+    registerInfo_t regInfo = {.mbId = SPI_LARGE_BUFFER_SHARE, .type = DATA_UINT};
+    registerRead(&regInfo);
+    if (setSpiLargeBufferShare(regInfo.u.dataUint) != RETURN_OK) {
+        setSpiLargeBufferShare(VALUE_SPI_LARGE_BUFFER_SHARE);
+    }
+
+    // the three busses share the SPI123 kernel clock, each starts at the clock set by the spi init
+    spiKernelHz = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_SPI123);
+    for (int i = 0; i < MAX_SPI; i++) {
+        spiLink_tp p_link = &spiCommThreadInfo[i].link;
+        p_link->bootMbr = (spiCommThreadInfo[i].hspi->Init.BaudRatePrescaler & SPI_CFG1_MBR) >> SPI_CFG1_MBR_Pos;
+        p_link->mbr = p_link->bootMbr;
+        p_link->appliedMbr = p_link->bootMbr;
+        p_link->resendBudget = MAX_CS_PER_SPI;
+        p_link->holdS = SPI_LINK_WINDOW_S;
+    }
+    regInfo.mbId = SPI_CRC_TARGET_PPM;
+    registerRead(&regInfo);
+    if (setSpiCrcTargetPpm(regInfo.u.dataUint) != RETURN_OK) {
+        setSpiCrcTargetPpm(VALUE_SPI_CRC_TARGET_PPM);
+    }
+
     spiMessageQCreateStatic(0, spiCommThreadInfo[0].msgQId, NULL);
     spiMessageQCreateStatic(1, spiCommThreadInfo[1].msgQId, NULL);
     spiMessageQCreateStatic(2, spiCommThreadInfo[2].msgQId, NULL);
 
-    osPoolDef(spiMsgPool, SPI_MSG_POOL_DEPTH, cncInfo_t);
-    spiMsgPool = osPoolCreate(osPool(spiMsgPool));
-    assert(spiMsgPool != NULL);
+    cncMsgListInit(&spiMsgList);
 
     spiCreateTask(SPI1_COM, 0, hmdma_mdma_channel0_sw_0);
     spiCreateTask(SPI2_COM, 1, hmdma_mdma_channel1_sw_0);
@@ -307,12 +618,154 @@ void ctrlSpiCommTaskInit(int priority, int stackSize) {
     spiCommThreadInfo[2].state.spiStats.msgPending = 0;
 }
 
+RETURN_CODE setSpiLargeBufferShare(uint32_t percent) {
+    if (percent < SPI_LARGE_BUFFER_SHARE_MIN || percent > SPI_LARGE_BUFFER_SHARE_MAX) {
+        return RETURN_ERR_PARAM;
+    }
+    spiLargeBufferShare = percent;
+    return RETURN_OK;
+}
+
+RETURN_CODE setSpiCrcTargetPpm(uint32_t ppm) {
+    if (ppm > SPI_CRC_TARGET_PPM_MAX) {
+        return RETURN_ERR_PARAM;
+    }
+    spiCrcTargetPpm = ppm;
+    for (int i = 0; i < MAX_SPI; i++) {
+        spiLink_tp p_link = &spiCommThreadInfo[i].link;
+        p_link->holdS = SPI_LINK_WINDOW_S;
+        if (ppm == 0) {
+            spiLinkAdjust(&spiCommThreadInfo[i], p_link->bootMbr, MAX_CS_PER_SPI);
+        }
+    }
+    return RETURN_OK;
+}
+
+/**
+ * @fn
+ *
+ * @brief Clock of a bus set by the link quality manager
+ *
+ * @param[in] p_link: bus link quality
+ *
+ * @return clock in kHz
+ **/
+static uint32_t spiLinkClockKhz(spiLink_tp p_link) {
+    return spiKernelHz / (2 << p_link->mbr) / 1000;
+}
+
+/**
+ * @fn
+ *
+ * @brief Bytes a bus transfers per ms at the clock set by the link quality manager
+ *
+ * @param[in] p_link: bus link quality
+ *
+ * @return bytes per ms
+ **/
+__ITCMRAM__ static inline uint32_t spiLinkBytesPerMs(spiLink_tp p_link) {
+    return spiKernelHz / (2 << p_link->mbr) / 8 / 1000;
+}
+
+/**
+ * @fn
+ *
+ * @brief Put the clock chosen by the link quality manager on the bus, called while nothing is on the wire
+ *
+ * CFG1 is only written while the spi is disabled, the HAL disables it at the end of each transfer.
+ *
+ * @param[in] p_threadInfo: spi bus
+ **/
+__ITCMRAM__ static void spiLinkApply(ctrlCommThreadInfo_tp p_threadInfo) {
+    spiLink_tp p_link = &p_threadInfo->link;
+    uint32_t mbr = p_link->mbr;
+
+    if (mbr != p_link->appliedMbr) {
+        SPI_HandleTypeDef *hspi = p_threadInfo->hspi;
+        hspi->Init.BaudRatePrescaler = mbr << SPI_CFG1_MBR_Pos;
+        __HAL_SPI_DISABLE(hspi);
+        MODIFY_REG(hspi->Instance->CFG1, SPI_CFG1_MBR, hspi->Init.BaudRatePrescaler);
+        p_link->appliedMbr = mbr;
+    }
+}
+
+RETURN_CODE spiLinkRead(const registerInfo_tp regInfo) {
+    assert(regInfo != NULL);
+    switch (regInfo->mbId) {
+        case SPI1_CLOCK_KHZ:
+        case SPI2_CLOCK_KHZ:
+        case SPI3_CLOCK_KHZ:
+            regInfo->u.dataUint = spiLinkClockKhz(&spiCommThreadInfo[regInfo->mbId - SPI1_CLOCK_KHZ].link);
+            break;
+        case SPI1_RESEND_BUDGET:
+        case SPI2_RESEND_BUDGET:
+        case SPI3_RESEND_BUDGET:
+            regInfo->u.dataUint = spiCommThreadInfo[regInfo->mbId - SPI1_RESEND_BUDGET].link.resendBudget;
+            break;
+        case SPI_LINK_ADJUSTS:
+            regInfo->u.dataUint = 0;
+            for (int i = 0; i < MAX_SPI; i++) {
+                regInfo->u.dataUint += spiCommThreadInfo[i].link.adjustCnt;
+            }
+            break;
+        default:
+            return RETURN_ERR_PARAM;
+    }
+    return RETURN_OK;
+}
+
+RETURN_CODE spiSetFrameSize(uint32_t destination, uint32_t frameSize) {
+    if (destination >= MAX_CS_ID || frameSize < SPI_DBMB_PKT_SIZE || frameSize > SPI_DBMB_EXT_PKT_SIZE ||
+        frameSize % sizeof(uint32_t) != 0) {
+        return RETURN_ERR_PARAM;
+    }
+    spiFrame[destination].legacyCnt = 0;
+    spiFrame[destination].size = frameSize;
+    return RETURN_OK;
+}
+
+__ITCMRAM__ uint32_t spiFrameSize(uint32_t destination) {
+    assert(destination < MAX_CS_ID);
+    return spiFrame[destination].size;
+}
+
+__ITCMRAM__ uint32_t spiFrameRxSize(uint32_t destination) {
+    assert(destination < MAX_CS_ID);
+    return spiFrame[destination].rxSize;
+}
+
+RETURN_CODE spiSetSensorResend(uint32_t destination, bool resend) {
+    if (destination >= MAX_CS_ID) {
+        return RETURN_ERR_PARAM;
+    }
+    spiFrame[destination].resend = resend;
+    return RETURN_OK;
+}
+
+RETURN_CODE spiSetLargeBufferChunked(uint32_t destination, bool chunked) {
+    if (destination >= MAX_CS_ID) {
+        return RETURN_ERR_PARAM;
+    }
+    spiFrame[destination].lbufChunked = chunked;
+    return RETURN_OK;
+}
+
+bool spiLargeBufferBusy(uint32_t destination) {
+    uint8_t spiDest = destination / MAX_CS_PER_SPI;
+    assert(spiDest < MAX_SPI);
+    return (spiCommThreadInfo[spiDest].lbuf.dest == destination);
+}
+
 void updateSPIEnableCount(uint8_t destination, bool enable) {
     uint8_t spiDest = destination / MAX_CS_PER_SPI;
     assert(spiDest < MAX_SPI);
 
     if (enable) {
         spiCommThreadInfo[spiDest].state.spiStats.enableCnt++;
+        // the board was rebooted when disabled, it starts on the legacy frame and keeps no frames
+        spiSetFrameSize(destination, SPI_DBMB_PKT_SIZE);
+        spiSetSensorResend(destination, false);
+        spiSetLargeBufferChunked(destination, false);
     } else {
         spiCommThreadInfo[spiDest].state.spiStats.enableCnt--;
     }
@@ -333,11 +786,10 @@ __ITCMRAM__ osStatus spiSendMsg(uint8_t destination,
                                 uint32_t cbId,
                                 uint32_t timeout_ms) {
 
-    cncInfo_tp p_cncInfo = osPoolAlloc(spiMsgPool);
+    cncInfo_tp p_cncInfo = cncMsgListAlloc(&spiMsgList);
     if (p_cncInfo == NULL) {
-        noSpiMsgPoolMemoryCnt++;
-        if (noSpiMsgPoolMemoryCnt == 1 || (noSpiMsgPoolMemoryCnt % 100) == 0) {
-            DPRINTF_ERROR("spiSendMsg pool is empty\r\n");
+        if (spiMsgList.emptyCnt == 1 || (spiMsgList.emptyCnt % 100) == 0) {
+            DPRINTF_ERROR("spiSendMsg list is empty\r\n");
         }
         return osErrorNoMemory;
     }
@@ -363,11 +815,36 @@ __ITCMRAM__ osStatus spiSendMsg(uint8_t destination,
     if (status != osOK) {
         spiCommThreadInfo[spiDest].state.spiStats.msgPending--;
         spiCommThreadInfo[spiDest].state.spiStats.qFullCnt++;
+        cncMsgListFree(&spiMsgList, p_cncInfo);
         DPRINTF_ERROR("SPI%d msgQ is full\r\n", spiDest + 1);
     }
     return status;
 }
 
+__ITCMRAM__ osStatus spiSendSensorMsg(uint8_t destination, uint8_t xInfo, uint32_t timeout_ms) {
+    assert(destination < MAX_CS_ID);
+    ctrlCommThreadInfo_tp p_threadInfo = &spiCommThreadInfo[destination / MAX_CS_PER_SPI];
+
+    // only the board's task queues its transaction, the bus task clears the flag once it is sent
+    if (spiSensorQueued[destination]) {
+        p_threadInfo->state.spiStats.sensorBusyCnt++;
+        return osErrorResource;
+    }
+    cncInfo_tp p_cncInfo = dbCommSensorMsg(destination);
+    p_cncInfo->xInfo = xInfo;
+    spiSensorQueued[destination] = true;
+    p_threadInfo->state.spiStats.msgPending++;
+
+    osStatus status = osMessagePut(p_threadInfo->msgQId, (uint32_t)p_cncInfo, timeout_ms);
+    if (status != osOK) {
+        spiSensorQueued[destination] = false;
+        p_threadInfo->state.spiStats.msgPending--;
+        p_threadInfo->state.spiStats.qFullCnt++;
+        DPRINTF_ERROR("SPI%d msgQ is full\r\n", p_threadInfo->spiBusId + 1);
+    }
+    return status;
+}
+
 __ITCMRAM__ void ctrlCommTaskThread(void const *argument) {
     ctrlCommThreadInfo_tp p_ctrlCommInfo = (ctrlCommThreadInfo_tp)argument;
     osEvent evt;
@@ -383,23 +860,130 @@ __ITCMRAM__ void ctrlCommTaskThread(void const *argument) {
     p_ctrlCommInfo->state.ready = true;
     while (1) {
         watchdogKickFromTask(p_ctrlCommInfo->watchDogId);
-        evt = osMessageGet(p_ctrlCommInfo->msgQId, 500);
+        evt = osMessageGet(p_ctrlCommInfo->msgQId,
+                           (p_ctrlCommInfo->lbuf.state == SPI_LBUF_IDLE) ? 500 : SPI_LBUF_POLL_MS);
         if (evt.status == osEventMessage) {
 
             spiCommThreadInfo[p_ctrlCommInfo->spiBusId].state.spiStats.msgPending--;
+#if SPI_FAST_PATH
+            spiDeferredRx_tp p_defer = (spiDeferredRx_tp)evt.value.p;
+            if (p_defer >= &spiDeferredRx[p_ctrlCommInfo->spiBusId][0] &&
+                p_defer < &spiDeferredRx[p_ctrlCommInfo->spiBusId][SPI_DEFERRED_RX_DEPTH]) {
+                // fast path response, the packet was already read by the DMA interrupt
+                p_ctrlCommInfo->state.dest = p_defer->info.destination;
+                handleRxMsg(p_ctrlCommInfo, &p_defer->info, (spiDbMbPacket_tp)&p_defer->pkt, p_defer->frameSize);
+                p_defer->used = false;
+                spiLargeBufferService(p_ctrlCommInfo, false);
+                continue;
+            }
+#endif
             cncInfo_tp p_data = (cncInfo_tp)evt.value.p;
             handleSpiMsg(p_ctrlCommInfo, p_data);
 #ifdef TRACEALYZER
             {
-                uint32_t index = (uint32_t)p_data - (uint32_t)(spiMsgPool->pool);
-                index = index / spiMsgPool->item_sz;
+                uint32_t index = p_data - spiMsgList.p_items;
                 xTracePrintCompactF2(spiCommTrace[p_ctrlCommInfo->spiBusId],
-                                     "Rx Msg, pending %lu poolIdx=%lu",
+                                     "Rx Msg, pending %lu listIdx=%lu",
                                      spiCommThreadInfo[p_ctrlCommInfo->spiBusId].state.spiStats.msgPending,
                                      index);
             }
 #endif
-            osPoolFree(spiMsgPool, p_data);
+            if (!cncMsgListOwns(&spiMsgList, p_data)) {
+                // sensor transaction of the board, it may be queued again
+                spiSensorQueued[p_data->destination] = false;
+            } else if (p_data != p_ctrlCommInfo->lbuf.p_cncInfo) {
+                // a large buffer request is kept until its last chunk is read
+                cncMsgListFree(&spiMsgList, p_data);
+            }
+        }
+        spiLargeBufferService(p_ctrlCommInfo, false);
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Read the next large buffer chunks once the bus share allows it
+ *
+ * @param[in] p_threadInfo: spi bus
+ * @param[in] drain: complete the read now, ignoring the bus share and waiting transactions
+ **/
+__ITCMRAM__ static void spiLargeBufferService(ctrlCommThreadInfo_tp p_threadInfo, bool drain) {
+    spiLargeBuffer_tp p_lbuf = &p_threadInfo->lbuf;
+
+    while (p_lbuf->state != SPI_LBUF_IDLE) {
+        uint32_t now = HAL_GetTick();
+        int32_t wait_ms = (int32_t)(p_lbuf->dueTick - now);
+        if (wait_ms > 0) {
+            if (!drain) {
+                return;
+            }
+            osDelay(wait_ms);
+            continue;
+        }
+
+        if (p_lbuf->state == SPI_LBUF_PROCESSING) {
+            p_lbuf->state = SPI_LBUF_READING;
+            p_lbuf->lastTick = p_lbuf->dueTick;
+            p_lbuf->credit = 0;
+        } else if (p_lbuf->state == SPI_LBUF_SETTLING) {
+            p_lbuf->state = SPI_LBUF_IDLE;
+            p_lbuf->dest = MAX_CS_ID;
+            return;
+        }
+
+        p_lbuf->credit +=
+            (now - p_lbuf->lastTick) * spiLinkBytesPerMs(&p_threadInfo->link) * spiLargeBufferShare / 100;
+        p_lbuf->lastTick = now;
+        if (p_lbuf->credit > SPI_LBUF_CREDIT_MAX_BYTES) {
+            p_lbuf->credit = SPI_LBUF_CREDIT_MAX_BYTES;
+        }
+
+        uint32_t len = p_lbuf->size - p_lbuf->offset;
+        bool whole = (spiLargeBufferShare >= SPI_LARGE_BUFFER_SHARE_MAX || !spiFrame[p_lbuf->dest].lbufChunked);
+        if (!whole && len > SPI_LBUF_CHUNK_BYTES) {
+            len = SPI_LBUF_CHUNK_BYTES;
+        }
+        if (!drain && ((!whole && p_lbuf->credit < len) || osMessageWaiting(p_threadInfo->msgQId) != 0)) {
+            return;
+        }
+        p_lbuf->credit = (p_lbuf->credit > len) ? p_lbuf->credit - len : 0;
+
+        spiBusAcquire(p_threadInfo);
+        LOWER_CS(p_lbuf->dest);
+        HAL_StatusTypeDef halResult = HAL_SPI_Receive_DMA(p_threadInfo->hspi, &p_lbuf->p_buffer[p_lbuf->offset], len);
+        uint32_t result = TASK_NOTIFY_OK;
+        if (halResult == HAL_OK) {
+            result = ulTaskNotifyTake(true, SPI_LBUF_CHUNK_TIMEOUT_MS(len, spiLinkBytesPerMs(&p_threadInfo->link)));
+        }
+        RAISE_CS(p_lbuf->dest);
+        spiBusRelease(p_threadInfo);
+        p_threadInfo->state.spiStats.lbufChunkCnt++;
+
+        if (halResult != HAL_OK || result != TASK_NOTIFY_OK) {
+            // no response is sent, the requester times out as it did for a failed single transfer
+            DPRINTF_ERROR("%s SPI%d large buffer chunk failure %d %d\r\n",
+                          __func__,
+                          p_threadInfo->spiBusId,
+                          halResult,
+                          result);
+            cncMsgListFree(&spiMsgList, p_lbuf->p_cncInfo);
+            p_lbuf->p_cncInfo = NULL;
+            p_lbuf->state = SPI_LBUF_SETTLING;
+            p_lbuf->dueTick = HAL_GetTick() + SB_BUFFER_CHANGE_DELAY_MS;
+            continue;
+        }
+
+        p_lbuf->offset += len;
+        if (p_lbuf->offset == p_lbuf->size) {
+            p_threadInfo->state.spiStats.txPktCnt += 2;
+            p_lbuf->p_cncInfo->cmdResponse.cmdResponse = NO_ERROR;
+            handleRxMsg(p_threadInfo, p_lbuf->p_cncInfo, &p_lbuf->rxInfo, SPI_DBMB_PKT_SIZE);
+            cncMsgListFree(&spiMsgList, p_lbuf->p_cncInfo);
+            p_lbuf->p_cncInfo = NULL;
+            // give time for the daughter board to reset its circular buffer
+            p_lbuf->state = SPI_LBUF_SETTLING;
+            p_lbuf->dueTick = HAL_GetTick() + SB_BUFFER_CHANGE_DELAY_MS;
         }
     }
 }
@@ -415,21 +999,32 @@ __ITCMRAM__ HAL_StatusTypeDef handleSpiMsg(ctrlCommThreadInfo_tp p_threadInfo, c
     assert(p_data != NULL);
     HAL_StatusTypeDef halResult = HAL_OK;
     uint32_t result = 0;
-    spiDbMbPacket_t rxLargeBufferInfo = {.header.cmd = SPICMD_RESP_CNC,
-                                         .header.xInfo = p_data->xInfo,
-                                         .header.cmdResponse.cmdUid = p_data->cmdResponse.cmdUid,
-                                         .header.cmdResponse.cmdResponse = NO_ERROR,
-                                         .header.cmdResponse.flags = p_data->cmdResponse.flags};
+    bool largeBufferRead = (p_data->payload.cmd.cncMsgPayloadHeader.action >= CNC_ACTION_READ_SMALL_BUFFER);
 
-    p_threadInfo->state.dest = p_data->destination;
-    if (p_threadInfo->state.dest < p_threadInfo->csStartIdx ||
-        p_threadInfo->state.dest > p_threadInfo->csStartIdx + MAX_CS_PER_SPI) {
-        DPRINTF_ERROR("dest %d out of range for SPI %d\r\n", p_threadInfo->state.dest, p_threadInfo->spiBusId);
+    if (p_data->destination < p_threadInfo->csStartIdx ||
+        p_data->destination > p_threadInfo->csStartIdx + MAX_CS_PER_SPI) {
+        DPRINTF_ERROR("dest %d out of range for SPI %d\r\n", p_data->destination, p_threadInfo->spiBusId);
         return HAL_ERROR;
     }
 
+    if (p_threadInfo->lbuf.state != SPI_LBUF_IDLE) {
+        if (p_data->destination == p_threadInfo->lbuf.dest && p_data->cmd == SPICMD_NOP) {
+            // the board is busy sending its buffer, it will answer the next trigger
+            p_threadInfo->state.spiStats.lbufSkipCnt++;
+            return HAL_OK;
+        }
+        if (p_data->destination == p_threadInfo->lbuf.dest || largeBufferRead) {
+            spiLargeBufferService(p_threadInfo, true);
+        }
+    }
+    p_threadInfo->state.dest = p_data->destination;
+
     spiDbMbPacket_tp p_rx = p_threadInfo->p_rxBuffer;
     spiDbMbPacket_tp p_tx = p_threadInfo->p_txBuffer;
+    uint32_t frameSize = spiFrame[p_data->destination].size;
+
+    // the DMA buffers are shared with the fast path walks
+    spiBusAcquire(p_threadInfo);
 
     p_tx->header.pktId = p_threadInfo->state.nxtTxId++;
     p_tx->header.cmd = p_data->cmd;
@@ -441,10 +1036,10 @@ __ITCMRAM__ HAL_StatusTypeDef handleSpiMsg(ctrlCommThreadInfo_tp p_threadInfo, c
     memcpy(p_tx->spiDBMBPacket_payload, &(p_data->payload), sizeof(cncMsgPayload_t));
 
     if (p_threadInfo->state.sendCrcErrors) {
-        p_tx->crc = p_threadInfo->state.sendCrcErrors;
+        SPI_FRAME_CRC(p_tx, frameSize) = p_threadInfo->state.sendCrcErrors;
         p_threadInfo->state.sendCrcErrors--;
     } else {
-        p_tx->crc = HAL_CRC_Calculate(&hcrc, p_tx->u32, (SPI_DBMB_PKT_SIZE - sizeof(uint32_t)) / sizeof(uint32_t));
+        spiPktSeal(p_tx, frameSize);
     }
 #if ENABLE_SPI_TRACE_BUFFER || PRINT_FULL_SPI_PACKET || PRINT_SPI_CRC_ERROR
     uint32_t spiBufferIndex;
@@ -524,21 +1119,17 @@ __ITCMRAM__ HAL_StatusTypeDef handleSpiMsg(ctrlCommThreadInfo_tp p_threadInfo, c
     xTracePrintCompactF3(urlLogTxMsg, "handleSpiMsg dest=%d per=%d lgBuf=%x", p_threadInfo->state.dest, p_data->payload.cmd.cncMsgPayloadHeader.peripheral, (uint32_t)p_dbCommThread->dbCommState.largeBuffer);
     xTracePrintCompactF2(urlLogTxMsg, "p_tx=%p p_rx=%p", (uint32_t)p_tx, (uint32_t)p_rx);
 
-    if(p_data->payload.cmd.cncMsgPayloadHeader.action>=CNC_ACTION_READ_SMALL_BUFFER) {
+    if (largeBufferRead) {
         const int PERIPHERAL_IDX_IN_PACKET = 8;
         xTracePrintCompactF2(
             urlLogTxMsg, "p_tx[%d]=0x%x", PERIPHERAL_IDX_IN_PACKET, p_tx->u8[PERIPHERAL_IDX_IN_PACKET]);
-        halResult =
-            HAL_SPI_TransmitReceive_DMA(p_threadInfo->hspi, (uint8_t *)p_tx, (uint8_t *)p_rx, SPI_DBMB_PKT_SIZE);
+        halResult = HAL_SPI_TransmitReceive_DMA(p_threadInfo->hspi, (uint8_t *)p_tx, (uint8_t *)p_rx, frameSize);
         if (halResult != HAL_OK) {
             DPRINTF_ERROR("%s SPI%d TXRX failure %d\r\n", __func__, p_threadInfo->spiBusId, halResult);
             goto handleSpiMsgEnd;
         }
 
         result = ulTaskNotifyTake(true, timeout_ms);
-        if (timeout_ms == SPI_RX_LARGEBUFFER_TIMEOUT_MS) {
-            p_threadInfo->state.spiStats.txPktCnt++;
-        }
         p_threadInfo->state.spiStats.txPktCnt++;
         if (result != TASK_NOTIFY_OK) {
             DPRINTF_ERROR("%s SPI%d SEMA failure %d\r\n", __func__, p_threadInfo->spiBusId, result);
@@ -546,43 +1137,48 @@ __ITCMRAM__ HAL_StatusTypeDef handleSpiMsg(ctrlCommThreadInfo_tp p_threadInfo, c
             goto handleSpiMsgEnd;
         }
         RAISE_CS(p_threadInfo->state.dest);
-        osDelay(SB_DATA_PROCESSING_DELAY_MS); // give time for Daughter card to process last message
-        LOWER_CS(p_threadInfo->state.dest);
 
-        uint8_t *p_rxLargeBuffer = p_data->payload.cmd.largeBufferAddr;
-        uint32_t sz = p_data->payload.cmd.cncMsgPayloadHeader.cncActionData.largeBufferSz;
+        // The buffer is read in chunks by spiLargeBufferService() once the daughter card
+        // had time to process the request, the bus keeps serving the other boards meanwhile.
+        spiLargeBuffer_tp p_lbuf = &p_threadInfo->lbuf;
+        p_lbuf->p_buffer = p_data->payload.cmd.largeBufferAddr;
+        p_lbuf->size = p_data->payload.cmd.cncMsgPayloadHeader.cncActionData.largeBufferSz;
 
         xTracePrintCompactF3(
-            urlLogTxMsg, "Lbuf SPI%d of sz=%d p_rx=%x", p_threadInfo->spiBusId, sz, (uint32_t)p_rxLargeBuffer);
-        rxLargeBufferInfo.largeBufferPtr = p_rxLargeBuffer;
-        p_rx = &rxLargeBufferInfo;
+            urlLogTxMsg, "Lbuf SPI%d of sz=%d p_rx=%x", p_threadInfo->spiBusId, p_lbuf->size, (uint32_t)p_lbuf->p_buffer);
+        memset(&p_lbuf->rxInfo, 0, sizeof(p_lbuf->rxInfo));
+        p_lbuf->rxInfo.header.cmd = SPICMD_RESP_CNC;
+        p_lbuf->rxInfo.header.xInfo = p_data->xInfo;
+        p_lbuf->rxInfo.header.cmdResponse.cmdUid = p_data->cmdResponse.cmdUid;
+        p_lbuf->rxInfo.header.cmdResponse.cmdResponse = NO_ERROR;
+        p_lbuf->rxInfo.header.cmdResponse.flags = p_data->cmdResponse.flags;
+        p_lbuf->rxInfo.largeBufferPtr = p_lbuf->p_buffer;
         // 0xFE is used as it cannot be a stuck MISO line at 0 or 1.
-
-        memset(p_rxLargeBuffer, NOT_A_STUCK_MISO_DATA, sz);
-        halResult = HAL_SPI_Receive_DMA(p_threadInfo->hspi, p_rxLargeBuffer, sz);
+        memset(p_lbuf->p_buffer, NOT_A_STUCK_MISO_DATA, p_lbuf->size);
 
         p_data->cmd = SPICMD_RESP_CNC;
         p_data->xInfo = p_tx->header.xInfo;
         p_data->cmdResponse.cmdUid = p_tx->header.cmdResponse.cmdUid;
         p_data->cmdResponse.cmdResponse = INTERNAL_COMMAND_ERROR;
         p_data->cmdResponse.flags = FLAG_LARGEBUFFER;
-
-        timeout_ms = SPI_RX_LARGEBUFFER_TIMEOUT_MS;
         p_dbCommThread->dbCommState.largeBuffer = NULL;
-    } else {
-        timeout_ms = SPI_TXRX_NOTIFY_TIMEOUT_MS;
-        halResult =
-            HAL_SPI_TransmitReceive_DMA(p_threadInfo->hspi, (uint8_t *)p_tx, (uint8_t *)p_rx, SPI_DBMB_PKT_SIZE);
+
+        p_lbuf->p_cncInfo = p_data;
+        p_lbuf->offset = 0;
+        p_lbuf->dest = p_threadInfo->state.dest;
+        p_lbuf->dueTick = HAL_GetTick() + SB_DATA_PROCESSING_DELAY_MS;
+        p_lbuf->state = SPI_LBUF_PROCESSING;
+        spiBusRelease(p_threadInfo);
+        return HAL_OK;
     }
+
+    halResult = HAL_SPI_TransmitReceive_DMA(p_threadInfo->hspi, (uint8_t *)p_tx, (uint8_t *)p_rx, frameSize);
     if (halResult != HAL_OK) {
         DPRINTF_ERROR("%s SPI%d TXRX failure %d\r\n", __func__, p_threadInfo->spiBusId, halResult);
         goto handleSpiMsgEnd;
     }
 
     result = ulTaskNotifyTake(true, timeout_ms);
-    if (timeout_ms == SPI_RX_LARGEBUFFER_TIMEOUT_MS) {
-        p_threadInfo->state.spiStats.txPktCnt++;
-    }
     p_threadInfo->state.spiStats.txPktCnt++;
     if (result != TASK_NOTIFY_OK) {
         DPRINTF_ERROR("%s SPI%d SEMA failure %d\r\n", __func__, p_threadInfo->spiBusId, result);
@@ -590,18 +1186,16 @@ __ITCMRAM__ HAL_StatusTypeDef handleSpiMsg(ctrlCommThreadInfo_tp p_threadInfo, c
         goto handleSpiMsgEnd;
     }
     RAISE_CS(p_threadInfo->state.dest);
-
-    if (timeout_ms == SPI_RX_LARGEBUFFER_TIMEOUT_MS) {
-        p_data->cmdResponse.cmdResponse = NO_ERROR;
-        osDelay(SB_BUFFER_CHANGE_DELAY_MS); // give time for the daughter board to reset its circular buffer
+    halResult = handleRxMsg(p_threadInfo, p_data, p_rx, frameSize);
+    spiBusRelease(p_threadInfo);
+    if (p_data->cmd == SPICMD_NOP) {
+        spiTimingDone(p_threadInfo);
     }
-    return handleRxMsg(p_threadInfo, p_data, p_rx);
+    return halResult;
 
 handleSpiMsgEnd:
-    if (timeout_ms == SPI_RX_LARGEBUFFER_TIMEOUT_MS) {
-        osDelay(SB_BUFFER_CHANGE_DELAY_MS); // give time for the daughter board to reset its circular buffer
-    }
     RAISE_CS(p_threadInfo->state.dest);
+    spiBusRelease(p_threadInfo);
     return result;
 }
 
@@ -625,7 +1219,8 @@ __ITCMRAM__ HAL_StatusTypeDef handleResponseLargeBuffer(ctrlCommThreadInfo_tp p_
 
 __ITCMRAM__ HAL_StatusTypeDef handleRxMsg(ctrlCommThreadInfo_tp p_threadInfo,
                                           cncInfo_tp p_cncInfo,
-                                          spiDbMbPacket_tp p_spiPkt) {
+                                          spiDbMbPacket_tp p_spiPkt,
+                                          uint32_t frameSize) {
     // The first byte because of the DB DMA FIFO may not be what we set it to be so just fix it to a known value.
 #ifdef SET_FIRST_BYTE_0XA5
     RX_DataCtrl[0] = 0xA5;
@@ -638,10 +1233,14 @@ __ITCMRAM__ HAL_StatusTypeDef handleRxMsg(ctrlCommThreadInfo_tp p_threadInfo,
         xTracePrintCompactF1(urlLogTxMsg, "hspi=%x Large buffer RX", (uint32_t)p_threadInfo->hspi);
         return handleResponseLargeBuffer(p_threadInfo, p_cncInfo, p_spiPkt);
     }
-    uint32_t crcCalc =
-        HAL_CRC_Calculate(&hcrc, p_spiPkt->u32, (SPI_DBMB_PKT_SIZE - sizeof(uint32_t)) / sizeof(uint32_t));
-
-    uint32_t crcRead = p_spiPkt->crc;
+    uint32_t rxSize = spiFrameCheck(p_threadInfo, p_threadInfo->state.dest, p_spiPkt, frameSize);
+    uint32_t crcCalc = 0;
+    uint32_t crcRead = 0;
+    if (rxSize == 0) {
+        // the no response patterns and the error report use the legacy frame
+        crcCalc = spiPktCrc(p_spiPkt, SPI_DBMB_PKT_SIZE);
+        crcRead = p_spiPkt->crc;
+    }
     static uint32_t pktSinceLastReportedError = 0;
     pktSinceLastReportedError++;
 #if TRACE_ANALZYE_SPI
@@ -680,7 +1279,7 @@ __ITCMRAM__ HAL_StatusTypeDef handleRxMsg(ctrlCommThreadInfo_tp p_threadInfo,
 
     vTracePrint(dbCommTrace[p_threadInfo->state.dest], spiTraceBuffer[p_threadInfo->spiBusId]);
 #endif
-    if (crcCalc == crcRead) {
+    if (rxSize != 0) {
 
 #if PRINT_FULL_SPI_PACKET
         DPRINTF_RAW("*** SPI %d MB RECEIVED from %d\r\n", p_threadInfo->spiBusId, p_threadInfo->state.dest);
@@ -761,20 +1360,392 @@ __ITCMRAM__ HAL_StatusTypeDef handleRxMsg(ctrlCommThreadInfo_tp p_threadInfo,
     return HAL_OK;
 }
 
+#if SPI_FAST_PATH
+/**
+ * @fn
+ *
+ * @brief Check for the response of a board not driving MISO, all 0x00 or all 0xFF
+ *
+ * @param[in] p_spiPkt: response
+ * @param[in] frameSize: size of the transfer in bytes
+ *
+ * @return true if no board answered
+ **/
+__ITCMRAM__ static inline bool spiPktBlank(spiDbMbPacket_tp p_spiPkt, uint32_t frameSize) {
+    uint32_t first = p_spiPkt->u32[0];
+    return (first == 0 || first == 0xFFFFFFFF) && SPI_FRAME_CRC(p_spiPkt, frameSize) == first;
+}
+
+/**
+ * @fn
+ *
+ * @brief Check that a sensor frame requested again is read before the next trigger,
+ *        the transfer time is estimated from the transfers of the walk so far
+ *
+ * @param[in] p_threadInfo: spi bus
+ *
+ * @return true if the bus has time for one more transfer
+ **/
+__ITCMRAM__ static bool spiResendFits(ctrlCommThreadInfo_tp p_threadInfo) {
+    uint32_t xferCnt = p_threadInfo->walk.xferCnt;
+    uint32_t elapsed_us = streamTimeUs() - p_threadInfo->timing.trigger_us;
+    uint32_t xfer_us = (xferCnt != 0) ? elapsed_us / xferCnt : elapsed_us;
+    return elapsed_us + xfer_us + SPI_RESEND_GUARD_US < dbTriggerIntervalUs();
+}
+
+/**
+ * @fn
+ *
+ * @brief Build the packet of the next board of the walk in the TX buffer that is not on the wire
+ *
+ * Called with the interrupts disabled or from the DMA complete interrupt.
+ *
+ * @param[in] p_threadInfo: spi bus
+ **/
+__ITCMRAM__ static void spiWalkPrepare(ctrlCommThreadInfo_tp p_threadInfo) {
+    spiWalk_tp p_walk = &p_threadInfo->walk;
+
+    p_walk->prepDest = MAX_CS_ID;
+    while (p_walk->mask != 0 || p_walk->resendMask != 0) {
+        // the sensor frames lost to a crc error are requested again after the boards of the trigger
+        bool resend = (p_walk->mask == 0);
+        uint32_t *p_mask = resend ? &p_walk->resendMask : &p_walk->mask;
+        uint32_t cs = __builtin_ctz(*p_mask);
+        *p_mask &= ~(1 << cs);
+        uint32_t dest = p_threadInfo->csStartIdx + cs;
+        if (resend && (dest == p_threadInfo->lbuf.dest || p_walk->resendLeft == 0 || !spiResendFits(p_threadInfo))) {
+            p_walk->lostCnt++;
+            continue;
+        }
+        if (dest == p_threadInfo->lbuf.dest) {
+            // the board is busy sending its buffer, it will answer the next trigger
+            p_threadInfo->state.spiStats.lbufSkipCnt++;
+            continue;
+        }
+
+        cncInfo_tp p_msg = dbCommSensorMsg(dest);
+        spiDbMbPacket_tp p_tx = SPI_PIPE_TX(p_threadInfo, p_walk->prepIdx);
+        uint32_t frameSize = spiFrame[dest].size;
+        p_tx->header.pktId = p_threadInfo->state.nxtTxId++;
+        p_tx->header.cmd = resend ? SPICMD_SENSOR_RESEND : p_msg->cmd;
+        p_tx->header.xInfo = p_msg->xInfo;
+        p_tx->header.cmdResponse.cmdUid = p_msg->cmdResponse.cmdUid;
+        p_tx->header.cmdResponse.cmdResponse = p_msg->cmdResponse.cmdResponse;
+        memcpy(p_tx->spiDBMBPacket_payload, &(p_msg->payload), sizeof(cncMsgPayload_t));
+        spiPktSeal(p_tx, frameSize);
+        p_walk->frameSize[p_walk->prepIdx] = frameSize;
+        p_walk->resend[p_walk->prepIdx] = resend;
+        p_walk->prepDest = dest;
+        if (resend) {
+            p_walk->resendCnt++;
+            p_walk->resendLeft--;
+        }
+        return;
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Put the prepared packet on the wire, the walk buffers swap
+ *
+ * @param[in] p_threadInfo: spi bus
+ *
+ * @return true if a transfer was started, false when no board is left
+ **/
+__ITCMRAM__ static bool spiWalkStart(ctrlCommThreadInfo_tp p_threadInfo) {
+    spiWalk_tp p_walk = &p_threadInfo->walk;
+
+    while (p_walk->prepDest != MAX_CS_ID) {
+        uint32_t idx = p_walk->prepIdx;
+        p_walk->dest = p_walk->prepDest;
+        p_walk->wireIdx = idx;
+        p_walk->prepIdx = idx ^ 1;
+        LOWER_CS(p_walk->dest);
+        if (HAL_SPI_TransmitReceive_DMA(p_threadInfo->hspi,
+                                        (uint8_t *)SPI_PIPE_TX(p_threadInfo, idx),
+                                        (uint8_t *)SPI_PIPE_RX(p_threadInfo, idx),
+                                        p_walk->frameSize[idx]) == HAL_OK) {
+            return true;
+        }
+        RAISE_CS(p_walk->dest);
+        p_walk->errorCnt++;
+        spiWalkPrepare(p_threadInfo);
+    }
+    return false;
+}
+
+/**
+ * @fn
+ *
+ * @brief End the walk, the bus task waiting for the bus is woken
+ *
+ * @param[in] p_threadInfo: spi bus
+ * @param[out] p_woken: set when the bus task was woken
+ **/
+__ITCMRAM__ static void spiWalkEnd(ctrlCommThreadInfo_tp p_threadInfo, BaseType_t *p_woken) {
+    spiWalk_tp p_walk = &p_threadInfo->walk;
+
+    p_walk->active = false;
+    if (p_walk->taskWaiting) {
+        p_walk->taskWaiting = false;
+        vTaskNotifyGiveFromISR(p_threadInfo->threadId, p_woken);
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Start a walk of the boards of a bus, the second packet is prepared while the first is on the wire
+ *
+ * Called with the interrupts disabled.
+ *
+ * @param[in] p_threadInfo: spi bus
+ * @param[in] busMask: boards to read, bit 0 is the first board of the bus
+ * @param[out] p_woken: set when the bus task was woken
+ **/
+__ITCMRAM__ static void spiWalkBegin(ctrlCommThreadInfo_tp p_threadInfo, uint32_t busMask, BaseType_t *p_woken) {
+    spiWalk_tp p_walk = &p_threadInfo->walk;
+
+    p_walk->active = true;
+    p_walk->walkCnt++;
+    p_walk->xferCnt = 0;
+    p_walk->resendLeft = p_threadInfo->link.resendBudget;
+    p_walk->mask = busMask;
+    spiLinkApply(p_threadInfo);
+    spiWalkPrepare(p_threadInfo);
+    if (spiWalkStart(p_threadInfo)) {
+        spiWalkPrepare(p_threadInfo);
+    } else {
+        spiWalkEnd(p_threadInfo, p_woken);
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Handle a sensor response, called from the DMA complete interrupt
+ *
+ * Sensor data is stored here, anything else (CRC errors, command responses, a board to enable)
+ * is copied and passed to the bus task which handles it as a task path response.
+ * A sensor frame that fails its crc is requested again once the boards of the trigger are read.
+ *
+ * @param[in] p_threadInfo: spi bus
+ * @param[in] dest: board that sent the response
+ * @param[in] p_tx: request the response answers
+ * @param[in] p_rx: response
+ * @param[in] frameSize: size of the transfer in bytes
+ * @param[in] resent: the request was a SPICMD_SENSOR_RESEND
+ **/
+__ITCMRAM__ static void spiWalkRx(ctrlCommThreadInfo_tp p_threadInfo,
+                                  uint32_t dest,
+                                  spiDbMbPacket_tp p_tx,
+                                  spiDbMbPacket_tp p_rx,
+                                  uint32_t frameSize,
+                                  bool resent) {
+    spiWalk_tp p_walk = &p_threadInfo->walk;
+    uint32_t rxSize = spiFrameCheck(p_threadInfo, dest, p_rx, frameSize);
+
+    if (resent) {
+        // the board answers with the frame that followed the last one stored
+        if (rxSize != 0 && p_rx->header.cmd == SPICMD_STREAM_SENSOR && p_rx->header.xInfo != p_tx->header.xInfo) {
+            p_walk->recoveredCnt++;
+        } else {
+            p_walk->lostCnt++;
+        }
+    } else if (rxSize == 0 && !spiPktBlank(p_rx, frameSize)) {
+        if (spiFrame[dest].resend) {
+            p_walk->resendMask |= 1 << (dest - p_threadInfo->csStartIdx);
+        } else {
+            // the board would answer with its latest frame, not the one that failed
+            p_walk->lostCnt++;
+        }
+    }
+
+    if (rxSize != 0 && p_rx->header.cmd == SPICMD_STREAM_SENSOR &&
+        dbCommSensorRxFromISR(dest,
+                              p_rx->header.xInfo,
+                              p_rx->header.cmdResponse.flags,
+                              (cncPayload_tp)(p_rx->spiDBMBPacket_payload),
+                              rxSize)) {
+        p_threadInfo->state.spiStats.rxPktCnt++;
+        return;
+    }
+
+    spiDeferredRx_tp p_defer = &spiDeferredRx[p_threadInfo->spiBusId][p_walk->deferIdx % SPI_DEFERRED_RX_DEPTH];
+    if (p_defer->used) {
+        p_walk->deferDropCnt++;
+        return;
+    }
+    p_walk->deferIdx++;
+    memcpy(&p_defer->info, dbCommSensorMsg(dest), sizeof(cncInfo_t));
+    memcpy(&p_defer->pkt, p_rx, frameSize);
+    // a crc error is checked again, and counted, by the bus task
+    p_defer->frameSize = (rxSize != 0) ? rxSize : frameSize;
+    p_defer->used = true;
+    p_threadInfo->state.spiStats.msgPending++;
+    if (osMessagePut(p_threadInfo->msgQId, (uint32_t)p_defer, 0) != osOK) {
+        p_threadInfo->state.spiStats.msgPending--;
+        p_defer->used = false;
+        p_walk->deferDropCnt++;
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Complete the transfer of the board being read, called from the DMA complete interrupt
+ *
+ * The prepared packet is put on the wire first, the response just received is checked and
+ * the packet after it is prepared while that transfer runs.
+ *
+ * @param[in] p_threadInfo: spi bus
+ * @param[out] p_woken: set when a task was woken
+ **/
+__ITCMRAM__ static void spiWalkRxFromISR(ctrlCommThreadInfo_tp p_threadInfo, BaseType_t *p_woken) {
+    spiWalk_tp p_walk = &p_threadInfo->walk;
+    uint32_t rxDest = p_walk->dest;
+    spiDbMbPacket_tp p_tx = SPI_PIPE_TX(p_threadInfo, p_walk->wireIdx);
+    spiDbMbPacket_tp p_rx = SPI_PIPE_RX(p_threadInfo, p_walk->wireIdx);
+    uint32_t rxFrameSize = p_walk->frameSize[p_walk->wireIdx];
+    bool resent = p_walk->resend[p_walk->wireIdx];
+
+    RAISE_CS(rxDest);
+    p_threadInfo->state.spiStats.txPktCnt++;
+    p_walk->xferCnt++;
+    if (p_walk->prepDest == MAX_CS_ID) {
+        // boards of an overrun trigger were added after the last one was prepared
+        spiWalkPrepare(p_threadInfo);
+    }
+    bool started = spiWalkStart(p_threadInfo);
+
+    spiWalkRx(p_threadInfo, rxDest, p_tx, p_rx, rxFrameSize, resent);
+    spiTimingDone(p_threadInfo);
+
+    if (!started) {
+        // the last board of the walk may need its frame again
+        spiWalkPrepare(p_threadInfo);
+        started = spiWalkStart(p_threadInfo);
+    }
+    if (started) {
+        spiWalkPrepare(p_threadInfo);
+    } else {
+        spiWalkEnd(p_threadInfo, p_woken);
+    }
+}
+
+__ITCMRAM__ void spiFastPathTriggerFromISR(uint32_t walkMask) {
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (int i = 0; i < MAX_SPI; i++) {
+        ctrlCommThreadInfo_tp p_threadInfo = &spiCommThreadInfo[i];
+        spiWalk_tp p_walk = &p_threadInfo->walk;
+        uint32_t busMask = (walkMask >> p_threadInfo->csStartIdx) & ((1 << MAX_CS_PER_SPI) - 1);
+
+        spiTimingTrigger(p_threadInfo, p_walk->active);
+        if (busMask == 0 || !p_threadInfo->state.ready) {
+            continue;
+        }
+        if (p_walk->active) {
+            // the previous trigger is still being read, its remaining boards are read once
+            p_walk->overrunCnt++;
+            p_walk->mask |= busMask;
+        } else if (p_walk->taskOwned) {
+            p_walk->pendingMask |= busMask;
+        } else {
+            spiWalkBegin(p_threadInfo, busMask, &xHigherPriorityTaskWoken);
+        }
+    }
+    __set_PRIMASK(primask);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+#endif
+
+__ITCMRAM__ void spiTimingTriggerFromISR(void) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (int i = 0; i < MAX_SPI; i++) {
+        spiTimingTrigger(&spiCommThreadInfo[i], false);
+    }
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @fn
+ *
+ * @brief Take the bus from the fast path, waits for the running walk to complete
+ *
+ * The triggers received while the task owns the bus are walked by spiBusRelease().
+ *
+ * @param[in] p_threadInfo: spi bus
+ **/
+__ITCMRAM__ static void spiBusAcquire(ctrlCommThreadInfo_tp p_threadInfo) {
+#if SPI_FAST_PATH
+    spiWalk_tp p_walk = &p_threadInfo->walk;
+    while (1) {
+        __disable_irq();
+        if (!p_walk->active) {
+            p_walk->taskOwned = true;
+            p_walk->taskWaiting = false;
+            __enable_irq();
+            break;
+        }
+        p_walk->taskWaiting = true;
+        __enable_irq();
+        ulTaskNotifyTake(true, SPI_TXRX_NOTIFY_TIMEOUT_MS);
+    }
+    // the walk complete notification must not be taken as the end of the next transfer
+    ulTaskNotifyTake(true, 0);
+#endif
+    spiLinkApply(p_threadInfo);
+}
+
+/**
+ * @fn
+ *
+ * @brief Give the bus back to the fast path, starts the walk of the triggers received meanwhile
+ *
+ * @param[in] p_threadInfo: spi bus
+ **/
+__ITCMRAM__ static void spiBusRelease(ctrlCommThreadInfo_tp p_threadInfo) {
+#if SPI_FAST_PATH
+    spiWalk_tp p_walk = &p_threadInfo->walk;
+    BaseType_t woken = pdFALSE;
+    __disable_irq();
+    p_walk->taskOwned = false;
+    if (p_walk->pendingMask != 0) {
+        uint32_t busMask = p_walk->pendingMask;
+        p_walk->pendingMask = 0;
+        spiWalkBegin(p_threadInfo, busMask, &woken);
+    }
+    __enable_irq();
+#endif
+}
+
 __ITCMRAM__ void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     volatile SPI_HandleTypeDef *t = hspi;
+    ctrlCommThreadInfo_tp p_threadInfo;
     if (hspi == &hspi1) {
-        vTaskNotifyGiveFromISR(spiCommThreadInfo[0].threadId, &xHigherPriorityTaskWoken);
+        p_threadInfo = &spiCommThreadInfo[0];
     } else if (hspi == &hspi2) {
-        vTaskNotifyGiveFromISR(spiCommThreadInfo[1].threadId, &xHigherPriorityTaskWoken);
+        p_threadInfo = &spiCommThreadInfo[1];
     } else if (hspi == &hspi3) {
-        vTaskNotifyGiveFromISR(spiCommThreadInfo[2].threadId, &xHigherPriorityTaskWoken);
+        p_threadInfo = &spiCommThreadInfo[2];
     } else {
         DPRINTF_ERROR("hspi %p not inuse \r\n", t);
 
         return;
     }
+#if SPI_FAST_PATH
+    if (p_threadInfo->walk.active) {
+        spiWalkRxFromISR(p_threadInfo, &xHigherPriorityTaskWoken);
+        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+        return;
+    }
+#endif
+    vTaskNotifyGiveFromISR(p_threadInfo->threadId, &xHigherPriorityTaskWoken);
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
@@ -784,6 +1755,25 @@ __ITCMRAM__ void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi) {
 
 static uint16_t cliResult;
 
+#define SPI_STRESS_ROUNDS_MAX 1000
+#define SPI_STRESS_DRAIN_MS 2000 // wait for the answers once the last round is sent
+
+extern __DTCMRAM__ dbCommThreadInfo_t dbCommThreads[MAX_CS_ID];
+static volatile uint32_t spiStressAnswerCnt;
+
+/**
+ * @fn
+ *
+ * @brief Average trigger to last board complete time
+ *
+ * @param[in] p_timing: bus timing statistics
+ *
+ * @return average in us, 0 before the first trigger completed
+ **/
+static uint32_t spiTimingAvgUs(spiTiming_tp p_timing) {
+    return (p_timing->cnt == 0) ? 0 : (uint32_t)(p_timing->sum_us / p_timing->cnt);
+}
+
 void appendSpiStatsToBuffer(char *buf, uint32_t bufSz, uint32_t spiId) {
     char *nxt = buf;
 
@@ -804,6 +1794,101 @@ void appendSpiStatsToBuffer(char *buf, uint32_t bufSz, uint32_t spiId) {
                     spiCommThreadInfo[spiId].state.spiStats.txPktRatePerSec);
     nxt += snprintf(
         (char *)nxt, bufSz - (nxt - buf), "\tMsg Pending= %lu\r\n", spiCommThreadInfo[spiId].state.spiStats.msgPending);
+    nxt += snprintf((char *)nxt,
+                    bufSz - (nxt - buf),
+                    "\tLbuf Chunks= %lu\r\n",
+                    spiCommThreadInfo[spiId].state.spiStats.lbufChunkCnt);
+    nxt += snprintf((char *)nxt,
+                    bufSz - (nxt - buf),
+                    "\tLbuf Skips = %lu\r\n",
+                    spiCommThreadInfo[spiId].state.spiStats.lbufSkipCnt);
+    nxt += snprintf((char *)nxt,
+                    bufSz - (nxt - buf),
+                    "\tTrig->Done = avg %lu us, max %lu us\r\n",
+                    spiTimingAvgUs(&spiCommThreadInfo[spiId].timing),
+                    spiCommThreadInfo[spiId].timing.max_us);
+    nxt += snprintf((char *)nxt,
+                    bufSz - (nxt - buf),
+                    "\tLink       = %lu kHz, %lu ppm crc errors\r\n",
+                    spiLinkClockKhz(&spiCommThreadInfo[spiId].link),
+                    spiCommThreadInfo[spiId].link.errorPpm);
+}
+
+/**
+ * @fn
+ *
+ * @brief Count the answers to the stress commands, called from the dbComm tasks
+ **/
+static osStatus spiStressCallback(spiDbMbCmd_e spiDbMbCmd,
+                                  uint32_t cbId,
+                                  uint8_t xInfo,
+                                  spiDbMbPacketCmdResponse_t cmdResponse,
+                                  cncPayload_tp p_cncMsg) {
+    __disable_irq();
+    spiStressAnswerCnt++;
+    __enable_irq();
+    return osOK;
+}
+
+/**
+ * @fn
+ *
+ * @brief Send rounds of register reads to every enabled board through the CNC task, as the web
+ *        requests are, while the triggers keep streaming, then report the message lists.
+ *
+ * A round is sent each ms without waiting for the answers of the previous ones.
+ *
+ * @param[in] hCli: cli the report is printed to
+ * @param[in] rounds: reads sent to each board, 1-SPI_STRESS_ROUNDS_MAX
+ **/
+static void spiCncStress(CLI *hCli, uint32_t rounds) {
+    cncMsgPayload_t payload = {.cncMsgPayloadHeader.peripheral = PER_MCU,
+                               .cncMsgPayloadHeader.action = CNC_ACTION_READ,
+                               .cncMsgPayloadHeader.addr = SB_FW_VERSION_MAJ};
+    uint32_t sentCnt = 0;
+    uint32_t refusedCnt = 0;
+    uint32_t boardCnt = 0;
+
+    rounds = MIN(MAX(rounds, 1), SPI_STRESS_ROUNDS_MAX);
+    spiStressAnswerCnt = 0;
+    for (int i = 0; i < MAX_CS_ID; i++) {
+        boardCnt += dbCommThreads[i].dbCommState.enabled;
+    }
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (int i = 0; i < MAX_CS_ID; i++) {
+            if (!dbCommThreads[i].dbCommState.enabled) {
+                continue;
+            }
+            if (cncSendMsg(i, SPICMD_CNC, (cncPayload_tp)&payload, 0, spiStressCallback, 0) == osOK) {
+                sentCnt++;
+            } else {
+                refusedCnt++;
+            }
+        }
+        osDelay(1);
+    }
+    uint32_t start = HAL_GetTick();
+    while (spiStressAnswerCnt < sentCnt && HAL_GetTick() - start < SPI_STRESS_DRAIN_MS) {
+        osDelay(10);
+    }
+
+    cncMsgList_tp p_cncList = cncMsgListGet();
+    CliPrintf(hCli,
+              "Stress = %lu boards, %lu sent, %lu refused, %lu answered\r\n",
+              boardCnt,
+              sentCnt,
+              refusedCnt,
+              spiStressAnswerCnt);
+    CliPrintf(hCli,
+              "\tCnc Msg List = %lu free, %lu low water, %lu empty\r\n",
+              p_cncList->freeCnt,
+              p_cncList->lowWater,
+              p_cncList->emptyCnt);
+    CliPrintf(hCli,
+              "\tSpi Msg List = %lu free, %lu low water, %lu empty\r\n",
+              spiMsgList.freeCnt,
+              spiMsgList.lowWater,
+              spiMsgList.emptyCnt);
 }
 
 int16_t spiCliCmd(CLI *hCli, int argc, char *argv[]) {
@@ -826,7 +1911,11 @@ int16_t spiCliCmd(CLI *hCli, int argc, char *argv[]) {
             }
             success = 1;
             CliPrintf(hCli, "System:\r\n");
-            CliPrintf(hCli, "\tSpi Msg Pool Memory Exhaustion = %lu\r\n", noSpiMsgPoolMemoryCnt);
+            CliPrintf(hCli,
+                      "\tSpi Msg List = %lu free, %lu low water, %lu empty\r\n",
+                      spiMsgList.freeCnt,
+                      spiMsgList.lowWater,
+                      spiMsgList.emptyCnt);
             for (int i = min; i < max; i++) {
                 CliPrintf(hCli, "SPI%d:\r\n", i + 1);
                 CliPrintf(hCli, "\tTx Cnt     = %lu\r\n", spiCommThreadInfo[i].state.spiStats.txPktCnt);
@@ -836,12 +1925,53 @@ int16_t spiCliCmd(CLI *hCli, int argc, char *argv[]) {
                 CliPrintf(hCli, "\tEnabled DBs= %lu\r\n", spiCommThreadInfo[i].state.spiStats.enableCnt);
                 CliPrintf(hCli, "\tPkt Rate   = %lu\r\n", spiCommThreadInfo[i].state.spiStats.txPktRatePerSec);
                 CliPrintf(hCli, "\tMsg Pending= %lu\r\n", spiCommThreadInfo[i].state.spiStats.msgPending);
+                CliPrintf(hCli, "\tLbuf Chunks= %lu\r\n", spiCommThreadInfo[i].state.spiStats.lbufChunkCnt);
+                CliPrintf(hCli, "\tLbuf Skips = %lu\r\n", spiCommThreadInfo[i].state.spiStats.lbufSkipCnt);
+                CliPrintf(hCli, "\tLbuf Share = %lu%%\r\n", spiLargeBufferShare);
+                uint32_t extCnt = 0;
+                for (int cs = 0; cs < MAX_CS_PER_SPI; cs++) {
+                    extCnt += (spiFrame[spiCommThreadInfo[i].csStartIdx + cs].size != SPI_DBMB_PKT_SIZE);
+                }
+                CliPrintf(hCli,
+                          "\tExt Frames = %lu boards, %lu legacy rx, %lu reverts\r\n",
+                          extCnt,
+                          spiCommThreadInfo[i].state.spiStats.frameLegacyCnt,
+                          spiCommThreadInfo[i].state.spiStats.frameRevertCnt);
+                CliPrintf(hCli,
+                          "\tTrig->Done = last %lu us, avg %lu us, max %lu us, %lu triggers\r\n",
+                          spiCommThreadInfo[i].timing.last_us,
+                          spiTimingAvgUs(&spiCommThreadInfo[i].timing),
+                          spiCommThreadInfo[i].timing.max_us,
+                          spiCommThreadInfo[i].timing.cnt);
+                CliPrintf(hCli,
+                          "\tLink       = %lu kHz, %lu ppm crc errors, resend budget %lu, %lu adjusts\r\n",
+                          spiLinkClockKhz(&spiCommThreadInfo[i].link),
+                          spiCommThreadInfo[i].link.errorPpm,
+                          spiCommThreadInfo[i].link.resendBudget,
+                          spiCommThreadInfo[i].link.adjustCnt);
+#if !SPI_FAST_PATH
+                CliPrintf(hCli, "\tSensor Busy= %lu\r\n", spiCommThreadInfo[i].state.spiStats.sensorBusyCnt);
+#endif
+#if SPI_FAST_PATH
+                CliPrintf(hCli,
+                          "\tFast Path  = %lu walks, %lu overruns, %lu deferred drops, %lu errors\r\n",
+                          spiCommThreadInfo[i].walk.walkCnt,
+                          spiCommThreadInfo[i].walk.overrunCnt,
+                          spiCommThreadInfo[i].walk.deferDropCnt,
+                          spiCommThreadInfo[i].walk.errorCnt);
+                CliPrintf(hCli,
+                          "\tResend     = %lu sent, %lu recovered, %lu lost\r\n",
+                          spiCommThreadInfo[i].walk.resendCnt,
+                          spiCommThreadInfo[i].walk.recoveredCnt,
+                          spiCommThreadInfo[i].walk.lostCnt);
+#endif
             }
         } else if (argc == CMD_PARAM_CNT(0) && strcmp(argv[CMD_ARG_IDX], "clear") == 0) {
             if (strcmp(argv[CMD_PARAM_IDX(0)], "all") == 0) {
                 min = 0;
                 max = MAX_SPI;
-                noSpiMsgPoolMemoryCnt = 0;
+                spiMsgList.emptyCnt = 0;
+                spiMsgList.lowWater = spiMsgList.freeCnt;
             } else {
                 uint32_t idx = atoi(argv[CMD_PARAM_IDX(0)]);
                 if (idx >= MAX_SPI) {
@@ -857,6 +1987,26 @@ int16_t spiCliCmd(CLI *hCli, int argc, char *argv[]) {
                 spiCommThreadInfo[i].state.spiStats.rxPktCnt = 0;
                 spiCommThreadInfo[i].state.spiStats.crcError = 0;
                 spiCommThreadInfo[i].state.spiStats.qFullCnt = 0;
+                spiCommThreadInfo[i].state.spiStats.lbufChunkCnt = 0;
+                spiCommThreadInfo[i].state.spiStats.lbufSkipCnt = 0;
+                spiCommThreadInfo[i].state.spiStats.frameLegacyCnt = 0;
+                spiCommThreadInfo[i].state.spiStats.frameRevertCnt = 0;
+                spiCommThreadInfo[i].state.spiStats.sensorBusyCnt = 0;
+                spiCommThreadInfo[i].walk.walkCnt = 0;
+                spiCommThreadInfo[i].walk.overrunCnt = 0;
+                spiCommThreadInfo[i].walk.deferDropCnt = 0;
+                spiCommThreadInfo[i].walk.errorCnt = 0;
+                spiCommThreadInfo[i].walk.resendCnt = 0;
+                spiCommThreadInfo[i].walk.recoveredCnt = 0;
+                spiCommThreadInfo[i].walk.lostCnt = 0;
+                spiCommThreadInfo[i].link.lastXfers = 0;
+                spiCommThreadInfo[i].link.lastErrors = 0;
+                __disable_irq();
+                spiCommThreadInfo[i].timing.done_us = 0;
+                spiCommThreadInfo[i].timing.max_us = 0;
+                spiCommThreadInfo[i].timing.sum_us = 0;
+                spiCommThreadInfo[i].timing.cnt = 0;
+                __enable_irq();
             }
         } else if (argc == CMD_PARAM_CNT(1) && strcmp(argv[CMD_ARG_IDX], "send") == 0) {
             int destination = atoi(argv[CMD_PARAM_IDX(0)]);
@@ -879,6 +2029,9 @@ int16_t spiCliCmd(CLI *hCli, int argc, char *argv[]) {
                 DPRINTF_ERROR("adc cli command timeout\r\n");
                 cliResult = 0;
             }
+        } else if (argc == CMD_PARAM_CNT(0) && strcmp(argv[CMD_ARG_IDX], "stress") == 0) {
+            spiCncStress(hCli, atoi(argv[CMD_PARAM_IDX(0)]));
+            success = 1;
         } else if (argc == CMD_PARAM_CNT(1) && strcmp(argv[CMD_ARG_IDX], "txcrcerror") == 0) {
             int destination = atoi(argv[CMD_PARAM_IDX(0)]);
             int crcCnt = atoi(argv[CMD_PARAM_IDX(1)]);
@@ -913,10 +2066,102 @@ osStatus ctrlSpiCommCliCallback(spiDbMbCmd_e spiDbMbCmd,
     return status;
 }
 
+/**
+ * @fn
+ *
+ * @brief Set the clock and resend budget of a bus, the window restarts to measure them
+ *
+ * The clock is put on the bus by spiLinkApply() once nothing is on the wire.
+ *
+ * @param[in] p_threadInfo: spi bus
+ * @param[in] mbr: clock divider 2 << mbr
+ * @param[in] resendBudget: sensor frames a walk may request again
+ **/
+static void spiLinkAdjust(ctrlCommThreadInfo_tp p_threadInfo, uint32_t mbr, uint32_t resendBudget) {
+    spiLink_tp p_link = &p_threadInfo->link;
+    uint32_t fromKhz = spiLinkClockKhz(p_link);
+    uint32_t fromBudget = p_link->resendBudget;
+
+    if (mbr == p_link->mbr && resendBudget == fromBudget) {
+        return;
+    }
+    if (mbr > p_link->mbr && p_link->raised) {
+        // the last raise did not hold, wait longer before trying it again
+        p_link->holdS = MIN(p_link->holdS * 2, SPI_LINK_HOLD_MAX_S);
+    }
+    if (mbr != p_link->mbr) {
+        p_link->raised = (mbr < p_link->mbr);
+    }
+    p_link->mbr = mbr;
+    p_link->resendBudget = resendBudget;
+    p_link->adjustCnt++;
+    p_link->sinceS = 0;
+    memset(p_link->xfers, 0, sizeof(p_link->xfers));
+    memset(p_link->errors, 0, sizeof(p_link->errors));
+    DPRINTF_INFO("SPI%lu link %lu ppm crc errors, clock %lu -> %lu kHz, resend budget %lu -> %lu\r\n",
+                 p_threadInfo->spiBusId + 1,
+                 p_link->errorPpm,
+                 fromKhz,
+                 spiLinkClockKhz(p_link),
+                 fromBudget,
+                 resendBudget);
+}
+
+/**
+ * @fn
+ *
+ * @brief Measure the crc error rate of a bus over the window, called once a second
+ *
+ * Above the target the clock is lowered and every board may have its frame requested again.
+ * Below a quarter of the target for holdS seconds the clock is raised and the resend budget halved.
+ * holdS doubles each time a raised clock has to be lowered again, so a bus settles on the fastest
+ * clock that keeps its error rate under the target.
+ *
+ * @param[in] p_threadInfo: spi bus
+ **/
+static void spiLinkUpdate(ctrlCommThreadInfo_tp p_threadInfo) {
+    spiLink_tp p_link = &p_threadInfo->link;
+    spiStats_tp p_stats = &p_threadInfo->state.spiStats;
+    uint32_t slot = p_link->slot++ % SPI_LINK_WINDOW_S;
+    uint32_t txPktCnt = p_stats->txPktCnt;
+    uint32_t crcError = p_stats->crcError;
+
+    p_link->xfers[slot] = txPktCnt - p_link->lastXfers;
+    p_link->errors[slot] = crcError - p_link->lastErrors;
+    p_link->lastXfers = txPktCnt;
+    p_link->lastErrors = crcError;
+    p_link->sinceS++;
+
+    uint32_t xfers = 0;
+    uint32_t errors = 0;
+    for (int i = 0; i < SPI_LINK_WINDOW_S; i++) {
+        xfers += p_link->xfers[i];
+        errors += p_link->errors[i];
+    }
+    if (xfers < SPI_LINK_MIN_XFERS) {
+        return;
+    }
+    p_link->errorPpm = (uint32_t)((uint64_t)errors * 1000000 / xfers);
+
+    uint32_t target = spiCrcTargetPpm;
+    if (target == 0) {
+        return;
+    }
+    if (p_link->errorPpm > target) {
+        spiLinkAdjust(p_threadInfo, MIN(p_link->mbr + 1, SPI_LINK_MBR_SLOW), MAX_CS_PER_SPI);
+    } else if (p_link->errorPpm <= target / 4 && p_link->sinceS >= p_link->holdS) {
+        uint32_t fastMbr = MAX(SPI_LINK_MBR_FAST, p_link->bootMbr);
+        spiLinkAdjust(p_threadInfo,
+                      (p_link->mbr > fastMbr) ? p_link->mbr - 1 : p_link->mbr,
+                      MAX(p_link->resendBudget / 2, SPI_LINK_RESEND_MIN));
+    }
+}
+
 void updateSpiStats(void) {
     for (int i = 0; i < MAX_SPI; i++) {
         spiCommThreadInfo[i].state.spiStats.txPktRatePerSec =
             spiCommThreadInfo[i].state.spiStats.txPktCnt - spiCommThreadInfo[i].state.spiStats.lastTxPktCnt;
         spiCommThreadInfo[i].state.spiStats.lastTxPktCnt = spiCommThreadInfo[i].state.spiStats.txPktCnt;
+        spiLinkUpdate(&spiCommThreadInfo[i]);
     }
 }
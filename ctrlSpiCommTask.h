@@ -10,6 +10,7 @@
 #define APP_INC_CTRLSPICOMMTASK_H_
 
 #include "cmdAndCtrl.h"
+#include "registerParams.h"
 #include "saqTarget.h"
 #include "watchDog.h"
 #include <stdlib.h>
@@ -22,11 +23,10 @@ typedef struct {
     uint8_t sensorUID; // xInfo changes with each new sensor data store last one
     uint32_t rxCmdsCnt;
     rx_dbNopPayload_t sensorPayload;
-    bool waitingForCNCResponse;
-    uint8_t xInfoMatch; // xInfo CNC Response message we need to match to.
-    uint8_t responseDelayCnt;
-    cncCbFnPtr cbFnPtr;
-    uint32_t cbId;
+    bool waitingForCNCResponse; // at least one CNC command is waiting for its response
+    uint8_t xInfoMatch;         // xInfo of the last CNC command sent, each command is sent with the next one
+    uint8_t cncWindow;          // CNC commands the board accepts before answering, see dbCommSetCncWindow()
+    uint8_t cncInFlight;        // CNC commands sent and waiting for their response
     uint32_t disableCnt;    // number of consecutive erred packets
     bool loopbackSensor;    // DEBUG will skip sending sensor and mock sensor data
     int32_t loopbackOffset; // offset sensor data calculation
@@ -36,10 +36,26 @@ typedef struct {
     uint32_t enabledCnt;       // number of times process has been enabled
     uint32_t procEnableAtTick; // Tick at which the proc was last enabled.
     uint32_t resendCNCCnt;     // number of times a CNC command was lost
+    uint32_t lostCNCCnt;       // number of CNC commands still not answered after the resend
+    uint32_t heldCNCCnt;       // number of CNC commands held while the window was full
     uint8_t *largeBuffer;      // pointer to the storage location of the next spi update
     uint32_t largeBufferSz;    // size of largeBuffer
 } dbCommState_t, *dbCommState_tp;
 
+// CNC commands queued by a board task while its window is full
+#define DB_CNC_HELD_MAX (DB_CNC_WINDOW_MAX * 2)
+
+typedef struct {
+    cncInfo_t cmd;        // copy of the command in case it needs to be resent
+    uint32_t sentAtTick;  // tick of the last send, the command times out DB_CNC_TIMEOUT_MS later
+    uint16_t cmdUid;      // matched to the cmdUid of a short response
+    uint8_t xInfo;        // matched to the xInfo of a CNC response
+    uint8_t xInfoPrev;    // xInfo of the first send, a late response to it is still accepted
+    uint8_t resendCnt;    // number of times the command has been resent, we just try once.
+    bool used;            // waiting for its response
+    bool exclusive;       // large buffer read, nothing else is sent to the board until it completes
+} dbCncSlot_t, *dbCncSlot_tp;
+
 typedef struct {
     uint8_t daughterBoardId;
     osMessageQId msgQId;
@@ -48,9 +64,12 @@ typedef struct {
     dbCommState_t dbCommState;
     uint32_t dbGroupEvtIdx; // 0,1
     uint32_t dbGroupEvtId;  // if 0 above then 0-31, else 0-15 bit
-    cncInfo_t copyLastCmd;  // Store the last CNC command in case we need to resend it
-    uint32_t resendCnt;     // number of times the command has been resent, we just try once.
-    uint16_t cmdUid;        // used to ensure the response is to the latest command sent.
+    dbCncSlot_t cncSlot[DB_CNC_WINDOW_MAX]; // CNC commands waiting for their response
+    cncInfo_tp cncHeld[DB_CNC_HELD_MAX];    // CNC commands waiting for a free slot, oldest first
+    uint8_t cncHeldHead;
+    uint8_t cncHeldCnt;
+    uint16_t cmdUid;        // given to the next command, used to match its short response.
+    cncInfo_t sensorMsg;    // sensor transaction of the triggers, owned by the board
 } dbCommThreadInfo_t, *dbCommThreadInfo_tp;
 
 /**
@@ -105,6 +124,19 @@ osStatus spiSendMsg(uint8_t destination,
                     uint32_t cbId,
                     uint32_t timeout_ms);
 
+/**
+ * Queue the sensor transaction of a trigger, SPI_FAST_PATH 0. The board's own sensorMsg is
+ * queued instead of a copy so the trigger path never allocates. A trigger is skipped while
+ * the transaction of the previous one is still queued.
+ *
+ * @param[in]     destination board to send the transaction to
+ * @param[in]     xInfo       sensor uid of the last sample received
+ * @param[in]     timeout_ms  amount of time to wait to add to queue.
+ *
+ * @ret osStatus, osErrorResource when the previous transaction is still queued
+ */
+osStatus spiSendSensorMsg(uint8_t destination, uint8_t xInfo, uint32_t timeout_ms);
+
 /*
  * Return the string name of the Chip select for this board
  *
@@ -125,6 +157,123 @@ char *csName(uint32_t csIdx);
  **/
 bool SPIIsReady(uint32_t destination);
 
+#define SPI_LARGE_BUFFER_SHARE_MIN 5
+#define SPI_LARGE_BUFFER_SHARE_MAX 100
+
+/**
+ * Set the share of each spi bus given to large buffer reads, log and debug buffers are read
+ * in chunks between the sensor transactions so the other boards on the bus keep streaming.
+ * Chunking needs daughter board firmware that keeps its SPI DMA position while deselected,
+ * see spiSetLargeBufferChunked().
+ *
+ * @param[in] percent of the bus time, 5-99, 100 reads the buffer in one transfer with the
+ *            chip select held
+ *
+ * @ret RETURN_OK or RETURN_ERR_PARAM if percent is out of range
+ **/
+RETURN_CODE setSpiLargeBufferShare(uint32_t percent);
+
+#define SPI_CRC_TARGET_PPM_MAX 100000
+
+/**
+ * Set the crc error rate each spi bus is kept under. Once a second the rate of the last seconds
+ * lowers the bus clock when above the target, or raises it back up to the boot clock when well
+ * below, the sensor frames a walk may request again follow. Each adjustment is logged.
+ *
+ * @param[in] ppm crc errors per million transfers, 0 puts every bus back on its boot clock
+ *
+ * @ret RETURN_OK or RETURN_ERR_PARAM if ppm is out of range
+ **/
+RETURN_CODE setSpiCrcTargetPpm(uint32_t ppm);
+
+/**
+ * Read the bus clocks, resend budgets and adjustment count of the link quality manager
+ *
+ * @param[out] regInfo SPIn_CLOCK_KHZ, SPIn_RESEND_BUDGET or SPI_LINK_ADJUSTS, u.dataUint is set
+ *
+ * @ret RETURN_OK or RETURN_ERR_PARAM if the register is not one of them
+ **/
+RETURN_CODE spiLinkRead(const registerInfo_tp regInfo);
+
+/**
+ * Return true while the board is sending a large buffer, sensor transactions to it are skipped
+ *
+ * @param[in] destination board to test
+ *
+ * @ret bool true if a large buffer read from the board is in progress.
+ **/
+bool spiLargeBufferBusy(uint32_t destination);
+
+/**
+ * Set the size of the frames exchanged with a board, the board must have accepted it through
+ * SB_SPI_FRAME_SIZE. A board answering the extended frame with legacy frames is put back on
+ * the legacy frame, as is a board that gets enabled.
+ *
+ * @param[in] destination board
+ * @param[in] frameSize whole words from sizeof(spiDbMbPacket_t) to sizeof(spiDbMbExtPacket_t)
+ *
+ * @ret RETURN_OK or RETURN_ERR_PARAM if the board or size is not valid
+ **/
+RETURN_CODE spiSetFrameSize(uint32_t destination, uint32_t frameSize);
+
+/**
+ * Return the size of the frames exchanged with a board
+ *
+ * @param[in] destination board
+ *
+ * @ret frame size in bytes
+ **/
+uint32_t spiFrameSize(uint32_t destination);
+
+/**
+ * Return the size of the last response from a board that passed its crc, a board sent
+ * extended frames may still answer with a legacy one. Valid while that response is handled.
+ *
+ * @param[in] destination board
+ *
+ * @ret frame size in bytes
+ **/
+uint32_t spiFrameRxSize(uint32_t destination);
+
+/**
+ * Allow the sensor frames of a board that failed their crc to be requested again with
+ * SPICMD_SENSOR_RESEND, the board must have accepted SB_SENSOR_RESEND. A board that gets
+ * enabled is not sent resends until it accepts it again.
+ *
+ * @param[in] destination board
+ * @param[in] resend true if the board keeps its frames
+ *
+ * @ret RETURN_OK or RETURN_ERR_PARAM if the board is not valid
+ **/
+RETURN_CODE spiSetSensorResend(uint32_t destination, bool resend);
+
+/**
+ * Allow the large buffers of a board to be read in chunks with the chip select raised between
+ * them, the board must have accepted SB_LBUF_CHUNKED. The large buffers of other boards are read
+ * in one transfer. A board that gets enabled is read in one transfer until it accepts it again.
+ *
+ * @param[in] destination board
+ * @param[in] chunked true if the board keeps its buffer position while deselected
+ *
+ * @ret RETURN_OK or RETURN_ERR_PARAM if the board is not valid
+ **/
+RETURN_CODE spiSetLargeBufferChunked(uint32_t destination, bool chunked);
+
+/**
+ * Start the sensor transactions of a trigger on every spi bus, called from the trigger interrupt.
+ * Each bus reads its boards back to back from the DMA complete interrupt, the bus tasks
+ * only send the slow path commands and large buffers in between.
+ *
+ * @param[in] walkMask bit per board to read, bit 0 is board 0
+ **/
+void spiFastPathTriggerFromISR(uint32_t walkMask);
+
+/**
+ * Record the trigger time for the trigger to last board complete statistics
+ * of the task path, SPI_FAST_PATH 0.
+ **/
+void spiTimingTriggerFromISR(void);
+
 /**
  * @fn
  *
@@ -41,7 +41,7 @@
 #error("MAX_DB_TASKS_TEST is larger than MAX_DB_TASKS")
 #endif
 
-#define DB_COMM_MSG_DEPTH 2
+#define DB_COMM_MSG_DEPTH (DB_CNC_WINDOW_MAX * 2 + 2) // a response for each command in flight and new commands
 #define DBCOMM_EVENT_DELAY_MS 1000
 
 #define CMD_IDX 1
@@ -50,9 +50,6 @@
 #define DATA_IDX 3
 #define MATCH_IDX(x) (x + 1)
 
-extern osPoolId spiMsgPool;
-extern osPoolId cncMsgPool;
-
 __DTCMRAM__ StaticQueue_t dbQMsgCtrl[MAX_DB_TASKS];
 __DTCMRAM__ uint8_t dbMsgQ[MAX_DB_TASKS][DB_COMM_MSG_DEPTH * sizeof(cncInfo_tp)];
 
@@ -98,6 +95,7 @@ __DTCMRAM__ StackType_t dbStack[MAX_DB_TASKS][DB_COMM_STACK_WORDS];
 
 static void dbCommTaskThread(void const *argument);
 static void handleDbMsg(dbCommThreadInfo_tp p_dbThread, cncInfo_tp p_data);
+static void dbCncFailAll(dbCommThreadInfo_tp p_dbThread);
 static osStatus dbProcRxSendMsg(spiDbMbCmd_e spiDbMbCmd,
                                 uint32_t cbId,
                                 uint8_t xInfo,
@@ -197,6 +195,10 @@ bool sensorBoardPresent(int dbId) {
     return false;
 }
 
+bool sensorBoardEnabled(int dbId) {
+    return dbCommThreads[dbId].dbCommState.enabled;
+}
+
 void dbCommTaskInit(int priority, int stackSize) {
     DPRINTF_CCOMM("Ctrl Comm task initializing all spi tasks\r\n");
     assert(stackSize == DB_COMM_STACK_WORDS);
@@ -220,9 +222,23 @@ void dbCommTaskInit(int priority, int stackSize) {
         dbCommThreads[i].dbGroupEvtIdx = GET_GROUP_EVT_IDX(i);
         dbCommThreads[i].dbGroupEvtId = GET_GROUP_EVT_ID(i);
         dbCommThreads[i].cmdUid = CMD_UID_DONT_CARE + 1;
+        dbCommThreads[i].dbCommState.cncWindow = 1; // until the board accepts SB_CNC_WINDOW
         dbCommThreads[i].dbCommState.largeBuffer = NULL;
         dbCommThreads[i].dbCommState.largeBufferSz = 0;
 
+        // sensor transaction sent by the spi fast path, or queued by spiSendSensorMsg(), the responses
+        // the fast path cannot handle in the interrupt are passed to dbProcRxSendMsg() from the spi bus task
+        cncInfo_tp p_sensorMsg = &dbCommThreads[i].sensorMsg;
+        p_sensorMsg->destination = i;
+        p_sensorMsg->cmd = SPICMD_NOP;
+        p_sensorMsg->xInfo = dbCommThreads[i].dbCommState.sensorUID;
+        p_sensorMsg->cmdResponse.cmdUid = CMD_UID_DONT_CARE;
+        p_sensorMsg->cmdResponse.cmdResponse = UNKNOWN_COMMAND;
+        p_sensorMsg->cmdResponse.flags = 0;
+        memcpy(&p_sensorMsg->payload, &sensorData, sizeof(cncMsgPayload_t));
+        p_sensorMsg->cbFnPtr = dbProcRxSendMsg;
+        p_sensorMsg->cbId = (uint32_t)&dbCommThreads[i];
+
         assert(dbCommThreads[i].threadId != NULL);
         DPRINTF_INFO("DB %d TCB=0x%p\r\n", i, dbCommThreads[i].threadId);
         osDelay(INIT_DELAYS);
@@ -263,14 +279,20 @@ __ITCMRAM__ void dbCommTaskThread(void const *argument) {
             if (evBits & p_dbCommInfo->dbGroupEvtId) {
                 handleDbMsg(p_dbCommInfo, &doNotFreeCncInfo);
             }
-            // regardless lets handle any messages received
-            osEvent evt = osMessageGet(p_dbCommInfo->msgQId, 0);
-            while (evt.status == osEventMessage) {
-                cncInfo_tp p_data = (cncInfo_tp)evt.value.p;
-                handleDbMsg(p_dbCommInfo, p_data);
-                evt = osMessageGet(p_dbCommInfo->msgQId, 0);
+            // regardless lets handle any messages received, a command put back while the board
+            // already holds DB_CNC_HELD_MAX commands is handled on the next wake
+            uint32_t pending = osMessageWaiting(p_dbCommInfo->msgQId);
+            while (pending-- > 0) {
+                osEvent evt = osMessageGet(p_dbCommInfo->msgQId, 0);
+                if (evt.status != osEventMessage) {
+                    break;
+                }
+                handleDbMsg(p_dbCommInfo, (cncInfo_tp)evt.value.p);
             }
         }
+        if (!p_dbCommInfo->dbCommState.enabled) {
+            dbCncFailAll(p_dbCommInfo);
+        }
     }
 }
 
@@ -278,36 +300,262 @@ void registerDbStateCallback(void (*cbFnPtr)(int daughterBoardId, bool enabled))
     registerDbStateCbFnPtr = cbFnPtr;
 }
 
-__ITCMRAM__ void handleDbMsg(dbCommThreadInfo_tp p_dbThread, cncInfo_tp p_data) {
+/**
+ * @fn
+ *
+ * @brief Check if a CNC command can be sent to the board now
+ *
+ * A large buffer read is answered in chunks by the spi bus task, it is sent alone.
+ *
+ * @param[in] p_dbThread: board
+ * @param[in] p_data: command
+ *
+ * @return true if a slot of the board's window is free for the command
+ **/
+__ITCMRAM__ static bool dbCncWindowOpen(dbCommThreadInfo_tp p_dbThread, cncInfo_tp p_data) {
+    if (p_dbThread->dbCommState.cncInFlight == 0) {
+        return true;
+    }
+    if (p_data->payload.cmd.cncMsgPayloadHeader.action >= CNC_ACTION_READ_SMALL_BUFFER ||
+        p_dbThread->dbCommState.cncInFlight >= p_dbThread->dbCommState.cncWindow) {
+        return false;
+    }
+    for (int i = 0; i < DB_CNC_WINDOW_MAX; i++) {
+        if (p_dbThread->cncSlot[i].used && p_dbThread->cncSlot[i].exclusive) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @fn
+ *
+ * @brief Send the command of a slot with the next xInfo
+ *
+ * @param[in] p_dbThread: board
+ * @param[in] p_slot: command slot, sent again on a resend
+ **/
+__ITCMRAM__ static void dbCncSlotTx(dbCommThreadInfo_tp p_dbThread, dbCncSlot_tp p_slot) {
+    p_dbThread->dbCommState.xInfoMatch++;
+    p_slot->xInfoPrev = p_slot->xInfo;
+    p_slot->xInfo = p_dbThread->dbCommState.xInfoMatch;
+    p_slot->sentAtTick = HAL_GetTick();
+
+    // a failed send is resent when the command times out
+    spiSendMsg(p_dbThread->daughterBoardId,
+               p_slot->cmd.cmd,
+               p_slot->xInfo,
+               p_slot->cmdUid,
+               (cncMsgPayload_tp)&p_slot->cmd.payload,
+               dbProcRxSendMsg,
+               (uint32_t)p_dbThread,
+               0);
+}
+
+/**
+ * @fn
+ *
+ * @brief Give a CNC command a free slot and a cmdUid and send it
+ *
+ * @param[in] p_dbThread: board, dbCncWindowOpen() is true for the command
+ * @param[in] p_data: command, freed once copied to the slot
+ **/
+__ITCMRAM__ static void dbCncSend(dbCommThreadInfo_tp p_dbThread, cncInfo_tp p_data) {
+    dbCncSlot_tp p_slot = NULL;
+    for (int i = 0; i < DB_CNC_WINDOW_MAX; i++) {
+        if (!p_dbThread->cncSlot[i].used) {
+            p_slot = &p_dbThread->cncSlot[i];
+            break;
+        }
+    }
+    assert(p_slot != NULL);
+
+    memcpy(&p_slot->cmd, p_data, sizeof(cncInfo_t));
+    cncMsgFree(p_data);
+
+    p_slot->cmdUid = p_dbThread->cmdUid++;
+    p_dbThread->cmdUid = (p_dbThread->cmdUid != CMD_UID_DONT_CARE) ? p_dbThread->cmdUid : CMD_UID_DONT_CARE + 1;
+    p_slot->cmd.payload.cmd.cncMsgPayloadHeader.shortCncId = p_slot->cmdUid;
+    p_slot->xInfo = p_dbThread->dbCommState.xInfoMatch;
+    p_slot->resendCnt = 0;
+    p_slot->exclusive = (p_slot->cmd.payload.cmd.cncMsgPayloadHeader.action >= CNC_ACTION_READ_SMALL_BUFFER);
+    p_slot->used = true;
+    p_dbThread->dbCommState.cncInFlight++;
+    p_dbThread->dbCommState.waitingForCNCResponse = true;
+
+    dbCncSlotTx(p_dbThread, p_slot);
+}
+
+/**
+ * @fn
+ *
+ * @brief Send the held CNC commands, oldest first, while the window has room
+ *
+ * @param[in] p_dbThread: board
+ **/
+__ITCMRAM__ static void dbCncSendHeld(dbCommThreadInfo_tp p_dbThread) {
+    while (p_dbThread->cncHeldCnt != 0 &&
+           dbCncWindowOpen(p_dbThread, p_dbThread->cncHeld[p_dbThread->cncHeldHead])) {
+        cncInfo_tp p_data = p_dbThread->cncHeld[p_dbThread->cncHeldHead];
+        p_dbThread->cncHeldHead = (p_dbThread->cncHeldHead + 1) % DB_CNC_HELD_MAX;
+        p_dbThread->cncHeldCnt--;
+        dbCncSend(p_dbThread, p_data);
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Complete the command of a slot, call its callback and send the held commands
+ *
+ * @param[in] p_dbThread: board
+ * @param[in] p_slot: completed command
+ * @param[in] cmd: response command
+ * @param[in] xInfo: response xInfo
+ * @param[in] cmdResponse: response cmdUid and result
+ * @param[in] payload: response payload, timeoutPayload when the command was lost
+ **/
+__ITCMRAM__ static void dbCncSlotDone(dbCommThreadInfo_tp p_dbThread,
+                                      dbCncSlot_tp p_slot,
+                                      spiDbMbCmd_e cmd,
+                                      uint8_t xInfo,
+                                      spiDbMbPacketCmdResponse_t cmdResponse,
+                                      cncPayload_tp payload) {
+    if (p_slot->cmd.cbFnPtr) {
+        p_slot->cmd.cbFnPtr(cmd, p_slot->cmd.cbId, xInfo, cmdResponse, payload);
+    } else {
+        DPRINTF_ERROR("%s:%d DB%d cbFn is null\r\n", __FUNCTION__, __LINE__, p_dbThread->daughterBoardId);
+    }
+    p_slot->used = false;
+    p_dbThread->dbCommState.cncInFlight--;
+    p_dbThread->dbCommState.waitingForCNCResponse = (p_dbThread->dbCommState.cncInFlight != 0);
+    dbCncSendHeld(p_dbThread);
+}
+
+/**
+ * @fn
+ *
+ * @brief Resend or fail the CNC commands not answered within DB_CNC_TIMEOUT_MS
+ *
+ * @param[in] p_dbThread: board
+ **/
+__ITCMRAM__ static void dbCncCheckTimeouts(dbCommThreadInfo_tp p_dbThread) {
+    uint32_t now = HAL_GetTick();
+    for (int i = 0; i < DB_CNC_WINDOW_MAX; i++) {
+        dbCncSlot_tp p_slot = &p_dbThread->cncSlot[i];
+        if (!p_slot->used || (now - p_slot->sentAtTick) <= DB_CNC_TIMEOUT_MS) {
+            continue;
+        }
+        /* Although the CRC error rate is 0.0005/sec it is still enough that we are seeing
+         * missed commands causing issues.
+         * We will resend the missed Command once
+         */
+        if (p_slot->resendCnt == 0) {
+            DPRINTF_INFO("DB %d lost CNC message %d resending\r\n", p_dbThread->daughterBoardId, p_slot->cmdUid);
+            p_dbThread->dbCommState.resendCNCCnt++;
+            p_slot->resendCnt++;
+            dbCncSlotTx(p_dbThread, p_slot);
+        } else {
+            DPRINTF_ERROR("DB %d lost CNC message %d\r\n", p_dbThread->daughterBoardId, p_slot->cmdUid);
+            spiDbMbPacketCmdResponse_t cmdResponse = {.cmdUid = CMD_UID_DONT_CARE, .cmdResponse = UNKNOWN_COMMAND};
+            p_dbThread->dbCommState.lostCNCCnt++;
+            dbCncSlotDone(p_dbThread, p_slot, SPICMD_RESP_CNC, p_slot->xInfo, cmdResponse, &timeoutPayload);
+        }
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Fail a CNC command that is not sent, its callback gets timeoutPayload
+ *
+ * @param[in] p_dbThread: board
+ * @param[in] p_data: command, freed
+ **/
+__ITCMRAM__ static void dbCncDrop(dbCommThreadInfo_tp p_dbThread, cncInfo_tp p_data) {
     spiDbMbPacketCmdResponse_t cmdResponse = {.cmdUid = CMD_UID_DONT_CARE, .cmdResponse = UNKNOWN_COMMAND};
-    if (p_dbThread->dbCommState.waitingForCNCResponse && p_data->cmd == SPICMD_TRIGGER) {
-        if (p_dbThread->dbCommState.responseDelayCnt++ > DB_MAX_UNANSWERED_RESPONSE) {
-            /* Although the CRC error rate is 0.0005/sec it is still enough that we are seeing
-             * missed commands causing issues.
-             * We will resend the missed Command once
-             */
-            if (p_dbThread->resendCnt == 0) {
-                DPRINTF_INFO("DB %d lost CNC message resending\r\n", p_dbThread->daughterBoardId);
-                p_dbThread->dbCommState.resendCNCCnt++;
-                p_dbThread->resendCnt++;
-                p_dbThread->dbCommState.waitingForCNCResponse = false; // going to resend it.
-                p_data = &p_dbThread->copyLastCmd;
-            } else {
-                DPRINTF_ERROR("DB %d lost CNC message\r\n", p_dbThread->daughterBoardId);
-                if (p_dbThread->dbCommState.cbFnPtr) {
-                    p_dbThread->dbCommState.cbFnPtr(SPICMD_RESP_CNC,
-                                                    p_dbThread->dbCommState.cbId,
-                                                    p_dbThread->dbCommState.xInfoMatch,
-                                                    cmdResponse,
-                                                    &timeoutPayload);
-                    p_dbThread->dbCommState.cbFnPtr = NULL;
-                }
+    p_dbThread->dbCommState.lostCNCCnt++;
+    if (p_data->cbFnPtr) {
+        p_data->cbFnPtr(SPICMD_RESP_CNC, p_data->cbId, p_data->xInfo, cmdResponse, &timeoutPayload);
+    }
+    cncMsgFree(p_data);
+}
 
-                p_dbThread->dbCommState.responseDelayCnt = 0;
-                p_dbThread->dbCommState.waitingForCNCResponse = false;
-                p_dbThread->cmdUid++;
-            }
+/**
+ * @fn
+ *
+ * @brief Fail the held and in flight CNC commands of a disabled board
+ *
+ * A disabled board is left out of the triggers, its commands would never time out.
+ *
+ * @param[in] p_dbThread: board
+ **/
+__ITCMRAM__ static void dbCncFailAll(dbCommThreadInfo_tp p_dbThread) {
+    // the held commands first so completing a slot does not send them
+    while (p_dbThread->cncHeldCnt != 0) {
+        cncInfo_tp p_data = p_dbThread->cncHeld[p_dbThread->cncHeldHead];
+        p_dbThread->cncHeldHead = (p_dbThread->cncHeldHead + 1) % DB_CNC_HELD_MAX;
+        p_dbThread->cncHeldCnt--;
+        dbCncDrop(p_dbThread, p_data);
+    }
+    for (int i = 0; i < DB_CNC_WINDOW_MAX; i++) {
+        dbCncSlot_tp p_slot = &p_dbThread->cncSlot[i];
+        if (p_slot->used) {
+            spiDbMbPacketCmdResponse_t cmdResponse = {.cmdUid = CMD_UID_DONT_CARE, .cmdResponse = UNKNOWN_COMMAND};
+            p_dbThread->dbCommState.lostCNCCnt++;
+            dbCncSlotDone(p_dbThread, p_slot, SPICMD_RESP_CNC, p_slot->xInfo, cmdResponse, &timeoutPayload);
+        }
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Find the command a CNC response answers
+ *
+ * The response to the first send of a resent command is still accepted. A response matching
+ * no command is given to the only command in flight, as a board answering one command at a
+ * time always answers the last one sent.
+ *
+ * @param[in] p_dbThread: board
+ * @param[in] xInfo: response xInfo
+ *
+ * @return command slot or NULL
+ **/
+__ITCMRAM__ static dbCncSlot_tp dbCncSlotFind(dbCommThreadInfo_tp p_dbThread, uint8_t xInfo) {
+    dbCncSlot_tp p_last = NULL;
+    for (int i = 0; i < DB_CNC_WINDOW_MAX; i++) {
+        dbCncSlot_tp p_slot = &p_dbThread->cncSlot[i];
+        if (!p_slot->used) {
+            continue;
+        }
+        if (p_slot->xInfo == xInfo || (p_slot->resendCnt != 0 && p_slot->xInfoPrev == xInfo)) {
+            return p_slot;
         }
+        p_last = p_slot;
+    }
+    if (p_dbThread->dbCommState.cncInFlight == 1) {
+        DPRINTF_ERROR("unmatched xinfo expected %x msg %x\r\n", p_last->xInfo, xInfo);
+        return p_last;
+    }
+    return NULL;
+}
+
+void dbCommSetCncWindow(uint32_t dbId, uint32_t window) {
+    assert(dbId < MAX_DB_TASKS && window != 0 && window <= DB_CNC_WINDOW_MAX);
+    dbCommThreads[dbId].dbCommState.cncWindow = window;
+}
+
+uint32_t dbCommCncWindow(uint32_t dbId) {
+    assert(dbId < MAX_DB_TASKS);
+    return dbCommThreads[dbId].dbCommState.cncWindow;
+}
+
+__ITCMRAM__ void handleDbMsg(dbCommThreadInfo_tp p_dbThread, cncInfo_tp p_data) {
+    spiDbMbPacketCmdResponse_t cmdResponse = {.cmdUid = CMD_UID_DONT_CARE, .cmdResponse = UNKNOWN_COMMAND};
+    if (p_dbThread->dbCommState.waitingForCNCResponse && p_data->cmd == SPICMD_TRIGGER) {
+        dbCncCheckTimeouts(p_dbThread);
     }
 
     switch (p_data->cmd) {
@@ -316,7 +564,7 @@ __ITCMRAM__ void handleDbMsg(dbCommThreadInfo_tp p_dbThread, cncInfo_tp p_data)
             p_dbThread->dbCommState.disableCnt = 0;
             static int sinLen = sizeof(sineArray) / sizeof(uint32_t);
             static uint8_t xInfo = 0;
-            static rx_dbNopPayload_t payload = {0};
+            static rx_dbExtPayload_t payload = {0}; // a board may use the extended frame
             static int32_t count = 0;
 
             xInfo++;
@@ -344,7 +592,7 @@ __ITCMRAM__ void handleDbMsg(dbCommThreadInfo_tp p_dbThread, cncInfo_tp p_data)
             for (int i = 0; i < NUMBER_OF_SENSOR_READINGS; i++) {
                 switch (i) {
                 case (0):
-                    rtemp = READ_XBITSVALUE(payload.adc[i].VALUE_X_BIT);
+                    rtemp = READ_XBITSVALUE(((uint8_t *)&payload.nop.adc[i]));
                     wtemp = (rtemp == stepFn_low_0) ? stepFn_high_0 : stepFn_low_0;
                     break;
                 case (1):
@@ -358,7 +606,7 @@ __ITCMRAM__ void handleDbMsg(dbCommThreadInfo_tp p_dbThread, cncInfo_tp p_data)
                         (dbCount % sawtooth_duration) * sawtooth_amplitude_multipler_3 + sawtooth_y_offset_3;
                     break;
                 case (4):
-                    rtemp = READ_XBITSVALUE(payload.adc[STEP_FN_DURATION(i)].VALUE_X_BIT);
+                    rtemp = READ_XBITSVALUE(((uint8_t *)&payload.nop.adc[STEP_FN_DURATION(i)]));
                     wtemp = (rtemp == stepFn_high_4) ? stepFn_low_4 : stepFn_high_4;
                     break;
                 case (5):
@@ -376,14 +624,23 @@ __ITCMRAM__ void handleDbMsg(dbCommThreadInfo_tp p_dbThread, cncInfo_tp p_data)
                 break;
                 }
 
-                WRITE_XBITVALUE(payload.adc[i].VALUE_X_BIT, wtemp);
+                WRITE_XBITVALUE(((uint8_t *)&payload.nop.adc[i]), wtemp);
             }
             dbProcRxSendMsg(SPICMD_STREAM_SENSOR, (uint32_t)p_dbThread, xInfo, cmdResponse, (cncPayload_tp)&payload);
+        } else if (spiLargeBufferBusy(p_dbThread->daughterBoardId)) {
+            // The board is sending a log or debug buffer in chunks between the other boards
+            // transactions, it cannot answer until done and must not be counted as unresponsive.
         } else {
 
             // If we send 10 messages with no responses then set the daughter board as disabled
+#if SPI_FAST_PATH
+            // the trigger interrupt already counted this trigger in dbCommTriggerFromISR()
+            if (p_dbThread->dbCommState.enabled &&
+                p_dbThread->dbCommState.disableCnt > DB_MAX_UNANSWERED_RESPONSE_DISABLE) {
+#else
             if (p_dbThread->dbCommState.enabled &&
                 p_dbThread->dbCommState.disableCnt++ > DB_MAX_UNANSWERED_RESPONSE_DISABLE) {
+#endif
                 DPRINTF_DBCOMM_VERBOSE("dbProc %d, disableCnt = %d sending Reboot cmd\r\n",
                                        p_dbThread->daughterBoardId,
                                        p_dbThread->dbCommState.disableCnt);
@@ -397,19 +654,16 @@ __ITCMRAM__ void handleDbMsg(dbCommThreadInfo_tp p_dbThread, cncInfo_tp p_data)
                 }
                 dbTriggerDisable(p_dbThread->daughterBoardId);
                 p_dbThread->dbCommState.enabled = false;
+                // the board restarts with a window of 1, negotiated again by the board verification
+                p_dbThread->dbCommState.cncWindow = 1;
             }
 
+#if !SPI_FAST_PATH
             if (p_dbThread->dbCommState.enabled) {
-                // use static msg payload stored globally.
-                spiSendMsg(p_dbThread->daughterBoardId,
-                           SPICMD_NOP,
-                           p_dbThread->dbCommState.sensorUID,
-                           CMD_UID_DONT_CARE,
-                           (cncMsgPayload_tp)&sensorData,
-                           dbProcRxSendMsg,
-                           (uint32_t)p_dbThread,
-                           0);
+                // the board's own sensor transaction is queued, nothing is allocated on the trigger path
+                spiSendSensorMsg(p_dbThread->daughterBoardId, p_dbThread->dbCommState.sensorUID, 0);
             }
+#endif
         }
     } break;
     case (SPICMD_STREAM_SENSOR): {
@@ -421,43 +675,17 @@ __ITCMRAM__ void handleDbMsg(dbCommThreadInfo_tp p_dbThread, cncInfo_tp p_data)
     // fall through
     case (SPICMD_CNC_SHORT): {
         xTracePrintCompactF2(urlLogTxMsg, "handleDbMsg dest=%d per=%d", p_dbThread->daughterBoardId, p_data->payload.cmd.cncMsgPayloadHeader.peripheral);
-        if (p_dbThread->dbCommState.waitingForCNCResponse) {
-            osThreadYield();
-            // Now put the message back in the queue
-            osStatus status;
-            if ((status = osMessagePut(p_dbThread->msgQId, (uint32_t)p_data, 0)) != osOK) {
-                // Q full drop message
-                DPRINTF_ERROR("DB%d too many messages for one process\r\n", p_dbThread->daughterBoardId);
-                osPoolFree(cncMsgPool, p_data);
-            }
-            return;
-        }
-        // If this is a new Command make a copy incase we need to resend.
-        if (p_data != &p_dbThread->copyLastCmd) {
-            memcpy(&p_dbThread->copyLastCmd, p_data, sizeof(cncInfo_t));
-            p_dbThread->resendCnt = 0;
-        }
-
-        p_dbThread->dbCommState.cbFnPtr = p_data->cbFnPtr;
-        p_dbThread->dbCommState.cbId = p_data->cbId;
-        p_dbThread->dbCommState.responseDelayCnt = 0;
-        p_dbThread->dbCommState.waitingForCNCResponse = true;
-        p_dbThread->dbCommState.xInfoMatch++;
-
-        p_data->payload.cmd.cncMsgPayloadHeader.shortCncId = p_dbThread->cmdUid;
-
-        spiSendMsg(p_dbThread->daughterBoardId,
-                   p_data->cmd,
-                   p_dbThread->dbCommState.xInfoMatch,
-                   p_dbThread->cmdUid,
-                   (cncMsgPayload_tp)&p_data->payload,
-                   dbProcRxSendMsg,
-                   (uint32_t)p_dbThread,
-                   0);
-
-        // Only free a new command. A stored copy does not need to be freed
-        if (p_data != &p_dbThread->copyLastCmd) {
-            osPoolFree(cncMsgPool, p_data);
+        if (p_dbThread->cncHeldCnt == 0 && dbCncWindowOpen(p_dbThread, p_data)) {
+            dbCncSend(p_dbThread, p_data);
+        } else if (p_dbThread->cncHeldCnt < DB_CNC_HELD_MAX) {
+            // held in order behind the commands already waiting for a slot
+            p_dbThread->cncHeld[(p_dbThread->cncHeldHead + p_dbThread->cncHeldCnt) % DB_CNC_HELD_MAX] = p_data;
+            p_dbThread->cncHeldCnt++;
+            p_dbThread->dbCommState.heldCNCCnt++;
+        } else if (osMessagePut(p_dbThread->msgQId, (uint32_t)p_data, 0) != osOK) {
+            // Q full drop message, its sender is told it timed out
+            DPRINTF_ERROR("DB%d too many messages for one process\r\n", p_dbThread->daughterBoardId);
+            dbCncDrop(p_dbThread, p_data);
         }
     } break;
     case (SPICMD_RESP_CNC): {
@@ -468,30 +696,16 @@ __ITCMRAM__ void handleDbMsg(dbCommThreadInfo_tp p_dbThread, cncInfo_tp p_data)
                        p_data->payload.cmd.value,
                        p_data->payload.cmd.result);
         if (p_dbCommState->waitingForCNCResponse) {
-            if (p_dbCommState->xInfoMatch == p_data->xInfo) {
-                if (p_dbCommState->cbFnPtr) {
-                    p_dbCommState->cbFnPtr(
-                        p_data->cmd, p_dbCommState->cbId, p_data->xInfo, cmdResponse, &p_data->payload);
-                    p_dbCommState->cbFnPtr = NULL;
-                    p_dbCommState->waitingForCNCResponse = false;
-                } else {
-                    DPRINTF_ERROR("%s:%d DB%d cbFn is null\r\n", __FUNCTION__, __LINE__, p_dbThread->daughterBoardId);
-                }
+            dbCncSlot_tp p_slot = dbCncSlotFind(p_dbThread, p_data->xInfo);
+            if (p_slot != NULL) {
+                dbCncSlotDone(p_dbThread, p_slot, p_data->cmd, p_data->xInfo, cmdResponse, &p_data->payload);
             } else {
-                DPRINTF_ERROR("unmatched xinfo expected %x msg %x\r\n", p_dbCommState->xInfoMatch, p_data->xInfo);
-                if (p_dbCommState->cbFnPtr) {
-                    p_dbCommState->cbFnPtr(
-                        p_data->cmd, p_dbCommState->cbId, p_data->xInfo, cmdResponse, &p_data->payload);
-                    p_dbCommState->cbFnPtr = NULL;
-                    p_dbCommState->waitingForCNCResponse = false;
-                } else {
-                    DPRINTF_ERROR("%s:%d DB%d cbFn is null\r\n", __FUNCTION__, __LINE__, p_dbThread->daughterBoardId);
-                }
+                DPRINTF_ERROR("DB%d unmatched xinfo msg %x\r\n", p_dbThread->daughterBoardId, p_data->xInfo);
             }
         } else {
             DPRINTF_ERROR("Unexpected command response\r\n")
         }
-        osPoolFree(cncMsgPool, p_data);
+        cncMsgFree(p_data);
     } break;
 
     // fall through
@@ -505,33 +719,27 @@ __ITCMRAM__ void handleDbMsg(dbCommThreadInfo_tp p_dbThread, cncInfo_tp p_data)
                        p_data->payload.cmd.value,
                        p_data->payload.cmd.result);
         if (p_dbCommState->waitingForCNCResponse) {
-
-            if (p_dbCommState->cbFnPtr) {
-                if (p_data->cmdResponse.cmdUid == p_dbThread->cmdUid) {
-                    p_dbThread->cmdUid++;
-                    p_dbThread->cmdUid =
-                        (p_dbThread->cmdUid != CMD_UID_DONT_CARE) ? p_dbThread->cmdUid : CMD_UID_DONT_CARE + 1;
-                    p_dbCommState->cbFnPtr(
-                        p_data->cmd, p_dbCommState->cbId, p_data->xInfo, p_data->cmdResponse, &p_data->payload);
-                    p_dbCommState->cbFnPtr = NULL;
-                    p_dbCommState->waitingForCNCResponse = false;
-
-                } else {
-                    DPRINTF_ERROR("%s:%d DB%d cmdUid %d != thread->cmdUid= %d\r\n",
-                                  __FUNCTION__,
-                                  __LINE__,
-                                  p_dbThread->daughterBoardId,
-                                  p_data->cmdResponse.cmdUid,
-                                  p_data->cmdResponse.cmdUid);
+            dbCncSlot_tp p_slot = NULL;
+            for (int i = 0; i < DB_CNC_WINDOW_MAX; i++) {
+                if (p_dbThread->cncSlot[i].used && p_dbThread->cncSlot[i].cmdUid == p_data->cmdResponse.cmdUid) {
+                    p_slot = &p_dbThread->cncSlot[i];
+                    break;
                 }
+            }
+            if (p_slot != NULL) {
+                dbCncSlotDone(
+                    p_dbThread, p_slot, p_data->cmd, p_data->xInfo, p_data->cmdResponse, &p_data->payload);
             } else {
-                DPRINTF_ERROR("%s:%d DB%d cbFn is null\r\n", __FUNCTION__, __LINE__, p_dbThread->daughterBoardId);
+                DPRINTF_ERROR("%s:%d DB%d cmdUid %d matches no command in flight\r\n",
+                              __FUNCTION__,
+                              __LINE__,
+                              p_dbThread->daughterBoardId,
+                              p_data->cmdResponse.cmdUid);
             }
-
         } else {
             DPRINTF_ERROR("Unexpected command response\r\n")
         }
-        osPoolFree(cncMsgPool, p_data);
+        cncMsgFree(p_data);
     } break;
     case (SPICMD_SET_SKIP_WAIT_FOR_RESPONSE):
         bool value = p_data->payload.cmd.value;
@@ -564,6 +772,98 @@ __ITCMRAM__ void handleDbMsg(dbCommThreadInfo_tp p_dbThread, cncInfo_tp p_data)
     }
 }
 
+/**
+ * @fn
+ *
+ * @brief Store the sensor readings of a response
+ *
+ * @param[in] p_dbThread: board that sent the response
+ * @param[in] xInfo: sensor data sequence number of the response
+ * @param[in] flags: header flags of the response, FLAG_SENSOR_BURST for a burst of samples
+ * @param[in] payload: sensor readings
+ * @param[in] rxSize: size of the frame received, a board may answer an extended frame with a legacy one
+ **/
+__ITCMRAM__ static inline void dbCommSensorRx(dbCommThreadInfo_tp p_dbThread,
+                                              uint8_t xInfo,
+                                              uint8_t flags,
+                                              cncPayload_tp payload,
+                                              uint32_t rxSize) {
+    p_dbThread->dbCommState.rxDataCnt++;
+
+    uint8_t v = xInfo - p_dbThread->dbCommState.sensorUID;
+    if (v == MULTIPLER) {
+        p_dbThread->dbCommState.delayBins[BIN_TARGET]++;
+    } else if (v == MULTIPLER + 1) {
+        p_dbThread->dbCommState.delayBins[BIN_GREATER1]++;
+    } else if (v == MULTIPLER - 1) {
+        p_dbThread->dbCommState.delayBins[BIN_LESS1]++;
+    } else if (v > MULTIPLER + 1) {
+        p_dbThread->dbCommState.delayBins[BIN_GREATER]++;
+    }
+#if MULTIPLER > 1
+    else if (v < MULTIPLER - 1) {
+        p_dbThread->dbCommState.delayBins[BIN_LESS]++;
+    }
+#endif
+
+    //  want to handle this as efficiently as possible so update sensor data and return
+    if (xInfo != p_dbThread->dbCommState.sensorUID) {
+        size_t payloadSize = rxSize - sizeof(spiDbMbPacketHeader_t) - SIZEOF_CRC;
+        if (flags & FLAG_SENSOR_BURST) {
+            updateSensorBurst(p_dbThread, payload->u8Array, payloadSize);
+        } else {
+            updateSensorData(p_dbThread, payload->u8Array, payloadSize);
+        }
+    }
+    p_dbThread->dbCommState.sensorUID = xInfo;
+}
+
+__ITCMRAM__ void dbCommTriggerFromISR(uint32_t triggerMask, uint32_t *p_walkMask, uint32_t *p_taskMask) {
+    uint32_t walkMask = 0;
+    uint32_t taskMask = 0;
+
+    for (int dbId = DB_TASK_START_ID; dbId < MAX_DB_TASKS_END_ID; dbId++) {
+        uint32_t evtId = GET_GROUP_EVT_ID(dbId);
+        dbCommState_tp p_dbCommState = &dbCommThreads[dbId].dbCommState;
+        if (!(triggerMask & evtId) || spiLargeBufferBusy(dbId)) {
+            continue;
+        }
+        if (p_dbCommState->loopbackSensor || p_dbCommState->waitingForCNCResponse) {
+            // the task mocks the sensor data, or counts the triggers its command waits for
+            taskMask |= evtId;
+        }
+        if (p_dbCommState->loopbackSensor || !p_dbCommState->enabled) {
+            continue;
+        }
+        if (p_dbCommState->disableCnt++ > DB_MAX_UNANSWERED_RESPONSE_DISABLE) {
+            // the task resets and disables the board
+            taskMask |= evtId;
+        } else {
+            dbCommThreads[dbId].sensorMsg.xInfo = p_dbCommState->sensorUID;
+            walkMask |= 1 << dbId;
+        }
+    }
+    *p_walkMask = walkMask;
+    *p_taskMask = taskMask;
+}
+
+__ITCMRAM__ cncInfo_tp dbCommSensorMsg(uint32_t dbId) {
+    assert(dbId < MAX_DB_TASKS);
+    return &dbCommThreads[dbId].sensorMsg;
+}
+
+__ITCMRAM__ bool
+dbCommSensorRxFromISR(uint32_t dbId, uint8_t xInfo, uint8_t flags, cncPayload_tp payload, uint32_t rxSize) {
+    dbCommThreadInfo_tp p_dbThread = &dbCommThreads[dbId];
+    if (!p_dbThread->dbCommState.enabled) {
+        // enabling the board updates the gather and spi state, left to the task
+        return false;
+    }
+    p_dbThread->dbCommState.disableCnt = 0;
+    dbCommSensorRx(p_dbThread, xInfo, flags, payload, rxSize);
+    return true;
+}
+
 __ITCMRAM__ static osStatus dbProcRxSendMsg(spiDbMbCmd_e spiDbMbCmd,
                                             uint32_t cbId,
                                             uint8_t xInfo,
@@ -601,29 +901,11 @@ __ITCMRAM__ static osStatus dbProcRxSendMsg(spiDbMbCmd_e spiDbMbCmd,
         DPRINTF_DBCOMM_VERBOSE(
             "%s dbThread %d cmd=0x%x, xInfo=%lu\r\n", __FUNCTION__, p_dbThread->daughterBoardId, spiDbMbCmd, xInfo);
     } else {
-        p_dbThread->dbCommState.rxDataCnt++;
-
-        uint8_t v = xInfo - p_dbThread->dbCommState.sensorUID;
-        if (v == MULTIPLER) {
-            p_dbThread->dbCommState.delayBins[BIN_TARGET]++;
-        } else if (v == MULTIPLER + 1) {
-            p_dbThread->dbCommState.delayBins[BIN_GREATER1]++;
-        } else if (v == MULTIPLER - 1) {
-            p_dbThread->dbCommState.delayBins[BIN_LESS1]++;
-        } else if (v > MULTIPLER + 1) {
-            p_dbThread->dbCommState.delayBins[BIN_GREATER]++;
-        }
-#if MULTIPLER > 1
-        else if (v < MULTIPLER - 1) {
-            p_dbThread->dbCommState.delayBins[BIN_LESS]++;
-        }
-#endif
-
-        //  want to handle this as efficiently as possible so update sensor data and return
-        if (xInfo != p_dbThread->dbCommState.sensorUID) {
-            updateSensorData(p_dbThread, payload->u8Array, sizeof(payload));
-        }
-        p_dbThread->dbCommState.sensorUID = xInfo;
+        // called from handleRxMsg() right after the crc check of the frame, or with the mock
+        // payload which is sized for the frame the board is configured for
+        uint32_t rxSize = p_dbThread->dbCommState.loopbackSensor ? spiFrameSize(p_dbThread->daughterBoardId)
+                                                                 : spiFrameRxSize(p_dbThread->daughterBoardId);
+        dbCommSensorRx(p_dbThread, xInfo, cmdResponse.flags, payload, rxSize);
         if (!(spiDbMbCmd & CMD_SHORTRSEPONSE)) {
             return osOK;
         }
@@ -640,7 +922,7 @@ __ITCMRAM__ static osStatus dbProcRxSendMsg(spiDbMbCmd_e spiDbMbCmd,
 
     cncInfo_tp msg = NULL;
     do {
-        msg = osPoolAlloc(cncMsgPool);
+        msg = cncMsgAlloc();
         if (msg == NULL) {
             noCncPoolMemoryCnt++;
             osDelay(1);
@@ -655,7 +937,11 @@ __ITCMRAM__ static osStatus dbProcRxSendMsg(spiDbMbCmd_e spiDbMbCmd,
     msg->cbFnPtr = NULL;
     msg->cbId = 0;
     msg->xInfo = xInfo;
-    return (osMessagePut(p_dbThread->msgQId, (uint32_t)msg, 0));
+    osStatus status = osMessagePut(p_dbThread->msgQId, (uint32_t)msg, 0);
+    if (status != osOK) {
+        cncMsgFree(msg);
+    }
+    return status;
 }
 
 __ITCMRAM__ osStatus
@@ -682,7 +968,7 @@ dbProcSendMsg(int dbId, spiDbMbCmd_e spiDbMbCmd, cncCbFnPtr cbFnPtr, uint32_t cb
             return osErrorNoMemory;
         }
 
-        msg = osPoolAlloc(cncMsgPool);
+        msg = cncMsgAlloc();
         if (msg == NULL) {
             DPRINTF_ERROR("%s dbThread %d No memory error\r\n", __FUNCTION__, p_dbThread->daughterBoardId);
             noCncPoolMemoryCnt++;
@@ -695,7 +981,16 @@ dbProcSendMsg(int dbId, spiDbMbCmd_e spiDbMbCmd, cncCbFnPtr cbFnPtr, uint32_t cb
     msg->cbFnPtr = cbFnPtr;
     msg->cbId = cbId;
     msg->xInfo = 0;
-    return (osMessagePut(p_dbThread->msgQId, (uint32_t)msg, 0));
+    osStatus status = osMessagePut(p_dbThread->msgQId, (uint32_t)msg, 0);
+    if (status != osOK) {
+        cncMsgFree(msg);
+#if SPI_FAST_PATH
+    } else if (dbTriggerEventGroup[p_dbThread->dbGroupEvtIdx] != NULL) {
+        // the triggers only wake the task while a command is in flight
+        xEventGroupSetBits(dbTriggerEventGroup[p_dbThread->dbGroupEvtIdx], p_dbThread->dbGroupEvtId);
+#endif
+    }
+    return status;
 }
 
 void appendDbprocStatsToBuffer(char *buf, uint32_t bufSz, uint32_t dbId) {
@@ -744,6 +1039,17 @@ void appendDbprocStatsToBuffer(char *buf, uint32_t bufSz, uint32_t dbId) {
                     bufSz - (nxt - buf),
                     "\tRetry Cmd Count       = %lu\r\n",
                     dbCommThreads[dbId].dbCommState.resendCNCCnt);
+    nxt += snprintf((char *)nxt,
+                    bufSz - (nxt - buf),
+                    "\tLost Cmd Count        = %lu\r\n",
+                    dbCommThreads[dbId].dbCommState.lostCNCCnt);
+    nxt += snprintf((char *)nxt,
+                    bufSz - (nxt - buf),
+                    "\tCmd Window            = %u in flight of %u, %u held, %lu held total\r\n",
+                    dbCommThreads[dbId].dbCommState.cncInFlight,
+                    dbCommThreads[dbId].dbCommState.cncWindow,
+                    dbCommThreads[dbId].cncHeldCnt,
+                    dbCommThreads[dbId].dbCommState.heldCNCCnt);
 
     nxt += printStreamDataToBuffer(nxt, bufSz - (nxt - buf), dbId);
 
@@ -807,6 +1113,13 @@ int16_t dbProcCliCmd(CLI *hCli, int argc, char *argv[]) {
                     ((HAL_GetTick() - dbCommThreads[i].dbCommState.procEnableAtTick) / HAL_GetTickFreq());
                 snprintf(buf, sizeof(buf), "\tCRC Error Rate        = %f /s\r\n", errorRate);
                 CliPrintf(hCli, "\tRetry Cmd Count       = %lu\r\n", dbCommThreads[i].dbCommState.resendCNCCnt);
+                CliPrintf(hCli, "\tLost Cmd Count        = %lu\r\n", dbCommThreads[i].dbCommState.lostCNCCnt);
+                CliPrintf(hCli,
+                          "\tCmd Window            = %u in flight of %u, %u held, %lu held total\r\n",
+                          dbCommThreads[i].dbCommState.cncInFlight,
+                          dbCommThreads[i].dbCommState.cncWindow,
+                          dbCommThreads[i].cncHeldCnt,
+                          dbCommThreads[i].dbCommState.heldCNCCnt);
                 CliPrintf(hCli, "%s", buf);
 
                 printStreamData(hCli, i);
@@ -855,8 +1168,9 @@ int16_t dbProcCliCmd(CLI *hCli, int argc, char *argv[]) {
                 dbCommThreads[i].dbCommState.newSensorData = 0;
                 dbCommThreads[i].dbCommState.sensorUID = 255;
                 dbCommThreads[i].dbCommState.rxCmdsCnt = 0;
+                dbCommThreads[i].dbCommState.heldCNCCnt = 0;
                 for (int j = 0; j < NUMBER_OF_SENSOR_READINGS; j++) {
-                    WRITE_XBITVALUE(dbCommThreads[i].dbCommState.sensorPayload.adc[j].VALUE_X_BIT, 0);
+                    WRITE_XBITVALUE(((uint8_t *)&dbCommThreads[i].dbCommState.sensorPayload.adc[j]), 0);
                 }
             }
         } else if (argc == MATCH_IDX(DATA_IDX) && strcmp(argv[CMD_IDX], "send") == 0) {
@@ -901,7 +1215,8 @@ int16_t dbProcCliCmd(CLI *hCli, int argc, char *argv[]) {
             if (dbId >= DB_TASK_START_ID && dbId < MAX_CS_ID && dbId < MAX_DB_TASKS_END_ID) {
                 dbCommThreads[dbId].dbCommState.enabled = enable;
                 dbCommThreads[dbId].dbCommState.disableCnt = 0;
-                dbCommThreads[dbId].dbCommState.waitingForCNCResponse = false;
+                // commands in flight time out, the board may have restarted with a window of 1
+                dbCommThreads[dbId].dbCommState.cncWindow = 1;
                 enable ? dbTriggerEnable(dbId) : dbTriggerDisable(dbId);
                 success = 1;
             }
@@ -115,6 +115,14 @@ bool dbCommTaskLoopbackParamsSet(int dbId, bool loopbackSetting, int32_t offsetS
  */
 bool sensorBoardPresent(int dbId);
 
+/**
+ * Return if the dbComm task of the sensor board has it enabled, it may not have answered yet
+ *
+ * @param[in] dbId: identify daughter board to query
+ * @return true if board is enabled
+ */
+bool sensorBoardEnabled(int dbId);
+
 /**
  * update sensor board crc stats
  *
@@ -137,4 +145,56 @@ void updateDBCrcErrorOccurred(int dbId);
  **/
 void appendDbprocStatsToBuffer(char *buf, uint32_t size, uint32_t dbId);
 
+/**
+ * Select the boards read by the spi fast path on this trigger, called from the trigger interrupt.
+ * Counts the trigger as unanswered until the board responds.
+ *
+ * @param[in]  triggerMask boards enabled for triggers
+ * @param[out] p_walkMask  boards to read from the spi DMA interrupt
+ * @param[out] p_taskMask  boards whose dbComm task must run, loopback, a command waiting
+ *                         for its response or too many unanswered triggers
+ */
+void dbCommTriggerFromISR(uint32_t triggerMask, uint32_t *p_walkMask, uint32_t *p_taskMask);
+
+/**
+ * Return the sensor transaction of a board, the spi fast path sends it and passes the
+ * responses it cannot handle in the interrupt to its callback.
+ *
+ * @param[in] dbId board
+ *
+ * @ret sensor transaction
+ */
+cncInfo_tp dbCommSensorMsg(uint32_t dbId);
+
+/**
+ * Store a sensor data response, called from the spi DMA interrupt.
+ *
+ * @param[in] dbId    board that responded
+ * @param[in] xInfo   sensor data sequence number
+ * @param[in] flags   header flags, FLAG_SENSOR_BURST for a burst of samples
+ * @param[in] payload sensor readings
+ * @param[in] rxSize  size of the frame received, legacy or extended
+ *
+ * @ret true if stored, false if the board must first be enabled by the task path
+ */
+bool dbCommSensorRxFromISR(uint32_t dbId, uint8_t xInfo, uint8_t flags, cncPayload_tp payload, uint32_t rxSize);
+
+/**
+ * Set the number of CNC commands sent to a board before its responses are received.
+ * Called once the board accepted the window, it is put back to 1 when the board is disabled.
+ *
+ * @param[in] dbId   board
+ * @param[in] window commands in flight, 1 to DB_CNC_WINDOW_MAX
+ */
+void dbCommSetCncWindow(uint32_t dbId, uint32_t window);
+
+/**
+ * Return the number of CNC commands sent to a board before its responses are received.
+ *
+ * @param[in] dbId board
+ *
+ * @ret commands in flight, 1 to DB_CNC_WINDOW_MAX
+ */
+uint32_t dbCommCncWindow(uint32_t dbId);
+
 #endif /* APP_INC_DBCOMMTASK_H_ */
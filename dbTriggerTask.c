@@ -10,6 +10,7 @@
 #include "cli/cli_print.h"
 #include "cmdAndCtrl.h"
 #include "cmsis_os.h"
+#include "ctrlSpiCommTask.h"
 #include "dbCommTask.h"
 #include "debugPrint.h"
 #include "main.h"
@@ -31,6 +32,7 @@ void dbTriggerThread(const void *arg);
 
 __DTCMRAM__ uint32_t dbTriggerEventGroupMask[MAX_DB_EVENT_GROUPS] = {0};
 __DTCMRAM__ EventGroupHandle_t dbTriggerEventGroup[MAX_DB_EVENT_GROUPS] = {NULL};
+static __DTCMRAM__ uint32_t dbTriggerInterval_us = VALUE_DB_SPI_INTERVAL_US;
 /* The event group used by all the task based tests. */
 
 __ITCMRAM__ inline void dbTriggerDisable(uint32_t dbId) {
@@ -73,7 +75,20 @@ __ITCMRAM__ inline void dbTriggerDisableAll(void) {
 
 __ITCMRAM__ void timerTriggerDbFromISR(void) {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+#if SPI_FAST_PATH
+    // sensor transactions are read from the spi DMA interrupts, the dbComm tasks only
+    // run for the boards needing the slow path
+    uint32_t walkMask;
+    uint32_t taskMask;
+    dbCommTriggerFromISR(dbTriggerEventGroupMask[0], &walkMask, &taskMask);
+    spiFastPathTriggerFromISR(walkMask);
+    if (taskMask != 0) {
+        xEventGroupSetBitsFromISR(dbTriggerEventGroup[0], taskMask, &xHigherPriorityTaskWoken);
+    }
+#else
+    spiTimingTriggerFromISR();
     xEventGroupSetBitsFromISR(dbTriggerEventGroup[0], dbTriggerEventGroupMask[0], &xHigherPriorityTaskWoken);
+#endif
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
@@ -105,10 +120,15 @@ void setDbTriggerInterval(uint32_t interval_us) {
     pwmMap[TIM_DB_TRIGGER_MSG].htim->Init.Period = arr;
     pwmMap[TIM_DB_TRIGGER_MSG].htim->Instance->PSC = psc;
     pwmMap[TIM_DB_TRIGGER_MSG].htim->Instance->ARR = arr;
+    dbTriggerInterval_us = interval_us;
 
     DPRINTF_INFO("SPI DB INTERVAL %u us TIM5 PSC=%u, ARR=%u\r\n", interval_us, psc, arr);
 }
 
+__ITCMRAM__ uint32_t dbTriggerIntervalUs(void) {
+    return dbTriggerInterval_us;
+}
+
 void dbTriggerThread(const void *arg) {
     watchdogAssignToCurrentTask(WDT_TASK_DBTRIGGER);
     watchdogSetTaskEnabled(WDT_TASK_DBTRIGGER, 1);
@@ -41,6 +41,15 @@ void dbTriggerThreadInit(int priority, int stackSize);
  */
 void setDbTriggerInterval(uint32_t interval_us);
 
+/**
+ *
+ * Get the trigger interval for spi messages to the
+ * daughter boards
+ *
+ * @return     interval in micro seconds
+ */
+uint32_t dbTriggerIntervalUs(void);
+
 /**
  *
  * Disable Trigger for Daughter board process
@@ -51,6 +51,11 @@
 
 #endif
 
+// 1 = build the cli "gather unpackbench" and the transmit cost counters of "gather stats"
+#ifndef GATHER_BENCH
+#define GATHER_BENCH 0
+#endif
+
 #ifdef DEBUG
 #define OPT_FAST 0
 #else
@@ -86,6 +86,31 @@ typedef enum {
     RED_LED_ON,           ///< Bool RED Led on otherwise use state off or blinking.
     PERIPHERAL_FAIL_MASK, ///< Each bit represents a peripheral
     FAN_POP,              ///< Fan population, bitwise b0=FAN1, b1=FAN2 population
+    STREAM_BATCH_CNT,     ///< Number of stream samples packed in one datagram, 1 = no batching
+    STREAM_RING_DEPTH,    ///< Number of stream ring slots, 2-8
+    STREAM_RING_HIGH_WATER, ///< Read only, most stream ring slots waiting to be sent
+    STREAM_RING_DROPS,    ///< Read only, stream samples dropped because the ring was full
+    STREAM_TCP_ZERO_COPY, ///< Bool send the TCP stream without copying it into lwIP
+    TIME_SYNC_SERVER,     ///< Time server IPv4 address, network byte order, 0 = no network time
+    TIME_SYNC_SERVER_PORT, ///< Time server udp port, 123 = NTP otherwise the two-way exchange
+    TIME_SYNC_INTERVAL_S, ///< Seconds between time server polls, 1-1024
+    TIME_SYNC_PTP_PORT,   ///< Udp port answering two-way exchange requests, 0 = not answering
+    TIME_SYNC_STATE,      ///< Read only, TIME_SYNC_STATE_e
+    TIME_SYNC_OFFSET_US,  ///< Read only, signed offset of the stream clock from the time server
+    TIME_SYNC_JITTER_US,  ///< Read only, mean offset change between polls
+    TIME_SYNC_DRIFT_PPB,  ///< Read only, signed frequency correction of the stream clock
+    SPI_LARGE_BUFFER_SHARE, ///< Percent of each spi bus time given to large buffer reads, 5-99, 100 reads in one transfer
+    SPI_BURST_CNT,          ///< ADC samples pulled from an ADC board per transaction, 1-4
+    SPI_CRC_TARGET_PPM,     ///< Crc errors per million spi transfers each bus is kept under, 0 = boot clock
+    SPI1_CLOCK_KHZ,         ///< Read only, spi 1 clock set from its crc error rate
+    SPI2_CLOCK_KHZ,         ///< Read only, spi 2 clock set from its crc error rate
+    SPI3_CLOCK_KHZ,         ///< Read only, spi 3 clock set from its crc error rate
+    SPI1_RESEND_BUDGET,     ///< Read only, sensor frames requested again per spi 1 trigger
+    SPI2_RESEND_BUDGET,     ///< Read only, sensor frames requested again per spi 2 trigger
+    SPI3_RESEND_BUDGET,     ///< Read only, sensor frames requested again per spi 3 trigger
+    SPI_LINK_ADJUSTS,       ///< Read only, spi clock and resend budget adjustments since boot
+    DB_CNC_WINDOW,          ///< CNC commands sent to a sensor board before its responses, 1-4
+    BOOT_FIRST_PACKET_MS,   ///< Read only, msec from boot to the first stream packet, 0 until it is sent
     MB_REG_MAX
 } REGISTER_MB_ID; // must occur before include of board_registersParams.h
 
@@ -115,6 +140,11 @@ typedef enum {
                              ///< data format is 1100<LOFF_STATP[7:0]><LOFF_STATN[7:0]><GPIO[7:4]>
                              ///< status word of 24bitsSTATUS 24bit value
     SB_ECG_LEG_LEAD_CONNECT, ///< LEG LEAD CONNECT ADC register 3, bit 0 RLD_STAT
+    SB_SPI_FRAME_SIZE,       ///< SPI frame size in bytes, written by the main board, boot value is the legacy frame
+    SB_SPI_BURST_CNT,        ///< ADC samples queued and sent per response, written by the main board, boot value 1
+    SB_CNC_WINDOW,           ///< CNC commands accepted before answering, written by the main board, boot value 1
+    SB_SENSOR_RESEND,        ///< sensor frames kept for SPICMD_SENSOR_RESEND, written by the main board, boot value 0
+    SB_LBUF_CHUNKED,         ///< large buffers read in chunks with CS raised between them, written by the main board
     SB_REG_MAX
 } REGISTER_DB_ID; // must occur before include of board_registersParams.h
 
@@ -12,6 +12,7 @@
 #include "byte_order.h"
 #include "debugCompileOptions.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define __DTCMRAM2__
@@ -53,6 +54,7 @@
 #define PRINT_FULL_SPI_PACKET 0
 #define TRACE_ANALYZE_SPI 0
 #define PRINT_SPI_CRC_ERROR 0
+#define SPI_FAST_PATH 1 // 1 = sensor transactions walked from the spi DMA interrupt, 0 = sent by the dbComm tasks
 #define PRINT_BYTE_CNT 8
 #define MAX_CS_PER_SPI 8
 #define MAX_SPI 3
@@ -100,10 +102,24 @@ extern ADC_MODE_e g_adcModeSwitch;
  * dbproc enable <id> 1 to force enable of a board id=0-48
  */
 #define VALUE_STREAM_INTERVAL_US 2000 * MULTIPLER
+#define VALUE_STREAM_BATCH_CNT 1 // samples per stream datagram, 1 = no batching
+#define VALUE_STREAM_RING_DEPTH 4 // stream ring slots, absorbs network stalls of depth - 2 intervals
+#define VALUE_STREAM_TCP_ZERO_COPY 0 // 1 = TCP stream sent with NETCONN_NOCOPY from the stream ring
+#define VALUE_TIME_SYNC_SERVER 0        // no network time, the stream clock follows the RTC
+#define VALUE_TIME_SYNC_SERVER_PORT 123 // NTP
+#define VALUE_TIME_SYNC_INTERVAL_S 16
+#define VALUE_TIME_SYNC_PTP_PORT 0 // not answering two-way exchange requests
+#define VALUE_SPI_LARGE_BUFFER_SHARE 25 // 40 chunks a 20K log read over about 52ms at the boot clock
+#define VALUE_SPI_BURST_CNT 1 // ADC samples pulled per transaction, 1 = one sample per trigger
+#define VALUE_SPI_CRC_TARGET_PPM 1000 // crc errors per million spi transfers, 0 = boot clock
+#define VALUE_DB_CNC_WINDOW 4 // CNC commands in flight per sensor board, 1 = wait for each response
 #define VALUE_DB_SPI_INTERVAL_US 2000 * MULTIPLER
 #define VALUE_DB_RETRY_INTERVAL_S 30          // 0.5 minutes
 #define DB_MAX_UNANSWERED_RESPONSE 240        // imu commands are worst case
 #define DB_MAX_UNANSWERED_RESPONSE_DISABLE 10 // number of no message before declaring the DB as disabled
+#define DB_CNC_TIMEOUT_MS (DB_MAX_UNANSWERED_RESPONSE * DB_SPI_INTERVAL_MS) // per CNC command, resent once
+#define DB_CNC_WINDOW_MAX 4                   // CNC commands in flight per sensor board
+#define DB_SENSOR_RESEND_DEPTH 2              // sensor frames a board keeps for SPICMD_SENSOR_RESEND
 #define DB_SPI_INTERVAL_MS 2
 
 // Sensor Defaults
@@ -307,6 +323,7 @@ typedef enum {
 
     SPICMD_SET_SKIP_WAIT_FOR_RESPONSE, // debug cmd SPI will not send to DB but will send sensor data back.
     SPICMD_SET_LOOPBACK_OFFSET,        // debug set daughter board loopback offset counter
+    SPICMD_SENSOR_RESEND,              // send again the kept sensor frame that followed xInfo
     SPICMD_MAX_CONSECUTIVE,            // must be last of the consecutive values
 
     SPICMD_UNUSED =
@@ -345,6 +362,7 @@ spiDbMbCmd_string_t spiDbMbCmd_string[DBCOMM_CNT] = {
     spiDbMbCmd_CreateInstanceConsecutive(SPICMD_SENSOR),
     spiDbMbCmd_CreateInstanceConsecutive(SPICMD_CNC),
     spiDbMbCmd_CreateInstanceConsecutive(SPICMD_SET_LOOPBACK_OFFSET),
+    spiDbMbCmd_CreateInstanceConsecutive(SPICMD_SENSOR_RESEND),
     spiDbMbCmd_CreateInstanceConsecutive(SPICMD_MAX_CONSECUTIVE),
     {.cmdId = SPICMD_UNUSED, .cmdName = tostr__(SPICMD_UNUSED)},
     {.cmdId = SPICMD_TRIGGER, .cmdName = tostr__(SPICMD_TRIGGER)},
@@ -419,31 +437,42 @@ extern const nibbleInfo_t imuNibbleInfo[IMU_PER_BOARD];
 
 
 #define BYTES_IN_24_BIT (24/8)
-#define USING32_ADC_SAMPLES_IN_SPI 1   // Setting to 0 is untested.
-
+// 1 = the sensor boards sign extend the ADC readings to 32 bit before sending them,
+// 0 = the readings are sent packed as read from the ADS1298, 24 bit big endian, saving 8 bytes
+// of every sensor packet. The main board sign extends them with adcUnpack24() when storing them
+// in the stream packet, `gather unpackbench` measures its cost when built with GATHER_BENCH.
+// Sensor and main boards must be built with the same value.
+#define USING32_ADC_SAMPLES_IN_SPI 1
+
+// The XBIT macros access a reading of the spi payload (adcSpiReading_t) through a byte pointer
 #if USING32_ADC_SAMPLES_IN_SPI
 #define VALUE_X_BIT value32bit
 #define READ_XBITSVALUE READ_32BITSVALUE
 #define READ_XBITUVALUE READ_32BITUVALUE
 #define WRITE_XBITVALUE WRITE_32BITVALUE
 #else
-#define VALUE_X_BIT value24bit;
+#define VALUE_X_BIT value24bit
 #define READ_XBITSVALUE READ_24BITSVALUE
 #define READ_XBITUVALUE READ_24BITUVALUE
 #define WRITE_XBITVALUE WRITE_24BITVALUE
 #endif
+
+// ADC reading of the stream packets, sign extended to 32 bit
 typedef struct {
-    // Concerned that the Mainboard translating 24 bit to 32 bit is going to tax the main board mcu
-    // since it has to repeat this 8*22 times.
-    // So going to take the hit on the SPI bandwidth side and send 8 wasted bytes per board instead
-    // and thus have the sensor boards do the 24 to 32 bit translations.
-#if USING32_ADC_SAMPLES_IN_SPI
     uint32_t value32bit;
-#else
+}adc24Reading_t;
+
+// ADC reading as read from the ADS1298, 24 bit big endian
+typedef struct {
     uint8_t value24bit[BYTES_IN_24_BIT];
-#endif
+}adcPacked24_t;
 
-}adc24Reading_t;
+// ADC reading of the spi sensor payload
+#if USING32_ADC_SAMPLES_IN_SPI
+typedef adc24Reading_t adcSpiReading_t;
+#else
+typedef adcPacked24_t adcSpiReading_t;
+#endif
 
 #define NEGATIVE_BIT 0x80
 #define NEGATIVE_EXT(b) (0xFF<<b)
@@ -471,7 +500,7 @@ typedef struct __attribute__((packed)) {
 typedef struct __attribute__((packed)) {
     union {
         struct {
-             adc24Reading_t adc[NUMBER_OF_SENSOR_READINGS];
+             adcSpiReading_t adc[NUMBER_OF_SENSOR_READINGS];
              coilData_t ctrlData[SENSORS_PER_BOARD];
         };
         struct {
@@ -485,7 +514,7 @@ typedef struct __attribute__((packed)) {
 // This Cmd payload structure is used to send commands from the Main board
 // to the sensor boards. The payload is CMD specific.
 typedef struct __attribute__((packed)) {
-    uint8_t payload[sizeof(adc24Reading_t)*NUMBER_OF_SENSOR_READINGS + (sizeof(coilData_t)*SENSORS_PER_BOARD)-sizeof(uint32_t)];
+    uint8_t payload[sizeof(adcSpiReading_t)*NUMBER_OF_SENSOR_READINGS + (sizeof(coilData_t)*SENSORS_PER_BOARD)-sizeof(uint32_t)];
     uint32_t flag2;
 } dbCmdPayload_t;
 
@@ -495,6 +524,7 @@ typedef uint8_t spiDBMBPacket_payload_t[sizeof(rx_dbNopPayload_t)];
 
 #define CMD_UID_DONT_CARE 0
 #define FLAG_LARGEBUFFER 1
+#define FLAG_SENSOR_BURST 2 // the sensor payload is a rx_dbBurstPayload_t
 typedef struct __attribute__((packed)) {
     uint16_t cmdUid; // allow for match of cmd response to command sent
     httpErrorCodes cmdResponse;
@@ -568,6 +598,7 @@ typedef enum {
     IMU_DATA_FLAG_SENT_MED_TRIBBLE,
     IMU_DATA_FLAG_SENT_LOW_TRIBBLE,
     IMU_DATA_FLAG_SENT_EMPTY_TRIBBLE, //< stay in sent EMPTY until NEW data is received by MSGQ
+    IMU_DATA_FLAG_SENT_FULL,          //< whole sample in the imuSample of an extended frame
 } IMU_DATA_FLAG_e;
 
 typedef enum {
@@ -652,6 +683,64 @@ typedef struct {
     };
 } imuData_t, *imuData_tp;
 
+// Extended sensor payload of a board that accepted SB_SPI_FRAME_SIZE, the legacy payload is
+// followed by the whole sample of each IMU whose imuFlag nibble is IMU_DATA_FLAG_SENT_FULL.
+// Boards that did not accept it keep sending the sample in tribbles.
+typedef struct __attribute__((packed)) {
+    rx_dbNopPayload_t nop;
+    quaternionData_t imuSample[IMU_PER_BOARD];
+} rx_dbExtPayload_t, *rx_dbExtPayload_tp;
+
+#define SPI_BURST_SAMPLES_MAX 4
+
+// One conversion queued by an ADC board, seq counts the conversions of the board and
+// age_us is the time from the conversion to the start of the transaction.
+typedef struct __attribute__((packed)) {
+    uint32_t seq;
+    uint32_t age_us;
+    adcSpiReading_t adc[NUMBER_OF_SENSOR_READINGS];
+    coilData_t ctrlData[SENSORS_PER_BOARD];
+} adcBurstSample_t, *adcBurstSample_tp;
+
+// Burst sensor payload of an ADC board that accepted SB_SPI_BURST_CNT, flagged with FLAG_SENSOR_BURST.
+// The board sends the conversions queued since its last response, oldest first, sampleCnt of them.
+typedef struct __attribute__((packed)) {
+    uint32_t sampleCnt;
+    adcBurstSample_t sample[SPI_BURST_SAMPLES_MAX];
+} rx_dbBurstPayload_t, *rx_dbBurstPayload_tp;
+
+// frame size in bytes of a packet carrying payloadSize bytes
+#define spiDbMbFrameSizeof(payloadSize) (sizeof(spiDbMbPacketHeader_t) + (payloadSize) + SIZEOF_CRC)
+
+// frame size in bytes of a burst of sampleCnt samples
+#define spiDbMbBurstFrameSizeof(sampleCnt) \
+    spiDbMbFrameSizeof(offsetof(rx_dbBurstPayload_t, sample) + (sampleCnt) * sizeof(adcBurstSample_t))
+
+#define spiDbMbExtPayloadSizeof \
+    (sizeof(rx_dbExtPayload_t) > sizeof(rx_dbBurstPayload_t) ? sizeof(rx_dbExtPayload_t) : sizeof(rx_dbBurstPayload_t))
+#define spiDbMbExtPacketSizeof spiDbMbFrameSizeof(spiDbMbExtPayloadSizeof)
+
+// Extended SPI packet, same header with the crc after the extended payload. The packet is sized for
+// the largest payload, the frame exchanged with a board only covers its negotiated payload.
+typedef struct __attribute__((packed, aligned(4))) {
+    union {
+        uint32_t u32[spiDbMbExtPacketSizeof / sizeof(uint32_t)];
+        uint8_t u8[spiDbMbExtPacketSizeof];
+        struct {
+            spiDbMbPacketHeader_t header;
+            union {
+                rx_dbExtPayload_t payload;
+                rx_dbBurstPayload_t burst;
+            };
+            uint32_t crc;
+        };
+    };
+} spiDbMbExtPacket_t, *spiDbMbExtPacket_tp;
+
+_Static_assert(sizeof(spiDbMbExtPacket_t) == spiDbMbExtPacketSizeof, "extended packet size error");
+_Static_assert(spiDbMbFrameSizeof(sizeof(rx_dbExtPayload_t)) % sizeof(uint32_t) == 0, "the crc unit reads whole words");
+_Static_assert(sizeof(adcBurstSample_t) % sizeof(uint32_t) == 0, "the crc unit reads whole words");
+
 #define SNPRINTF_TEST_AND_ADD(tmp,nxt, action) if(tmp <= 0 ) {action;} nxt+=tmp
 
 #endif /* INC_SAQTARGET_H_ */
@@ -25,6 +25,10 @@
 #define MONGOOSE_STACK_WORDS 1024
 #define DBTRIGGER_STACK_WORDS 256
 #define MBGATHER_STACK_WORDS 1024
+#define STREAMTX_STACK_WORDS 512
+#define TIMESYNC_STACK_WORDS 512
+#define WEBBATCH_STACK_WORDS 512
+#define BOARDSTATUS_STACK_WORDS 512
 #define DDSTRIGGER_STACK_WORDS 128
 #define DB_COMM_STACK_WORDS 512
 #define SPI_STACK_WORDS 320
@@ -0,0 +1,484 @@
+/*
+ * timeSync.c
+ *
+ * Network time sync of the stream clock, NTP client and two-way exchange responder
+ *
+ *  Copyright Nuvation Research Corporation 2018-2024. All Rights Reserved.
+ *      Author: rlegault
+ */
+
+/*
+ * The stream clock (MB_gatherTask.c) is a monotonic timebase plus a wall clock offset.
+ * This task measures the offset against a time server once per poll interval:
+ *
+ *   offset = ((t2 - t1) + (t3 - t4)) / 2    delay = (t4 - t1) - (t3 - t2)
+ *
+ * t1/t4 are the local transmit/receive times and t2/t3 the server receive/transmit
+ * times, from the NTP timestamps or a timeSyncMsg_t exchange with another main board.
+ * Large offsets are stepped, smaller ones are removed by a PI servo that slews the
+ * offset, its integral term is the drift estimate of the local oscillator.
+ */
+
+#define GENERATE_TIME_SYNC_STATE_STRING_NAMES
+#include "timeSync.h"
+#undef GENERATE_TIME_SYNC_STATE_STRING_NAMES
+#include "MB_gatherTask.h"
+#include "cli/cli_print.h"
+#include "cmsis_os.h"
+#include "debugPrint.h"
+#include "stmTarget.h"
+#include "taskWatchdog.h"
+#include "watchDog.h"
+#include <lwip/api.h>
+#include <lwip/inet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TIME_SYNC_RECV_TIMEOUT_MS 500  // the task wakes at least this often to poll and kick the watchdog
+#define TIME_SYNC_REPLY_TIMEOUT_MS 1000 // later replies are ignored, their delay is meaningless
+#define TIME_SYNC_STEP_US 128000        // larger offsets are stepped instead of slewed, as ntpd
+#define TIME_SYNC_LOCK_US 1000          // offsets below this count toward lock
+#define TIME_SYNC_LOCK_CNT 4            // consecutive small offsets to report lock
+#define TIME_SYNC_HOLDOVER_POLLS 4      // polls without a reply before holdover
+#define TIME_SYNC_KP_DIV 4              // the proportional term removes 1/4 of the offset per poll
+#define TIME_SYNC_KI_DIV 16             // the drift estimate moves by 1/16 of the offset rate per poll
+#define TIME_SYNC_JITTER_DIV 8          // jitter is averaged over about 8 polls
+#define TIME_SYNC_SPIKE_CNT 3           // consecutive outliers accepted as a real offset change
+#define TIME_SYNC_DRIFT_MAX_PPB 500000
+
+#define TIME_SYNC_US_PER_S 1000000LL
+
+#define NTP_PKT_SIZE 48
+#define NTP_ORIGINATE_IDX 24
+#define NTP_RECEIVE_IDX 32
+#define NTP_TRANSMIT_IDX 40
+#define NTP_UNIX_OFFSET_S 2208988800ULL // 1900 to 1970
+#define NTP_LI_VN_MODE_CLIENT 0x23      // no leap warning, version 4, client mode
+#define NTP_MODE_MASK 0x07
+#define NTP_MODE_SERVER 4
+
+typedef struct {
+    // configuration, written by the register handlers
+    volatile uint32_t serverAddr; // network byte order, 0 = disabled
+    volatile uint16_t serverPort;
+    volatile uint16_t ptpPort;
+    volatile uint32_t interval_s;
+    // servo state, written by the time sync task only
+    TIME_SYNC_STATE_e state;
+    int64_t offset_us; // last offset followed by the servo, 0 after a step
+    uint32_t jitter_us;
+    int32_t driftPpb;
+    uint32_t delay_us;
+    uint32_t lockCnt;
+    uint32_t spikeCnt;
+    uint32_t missedPolls;
+    // request waiting for its reply
+    bool waiting;
+    uint16_t seq;
+    int64_t t1_us;
+    uint8_t ntpTransmit[8]; // NTP transmit timestamp sent, echoed as the originate timestamp
+    uint32_t sentTick;
+    // statistics
+    uint32_t polls;
+    uint32_t replies;
+    uint32_t spikes;
+    uint32_t steps;
+    uint32_t answers;
+} timeSync_t;
+
+static timeSync_t timeSync = {
+    .serverPort = TIME_SYNC_NTP_PORT, .interval_s = VALUE_TIME_SYNC_INTERVAL_S, .state = TIME_SYNC_DISABLED};
+static struct netconn *timeSyncConn = NULL;
+
+/**
+ * @fn
+ *
+ * @brief Time sync thread, polls the time server and answers two-way exchange requests
+ *
+ * @param arg, unused.
+ **/
+static void timeSyncThread(const void *arg);
+
+/**
+ * @fn
+ *
+ * @brief Wall clock time now
+ *
+ * @return microseconds since epoch
+ **/
+static inline int64_t timeSyncNow(void) {
+    return streamWallTimeUs(streamTimeUs());
+}
+
+/**
+ * @fn
+ *
+ * @brief Write a time as an NTP timestamp, big endian seconds since 1900 and 2^-32 fractions
+ *
+ * @param[out] p_dst: 8 byte timestamp
+ * @param[in] time_us: microseconds since epoch
+ **/
+static void ntpWriteTime(uint8_t *p_dst, int64_t time_us) {
+    uint32_t sec = lwip_htonl((uint32_t)(time_us / TIME_SYNC_US_PER_S + NTP_UNIX_OFFSET_S));
+    uint32_t frac = lwip_htonl((uint32_t)(((uint64_t)(time_us % TIME_SYNC_US_PER_S) << 32) / TIME_SYNC_US_PER_S));
+    memcpy(p_dst, &sec, sizeof(sec));
+    memcpy(p_dst + sizeof(sec), &frac, sizeof(frac));
+}
+
+/**
+ * @fn
+ *
+ * @brief Read an NTP timestamp
+ *
+ * @param[in] p_src: 8 byte timestamp
+ *
+ * @return microseconds since epoch
+ **/
+static int64_t ntpReadTime(const uint8_t *p_src) {
+    uint32_t sec;
+    uint32_t frac;
+    memcpy(&sec, p_src, sizeof(sec));
+    memcpy(&frac, p_src + sizeof(sec), sizeof(frac));
+    return ((int64_t)lwip_ntohl(sec) - (int64_t)NTP_UNIX_OFFSET_S) * TIME_SYNC_US_PER_S +
+           (int64_t)(((uint64_t)lwip_ntohl(frac) * TIME_SYNC_US_PER_S) >> 32);
+}
+
+/**
+ * @fn
+ *
+ * @brief Send the next request to the time server, NTP or two-way exchange
+ **/
+static void timeSyncSendRequest(void) {
+    bool ntp = (timeSync.serverPort == TIME_SYNC_NTP_PORT);
+    uint16_t len = ntp ? NTP_PKT_SIZE : sizeof(timeSyncMsg_t);
+    ip_addr_t addr;
+    ip_addr_set_ip4_u32(&addr, timeSync.serverAddr);
+
+    struct netbuf *buf = netbuf_new();
+    if (buf == NULL) {
+        return;
+    }
+    uint8_t *p_data = netbuf_alloc(buf, len);
+    if (p_data == NULL) {
+        netbuf_delete(buf);
+        return;
+    }
+    memset(p_data, 0, len);
+    timeSync.seq++;
+    // t1 is taken last so the packet preparation is not part of the measured delay
+    timeSync.t1_us = timeSyncNow();
+    if (ntp) {
+        p_data[0] = NTP_LI_VN_MODE_CLIENT;
+        ntpWriteTime(&p_data[NTP_TRANSMIT_IDX], timeSync.t1_us);
+        memcpy(timeSync.ntpTransmit, &p_data[NTP_TRANSMIT_IDX], sizeof(timeSync.ntpTransmit));
+    } else {
+        timeSyncMsg_tp p_msg = (timeSyncMsg_tp)p_data;
+        p_msg->magic = TIME_SYNC_MAGIC;
+        p_msg->version = TIME_SYNC_MSG_VERSION;
+        p_msg->type = TIME_SYNC_REQUEST;
+        p_msg->seq = timeSync.seq;
+        p_msg->t1_us = timeSync.t1_us;
+    }
+    err_t err = netconn_sendto(timeSyncConn, buf, &addr, timeSync.serverPort);
+    netbuf_delete(buf);
+    timeSync.polls++;
+    timeSync.sentTick = HAL_GetTick();
+    timeSync.waiting = (err == ERR_OK);
+    if (err != ERR_OK) {
+        DPRINTF_ERROR("Time sync send failed %d\r\n", err);
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Count a poll without reply, the servo holds the last drift estimate after a few
+ **/
+static void timeSyncMissed(void) {
+    timeSync.waiting = false;
+    if (++timeSync.missedPolls >= TIME_SYNC_HOLDOVER_POLLS &&
+        (timeSync.state == TIME_SYNC_LOCKED || timeSync.state == TIME_SYNC_LOCKING)) {
+        streamClockSteer(0, timeSync.driftPpb);
+        timeSync.state = TIME_SYNC_HOLDOVER;
+        DPRINTF_INFO("Time sync holdover, drift %ld ppb\r\n", timeSync.driftPpb);
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Run the servo on one offset measurement
+ *
+ * @param[in] t1_us: request transmit time, local
+ * @param[in] t2_us: request receive time, server
+ * @param[in] t3_us: reply transmit time, server
+ * @param[in] t4_us: reply receive time, local
+ **/
+static void timeSyncSample(int64_t t1_us, int64_t t2_us, int64_t t3_us, int64_t t4_us) {
+    int64_t offset = ((t2_us - t1_us) + (t3_us - t4_us)) / 2;
+    int64_t delay = (t4_us - t1_us) - (t3_us - t2_us);
+
+    timeSync.waiting = false;
+    timeSync.missedPolls = 0;
+    timeSync.replies++;
+    timeSync.delay_us = (delay > 0) ? delay : 0;
+
+    if (timeSync.state == TIME_SYNC_UNSYNCED || llabs(offset) > TIME_SYNC_STEP_US) {
+        streamClockSteer(offset, timeSync.driftPpb);
+        // the step removed the offset, the next reply is compared to what is left of it
+        timeSync.offset_us = 0;
+        timeSync.jitter_us = 0;
+        timeSync.state = TIME_SYNC_LOCKING;
+        timeSync.lockCnt = 0;
+        timeSync.spikeCnt = 0;
+        timeSync.steps++;
+        DPRINTF_INFO("Time sync stepped %lld us\r\n", (long long)offset);
+        return;
+    }
+
+    // a single delayed reply is not followed, a lasting change is
+    int64_t change = llabs(offset - timeSync.offset_us);
+    if (timeSync.jitter_us != 0 && change > 3 * timeSync.jitter_us + TIME_SYNC_LOCK_US &&
+        timeSync.spikeCnt < TIME_SYNC_SPIKE_CNT) {
+        timeSync.spikeCnt++;
+        timeSync.spikes++;
+        return;
+    }
+    timeSync.spikeCnt = 0;
+    timeSync.jitter_us += (change - (int64_t)timeSync.jitter_us) / TIME_SYNC_JITTER_DIV;
+    timeSync.offset_us = offset;
+
+    // removing offset us over one poll interval takes offset * 1000 / interval_s ppb
+    int64_t offsetPpb = offset * 1000 / timeSync.interval_s;
+    int64_t drift = timeSync.driftPpb + offsetPpb / TIME_SYNC_KI_DIV;
+    if (drift > TIME_SYNC_DRIFT_MAX_PPB) {
+        drift = TIME_SYNC_DRIFT_MAX_PPB;
+    } else if (drift < -TIME_SYNC_DRIFT_MAX_PPB) {
+        drift = -TIME_SYNC_DRIFT_MAX_PPB;
+    }
+    timeSync.driftPpb = drift;
+    streamClockSteer(0, drift + offsetPpb / TIME_SYNC_KP_DIV);
+
+    if (llabs(offset) < TIME_SYNC_LOCK_US) {
+        if (++timeSync.lockCnt >= TIME_SYNC_LOCK_CNT) {
+            timeSync.state = TIME_SYNC_LOCKED;
+        }
+    } else {
+        timeSync.lockCnt = 0;
+        timeSync.state = TIME_SYNC_LOCKING;
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Handle a received datagram, server reply or two-way exchange request
+ *
+ * @param[in] buf: received datagram
+ * @param[in] rx_us: wall clock time it was received
+ **/
+static void timeSyncRecv(struct netbuf *buf, int64_t rx_us) {
+    void *p_data;
+    uint16_t len;
+    netbuf_data(buf, &p_data, &len);
+    bool inTime = timeSync.waiting && (HAL_GetTick() - timeSync.sentTick) < TIME_SYNC_REPLY_TIMEOUT_MS;
+
+    if (len >= sizeof(timeSyncMsg_t)) {
+        timeSyncMsg_tp p_msg = (timeSyncMsg_tp)p_data;
+        if (p_msg->magic != TIME_SYNC_MAGIC || p_msg->version != TIME_SYNC_MSG_VERSION) {
+            // not an exchange message, may still be an NTP reply
+        } else if (p_msg->type == TIME_SYNC_REQUEST && timeSync.ptpPort != 0) {
+            p_msg->type = TIME_SYNC_RESPONSE;
+            p_msg->t2_us = rx_us;
+            p_msg->t3_us = timeSyncNow();
+            if (netconn_sendto(timeSyncConn, buf, netbuf_fromaddr(buf), netbuf_fromport(buf)) == ERR_OK) {
+                timeSync.answers++;
+            }
+            return;
+        } else if (p_msg->type == TIME_SYNC_RESPONSE) {
+            if (inTime && timeSync.serverPort != TIME_SYNC_NTP_PORT && p_msg->seq == timeSync.seq &&
+                p_msg->t1_us == timeSync.t1_us) {
+                timeSyncSample(p_msg->t1_us, p_msg->t2_us, p_msg->t3_us, rx_us);
+            }
+            return;
+        }
+    }
+
+    uint8_t *p_ntp = (uint8_t *)p_data;
+    if (len >= NTP_PKT_SIZE && inTime && timeSync.serverPort == TIME_SYNC_NTP_PORT &&
+        netbuf_fromport(buf) == TIME_SYNC_NTP_PORT && (p_ntp[0] & NTP_MODE_MASK) == NTP_MODE_SERVER &&
+        p_ntp[1] != 0 && memcmp(&p_ntp[NTP_ORIGINATE_IDX], timeSync.ntpTransmit, sizeof(timeSync.ntpTransmit)) == 0) {
+        timeSyncSample(
+            timeSync.t1_us, ntpReadTime(&p_ntp[NTP_RECEIVE_IDX]), ntpReadTime(&p_ntp[NTP_TRANSMIT_IDX]), rx_us);
+    }
+}
+
+static void timeSyncThread(const void *arg) {
+    uint32_t boundPort = UINT32_MAX;
+    uint32_t lastPollTick = 0;
+    DPRINTF_INFO("Time Sync Task starting\r\n");
+
+    timeSyncConn = netconn_new(NETCONN_UDP);
+    assert(timeSyncConn != NULL);
+    netconn_set_recvtimeout(timeSyncConn, TIME_SYNC_RECV_TIMEOUT_MS);
+
+    watchdogAssignToCurrentTask(WDT_TASK_TIMESYNC);
+    watchdogSetTaskEnabled(WDT_TASK_TIMESYNC, 1);
+
+    while (1) {
+        watchdogKickFromTask(WDT_TASK_TIMESYNC);
+
+        // requests and replies share one socket, bound to the exchange port when answering is enabled
+        if (timeSync.ptpPort != boundPort) {
+            boundPort = timeSync.ptpPort;
+            err_t err = netconn_bind(timeSyncConn, IP_ADDR_ANY, boundPort);
+            if (err != ERR_OK) {
+                DPRINTF_ERROR("Time sync bind to port %lu failed %d\r\n", boundPort, err);
+            }
+        }
+
+        if (timeSync.serverAddr == 0) {
+            if (timeSync.state != TIME_SYNC_DISABLED) {
+                timeSync.state = TIME_SYNC_DISABLED;
+                timeSync.waiting = false;
+                streamClockRelease();
+            }
+        } else {
+            if (timeSync.state == TIME_SYNC_DISABLED) {
+                timeSync.state = TIME_SYNC_UNSYNCED;
+                lastPollTick = HAL_GetTick() - timeSync.interval_s * 1000;
+            }
+            if (HAL_GetTick() - lastPollTick >= timeSync.interval_s * 1000) {
+                lastPollTick = HAL_GetTick();
+                if (timeSync.waiting) {
+                    timeSyncMissed();
+                }
+                timeSyncSendRequest();
+            }
+        }
+
+        struct netbuf *buf;
+        if (netconn_recv(timeSyncConn, &buf) == ERR_OK) {
+            int64_t rx_us = timeSyncNow();
+            timeSyncRecv(buf, rx_us);
+            netbuf_delete(buf);
+        }
+    }
+}
+
+void timeSyncTaskInit(int priority, int stackSize) {
+    registerInfo_t regInfo = {.mbId = TIME_SYNC_SERVER, .type = DATA_UINT};
+    registerRead(&regInfo);
+    setTimeSyncServer(regInfo.u.dataUint);
+
+    regInfo.mbId = TIME_SYNC_SERVER_PORT;
+    registerRead(&regInfo);
+    if (setTimeSyncServerPort(regInfo.u.dataUint) != RETURN_OK) {
+        setTimeSyncServerPort(VALUE_TIME_SYNC_SERVER_PORT);
+    }
+
+    regInfo.mbId = TIME_SYNC_INTERVAL_S;
+    registerRead(&regInfo);
+    if (setTimeSyncInterval(regInfo.u.dataUint) != RETURN_OK) {
+        setTimeSyncInterval(VALUE_TIME_SYNC_INTERVAL_S);
+    }
+
+    regInfo.mbId = TIME_SYNC_PTP_PORT;
+    registerRead(&regInfo);
+    if (setTimeSyncPtpPort(regInfo.u.dataUint) != RETURN_OK) {
+        setTimeSyncPtpPort(VALUE_TIME_SYNC_PTP_PORT);
+    }
+
+    osThreadDef(timeSyncTask, timeSyncThread, priority, 0, stackSize);
+    osThreadId thread = osThreadCreate(osThread(timeSyncTask), NULL);
+    assert(thread != NULL);
+}
+
+void setTimeSyncServer(uint32_t addr) {
+    timeSync.serverAddr = addr;
+}
+
+RETURN_CODE setTimeSyncServerPort(uint32_t port) {
+    if (port == 0 || port > UINT16_MAX) {
+        return RETURN_ERR_PARAM;
+    }
+    timeSync.serverPort = port;
+    return RETURN_OK;
+}
+
+RETURN_CODE setTimeSyncInterval(uint32_t interval_s) {
+    if (interval_s < TIME_SYNC_INTERVAL_MIN_S || interval_s > TIME_SYNC_INTERVAL_MAX_S) {
+        return RETURN_ERR_PARAM;
+    }
+    timeSync.interval_s = interval_s;
+    return RETURN_OK;
+}
+
+RETURN_CODE setTimeSyncPtpPort(uint32_t port) {
+    if (port > UINT16_MAX) {
+        return RETURN_ERR_PARAM;
+    }
+    timeSync.ptpPort = port;
+    return RETURN_OK;
+}
+
+RETURN_CODE timeSyncStateRead(const registerInfo_tp regInfo) {
+    regInfo->type = DATA_UINT;
+    regInfo->u.dataUint = timeSync.state;
+    return RETURN_OK;
+}
+
+RETURN_CODE timeSyncOffsetRead(const registerInfo_tp regInfo) {
+    int64_t offset = timeSync.offset_us;
+    regInfo->type = DATA_INT;
+    regInfo->u.dataInt = (offset > INT32_MAX) ? INT32_MAX : (offset < INT32_MIN) ? INT32_MIN : (int32_t)offset;
+    return RETURN_OK;
+}
+
+RETURN_CODE timeSyncJitterRead(const registerInfo_tp regInfo) {
+    regInfo->type = DATA_UINT;
+    regInfo->u.dataUint = timeSync.jitter_us;
+    return RETURN_OK;
+}
+
+RETURN_CODE timeSyncDriftRead(const registerInfo_tp regInfo) {
+    regInfo->type = DATA_INT;
+    regInfo->u.dataInt = timeSync.driftPpb;
+    return RETURN_OK;
+}
+
+#define CMD_ARG_IDX 1
+
+int16_t timeSyncCliCmd(CLI *hCli, int argc, char *argv[]) {
+    uint16_t success = 0;
+    if (argc == CMD_ARG_IDX + 1 && strcmp(argv[CMD_ARG_IDX], "stats") == 0) {
+        ip_addr_t addr;
+        ip_addr_set_ip4_u32(&addr, timeSync.serverAddr);
+        int64_t now_us = timeSyncNow();
+        CliPrintf(hCli, "State          = %s\r\n", TIME_SYNC_STATE_e_Strings[timeSync.state]);
+        CliPrintf(hCli,
+                  "Server         = %s:%u %s, every %lu s\r\n",
+                  ipaddr_ntoa(&addr),
+                  timeSync.serverPort,
+                  (timeSync.serverPort == TIME_SYNC_NTP_PORT) ? "ntp" : "two-way",
+                  timeSync.interval_s);
+        CliPrintf(hCli, "Exchange Port  = %u%s\r\n", timeSync.ptpPort, timeSync.ptpPort ? "" : " (not answering)");
+        CliPrintf(hCli, "Offset         = %lld us\r\n", (long long)timeSync.offset_us);
+        CliPrintf(hCli, "Jitter         = %lu us\r\n", timeSync.jitter_us);
+        CliPrintf(hCli, "Delay          = %lu us\r\n", timeSync.delay_us);
+        CliPrintf(hCli, "Drift          = %ld ppb\r\n", timeSync.driftPpb);
+        CliPrintf(hCli,
+                  "Polls          = %lu, replies %lu, spikes %lu, steps %lu\r\n",
+                  timeSync.polls,
+                  timeSync.replies,
+                  timeSync.spikes,
+                  timeSync.steps);
+        CliPrintf(hCli, "Answered       = %lu\r\n", timeSync.answers);
+        CliPrintf(hCli,
+                  "Wall Clock     = %lu.%06lu s\r\n",
+                  (uint32_t)(now_us / TIME_SYNC_US_PER_S),
+                  (uint32_t)(now_us % TIME_SYNC_US_PER_S));
+        success = 1;
+    }
+    return success;
+}
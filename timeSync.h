@@ -0,0 +1,171 @@
+/*
+ * timeSync.h
+ *
+ * Network time sync of the stream clock, NTP client and two-way exchange responder
+ *
+ *  Copyright Nuvation Research Corporation 2018-2024. All Rights Reserved.
+ *      Author: rlegault
+ */
+
+#ifndef APP_INC_TIMESYNC_H_
+#define APP_INC_TIMESYNC_H_
+
+#include "cli/cli.h"
+#include "registerParams.h"
+#include "saqTarget.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TIME_SYNC_NTP_PORT 123
+#define TIME_SYNC_INTERVAL_MIN_S 1
+#define TIME_SYNC_INTERVAL_MAX_S 1024
+
+#define TIME_SYNC_MAGIC 0x54514153 // "SAQT" little endian
+#define TIME_SYNC_MSG_VERSION 1
+
+#define macro_TIME_SYNC_STATE(T)                                                                                       \
+    T(TIME_SYNC_DISABLED) /* no server configured */                                                                   \
+    T(TIME_SYNC_UNSYNCED) /* waiting for the first reply */                                                            \
+    T(TIME_SYNC_LOCKING)  /* offset stepped, servo converging */                                                       \
+    T(TIME_SYNC_LOCKED)   /* offset within TIME_SYNC_LOCK_US */                                                        \
+    T(TIME_SYNC_HOLDOVER) /* server lost, running on the last drift estimate */
+
+#ifdef GENERATE_TIME_SYNC_STATE_STRING_NAMES
+GENERATE_ENUM_STRING_NAMES(macro_TIME_SYNC_STATE, TIME_SYNC_STATE_e)
+#else
+extern const char *TIME_SYNC_STATE_e_Strings[];
+#endif
+GENERATE_ENUM_LIST(macro_TIME_SYNC_STATE, TIME_SYNC_STATE_e)
+#undef macro_TIME_SYNC_STATE
+
+typedef enum { TIME_SYNC_REQUEST = 1, TIME_SYNC_RESPONSE } TIME_SYNC_MSG_e;
+
+// Two-way time exchange between main boards, little endian, wall clock times in us since epoch.
+// The requester sends t1, the responder echoes it with its receive (t2) and transmit (t3) times.
+typedef struct __attribute__((packed)) {
+    uint32_t magic; // TIME_SYNC_MAGIC
+    uint8_t version;
+    uint8_t type; // TIME_SYNC_MSG_e
+    uint16_t seq;
+    int64_t t1_us;
+    int64_t t2_us;
+    int64_t t3_us;
+} timeSyncMsg_t, *timeSyncMsg_tp;
+
+/**
+ * @fn
+ *
+ * @brief Initialize the time sync task
+ *
+ * This task polls the TIME_SYNC_SERVER every TIME_SYNC_INTERVAL_S seconds, with NTP when
+ * TIME_SYNC_SERVER_PORT is 123 and with the two-way exchange of timeSyncMsg_t otherwise,
+ * and steers the stream clock with a PI servo. It also answers two-way exchange requests
+ * on TIME_SYNC_PTP_PORT so other main boards can sync to this one.
+ * @note must be called after mbGatherTaskInit()
+ *
+ * @param[in] priority: Set the task priority
+ *
+ * @param[in] stackSize: set the stask size for the task.
+ **/
+void timeSyncTaskInit(int priority, int stackSize);
+
+/**
+ * @fn
+ *
+ * @brief Set the time server, 0 disables the sync and hands the stream clock back to the RTC
+ *
+ * @param[in] addr: IPv4 address in network byte order
+ **/
+void setTimeSyncServer(uint32_t addr);
+
+/**
+ * @fn
+ *
+ * @brief Set the time server port, 123 selects NTP, any other port the two-way exchange
+ *
+ * @param[in] port: udp port
+ *
+ * @return RETURN_OK or RETURN_ERR_PARAM if port is 0 or above 65535
+ **/
+RETURN_CODE setTimeSyncServerPort(uint32_t port);
+
+/**
+ * @fn
+ *
+ * @brief Set the time server poll interval
+ *
+ * @param[in] interval_s: seconds between polls, 1-1024
+ *
+ * @return RETURN_OK or RETURN_ERR_PARAM if interval_s is out of range
+ **/
+RETURN_CODE setTimeSyncInterval(uint32_t interval_s);
+
+/**
+ * @fn
+ *
+ * @brief Set the port answering two-way exchange requests
+ *
+ * @param[in] port: udp port, 0 stops answering
+ *
+ * @return RETURN_OK or RETURN_ERR_PARAM if port is above 65535
+ **/
+RETURN_CODE setTimeSyncPtpPort(uint32_t port);
+
+/**
+ * @fn
+ *
+ * @brief Read the time sync state
+ *
+ * @param[out] regInfo: u.dataUint is set to the TIME_SYNC_STATE_e value
+ *
+ * @return RETURN_OK
+ **/
+RETURN_CODE timeSyncStateRead(const registerInfo_tp regInfo);
+
+/**
+ * @fn
+ *
+ * @brief Read the last measured offset of the stream clock from the time server
+ *
+ * @param[out] regInfo: u.dataInt is set to the offset in us, positive when the server is ahead
+ *
+ * @return RETURN_OK
+ **/
+RETURN_CODE timeSyncOffsetRead(const registerInfo_tp regInfo);
+
+/**
+ * @fn
+ *
+ * @brief Read the offset jitter
+ *
+ * @param[out] regInfo: u.dataUint is set to the mean offset change between polls in us
+ *
+ * @return RETURN_OK
+ **/
+RETURN_CODE timeSyncJitterRead(const registerInfo_tp regInfo);
+
+/**
+ * @fn
+ *
+ * @brief Read the estimated drift of the stream clock
+ *
+ * @param[out] regInfo: u.dataInt is set to the frequency correction in ppb
+ *
+ * @return RETURN_OK
+ **/
+RETURN_CODE timeSyncDriftRead(const registerInfo_tp regInfo);
+
+/**
+ * @fn
+ *
+ * @brief CLI command to display the time sync status
+ *
+ * @param[in] hCli: CLI instance
+ * @param[in] argc: Number or command line arguments
+ * @param[in] argv: List of command line arguments
+ *
+ * @return 1 on success
+ **/
+int16_t timeSyncCliCmd(CLI *hCli, int argc, char *argv[]);
+
+#endif /* APP_INC_TIMESYNC_H_ */
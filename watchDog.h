@@ -78,6 +78,10 @@ typedef enum WatchdogTask {
     WDT_TASK_UDPCONNECTION,
     WDT_TASK_RESET,
     WDT_TASK_DDSTRIGGER,
+    WDT_TASK_STREAMTX,
+    WDT_TASK_TIMESYNC,
+    WDT_TASK_WEBBATCH,
+    WDT_TASK_BOARDSTATUS,
     WDT_NUM_TASKS // Not a real task. Must be at the end
 } WatchdogTask_e;
 
@@ -80,7 +80,11 @@ WatchdogTaskDef_t watchdogTaskDefs[WDT_NUM_TASKS] = {{WDT_TASK_CLI, NULL, "cliTa
                                                      {WDT_TASK_GATHER, NULL, "gather", 2000, 0, 0, 0},
                                                      {WDT_TASK_UDPCONNECTION, NULL, "udp", 2000, 0, 0, 0},
                                                      {WDT_TASK_RESET, NULL, "resetTask", 4000, 0, 0, 0},
-                                                     {WDT_TASK_DDSTRIGGER, NULL, "ddsTrig", 4000, 0, 0, 0}};
+                                                     {WDT_TASK_DDSTRIGGER, NULL, "ddsTrig", 4000, 0, 0, 0},
+                                                     {WDT_TASK_STREAMTX, NULL, "streamTx", 2000, 0, 0, 0},
+                                                     {WDT_TASK_TIMESYNC, NULL, "timeSync", 2000, 0, 0, 0},
+                                                     {WDT_TASK_WEBBATCH, NULL, "webBatch", 2000, 0, 0, 0},
+                                                     {WDT_TASK_BOARDSTATUS, NULL, "boardStatus", 8000, 0, 0, 0}};
 
 // Initializes the watchdog task.
 // This assumes the hardware watchdog is already configured
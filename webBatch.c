@@ -0,0 +1,733 @@
+/*
+ * webBatch.c
+ *
+ * Batch of CNC operations, /batch endpoint
+ *
+ *  Copyright Nuvation Research Corporation 2018-2024. All Rights Reserved.
+ *      Author: rlegault
+ */
+
+#include "webBatch.h"
+#include "MB_cncHandleMsg.h"
+#include "cmdAndCtrl.h"
+#include "dbCommTask.h"
+#include "debugPrint.h"
+#include "json.h"
+#include "saqTarget.h"
+#include "stmTarget.h"
+#include "taskWatchdog.h"
+#include "watchDog.h"
+#include "webCliMisc.h"
+#include "webCmdHandler.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define WEB_BATCH_MAX_IN_FLIGHT (CNC_MSG_POOL_DEPTH / 2) // leaves cnc messages to the other web requests
+#define WEB_BATCH_WAIT_MS 500                           // the batch task kicks its watchdog at least this often
+#define WEB_BATCH_MAIN_BOARD_SLOT MAX_CS_ID             // in flight count of the main board
+#define ERRORBUFFER_SZ 60
+
+typedef enum {
+    WEB_BATCH_OP_QUEUED,      // not sent yet
+    WEB_BATCH_OP_SENT,        // waiting for the response
+    WEB_BATCH_OP_DONE,        // response received
+    WEB_BATCH_OP_TIMEOUT,     // no response, the batch stopped waiting
+    WEB_BATCH_OP_SEND_ERROR,  // the command could not be queued
+    WEB_BATCH_OP_NOT_PRESENT, // the board is disabled or missing
+} WEB_BATCH_OP_e;
+
+static const char *webBatchOpStatusStr[] = {
+    [WEB_BATCH_OP_QUEUED] = "not run",
+    [WEB_BATCH_OP_SENT] = "sent",
+    [WEB_BATCH_OP_DONE] = "done",
+    [WEB_BATCH_OP_TIMEOUT] = "timeout",
+    [WEB_BATCH_OP_SEND_ERROR] = "send error",
+    [WEB_BATCH_OP_NOT_PRESENT] = "not present",
+};
+
+// One operation of a batch, value and result are replaced by the response
+typedef struct {
+    struct webBatch *p_batch; // batch of the operation, for the callback
+    uint32_t addr;
+    uint32_t value;
+    uint32_t result; // cnc result, 0 on success
+    uint32_t tick;   // send tick, then msec from the send to the response
+    uint8_t destination;
+    uint8_t peripheral; // PERIPHERAL_e
+    uint8_t action;     // CNC_ACTION_e
+    uint8_t status;     // WEB_BATCH_OP_e
+} webBatchOp_t, *webBatchOp_tp;
+
+/*
+ * The batch is freed by the last of its owner and the responses still to come, a response
+ * arriving after the batch stopped waiting is dropped.
+ */
+typedef struct webBatch {
+    osThreadId taskHandle; // notified by each response
+    uint32_t startTick;
+    uint32_t msec;                    // run time of the batch
+    uint32_t refs;                    // responses still to come plus the owner
+    volatile uint32_t done;           // operations finished, whatever their result
+    volatile uint32_t inFlightCnt;    // operations sent and not answered
+    volatile uint8_t inFlight[MAX_CS_ID + 1]; // per board, the main board last
+    bool abandoned;                   // responses are dropped
+    uint8_t uid;
+    uint32_t cnt;
+    webBatchOp_t op[];
+} webBatch_t, *webBatch_tp;
+
+typedef enum {
+    WEB_BATCH_JOB_FREE,
+    WEB_BATCH_JOB_QUEUED,
+    WEB_BATCH_JOB_RUNNING,
+    WEB_BATCH_JOB_DONE,
+} WEB_BATCH_JOB_e;
+
+static const char *webBatchJobStateStr[] = {
+    [WEB_BATCH_JOB_FREE] = "free",
+    [WEB_BATCH_JOB_QUEUED] = "queued",
+    [WEB_BATCH_JOB_RUNNING] = "running",
+    [WEB_BATCH_JOB_DONE] = "done",
+};
+
+// Asynchronous batch, owns p_batch until it is read or dropped
+typedef struct {
+    uint32_t id;
+    WEB_BATCH_JOB_e state;
+    webBatch_tp p_batch;
+} webBatchJob_t, *webBatchJob_tp;
+
+static webBatchJob_t webBatchJobs[WEB_BATCH_MAX_JOBS];
+static uint32_t webBatchNextJobId = 1;
+static osMutexId webBatchJobAccess = NULL; // job table, web requests and batch task
+static osMessageQId webBatchJobQ = NULL;   // index of the jobs to run
+osMutexDef(webBatchJobAccess);
+osMessageQDef(webBatchJobQ, WEB_BATCH_MAX_JOBS, uint32_t);
+
+/**
+ * @fn
+ *
+ * @brief Index of the in flight count of a destination
+ *
+ * @param[in] destination: sensor board or MAIN_BOARD_ID
+ *
+ * @return index in webBatch_t.inFlight
+ **/
+static inline uint32_t webBatchSlot(uint8_t destination) {
+    return (destination == MAIN_BOARD_ID) ? WEB_BATCH_MAIN_BOARD_SLOT : destination;
+}
+
+/**
+ * @fn
+ *
+ * @brief Operations a destination is sent before its first response
+ *
+ * @param[in] destination: sensor board or MAIN_BOARD_ID
+ *
+ * @return the CNC window negotiated with a sensor board, 1 for the main board
+ **/
+static uint32_t webBatchWindow(uint8_t destination) {
+    if (destination == MAIN_BOARD_ID) {
+        return 1;
+    }
+    uint32_t window = dbCommCncWindow(destination);
+    return (window != 0) ? window : 1;
+}
+
+/**
+ * @fn
+ *
+ * @brief Drop the owner reference of a batch, the batch is freed by the last reference
+ *
+ * @param[in] p_batch: batch, may be NULL
+ **/
+static void webBatchRelease(webBatch_tp p_batch) {
+    if (p_batch == NULL) {
+        return;
+    }
+    vTaskSuspendAll();
+    bool last = (--p_batch->refs == 0);
+    xTaskResumeAll();
+
+    if (last) {
+        vPortFree(p_batch);
+    }
+}
+
+/**
+ * @fn
+ *
+ * @brief Store the response of a batch operation
+ *
+ * The scheduler is suspended while the batch is updated so its owner cannot stop waiting,
+ * and free it, between the test of abandoned and the notification.
+ *
+ * @param[in] cbId: webBatchOp_tp of the operation
+ *
+ * @return osOK
+ **/
+static osStatus webBatchCB(spiDbMbCmd_e spiDbMbCmd,
+                           uint32_t cbId,
+                           uint8_t xInfo,
+                           spiDbMbPacketCmdResponse_t cmdResponse,
+                           cncPayload_tp p_payload) {
+    webBatchOp_tp p_op = (webBatchOp_tp)cbId;
+    webBatch_tp p_batch = p_op->p_batch;
+
+    vTaskSuspendAll();
+    if (!p_batch->abandoned) {
+        p_op->result = p_payload->cmd.cncMsgPayloadHeader.cncActionData.result;
+        p_op->value = p_payload->cmd.value;
+        p_op->tick = HAL_GetTick() - p_op->tick;
+        p_op->status = WEB_BATCH_OP_DONE;
+        p_batch->inFlight[webBatchSlot(p_op->destination)]--;
+        p_batch->inFlightCnt--;
+        p_batch->done++;
+        xTaskNotifyGive(p_batch->taskHandle);
+    }
+    bool last = (--p_batch->refs == 0);
+    xTaskResumeAll();
+
+    if (last) {
+        vPortFree(p_batch);
+    }
+    return osOK;
+}
+
+/**
+ * @fn
+ *
+ * @brief Send one operation of a batch
+ *
+ * An operation for a missing board is finished at once. When the cnc message queue is full
+ * the operation is sent again after the next response, or fails when nothing is in flight.
+ *
+ * @param[in] p_batch: batch
+ * @param[in] p_op: operation to send
+ *
+ * @return false when the operation must be sent again later
+ **/
+static bool webBatchSend(webBatch_tp p_batch, webBatchOp_tp p_op) {
+    if ((p_op->destination != MAIN_BOARD_ID) && !sensorBoardPresent(p_op->destination)) {
+        vTaskSuspendAll();
+        p_op->result = osErrorResource;
+        p_op->status = WEB_BATCH_OP_NOT_PRESENT;
+        p_batch->done++;
+        xTaskResumeAll();
+        return true;
+    }
+
+    cncMsgPayload_t cncPayload = {.cncMsgPayloadHeader.peripheral = p_op->peripheral,
+                                  .cncMsgPayloadHeader.action = p_op->action,
+                                  .cncMsgPayloadHeader.addr = p_op->addr,
+                                  .value = p_op->value,
+                                  .cncMsgPayloadHeader.cncActionData.result = 0xFF};
+    uint32_t slot = webBatchSlot(p_op->destination);
+
+    p_op->status = WEB_BATCH_OP_SENT;
+    p_op->tick = HAL_GetTick();
+    vTaskSuspendAll();
+    p_batch->inFlight[slot]++;
+    p_batch->inFlightCnt++;
+    p_batch->refs++;
+    xTaskResumeAll();
+
+    osStatus status =
+        cncSendMsg(p_op->destination, SPICMD_CNC, (cncPayload_tp)&cncPayload, p_batch->uid, webBatchCB, (uint32_t)p_op);
+    if (status == osOK) {
+        return true;
+    }
+
+    // the message was not queued, no callback will come
+    vTaskSuspendAll();
+    p_batch->inFlight[slot]--;
+    p_batch->inFlightCnt--;
+    p_batch->refs--;
+    bool retry = (p_batch->inFlightCnt != 0);
+    if (retry) {
+        p_op->status = WEB_BATCH_OP_QUEUED;
+    } else {
+        p_op->result = status;
+        p_op->status = WEB_BATCH_OP_SEND_ERROR;
+        p_batch->done++;
+    }
+    xTaskResumeAll();
+    return !retry;
+}
+
+/**
+ * @fn
+ *
+ * @brief Run all the operations of a batch
+ *
+ * The operations of a board are sent in request order, up to its CNC window at once. A board
+ * that is waiting does not hold back the operations of the other boards, so the boards, and
+ * the spi busses they are on, are served in parallel.
+ *
+ * @param[in] p_batch: batch, every operation queued
+ * @param[in] kick: run by webBatchThread(), its watchdog is kicked while the responses are waited for
+ **/
+static void webBatchRun(webBatch_tp p_batch, bool kick) {
+    uint32_t first = 0; // the operations before first are all sent
+
+    p_batch->taskHandle = xTaskGetCurrentTaskHandle();
+    p_batch->startTick = HAL_GetTick();
+
+    while (p_batch->done < p_batch->cnt) {
+        bool blocked[MAX_CS_ID + 1] = {false};
+        bool full = false;
+
+        while ((first < p_batch->cnt) && (p_batch->op[first].status != WEB_BATCH_OP_QUEUED)) {
+            first++;
+        }
+        for (uint32_t i = first; (i < p_batch->cnt) && !full && (p_batch->inFlightCnt < WEB_BATCH_MAX_IN_FLIGHT); i++) {
+            webBatchOp_tp p_op = &p_batch->op[i];
+            uint32_t slot = webBatchSlot(p_op->destination);
+            if ((p_op->status != WEB_BATCH_OP_QUEUED) || blocked[slot]) {
+                continue;
+            }
+            if (p_batch->inFlight[slot] >= webBatchWindow(p_op->destination)) {
+                // the later operations of the board wait behind this one
+                blocked[slot] = true;
+                continue;
+            }
+            full = !webBatchSend(p_batch, p_op);
+        }
+        if (p_batch->done == p_batch->cnt) {
+            break;
+        }
+
+        uint32_t done = p_batch->done;
+        uint32_t waitTick = HAL_GetTick();
+        while ((p_batch->done == done) && ((HAL_GetTick() - waitTick) < TRANSIENT_TASK_NOTIFY_TIMEOUT_MS)) {
+            if (kick) {
+                watchdogKickFromTask(WDT_TASK_WEBBATCH);
+            }
+            ulTaskNotifyTake(true, WEB_BATCH_WAIT_MS);
+        }
+        if (p_batch->done == done) {
+            // the CNC tasks time out first, a batch only stops here when a response was lost
+            DPRINTF_ERROR("%s no response in %u msec, %lu of %lu done\r\n",
+                          __FUNCTION__,
+                          TRANSIENT_TASK_NOTIFY_TIMEOUT_MS,
+                          p_batch->done,
+                          p_batch->cnt);
+            break;
+        }
+    }
+
+    vTaskSuspendAll();
+    p_batch->abandoned = true;
+    for (uint32_t i = 0; i < p_batch->cnt; i++) {
+        webBatchOp_tp p_op = &p_batch->op[i];
+        if (p_op->status == WEB_BATCH_OP_SENT) {
+            p_op->result = osEventTimeout;
+            p_op->tick = HAL_GetTick() - p_op->tick;
+            p_op->status = WEB_BATCH_OP_TIMEOUT;
+        }
+    }
+    xTaskResumeAll();
+    p_batch->msec = HAL_GetTick() - p_batch->startTick;
+    // a response notified after the last wait must not wake the next take of this task
+    ulTaskNotifyTake(true, 0);
+}
+
+/**
+ * @fn
+ *
+ * @brief Fill the web response with the results of a finished batch
+ *
+ * @param[in] p_webResponse: Web response
+ * @param[in] p_batch: batch
+ **/
+static void webBatchResults(webResponse_tp p_webResponse, webBatch_tp p_batch) {
+    char buf[ERRORBUFFER_SZ];
+    uint32_t failed = 0;
+
+    json_object *jsonValuesArray = json_object_new_array();
+    for (uint32_t i = 0; i < p_batch->cnt; i++) {
+        webBatchOp_tp p_op = &p_batch->op[i];
+        json_object *next = json_object_new_object();
+
+        json_object *jsonDest = json_object_new_int(p_op->destination);
+        json_object_object_add_ex(next, "destination", jsonDest, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object *jsonPeripheral = json_object_new_string(peripheralLUT[p_op->peripheral].name);
+        json_object_object_add_ex(next, "peripheral", jsonPeripheral, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object *jsonCommand = json_object_new_string(commandLUT[p_op->action].name);
+        json_object_object_add_ex(next, "command", jsonCommand, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object *jsonAddress = json_object_new_int(p_op->addr);
+        json_object_object_add_ex(next, "address", jsonAddress, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object *jsonValue = json_object_new_int(p_op->value);
+        json_object_object_add_ex(next, "value", jsonValue, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object *jsonOpResult = json_object_new_int(p_op->result);
+        json_object_object_add_ex(next, "result", jsonOpResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object *jsonStatus = json_object_new_string(webBatchOpStatusStr[p_op->status]);
+        json_object_object_add_ex(next, "status", jsonStatus, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object *jsonMsec = json_object_new_int(p_op->status == WEB_BATCH_OP_QUEUED ? 0 : p_op->tick);
+        json_object_object_add_ex(next, "msec", jsonMsec, JSON_C_OBJECT_KEY_IS_CONSTANT);
+
+        if ((p_op->status != WEB_BATCH_OP_DONE) || (p_op->result != 0)) {
+            failed++;
+        }
+        json_object_array_add(jsonValuesArray, next);
+    }
+
+    if (failed != 0) {
+        p_webResponse->httpCode = HTTP_ERROR_BAD_REQUEST;
+        json_object *jsonResult = json_object_new_string("cnc error");
+        snprintf(buf, sizeof(buf), "%lu of %lu operations failed", failed, p_batch->cnt);
+        json_object *jsonError = json_object_new_string(buf);
+        json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object_object_add_ex(p_webResponse->jsonResponse, "detail", jsonError, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    } else {
+        p_webResponse->httpCode = HTTP_OK;
+        json_object *jsonResult = json_object_new_string("success");
+        json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    }
+    json_object *jsonTotal = json_object_new_int(p_batch->cnt);
+    json_object_object_add_ex(p_webResponse->jsonResponse, "total", jsonTotal, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    json_object *jsonFailed = json_object_new_int(failed);
+    json_object_object_add_ex(p_webResponse->jsonResponse, "failed", jsonFailed, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    json_object *jsonMsec = json_object_new_int(p_batch->msec);
+    json_object_object_add_ex(p_webResponse->jsonResponse, "msec", jsonMsec, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    json_object_object_add_ex(p_webResponse->jsonResponse, "values", jsonValuesArray, JSON_C_OBJECT_KEY_IS_CONSTANT);
+}
+
+/**
+ * @fn
+ *
+ * @brief Add the index of the operation that failed its checks to the web response
+ *
+ * @param[in] p_webResponse: Web response, result and detail already filled
+ * @param[in] idx: operation index in the request
+ **/
+static void webBatchErrorIndex(webResponse_tp p_webResponse, uint32_t idx) {
+    json_object *jsonIndex = json_object_new_int(idx);
+    json_object_object_add_ex(p_webResponse->jsonResponse, "index", jsonIndex, JSON_C_OBJECT_KEY_IS_CONSTANT);
+}
+
+/**
+ * @fn
+ *
+ * @brief Get a parameter of an operation
+ *
+ * @param[in] p_webResponse: Web response, filled when the parameter is missing
+ * @param[in] jsonOp: operation object
+ * @param[in] key: parameter name
+ * @param[in] idx: operation index in the request
+ * @param[out] p_value: parameter
+ *
+ * @return true if the parameter is present
+ **/
+static bool webBatchOpParam(
+    webResponse_tp p_webResponse, json_object *jsonOp, const char *key, uint32_t idx, json_object **p_value) {
+    if ((jsonOp != NULL) && json_object_object_get_ex(jsonOp, key, p_value)) {
+        return true;
+    }
+    p_webResponse->httpCode = HTTP_ERROR_BAD_REQUEST;
+    json_object *jsonResult = json_object_new_string("missing param error");
+    json_object *jsonParam = json_object_new_string(key);
+    json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    json_object_object_add_ex(p_webResponse->jsonResponse, "param", jsonParam, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    webBatchErrorIndex(p_webResponse, idx);
+    return false;
+}
+
+/**
+ * @fn
+ *
+ * @brief Check an operation of the request and store it in the batch
+ *
+ * @param[in] p_webResponse: Web response, filled when the operation is not valid
+ * @param[in] jsonOp: operation object
+ * @param[in] idx: operation index in the request
+ * @param[out] p_op: operation, queued
+ *
+ * @return true if the operation is valid
+ **/
+static bool webBatchParseOp(webResponse_tp p_webResponse, json_object *jsonOp, uint32_t idx, webBatchOp_tp p_op) {
+    json_object *tmp;
+
+    if (!webBatchOpParam(p_webResponse, jsonOp, "destination", idx, &tmp)) {
+        return false;
+    }
+    int destination = json_object_get_int(tmp);
+    if (destination < 0) {
+        p_webResponse->httpCode = HTTP_ERROR_BAD_REQUEST;
+        json_object *jsonResult = json_object_new_string("destination value error");
+        json_object *jsonError = json_object_new_string("Each operation must name one board");
+        json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object_object_add_ex(p_webResponse->jsonResponse, "detail", jsonError, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        webBatchErrorIndex(p_webResponse, idx);
+        return false;
+    }
+    if (!testDestinationValue(p_webResponse, destination)) {
+        webBatchErrorIndex(p_webResponse, idx);
+        return false;
+    }
+
+    PERIPHERAL_e periEnum;
+    if (!webBatchOpParam(p_webResponse, jsonOp, "peripheral", idx, &tmp)) {
+        return false;
+    }
+    if (!getPeripheralEnum(p_webResponse, destination, json_object_get_string(tmp), &periEnum)) {
+        webBatchErrorIndex(p_webResponse, idx);
+        return false;
+    }
+
+    CNC_ACTION_e commandEnum;
+    if (!webBatchOpParam(p_webResponse, jsonOp, "command", idx, &tmp)) {
+        return false;
+    }
+    if (!getCommandEnum(p_webResponse, json_object_get_string(tmp), &commandEnum)) {
+        webBatchErrorIndex(p_webResponse, idx);
+        return false;
+    }
+
+    if (!webBatchOpParam(p_webResponse, jsonOp, "address", idx, &tmp)) {
+        return false;
+    }
+    p_op->addr = json_object_get_int(tmp);
+
+    // a read needs no value
+    p_op->value = json_object_object_get_ex(jsonOp, "value", &tmp) ? json_object_get_int(tmp) : 0;
+    p_op->destination = destination;
+    p_op->peripheral = periEnum;
+    p_op->action = commandEnum;
+    p_op->result = UNKNOWN_RESULT;
+    p_op->tick = 0;
+    p_op->status = WEB_BATCH_OP_QUEUED;
+    return true;
+}
+
+/**
+ * @fn
+ *
+ * @brief Queue a batch to the batch task
+ *
+ * When every job is in use the oldest finished job that was never read is dropped.
+ *
+ * @param[in] p_webResponse: Web response, the job id or the error
+ * @param[in] p_batch: batch, owned by the job once queued
+ **/
+static void webBatchQueue(webResponse_tp p_webResponse, webBatch_tp p_batch) {
+    char buf[ERRORBUFFER_SZ];
+    webBatchJob_tp p_job = NULL;
+    uint32_t jobId = 0;
+    uint32_t total = p_batch->cnt; // the batch belongs to the job once it is queued
+
+    osMutexWait(webBatchJobAccess, osWaitForever);
+    for (int i = 0; i < WEB_BATCH_MAX_JOBS; i++) {
+        if (webBatchJobs[i].state == WEB_BATCH_JOB_FREE) {
+            p_job = &webBatchJobs[i];
+            break;
+        }
+    }
+    if (p_job == NULL) {
+        for (int i = 0; i < WEB_BATCH_MAX_JOBS; i++) {
+            if ((webBatchJobs[i].state == WEB_BATCH_JOB_DONE) && ((p_job == NULL) || (webBatchJobs[i].id < p_job->id))) {
+                p_job = &webBatchJobs[i];
+            }
+        }
+        if (p_job != NULL) {
+            DPRINTF_WARN("Batch job %lu dropped before it was read\r\n", p_job->id);
+            webBatchRelease(p_job->p_batch);
+        }
+    }
+    if (p_job != NULL) {
+        jobId = webBatchNextJobId++;
+        p_job->id = jobId;
+        p_job->state = WEB_BATCH_JOB_QUEUED;
+        p_job->p_batch = p_batch;
+        if (osMessagePut(webBatchJobQ, p_job - webBatchJobs, 0) != osOK) {
+            p_job->state = WEB_BATCH_JOB_FREE;
+            p_job->p_batch = NULL;
+            p_job = NULL;
+        }
+    }
+    osMutexRelease(webBatchJobAccess);
+
+    if (p_job == NULL) {
+        webBatchRelease(p_batch);
+        p_webResponse->httpCode = HTTP_ERROR_PRECONDITION_FAILED;
+        json_object *jsonResult = json_object_new_string("error");
+        snprintf(buf, sizeof(buf), "%d batch jobs are queued or running", WEB_BATCH_MAX_JOBS);
+        json_object *jsonDetail = json_object_new_string(buf);
+        json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object_object_add_ex(p_webResponse->jsonResponse, "detail", jsonDetail, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        return;
+    }
+
+    p_webResponse->httpCode = HTTP_OK;
+    json_object *jsonResult = json_object_new_string("success");
+    json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    json_object *jsonJob = json_object_new_int(jobId);
+    json_object_object_add_ex(p_webResponse->jsonResponse, "job", jsonJob, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    json_object *jsonTotal = json_object_new_int(total);
+    json_object_object_add_ex(p_webResponse->jsonResponse, "total", jsonTotal, JSON_C_OBJECT_KEY_IS_CONSTANT);
+}
+
+webResponse_tp webBatch(const char *jsonStr, int strLen) {
+    char buf[ERRORBUFFER_SZ];
+    WEB_CMD_PARAM_SETUP(jsonStr, strLen);
+
+    GET_REQ_KEY_VALUE(int, uid, obj, json_object_get_int);
+
+    json_object *jsonOps;
+    if (!json_object_object_get_ex(obj, "ops", &jsonOps) || !json_object_is_type(jsonOps, json_type_array) ||
+        (json_object_array_length(jsonOps) == 0) || (json_object_array_length(jsonOps) > WEB_BATCH_MAX_OPS)) {
+        p_webResponse->httpCode = HTTP_ERROR_BAD_REQUEST;
+        json_object *jsonResult = json_object_new_string("ops value error");
+        snprintf(buf, sizeof(buf), "ops must be an array of 1 to %d operations", WEB_BATCH_MAX_OPS);
+        json_object *jsonError = json_object_new_string(buf);
+        json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object_object_add_ex(p_webResponse->jsonResponse, "detail", jsonError, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        WEB_CMD_PARAM_CLEANUP
+        return p_webResponse;
+    }
+
+    bool async = false;
+    json_object *tmp;
+    if (json_object_object_get_ex(obj, "async", &tmp)) {
+        async = json_object_get_boolean(tmp);
+    }
+
+    uint32_t cnt = json_object_array_length(jsonOps);
+    webBatch_tp p_batch = pvPortMalloc(sizeof(webBatch_t) + cnt * sizeof(webBatchOp_t));
+    if (p_batch == NULL) {
+        DPRINTF_ERROR("%s no memory for %u operations\r\n", __FUNCTION__, cnt);
+        cncFanOutNoMemory(p_webResponse);
+        WEB_CMD_PARAM_CLEANUP
+        return p_webResponse;
+    }
+    memset(p_batch, 0, sizeof(webBatch_t));
+    p_batch->refs = 1;
+    p_batch->uid = uid;
+    p_batch->cnt = cnt;
+
+    // the whole request is checked before the first operation is sent
+    for (uint32_t i = 0; i < cnt; i++) {
+        webBatchOp_tp p_op = &p_batch->op[i];
+        p_op->p_batch = p_batch;
+        if (!webBatchParseOp(p_webResponse, json_object_array_get_idx(jsonOps, i), i, p_op)) {
+            webBatchRelease(p_batch);
+            WEB_CMD_PARAM_CLEANUP
+            return p_webResponse;
+        }
+    }
+    WEB_CMD_PARAM_CLEANUP
+
+    if (async) {
+        webBatchQueue(p_webResponse, p_batch);
+        return p_webResponse;
+    }
+
+    webBatchRun(p_batch, false);
+    webBatchResults(p_webResponse, p_batch);
+    webBatchRelease(p_batch);
+    return p_webResponse;
+}
+
+webResponse_tp webBatchGet(const char *jsonStr, int strLen) {
+    char buf[ERRORBUFFER_SZ];
+    WEB_CMD_PARAM_SETUP(jsonStr, strLen);
+
+    GET_REQ_KEY_VALUE(int, job, obj, json_object_get_int);
+    WEB_CMD_PARAM_CLEANUP
+
+    webBatchJob_tp p_job = NULL;
+    webBatch_tp p_done = NULL;
+
+    osMutexWait(webBatchJobAccess, osWaitForever);
+    for (int i = 0; i < WEB_BATCH_MAX_JOBS; i++) {
+        if ((webBatchJobs[i].state != WEB_BATCH_JOB_FREE) && (webBatchJobs[i].id == job)) {
+            p_job = &webBatchJobs[i];
+            break;
+        }
+    }
+    if (p_job != NULL) {
+        if (p_job->state == WEB_BATCH_JOB_DONE) {
+            // the results are read once
+            p_done = p_job->p_batch;
+            p_job->p_batch = NULL;
+            p_job->state = WEB_BATCH_JOB_FREE;
+        } else {
+            p_webResponse->httpCode = HTTP_OK;
+            json_object *jsonResult = json_object_new_string("success");
+            json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
+            json_object *jsonState = json_object_new_string(webBatchJobStateStr[p_job->state]);
+            json_object_object_add_ex(p_webResponse->jsonResponse, "state", jsonState, JSON_C_OBJECT_KEY_IS_CONSTANT);
+            json_object *jsonDone = json_object_new_int(p_job->p_batch->done);
+            json_object_object_add_ex(p_webResponse->jsonResponse, "done", jsonDone, JSON_C_OBJECT_KEY_IS_CONSTANT);
+            json_object *jsonTotal = json_object_new_int(p_job->p_batch->cnt);
+            json_object_object_add_ex(p_webResponse->jsonResponse, "total", jsonTotal, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        }
+    }
+    osMutexRelease(webBatchJobAccess);
+
+    if (p_job == NULL) {
+        p_webResponse->httpCode = HTTP_ERROR_BAD_REQUEST;
+        json_object *jsonResult = json_object_new_string("job value error");
+        snprintf(buf, sizeof(buf), "Unknown job %d", job);
+        json_object *jsonError = json_object_new_string(buf);
+        json_object_object_add_ex(p_webResponse->jsonResponse, "result", jsonResult, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        json_object_object_add_ex(p_webResponse->jsonResponse, "detail", jsonError, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        return p_webResponse;
+    }
+
+    json_object *jsonJob = json_object_new_int(job);
+    json_object_object_add_ex(p_webResponse->jsonResponse, "job", jsonJob, JSON_C_OBJECT_KEY_IS_CONSTANT);
+    if (p_done != NULL) {
+        json_object *jsonState = json_object_new_string(webBatchJobStateStr[WEB_BATCH_JOB_DONE]);
+        json_object_object_add_ex(p_webResponse->jsonResponse, "state", jsonState, JSON_C_OBJECT_KEY_IS_CONSTANT);
+        webBatchResults(p_webResponse, p_done);
+        webBatchRelease(p_done);
+    }
+    return p_webResponse;
+}
+
+/**
+ * @fn
+ *
+ * @brief Run the asynchronous batches one after the other
+ *
+ * @param[in] arg: unused
+ **/
+static void webBatchThread(const void *arg) {
+    DPRINTF_INFO("Web batch task starting\r\n");
+    watchdogAssignToCurrentTask(WDT_TASK_WEBBATCH);
+    watchdogSetTaskEnabled(WDT_TASK_WEBBATCH, 1);
+
+    while (1) {
+        watchdogKickFromTask(WDT_TASK_WEBBATCH);
+        osEvent evt = osMessageGet(webBatchJobQ, WEB_BATCH_WAIT_MS);
+        if (evt.status != osEventMessage) {
+            continue;
+        }
+        webBatchJob_tp p_job = &webBatchJobs[evt.value.v];
+
+        osMutexWait(webBatchJobAccess, osWaitForever);
+        p_job->state = WEB_BATCH_JOB_RUNNING;
+        webBatch_tp p_batch = p_job->p_batch;
+        osMutexRelease(webBatchJobAccess);
+
+        webBatchRun(p_batch, true);
+
+        osMutexWait(webBatchJobAccess, osWaitForever);
+        p_job->state = WEB_BATCH_JOB_DONE;
+        osMutexRelease(webBatchJobAccess);
+    }
+}
+
+void webBatchTaskInit(int priority, int stackSize) {
+    memset(webBatchJobs, 0, sizeof(webBatchJobs));
+    webBatchJobAccess = osMutexCreate(osMutex(webBatchJobAccess));
+    assert(webBatchJobAccess != NULL);
+    webBatchJobQ = osMessageCreate(osMessageQ(webBatchJobQ), NULL);
+    assert(webBatchJobQ != NULL);
+
+    osThreadDef(webBatchTask, webBatchThread, priority, 0, stackSize);
+    osThreadId thread = osThreadCreate(osThread(webBatchTask), NULL);
+    assert(thread != NULL);
+}
@@ -0,0 +1,64 @@
+/*
+ * webBatch.h
+ *
+ * Batch of CNC operations, /batch endpoint
+ *
+ *  Copyright Nuvation Research Corporation 2018-2024. All Rights Reserved.
+ *      Author: rlegault
+ */
+
+#ifndef WEBSERVER_INC_WEBBATCH_H_
+#define WEBSERVER_INC_WEBBATCH_H_
+
+#include "mongooseHandler.h"
+
+#define WEB_BATCH_MAX_OPS 256 // operations in one request
+#define WEB_BATCH_MAX_JOBS 4  // asynchronous batches queued, running or waiting to be read
+
+/**
+ * @fn
+ *
+ * @brief Handler for web API batch request
+ *
+ * The body is {"uid": n, "async": bool, "ops": [{"destination", "peripheral", "command",
+ * "address", "value"}, ...]}, each operation takes the parameters of /cnc. Every operation
+ * is checked before the first one is sent.
+ * The operations of a board are sent in order, up to its CNC window at once, while the
+ * other boards are served in parallel. The "values" array holds one result per operation
+ * in request order.
+ * When async is true the batch is queued to the batch task and {"job": id} is returned,
+ * the results are read with /batch/get.
+ *
+ * @param[in] const char *jsonStr: Pointer to JSON body
+ * @param[in] int strLen: JSON body string length
+ *
+ * @return webResponse_tp: Updated JSON structure
+ **/
+webResponse_tp webBatch(const char *jsonStr, int strLen);
+
+/**
+ * @fn
+ *
+ * @brief Handler for web API batch job poll
+ *
+ * The body is {"job": id}. A job still queued or running reports its progress, a finished
+ * job returns the response /batch would have returned and is released.
+ *
+ * @param[in] const char *jsonStr: Pointer to JSON body
+ * @param[in] int strLen: JSON body string length
+ *
+ * @return webResponse_tp: Updated JSON structure
+ **/
+webResponse_tp webBatchGet(const char *jsonStr, int strLen);
+
+/**
+ * @fn
+ *
+ * @brief Create the task that runs the asynchronous batches
+ *
+ * @param[in] priority: task priority
+ * @param[in] stackSize: task stack size in words
+ **/
+void webBatchTaskInit(int priority, int stackSize);
+
+#endif /* WEBSERVER_INC_WEBBATCH_H_ */
@@ -19,6 +19,7 @@
 #include "peripherals/MB_handlePwrCtrl.h"
 #include "peripherals/MB_handleReg.h"
 #include "realTimeClock.h"
+#include "webBatch.h"
 #include "webCliMisc.h"
 #include "webCmdHandler.h"
 #include <peripherals/MB_handleADC.h>
@@ -68,7 +69,7 @@ webResponse_tp webUnrecognizedCmd(const char *jsonStr, int strLen);
  **/
 webResponse_tp webCnc(const char *jsonStr, int strLen);
 
-#define NUM_WEB_COMMANDS 111
+#define NUM_WEB_COMMANDS 113
 
 static const WEB_COMMAND webCommandList[NUM_WEB_COMMANDS] = {
     {"/dac/compensation/set",
@@ -245,7 +246,7 @@ static const WEB_COMMAND webCommandList[NUM_WEB_COMMANDS] = {
     {"/mfg_write_en/set", "Set the value of mfg_write_en", "uid, mfg_write_en", webMfgWriteEnSet},
     {"/imu/cmd", "Send a IMU command", "uid, destination, imuIdx, imu command as a string", webImuCmd},
     {"/sensor_configure/set",
-     "Set the configuration for a slot, requires reboot for get to see change",
+     "Set the configuration for a slot, get shows LAYOUT_PENDING until the stream layout is changed",
      "uid, destination [0-23,all], type [BOARDTYPE_MCG|BOARDTYPE_ECG|BOARDTYPE_IMU_COIL|BOARDTYPE_EMPTY]",
      webSensorConfigureSet},
     {"/sensor_configure/get",
@@ -256,6 +257,11 @@ static const WEB_COMMAND webCommandList[NUM_WEB_COMMANDS] = {
     {"/system_status/get", "Return the system error status", "uid", webSystemStatusGet},
     {"/echo", "Send a simple JSON command back", "echo", NULL},
     {"/cnc", "Send a CNC command", "destination, peripheral, command, address, value, uid", webCnc},
+    {"/batch",
+     "Send a list of CNC commands, the boards are served in parallel",
+     "uid, async (optional bool), ops [{destination, peripheral, command, address, value}]",
+     webBatch},
+    {"/batch/get", "Get the progress or the results of an async batch", "job", webBatchGet},
     {"/fan/speed/get", "Get the Fan speed as a percentage", "uid", webFanSpeedGet},
     {"/fan/speed/set", "Get the Fan speed as a percentage", "uid, speed [0-100]", webFanSpeedSet},
     {"/fan/tachometer/get", "Get the current Fan speed in RPM of the fan [0|1]", "uid fan", webFanTachometerGet},